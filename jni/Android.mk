@@ -53,11 +53,37 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := lossless
 LOCAL_STATIC_LIBRARIES := alac ape flac wav wv mpc
 LOCAL_CFLAGS += -O2 -Wall -DBUILD_STANDALONE -DCPU_ARM -DAVSREMOTE -finline-functions -fPIC -D__ARM_EABI__=1 -DOLD_LOGDH
-LOCAL_SRC_FILES := main.c
+# OpenSL ES and AAudio are dlopen'ed, their headers need APP_PLATFORM android-9 or later
+LOCAL_SRC_FILES := main.c status.c trace.c sink_opensl.c sink_aaudio.c sink_offline.c
 LOCAL_ARM_MODE := arm
 LOCAL_LDLIBS := -llog -ldl
 include $(BUILD_SHARED_LIBRARY)
 
+# the UI's reader of the status block, see status_read.c
+include $(CLEAR_VARS)
+LOCAL_MODULE := statusblock
+LOCAL_CFLAGS += -O2 -Wall
+LOCAL_SRC_FILES := status_read.c
+include $(BUILD_SHARED_LIBRARY)
+
+# kernel microbenchmarks, run with adb rather than packaged, see bench/kernelbench.c
+include $(CLEAR_VARS)
+LOCAL_MODULE := kernelbench
+LOCAL_SHARED_LIBRARIES := lossless
+# the APE filters and C predictor under other names, see ape/Android.mk
+LOCAL_STATIC_LIBRARIES := apefilter_generic apefilter_armv5te apepredictor_c
+LOCAL_CFLAGS += -O2 -Wall -DBUILD_STANDALONE -DCPU_ARM -DMPC_LITTLE_ENDIAN -DMPC_FIXED_POINT
+LOCAL_C_INCLUDES += $(LOCAL_PATH)/wv $(LOCAL_PATH)/alac $(LOCAL_PATH)/mpc $(LOCAL_PATH)/ape $(LOCAL_PATH)/flac
+LOCAL_SRC_FILES := bench/kernelbench.c bench/bench_wv.c bench/bench_alac.c bench/bench_mpc.c \
+	bench/bench_ape.c bench/bench_flac.c
+LOCAL_ARM_MODE := arm
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+LOCAL_CFLAGS += -DWV_NEON -DALAC_NEON -DMPC_NEON -DAPE_ARMV6
+LOCAL_STATIC_LIBRARIES += apefilter_armv6
+endif
+LOCAL_LDLIBS := -lm
+include $(BUILD_EXECUTABLE)
+
 CODECS := alac ape flac wav wv mpc
 codec-makefiles =  $(patsubst %,$(LOCAL_PATH)/%/Android.mk,$(CODECS)) 
 include $(call codec-makefiles)
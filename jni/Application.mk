@@ -0,0 +1,6 @@
+# armeabi-v7a gets the NEON decoder kernels, which check for NEON at
+# runtime; armeabi is for the older ARMv6 phones. No 64-bit ABIs: contexts
+# cross JNI as jint, and the prebuilt libmedia in Android/lib is 32-bit.
+APP_ABI := armeabi-v7a armeabi
+# OpenSL ES headers, see Android.mk
+APP_PLATFORM := android-9
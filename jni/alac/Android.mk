@@ -4,9 +4,21 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := alac
 
 LOCAL_SRC_FILES += alac_decoder.c demux.c m4a.c main.c
-LOCAL_CFLAGS += -O2 -Wall -DBUILD_STANDALONE -DCPU_ARM -finline-functions -fPIC
+LOCAL_CFLAGS += -O2 -Wall -DBUILD_STANDALONE -finline-functions -fPIC
 #-DDBG_TIME
+
+LOCAL_CFLAGS += -DCPU_ARM
 LOCAL_ARM_MODE := arm
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+# NEON is optional on v7, alac_neon.c checks for it at runtime
+LOCAL_SRC_FILES += alac_neon.c.neon
+LOCAL_CFLAGS += -DALAC_NEON
+LOCAL_STATIC_LIBRARIES += cpufeatures
+endif
 
 include $(BUILD_STATIC_LIBRARY)
 # include $(BUILD_SHARED_LIBRARY)
+
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+$(call import-module,android/cpufeatures)
+endif
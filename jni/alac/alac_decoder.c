@@ -37,7 +37,6 @@
 
 #include "decomp.h"
 
-int16_t predictor_coef_table[32] IBSS_ATTR;
 int16_t predictor_coef_table_a[32] IBSS_ATTR;
 int16_t predictor_coef_table_b[32] IBSS_ATTR;
 
@@ -71,7 +70,7 @@ void alac_set_info(alac_file *alac, char *inputbuffer)
   alac->setinfo_rice_historymult = *ptr++;
   alac->setinfo_rice_initialhistory = *ptr++;
   alac->setinfo_rice_kmodifier = *ptr++;
-  alac->setinfo_7f = *ptr++;
+  alac->setinfo_7f = *ptr++; /* number of channels */
   ptr += 1;
   alac->setinfo_80 = get_uint16be(ptr);
   ptr += 2;
@@ -81,124 +80,82 @@ void alac_set_info(alac_file *alac, char *inputbuffer)
   ptr += 4;
   alac->setinfo_8a_rate = get_uint32be(ptr);
   ptr += 4;
+
+  /* the stsd channel count isn't always right for multichannel files */
+  if (alac->setinfo_7f >= 1 && alac->setinfo_7f <= ALAC_MAX_CHANNELS)
+      alac->numchannels = alac->setinfo_7f;
 }
 
 /* stream reading */
 
-/* supports reading 1 to 16 bits, in big endian format */
-static inline uint32_t readbits_16(alac_file *alac, int bits)
-{
-    uint32_t result;
-    int new_accumulator;
-
-    result = (alac->input_buffer[0] << 16) |
-             (alac->input_buffer[1] << 8) |
-             (alac->input_buffer[2]);
-
-    /* shift left by the number of bits we've already read,
-     * so that the top 'n' bits of the 24 bits we read will
-     * be the return bits */
-    result = result << alac->input_buffer_bitaccumulator;
-
-    result = result & 0x00ffffff;
-
-    /* and then only want the top 'n' bits from that, where
-     * n is 'bits' */
-    result = result >> (24 - bits);
+/* The input is read through a 64-bit cache holding the next unread bits
+ * at the top. refill() tops it up to at least 56 valid bits with one
+ * unaligned big endian load, so any read of up to 32 bits (or a rice
+ * code's unary prefix plus its escape value) needs at most one refill.
+ * The cache is only refilled when the next read may need more than it
+ * holds, so a load starts at most 5 bytes past the next unread byte.
+ * The bits below the valid ones are the following input bits already,
+ * the next load ORs the same values over them. */
 
-    new_accumulator = (alac->input_buffer_bitaccumulator + bits);
+static inline uint64_t load_be64(const unsigned char *p)
+{
+    uint64_t v;
 
-    /* increase the buffer pointer if we've read over n bytes. */
-    alac->input_buffer += (new_accumulator >> 3);
+    memcpy(&v, p, sizeof(v));
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+    v = __builtin_bswap64(v);
+#endif
+    return v;
+}
 
-    /* and the remainder goes back into the bit accumulator */
-    alac->input_buffer_bitaccumulator = (new_accumulator & 7);
+/* a rice code is at most 9 bits of prefix and a 32-bit escape value */
+#define RICE_MAX_CODE_BITS 41
 
-    return result;
+static inline void refill(alac_file *alac)
+{
+    alac->input_cache |= load_be64(alac->input_buffer) >> alac->input_cache_bits;
+    alac->input_buffer += (63 - alac->input_cache_bits) >> 3;
+    alac->input_cache_bits |= 56;
 }
 
-/* supports reading 1 to 32 bits, in big endian format */
-static inline uint32_t readbits(alac_file *alac, int bits)
+/* top 'bits' bits of the cache, 0 to 32, refill() must have been done */
+static inline uint32_t peekbits(alac_file *alac, int bits)
 {
-    int32_t result = 0;
-
-    if (bits > 16)
-    {
-        bits -= 16;
-        result = readbits_16(alac, 16) << bits;
-    }
-
-    result |= readbits_16(alac, bits);
-
-    return result;
+    if (!bits) return 0;
+    return (uint32_t)(alac->input_cache >> (64 - bits));
 }
 
-/* reads a single bit */
-static inline int readbit(alac_file *alac)
+static inline void skipbits(alac_file *alac, int bits)
 {
-    int result;
-    int new_accumulator;
-
-    result = alac->input_buffer[0];
-
-    result = result << alac->input_buffer_bitaccumulator;
-
-    result = result >> 7 & 1;
+    alac->input_cache <<= bits;
+    alac->input_cache_bits -= bits;
+}
 
-    new_accumulator = (alac->input_buffer_bitaccumulator + 1);
+/* supports reading 0 to 32 bits, in big endian format */
+static inline uint32_t readbits(alac_file *alac, int bits)
+{
+    uint32_t result;
 
-    alac->input_buffer += (new_accumulator / 8);
+    if (!bits) return 0;
+    if (alac->input_cache_bits < bits) refill(alac);
 
-    alac->input_buffer_bitaccumulator = (new_accumulator % 8);
+    result = peekbits(alac, bits);
+    skipbits(alac, bits);
 
     return result;
 }
 
-static inline void unreadbits(alac_file *alac, int bits)
+/* number of 1 bits before the first 0, the 0 is not consumed */
+static inline int count_leading_ones(alac_file *alac)
 {
-    int new_accumulator = (alac->input_buffer_bitaccumulator - bits);
-
-    alac->input_buffer += (new_accumulator >> 3);
-
-    alac->input_buffer_bitaccumulator = (new_accumulator & 7);
-    if (alac->input_buffer_bitaccumulator < 0)
-        alac->input_buffer_bitaccumulator *= -1;
+    return __builtin_clzll(~alac->input_cache | 1);
 }
 
-static const unsigned char bittab[16] ICONST_ATTR = {
-    0, 1, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 4, 4, 4, 4
-};
-
-static inline int count_leading_zeros(int input)
+static inline int count_leading_zeros(uint32_t input)
 {
-    int output = 32;
-
-#if 0
-    /* Experimentation has shown that the following test is always false,
-       so we don't bother to perform it. */
-    if (input & 0xffff0000)
-    {
-        input >>= 16;
-        output -= 16;
-    }
-#endif
-    if (input & 0xff00)
-    {
-        input >>= 8;
-        output -= 8;
-    }
-    if (input & 0xf0)
-    {
-        input >>= 4;
-        output -= 4;
-    }
-    output -= bittab[input];
-    return output;
+    return input ? __builtin_clz(input) : 32;
 }
 
-
-
-
 void basterdised_rice_decompress(alac_file *alac,
                                  int32_t *output_buffer,
                                  int output_size,
@@ -224,34 +181,30 @@ void basterdised_rice_decompress(alac_file *alac,
 
     for (output_count = 0; output_count < output_size; output_count++)
     {
-        int32_t x = 0;
+        int32_t x;
         int32_t x_modified;
         int32_t final_val;
 
-        /* read x - number of 1s before 0 represent the rice */
-        while (x <= 8 && readbit(alac))
-        {
-            x++;
-        }
+        /* the longest code is 9 + 32 bits, one refill covers it */
+        if (alac->input_cache_bits < RICE_MAX_CODE_BITS) refill(alac);
 
+        /* read x - number of 1s before 0 represent the rice */
+        x = count_leading_ones(alac);
 
         if (x > 8) /* RICE THRESHOLD */
         { /* use alternative encoding */
-            int32_t value;
-
-            value = readbits(alac, readsamplesize);
+            skipbits(alac, 9);
 
-            /* mask value to readsamplesize size */
-            if (readsamplesize != 32)
-                value &= (0xffffffff >> (32 - readsamplesize));
-
-            x = value;
+            x = readsamplesize ? peekbits(alac, readsamplesize) : 0;
+            skipbits(alac, readsamplesize);
         }
         else
         { /* standard rice encoding */
             int extrabits;
             int k; /* size of extra bits */
 
+            skipbits(alac, x + 1);
+
             /* read k, that is bits as is */
             k = 31 - rice_kmodifier - count_leading_zeros((history >> 9) + 3);
 
@@ -260,16 +213,18 @@ void basterdised_rice_decompress(alac_file *alac,
 
             if (k != 1)
             {
-                extrabits = readbits(alac, k);
+                extrabits = peekbits(alac, k);
 
                 /* multiply x by 2^k - 1, as part of their strange algorithm */
                 x = (x << k) - x;
 
+                /* values 0 and 1 are sent as k-1 bits */
                 if (extrabits > 1)
                 {
                     x += extrabits - 1;
+                    skipbits(alac, k);
                 }
-                else unreadbits(alac, 1);
+                else if (k) skipbits(alac, k - 1);
             }
         }
 
@@ -295,25 +250,26 @@ void basterdised_rice_decompress(alac_file *alac,
 
             sign_modifier = 1;
 
-            x = 0;
-            while (x <= 8 && readbit(alac))
-            {
-                x++;
-            }
+            if (alac->input_cache_bits < RICE_MAX_CODE_BITS) refill(alac);
+
+            x = count_leading_ones(alac);
 
             if (x > 8)
             {
-                block_size = readbits(alac, 16);
-                block_size &= 0xffff;
+                skipbits(alac, 9);
+                block_size = peekbits(alac, 16);
+                skipbits(alac, 16);
             }
             else
             {
                 int k;
                 int extrabits;
 
+                skipbits(alac, x + 1);
+
                 k = count_leading_zeros(history) + ((history + 16) >> 6 /* / 64 */) - 24;
 
-                extrabits = readbits(alac, k);
+                extrabits = peekbits(alac, k);
 
                 block_size = (((1 << k) - 1) & rice_kmodifier_mask) * x
                            + extrabits - 1;
@@ -322,10 +278,15 @@ void basterdised_rice_decompress(alac_file *alac,
                 {
                     x = 1 - extrabits;
                     block_size += x;
-                    unreadbits(alac, 1);
+                    skipbits(alac, k - 1);
                 }
+                else skipbits(alac, k);
             }
 
+            /* don't let a broken frame run past the buffer */
+            if (block_size > output_size - output_count - 1)
+                block_size = output_size - output_count - 1;
+
             if (block_size > 0)
             {
                 memset(&output_buffer[output_count+1], 0, block_size * 4);
@@ -348,20 +309,14 @@ void basterdised_rice_decompress(alac_file *alac,
                                 ((v > 0) ? (1) : \
                                            (0)))
 
-static void predictor_decompress_fir_adapt(int32_t *error_buffer,
-                                           int32_t *buffer_out,
-                                           int output_size,
-                                           int readsamplesize,
-                                           int16_t *predictor_coef_table,
-                                           int predictor_coef_num,
-                                           int predictor_quantitization) ICODE_ATTR_ALAC;
-static void predictor_decompress_fir_adapt(int32_t *error_buffer,
-                                           int32_t *buffer_out,
-                                           int output_size,
-                                           int readsamplesize,
-                                           int16_t *predictor_coef_table,
-                                           int predictor_coef_num,
-                                           int predictor_quantitization)
+/* not static so that jni/bench/kernelbench.c can time it */
+void predictor_decompress_fir_adapt(int32_t *error_buffer,
+                                    int32_t *buffer_out,
+                                    int output_size,
+                                    int readsamplesize,
+                                    int16_t *predictor_coef_table,
+                                    int predictor_coef_num,
+                                    int predictor_quantitization)
 {
     int i;
 
@@ -408,6 +363,16 @@ static void predictor_decompress_fir_adapt(int32_t *error_buffer,
         }
     }
 
+#ifdef ALAC_NEON
+    if ((predictor_coef_num == 4 || predictor_coef_num == 8) && alac_neon_supported())
+    {
+        predictor_decompress_fir_adapt_neon(error_buffer, buffer_out, output_size,
+                                            readsamplesize, predictor_coef_table,
+                                            predictor_coef_num, predictor_quantitization);
+        return;
+    }
+#endif
+
     /* 4 and 8 are very common cases (the only ones i've seen).
 
       The following code is an initial attempt to unroll and optimise
@@ -622,233 +587,91 @@ static void predictor_decompress_fir_adapt(int32_t *error_buffer,
     }
 }
 
-void deinterlace_16(int32_t* buffer0,
-                    int32_t* buffer1,
-                    int numsamples,
-                    uint8_t interlacing_shift,
-                    uint8_t interlacing_leftweight) ICODE_ATTR_ALAC;
-void deinterlace_16(int32_t* buffer0,
-                    int32_t* buffer1,
-                    int numsamples,
-                    uint8_t interlacing_shift,
-                    uint8_t interlacing_leftweight)
+void deinterlace(int32_t* buffer0,
+                 int32_t* buffer1,
+                 int numsamples,
+                 uint8_t interlacing_shift,
+                 uint8_t interlacing_leftweight) ICODE_ATTR_ALAC;
+void deinterlace(int32_t* buffer0,
+                 int32_t* buffer1,
+                 int numsamples,
+                 uint8_t interlacing_shift,
+                 uint8_t interlacing_leftweight)
 {
     int i;
-    if (numsamples <= 0) return;
-
-    /* weighted interlacing */
-    if (interlacing_leftweight)
-    {
-        for (i = 0; i < numsamples; i++)
-        {
-            int32_t difference, midright;
-
-            midright = buffer0[i];
-            difference = buffer1[i];
-
-            buffer0[i] = ((midright - ((difference * interlacing_leftweight)
-                            >> interlacing_shift)) + difference) << SCALE16;
-            buffer1[i] = (midright - ((difference * interlacing_leftweight) 
-                            >> interlacing_shift)) << SCALE16;
-        }
 
-        return;
-    }
+    /* otherwise basic interlacing took place, the buffers already
+     * hold left and right */
+    if (numsamples <= 0 || !interlacing_leftweight) return;
 
-    /* otherwise basic interlacing took place */
+    /* weighted interlacing */
     for (i = 0; i < numsamples; i++)
     {
-        buffer0[i] = buffer0[i] << SCALE16;
-        buffer1[i] = buffer1[i] << SCALE16;
-    }
-}
-
-
-static inline int decode_frame_mono(
-                    alac_file *alac,
-                    int32_t outputbuffer[ALAC_MAX_CHANNELS][ALAC_BLOCKSIZE]) {
-    int hassize;
-    int isnotcompressed;
-    int readsamplesize;
-    int outputsamples = alac->setinfo_max_samples_per_frame;
-
-    int wasted_bytes;
-    int ricemodifier;
-
-
-    /* 2^result = something to do with output waiting.
-     * perhaps matters if we read > 1 frame in a pass?
-     */
-    readbits(alac, 4);
-
-    readbits(alac, 12); /* unknown, skip 12 bits */
-
-    hassize = readbits(alac, 1); /* the output sample size is stored soon */
-
-    wasted_bytes = readbits(alac, 2); /* unknown ? */
-
-    isnotcompressed = readbits(alac, 1); /* whether the frame is compressed */
-
-    if (hassize)
-    {
-        /* now read the number of samples,
-         * as a 32bit integer */
-        outputsamples = readbits(alac, 32);
-    }
-
-    readsamplesize = alac->setinfo_sample_size - (wasted_bytes * 8);
-
-    if (!isnotcompressed)
-    { /* so it is compressed */
-        int predictor_coef_num;
-        int prediction_type;
-        int prediction_quantitization;
-        int i;
-
-        /* skip 16 bits, not sure what they are. seem to be used in
-         * two channel case */
-        readbits(alac, 8);
-        readbits(alac, 8);
-
-        prediction_type = readbits(alac, 4);
-        prediction_quantitization = readbits(alac, 4);
-
-        ricemodifier = readbits(alac, 3);
-        predictor_coef_num = readbits(alac, 5);
-
-        /* read the predictor table */
-        for (i = 0; i < predictor_coef_num; i++)
-        {
-            predictor_coef_table[i] = (int16_t)readbits(alac, 16);
-        }
-
-        if (wasted_bytes)
-        {
-            /* these bytes seem to have something to do with
-             * > 2 channel files.
-             */
-            //fprintf(stderr, "FIXME: unimplemented, unhandling of wasted_bytes\n");
-        }
+        int32_t difference, midright;
 
-       // yield();
-
-        basterdised_rice_decompress(alac,
-                                    outputbuffer[0],
-                                    outputsamples,
-                                    readsamplesize,
-                                    alac->setinfo_rice_initialhistory,
-                                    alac->setinfo_rice_kmodifier,
-                                    ricemodifier * alac->setinfo_rice_historymult / 4,
-                                    (1 << alac->setinfo_rice_kmodifier) - 1);
-
-       // yield();
-
-        if (prediction_type == 0)
-        { /* adaptive fir */
-            predictor_decompress_fir_adapt(outputbuffer[0],
-                                           outputbuffer[0],
-                                           outputsamples,
-                                           readsamplesize,
-                                           predictor_coef_table,
-                                           predictor_coef_num,
-                                           prediction_quantitization);
-        }
-        else
-        {
-            //fprintf(stderr, "FIXME: unhandled predicition type: %i\n", prediction_type);
-            /* i think the only other prediction type (or perhaps this is just a
-             * boolean?) runs adaptive fir twice.. like:
-             * predictor_decompress_fir_adapt(predictor_error, tempout, ...)
-             * predictor_decompress_fir_adapt(predictor_error, outputsamples ...)
-             * little strange..
-             */
-        }
+        midright = buffer0[i];
+        difference = buffer1[i];
 
+        buffer1[i] = midright - ((difference * interlacing_leftweight)
+                        >> interlacing_shift);
+        buffer0[i] = buffer1[i] + difference;
     }
-    else
-    { /* not compressed, easy case */
-        if (readsamplesize <= 16)
-        {
-            int i;
-            for (i = 0; i < outputsamples; i++)
-            {
-                int32_t audiobits = readbits(alac, readsamplesize);
-
-                audiobits = SIGN_EXTENDED32(audiobits, readsamplesize);
-
-                outputbuffer[0][i] = audiobits;
-            }
-        }
-        else
-        {
-            int i;
-            for (i = 0; i < outputsamples; i++)
-            {
-                int32_t audiobits;
-
-                audiobits = readbits(alac, 16);
-                /* special case of sign extension..
-                 * as we'll be ORing the low 16bits into this */
-                audiobits = audiobits << 16;
-                audiobits = audiobits >> (32 - readsamplesize);
-
-                audiobits |= readbits(alac, readsamplesize - 16);
-
-                outputbuffer[0][i] = audiobits;
-            }
-        }
-        /* wasted_bytes = 0; // unused */
-    }
+}
 
-    // yield();
+/* the low wasted_bytes*8 bits of each sample are stored verbatim ahead
+ * of the rice coded data (the "shift buffer"), one value per channel
+ * per sample */
+static uint16_t shift_buffer[2][ALAC_BLOCKSIZE] IBSS_ATTR;
 
-    switch(alac->setinfo_sample_size)
-    {
-    case 16:
-    {
-        int i;
-        for (i = 0; i < outputsamples; i++)
-        {
-            /* Output mono data as stereo */
-            outputbuffer[0][i] = outputbuffer[0][i] << SCALE16;
-            outputbuffer[1][i] = outputbuffer[0][i];
-        }
-        break;
-    }
-    case 20:
-    case 24:
-    case 32:
-        //fprintf(stderr, "FIXME: unimplemented sample size %i\n", alac->setinfo_sample_size);
-        break;
-    default:
-        break;
-    }
+static void append_shift_buffer(int32_t *buffer,
+                                uint16_t *shift,
+                                int numsamples,
+                                int shift_bits)
+{
+    int i;
 
-    return outputsamples;
+    for (i = 0; i < numsamples; i++)
+        buffer[i] = (int32_t)((uint32_t)buffer[i] << shift_bits) | shift[i];
 }
 
-static inline int decode_frame_stereo(
-                    alac_file *alac,
-                    int32_t outputbuffer[ALAC_MAX_CHANNELS][ALAC_BLOCKSIZE]) {
+/* element ids, the first 3 bits of each element in a frame */
+#define ID_SCE 0 /* single channel */
+#define ID_CPE 1 /* channel pair */
+#define ID_CCE 2
+#define ID_LFE 3 /* low frequency, coded like a single channel */
+#define ID_DSE 4
+#define ID_PCE 5
+#define ID_FIL 6
+#define ID_END 7
+
+/* Decodes one single channel (channels == 1) or channel pair (channels == 2)
+ * element into outbuf[0] (and outbuf[1]). Returns the number of samples
+ * per channel, or -1 if the element can't be decoded. */
+static int decode_element(alac_file *alac,
+                          int32_t *outbuf[2],
+                          int channels)
+{
+    static int16_t *coef_tables[2] = { predictor_coef_table_a,
+                                       predictor_coef_table_b };
     int hassize;
     int isnotcompressed;
     int readsamplesize;
-    int outputsamples = alac->setinfo_max_samples_per_frame;
+    uint32_t outputsamples = alac->setinfo_max_samples_per_frame;
     int wasted_bytes;
+    int ch, i;
 
-    uint8_t interlacing_shift;
-    uint8_t interlacing_leftweight;
+    uint8_t interlacing_shift = 0;
+    uint8_t interlacing_leftweight = 0;
 
-    /* 2^result = something to do with output waiting.
-     * perhaps matters if we read > 1 frame in a pass?
-     */
+    /* element instance tag */
     readbits(alac, 4);
 
     readbits(alac, 12); /* unknown, skip 12 bits */
 
     hassize = readbits(alac, 1); /* the output sample size is stored soon */
 
-    wasted_bytes = readbits(alac, 2); /* unknown ? */
+    wasted_bytes = readbits(alac, 2); /* bytes stored outside the rice data */
+    if (wasted_bytes > 2) return -1;  /* the shift buffer holds 16 bits, as in Apple's decoder */
 
     isnotcompressed = readbits(alac, 1); /* whether the frame is compressed */
 
@@ -859,205 +682,174 @@ static inline int decode_frame_stereo(
         outputsamples = readbits(alac, 32);
     }
 
-    readsamplesize = alac->setinfo_sample_size - (wasted_bytes * 8) + 1;
+    if (outputsamples > ALAC_BLOCKSIZE) return -1;
+
+    /* the side channel of a pair needs one more bit */
+    readsamplesize = alac->setinfo_sample_size - (wasted_bytes * 8)
+                   + channels - 1;
 
-    // yield();
     if (!isnotcompressed)
     { /* compressed */
-        int predictor_coef_num_a;
-        int prediction_type_a;
-        int prediction_quantitization_a;
-        int ricemodifier_a;
-
-        int predictor_coef_num_b;
-        int prediction_type_b;
-        int prediction_quantitization_b;
-        int ricemodifier_b;
+        int prediction_type[2];
+        int prediction_quantitization[2];
+        int ricemodifier[2];
+        int predictor_coef_num[2];
 
-        int i;
+        if (readsamplesize > 32) return -1;
 
         interlacing_shift = readbits(alac, 8);
         interlacing_leftweight = readbits(alac, 8);
 
-        /******** channel 1 ***********/
-        prediction_type_a = readbits(alac, 4);
-        prediction_quantitization_a = readbits(alac, 4);
-
-        ricemodifier_a = readbits(alac, 3);
-        predictor_coef_num_a = readbits(alac, 5);
-
-        /* read the predictor table */
-        for (i = 0; i < predictor_coef_num_a; i++)
+        for (ch = 0; ch < channels; ch++)
         {
-            predictor_coef_table_a[i] = (int16_t)readbits(alac, 16);
-        }
-
-        /******** channel 2 *********/
-        prediction_type_b = readbits(alac, 4);
-        prediction_quantitization_b = readbits(alac, 4);
+            prediction_type[ch] = readbits(alac, 4);
+            prediction_quantitization[ch] = readbits(alac, 4);
 
-        ricemodifier_b = readbits(alac, 3);
-        predictor_coef_num_b = readbits(alac, 5);
+            ricemodifier[ch] = readbits(alac, 3);
+            predictor_coef_num[ch] = readbits(alac, 5);
 
-        /* read the predictor table */
-        for (i = 0; i < predictor_coef_num_b; i++)
-        {
-            predictor_coef_table_b[i] = (int16_t)readbits(alac, 16);
+            /* read the predictor table */
+            for (i = 0; i < predictor_coef_num[ch]; i++)
+            {
+                coef_tables[ch][i] = (int16_t)readbits(alac, 16);
+            }
         }
 
-        /*********************/
         if (wasted_bytes)
-        { /* see mono case */
-            //fprintf(stderr, "FIXME: unimplemented, unhandling of wasted_bytes\n");
+        {
+            for (i = 0; i < (int)outputsamples; i++)
+                for (ch = 0; ch < channels; ch++)
+                    shift_buffer[ch][i] = readbits(alac, wasted_bytes * 8);
         }
 
-       // yield();
-        /* channel 1 */
-        basterdised_rice_decompress(alac,
-                                    outputbuffer[0],
-                                    outputsamples,
-                                    readsamplesize,
-                                    alac->setinfo_rice_initialhistory,
-                                    alac->setinfo_rice_kmodifier,
-                                    ricemodifier_a * alac->setinfo_rice_historymult / 4,
-                                    (1 << alac->setinfo_rice_kmodifier) - 1);
-
-        // yield();
-        if (prediction_type_a == 0)
-        { /* adaptive fir */
-            predictor_decompress_fir_adapt(outputbuffer[0],
-                                           outputbuffer[0],
-                                           outputsamples,
-                                           readsamplesize,
-                                           predictor_coef_table_a,
-                                           predictor_coef_num_a,
-                                           prediction_quantitization_a);
-        }
-        else
-        { /* see mono case */
-            //fprintf(stderr, "FIXME: unhandled predicition type: %i\n", prediction_type_a);
-        }
+        for (ch = 0; ch < channels; ch++)
+        {
+            basterdised_rice_decompress(alac,
+                                        outbuf[ch],
+                                        outputsamples,
+                                        readsamplesize,
+                                        alac->setinfo_rice_initialhistory,
+                                        alac->setinfo_rice_kmodifier,
+                                        ricemodifier[ch] * alac->setinfo_rice_historymult / 4,
+                                        (1 << alac->setinfo_rice_kmodifier) - 1);
+
+            if (prediction_type[ch] != 0)
+            {
+                /* the residual was run through a first order
+                 * difference before the adaptive fir */
+                predictor_decompress_fir_adapt(outbuf[ch],
+                                               outbuf[ch],
+                                               outputsamples,
+                                               readsamplesize,
+                                               NULL,
+                                               31,
+                                               0);
+            }
 
-        // yield();
-
-        /* channel 2 */
-        basterdised_rice_decompress(alac,
-                                    outputbuffer[1],
-                                    outputsamples,
-                                    readsamplesize,
-                                    alac->setinfo_rice_initialhistory,
-                                    alac->setinfo_rice_kmodifier,
-                                    ricemodifier_b * alac->setinfo_rice_historymult / 4,
-                                    (1 << alac->setinfo_rice_kmodifier) - 1);
-
-        // yield();
-        if (prediction_type_b == 0)
-        { /* adaptive fir */
-            predictor_decompress_fir_adapt(outputbuffer[1],
-                                           outputbuffer[1],
+            /* adaptive fir */
+            predictor_decompress_fir_adapt(outbuf[ch],
+                                           outbuf[ch],
                                            outputsamples,
                                            readsamplesize,
-                                           predictor_coef_table_b,
-                                           predictor_coef_num_b,
-                                           prediction_quantitization_b);
-        }
-        else
-        {
-            //fprintf(stderr, "FIXME: unhandled predicition type: %i\n", prediction_type_b);
+                                           coef_tables[ch],
+                                           predictor_coef_num[ch],
+                                           prediction_quantitization[ch]);
         }
     }
     else
     { /* not compressed, easy case */
-        if (alac->setinfo_sample_size <= 16)
-        {
-            int i;
-            for (i = 0; i < outputsamples; i++)
-            {
-                int32_t audiobits_a, audiobits_b;
-
-                audiobits_a = readbits(alac, alac->setinfo_sample_size);
-                audiobits_b = readbits(alac, alac->setinfo_sample_size);
-
-                audiobits_a = SIGN_EXTENDED32(audiobits_a, alac->setinfo_sample_size);
-                audiobits_b = SIGN_EXTENDED32(audiobits_b, alac->setinfo_sample_size);
+        int samplesize = alac->setinfo_sample_size;
 
-                outputbuffer[0][i] = audiobits_a;
-                outputbuffer[1][i] = audiobits_b;
-            }
-        }
-        else
+        for (i = 0; i < (int)outputsamples; i++)
         {
-            int i;
-            for (i = 0; i < outputsamples; i++)
+            for (ch = 0; ch < channels; ch++)
             {
-                int32_t audiobits_a, audiobits_b;
+                int32_t audiobits = readbits(alac, samplesize);
 
-                audiobits_a = readbits(alac, 16);
-                audiobits_a = audiobits_a << 16;
-                audiobits_a = audiobits_a >> (32 - alac->setinfo_sample_size);
-                audiobits_a |= readbits(alac, alac->setinfo_sample_size - 16);
-
-                audiobits_b = readbits(alac, 16);
-                audiobits_b = audiobits_b << 16;
-                audiobits_b = audiobits_b >> (32 - alac->setinfo_sample_size);
-                audiobits_b |= readbits(alac, alac->setinfo_sample_size - 16);
-
-                outputbuffer[0][i] = audiobits_a;
-                outputbuffer[1][i] = audiobits_b;
+                outbuf[ch][i] = SIGN_EXTENDED32(audiobits, samplesize);
             }
         }
-        /* wasted_bytes = 0; */
-        interlacing_shift = 0;
-        interlacing_leftweight = 0;
+        wasted_bytes = 0;
     }
 
-    // yield();
-
-    switch(alac->setinfo_sample_size)
+    if (channels == 2)
     {
-    case 16:
-    {
-        deinterlace_16(outputbuffer[0],
-                       outputbuffer[1],
-                       outputsamples,
-                       interlacing_shift,
-                       interlacing_leftweight);
-        break;
+        deinterlace(outbuf[0],
+                    outbuf[1],
+                    outputsamples,
+                    interlacing_shift,
+                    interlacing_leftweight);
     }
-    case 20:
-    case 24:
-    case 32:
-        //fprintf(stderr, "FIXME: unimplemented sample size %i\n", alac->setinfo_sample_size);
-        break;
-    default:
-        break;
+
+    if (wasted_bytes)
+    {
+        for (ch = 0; ch < channels; ch++)
+            append_shift_buffer(outbuf[ch], shift_buffer[ch],
+                                outputsamples, wasted_bytes * 8);
     }
+
     return outputsamples;
 }
 
+/* WAV channel index of each decoded channel, by channel count. The
+ * elements come as C, L R, (Ls Rs | Cs), LFE, with 7.1 carrying the
+ * front centre pair first. */
+static const uint8_t channel_map[ALAC_MAX_CHANNELS][ALAC_MAX_CHANNELS] ICONST_ATTR = {
+    { 0 },
+    { 0, 1 },
+    { 2, 0, 1 },
+    { 2, 0, 1, 3 },
+    { 2, 0, 1, 3, 4 },
+    { 2, 0, 1, 4, 5, 3 },
+    { 2, 0, 1, 4, 5, 6, 3 },
+    { 2, 6, 7, 0, 1, 4, 5, 3 },
+};
+
 int alac_decode_frame(alac_file *alac,
                       unsigned char *inbuffer,
                       int32_t outputbuffer[ALAC_MAX_CHANNELS][ALAC_BLOCKSIZE]) {
-    int channels;
-    int outputsamples;
+    const uint8_t *map;
+    int channels = alac->numchannels;
+    int decoded = 0;
+    int outputsamples = 0;
 
     /* setup the stream */
     alac->input_buffer = inbuffer;
-    alac->input_buffer_bitaccumulator = 0;
+    alac->input_cache = 0;
+    alac->input_cache_bits = 0;
 
-    channels = readbits(alac, 3);
+    if (channels < 1 || channels > ALAC_MAX_CHANNELS) return -1;
+    map = channel_map[channels - 1];
 
-    /* TODO: The mono and stereo functions should be combined. */
-    switch(channels)
+    /* one element per mono channel or channel pair, stop once all
+     * channels are in (the END element follows) */
+    while (decoded < channels)
     {
-        case 0: /* 1 channel */
-            outputsamples=decode_frame_mono(alac,outputbuffer);
-            break;
-        case 1: /* 2 channels */
-            outputsamples=decode_frame_stereo(alac,outputbuffer);
-            break;
-        default: /* Unsupported */
-            return -1;
+        int32_t *outbuf[2];
+        int n, samples;
+
+        switch (readbits(alac, 3))
+        {
+            case ID_SCE:
+            case ID_LFE:
+                n = 1;
+                break;
+            case ID_CPE:
+                n = 2;
+                break;
+            default: /* Unsupported */
+                return -1;
+        }
+        if (decoded + n > channels) return -1;
+
+        outbuf[0] = outputbuffer[map[decoded]];
+        outbuf[1] = (n == 2) ? outputbuffer[map[decoded + 1]] : NULL;
+
+        samples = decode_element(alac, outbuf, n);
+        if (samples < 0 || (decoded && samples != outputsamples)) return -1;
+
+        outputsamples = samples;
+        decoded += n;
     }
     return outputsamples;
 }
@@ -0,0 +1,176 @@
+/*
+ * ALAC (Apple Lossless Audio Codec) decoder
+ *
+ * NEON version of the adaptive FIR predictor for the common orders 4
+ * and 8. Same licence as alac_decoder.c.
+ *
+ * Each output sample depends on the one before it, so the vectors run
+ * across the taps of one sample, not across samples: the dot product is
+ * a multiply-accumulate and a horizontal add, and the sign-adaptive
+ * coefficient update is done for all taps at once.
+ *
+ * The scalar update walks the taps from the oldest sample to the newest
+ * and stops as soon as the error has been used up (changed sign). Each tap
+ * takes (|val| >> quantization) * weight off the error, and that amount
+ * always has the error's sign. So the error left before a tap is the
+ * original error minus a running sum of the earlier taps' amounts, and
+ * "not used up" at that point is the same as "not used up" at every
+ * earlier tap. One running sum plus one compare therefore gives the
+ * update mask for all taps.
+ */
+
+#include <string.h>
+#include <inttypes.h>
+
+#include <arm_neon.h>
+
+#include "decomp.h"
+
+#include <cpu-features.h>
+
+#define SIGN_EXTENDED32(val, bits) ((val << (32 - bits)) >> (32 - bits))
+
+extern volatile int audio_simd;    /* see audioSetSimd() in ../main.c */
+
+/* Returns 1 if predictor_decompress_fir_adapt_neon() may be used. NEON
+ * is optional on ARMv7, so we have to ask the kernel. */
+int alac_neon_supported(void)
+{
+    static int neon = -1;
+
+    if (neon < 0)
+        neon = (android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM &&
+            (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON)) ? 1 : 0;
+
+    return neon && audio_simd;
+}
+
+static inline int32_t add_lanes(int32x4_t v)
+{
+    int32x2_t s = vadd_s32(vget_low_s32(v), vget_high_s32(v));
+
+    return vget_lane_s32(vpadd_s32(s, s), 0);
+}
+
+/* t0, t0+t1, t0+t1+t2, t0+t1+t2+t3 */
+static inline int32x4_t running_sum(int32x4_t t)
+{
+    int32x4_t zero = vdupq_n_s32(0);
+
+    t = vaddq_s32(t, vextq_s32(zero, t, 3));
+    return vaddq_s32(t, vextq_s32(zero, t, 2));
+}
+
+/* -1, 0 or 1 per lane */
+static inline int32x4_t sign_of(int32x4_t v)
+{
+    int32x4_t zero = vdupq_n_s32(0);
+
+    return vsubq_s32(vreinterpretq_s32_u32(vcltq_s32(v, zero)),
+                     vreinterpretq_s32_u32(vcgtq_s32(v, zero)));
+}
+
+/* Coefficient changes for one group of 4 taps. diff holds sample - base
+ * for the taps, weight their weights, sum_before the amount the earlier
+ * groups took off the error. Adds this group's amount to *sum_before. */
+static inline int32x4_t update_taps(int32x4_t diff, int32x4_t weight,
+                                    int32_t error_val, int32x4_t shift,
+                                    int32x4_t *sum_before)
+{
+    int32x4_t zero = vdupq_n_s32(0);
+    int32x4_t val = vabsq_s32(diff);
+    int32x4_t taken, sum, left;
+    uint32x4_t mask;
+
+    if (error_val < 0) val = vnegq_s32(val);
+
+    taken = vmulq_s32(vshlq_s32(val, shift), weight);
+    sum = vaddq_s32(running_sum(taken), *sum_before);
+
+    /* error left before each tap */
+    left = vaddq_s32(vsubq_s32(vdupq_n_s32(error_val), sum), taken);
+    mask = (error_val > 0) ? vcgtq_s32(left, zero) : vcltq_s32(left, zero);
+
+    *sum_before = vdupq_n_s32(vgetq_lane_s32(sum, 3));
+
+    /* val is base - sample, the scalar code does coef -= sign(val) for a
+       positive error and coef += sign(val) for a negative one */
+    val = vandq_s32(sign_of(diff), vreinterpretq_s32_u32(mask));
+    return (error_val > 0) ? val : vnegq_s32(val);
+}
+
+/* The coefficients are int16_t in the scalar code and wrap as such */
+static inline int32x4_t wrap16(int32x4_t v)
+{
+    return vshrq_n_s32(vshlq_n_s32(v, 16), 16);
+}
+
+/* Drop-in replacement for the order 4 and 8 loops of
+ * predictor_decompress_fir_adapt(), to be called once the warm-up samples
+ * buffer_out[0..predictor_coef_num] are in. */
+void predictor_decompress_fir_adapt_neon(int32_t *error_buffer,
+                                         int32_t *buffer_out,
+                                         int output_size,
+                                         int readsamplesize,
+                                         int16_t *predictor_coef_table,
+                                         int predictor_coef_num,
+                                         int predictor_quantitization)
+{
+    static const int32_t weights[8] = { 1, 2, 3, 4, 5, 6, 7, 8 };
+    int32_t coefs[8];
+    int32x4_t coef_lo, coef_hi = vdupq_n_s32(0);
+    int32x4_t weight_lo = vld1q_s32(weights), weight_hi = vld1q_s32(weights + 4);
+    int32x4_t shift = vdupq_n_s32(-predictor_quantitization);
+    int i, j;
+
+    /* Lane j goes with buffer_out[1 + j], so the coefficients (which start
+     * with the newest sample) are loaded in reverse. */
+    for (j = 0; j < predictor_coef_num; j++)
+        coefs[j] = predictor_coef_table[predictor_coef_num - 1 - j];
+
+    coef_lo = vld1q_s32(coefs);
+    if (predictor_coef_num == 8) coef_hi = vld1q_s32(coefs + 4);
+
+    for (i = predictor_coef_num + 1; i < output_size; i++)
+    {
+        int32_t base = buffer_out[0];
+        int32_t error_val = error_buffer[i];
+        int32x4_t vbase = vdupq_n_s32(base);
+        int32x4_t diff_lo, diff_hi = vdupq_n_s32(0), acc;
+        int32_t outval;
+
+        diff_lo = vsubq_s32(vld1q_s32(buffer_out + 1), vbase);
+        acc = vmulq_s32(diff_lo, coef_lo);
+        if (predictor_coef_num == 8)
+        {
+            diff_hi = vsubq_s32(vld1q_s32(buffer_out + 5), vbase);
+            acc = vmlaq_s32(acc, diff_hi, coef_hi);
+        }
+
+        outval = (1 << (predictor_quantitization-1)) + add_lanes(acc);
+        outval = outval >> predictor_quantitization;
+        outval = outval + base + error_val;
+        outval = SIGN_EXTENDED32(outval, readsamplesize);
+
+        buffer_out[predictor_coef_num+1] = outval;
+
+        if (error_val)
+        {
+            int32x4_t sum_before = vdupq_n_s32(0);
+
+            coef_lo = wrap16(vaddq_s32(coef_lo,
+                update_taps(diff_lo, weight_lo, error_val, shift, &sum_before)));
+            if (predictor_coef_num == 8)
+                coef_hi = wrap16(vaddq_s32(coef_hi,
+                    update_taps(diff_hi, weight_hi, error_val, shift, &sum_before)));
+        }
+
+        buffer_out++;
+    }
+
+    vst1q_s32(coefs, coef_lo);
+    if (predictor_coef_num == 8) vst1q_s32(coefs + 4, coef_hi);
+
+    for (j = 0; j < predictor_coef_num; j++)
+        predictor_coef_table[predictor_coef_num - 1 - j] = coefs[j];
+}
@@ -8,17 +8,20 @@
 #define IBSS_ATTR
 #endif
 
-/* Always output samples shifted to 28 bits + sign*/
-#define ALAC_OUTPUT_DEPTH 29
-#define SCALE16 (ALAC_OUTPUT_DEPTH - 16)
-#define ALAC_MAX_CHANNELS 2
+/* Samples are output at the stream's own bit depth (setinfo_sample_size),
+   one buffer per channel, in WAV channel order (L R C LFE Ls Rs ...) */
+#define ALAC_MAX_CHANNELS 8
 #define ALAC_BLOCKSIZE 4096  /* Number of samples per channel per block */
+/* the bit reader loads 8 bytes at a time, starting up to 5 bytes past
+   the byte it is reading, so the input buffer must have at least 12
+   readable bytes past the end of a frame */
+#define ALAC_INPUT_PADDING 16
 
 typedef struct
 {
-    unsigned char *input_buffer;
-    int input_buffer_bitaccumulator; /* used so we can do arbitary
-                                        bit reads */
+    unsigned char *input_buffer; /* next byte to go into the cache */
+    uint64_t input_cache;        /* unread bits, left aligned */
+    int input_cache_bits;        /* number of valid bits in the cache */
     int samplesize;
     int numchannels;
     int bytespersample;
@@ -44,6 +47,25 @@ int alac_decode_frame(alac_file *alac,
                       unsigned char *inbuffer,
                       int32_t outputbuffer[ALAC_MAX_CHANNELS][ALAC_BLOCKSIZE]) ICODE_ATTR_ALAC;
 void alac_set_info(alac_file *alac, char *inputbuffer) ICODE_ATTR_ALAC;
+void predictor_decompress_fir_adapt(int32_t *error_buffer,
+                                    int32_t *buffer_out,
+                                    int output_size,
+                                    int readsamplesize,
+                                    int16_t *predictor_coef_table,
+                                    int predictor_coef_num,
+                                    int predictor_quantitization) ICODE_ATTR_ALAC;
+
+#ifdef ALAC_NEON
+/* alac_neon.c */
+int alac_neon_supported(void);
+void predictor_decompress_fir_adapt_neon(int32_t *error_buffer,
+                                         int32_t *buffer_out,
+                                         int output_size,
+                                         int readsamplesize,
+                                         int16_t *predictor_coef_table,
+                                         int predictor_coef_num,
+                                         int predictor_quantitization);
+#endif
 
 #endif /* __ALAC__DECOMP_H */
 
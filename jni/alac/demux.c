@@ -225,13 +225,18 @@ static bool read_chunk_stsd(qtmovie_t *qtmovie, size_t chunk_len)
 //               return false;
 //          }
 
+          uint32_t codecdata_read = entry_remaining;
+
           /* 12 = audio format atom, 8 = padding */
-          qtmovie->res->codecdata_len = entry_remaining + 12 + 8;
-          if (qtmovie->res->codecdata_len > MAX_CODECDATA_SIZE)
+          if (codecdata_read + 12 + 8 > MAX_CODECDATA_SIZE)
           {
+             /* multichannel files carry a 'chan' atom after the 'alac'
+                one; the decoder only needs the latter */
              DEBUGF("codecdata too large (%d) in stsd\n", 
-                    (int)qtmovie->res->codecdata_len);
+                    (int)entry_remaining + 12 + 8);
+             codecdata_read = MAX_CODECDATA_SIZE - 12 - 8;
           }
+          qtmovie->res->codecdata_len = codecdata_read + 12 + 8;
 
           memset(qtmovie->res->codecdata, 0, qtmovie->res->codecdata_len);
           /* audio format atom */
@@ -244,9 +249,9 @@ static bool read_chunk_stsd(qtmovie_t *qtmovie, size_t chunk_len)
 #endif
 
           stream_read(qtmovie->stream,
-                  entry_remaining,
+                  codecdata_read,
                   ((char*)qtmovie->res->codecdata) + 12);
-          entry_remaining -= entry_remaining;
+          entry_remaining -= codecdata_read;
 
           if (entry_remaining)
               stream_skip(qtmovie->stream, entry_remaining);
@@ -317,6 +322,16 @@ static bool read_chunk_stts(qtmovie_t *qtmovie, size_t chunk_len)
     numentries = stream_read_uint32(qtmovie->stream);
     size_remaining -= 4;
 
+    /* a table that doesn't fit in its atom is broken */
+    if (numentries > size_remaining / 8)
+    {
+        DEBUGF("stts truncated\n");
+        return false;
+    }
+
+    /* only the last table of its kind is used */
+    free(qtmovie->res->time_to_sample);
+
     qtmovie->res->num_time_to_samples = numentries;
     qtmovie->res->time_to_sample = malloc(numentries * sizeof(*qtmovie->res->time_to_sample));
 
@@ -370,6 +385,16 @@ static bool read_chunk_stsz(qtmovie_t *qtmovie, size_t chunk_len)
     numentries = stream_read_uint32(qtmovie->stream);
     size_remaining -= 4;
 
+    /* a table that doesn't fit in its atom is broken */
+    if (numentries > size_remaining / 4)
+    {
+        DEBUGF("stsz truncated\n");
+        return false;
+    }
+
+    /* only the last table of its kind is used */
+    free(qtmovie->res->sample_byte_size);
+
     qtmovie->res->num_sample_byte_sizes = numentries;
     qtmovie->res->sample_byte_size = malloc(numentries * sizeof(*qtmovie->res->sample_byte_size));
 
@@ -381,16 +406,13 @@ static bool read_chunk_stsz(qtmovie_t *qtmovie, size_t chunk_len)
 
     for (i = 0; i < numentries; i++)
     {
-        uint32_t v = stream_read_uint32(qtmovie->stream);
-        
-        if (v > 0x0000ffff)
+        qtmovie->res->sample_byte_size[i] = stream_read_uint32(qtmovie->stream);
+        size_remaining -= 4;
+        if (qtmovie->res->sample_byte_size[i] > MAX_SAMPLE_BYTE_SIZE)
         {
-            DEBUGF("stsz[%d] > 65 kB (%ld)\n", i, (long)v);
+            DEBUGF("stsz entry too large\n");
             return false;
         }
-        
-        qtmovie->res->sample_byte_size[i] = v;
-        size_remaining -= 4;
     }
 
     if (size_remaining)
@@ -415,6 +437,16 @@ static bool read_chunk_stsc(qtmovie_t *qtmovie, size_t chunk_len)
     numentries = stream_read_uint32(qtmovie->stream);
     size_remaining -= 4;
 
+    /* a table that doesn't fit in its atom is broken */
+    if (numentries > size_remaining / 12)
+    {
+        DEBUGF("stsc truncated\n");
+        return false;
+    }
+
+    /* only the last table of its kind is used */
+    free(qtmovie->res->sample_to_chunk);
+
     qtmovie->res->num_sample_to_chunks = numentries;
     qtmovie->res->sample_to_chunk = malloc(numentries *
         sizeof(*qtmovie->res->sample_to_chunk));
@@ -444,7 +476,8 @@ static bool read_chunk_stsc(qtmovie_t *qtmovie, size_t chunk_len)
     return true;
 }
 
-static bool read_chunk_stco(qtmovie_t *qtmovie, size_t chunk_len)
+/* stco holds 32-bit chunk offsets, co64 (files over 4 GB) 64-bit ones */
+static bool read_chunk_stco(qtmovie_t *qtmovie, size_t chunk_len, bool co64)
 {
     unsigned int i;
     uint32_t numentries;
@@ -457,6 +490,16 @@ static bool read_chunk_stco(qtmovie_t *qtmovie, size_t chunk_len)
     numentries = stream_read_uint32(qtmovie->stream);
     size_remaining -= 4;
 
+    /* a table that doesn't fit in its atom is broken */
+    if (numentries > size_remaining / (co64 ? 8 : 4))
+    {
+        DEBUGF("stco truncated\n");
+        return false;
+    }
+
+    /* only the last table of its kind is used */
+    free(qtmovie->res->chunk_offset);
+
     qtmovie->res->num_chunk_offsets = numentries;
     qtmovie->res->chunk_offset = malloc(numentries * 
         sizeof(*qtmovie->res->chunk_offset));
@@ -469,8 +512,16 @@ static bool read_chunk_stco(qtmovie_t *qtmovie, size_t chunk_len)
 
     for (i = 0; i < numentries; i++)
     {
-        qtmovie->res->chunk_offset[i] = stream_read_uint32(qtmovie->stream);
-        size_remaining -= 4;
+        if (co64)
+        {
+            qtmovie->res->chunk_offset[i] = stream_read_uint64(qtmovie->stream);
+            size_remaining -= 8;
+        }
+        else
+        {
+            qtmovie->res->chunk_offset[i] = stream_read_uint32(qtmovie->stream);
+            size_remaining -= 4;
+        }
     }
 
     if (size_remaining)
@@ -527,7 +578,13 @@ static bool read_chunk_stbl(qtmovie_t *qtmovie, size_t chunk_len)
             }
             break;
         case MAKEFOURCC('s','t','c','o'):
-            if (!read_chunk_stco(qtmovie, sub_chunk_len))
+            if (!read_chunk_stco(qtmovie, sub_chunk_len, false))
+            {
+               return false;
+            }
+            break;
+        case MAKEFOURCC('c','o','6','4'):
+            if (!read_chunk_stco(qtmovie, sub_chunk_len, true))
             {
                return false;
             }
@@ -718,14 +775,12 @@ static bool read_chunk_moov(qtmovie_t *qtmovie, size_t chunk_len)
     return true;
 }
 
-static void read_chunk_mdat(qtmovie_t *qtmovie, size_t chunk_len)
+static void read_chunk_mdat(qtmovie_t *qtmovie, uint64_t data_len)
 {
-    size_t size_remaining = chunk_len - 8;
-
-    qtmovie->res->mdat_len = size_remaining;
+    qtmovie->res->mdat_len = data_len;
 }
 
-int qtmovie_read(stream_t *file, demux_res_t *demux_res)
+static int qtmovie_read_chunks(stream_t *file, demux_res_t *demux_res)
 {
     qtmovie_t qtmovie;
 
@@ -736,7 +791,8 @@ int qtmovie_read(stream_t *file, demux_res_t *demux_res)
     /* read the chunks */
     while (1)
     {
-        size_t chunk_len;
+        uint64_t chunk_len;
+        uint32_t header_len = 8;
         fourcc_t chunk_id;
 
         chunk_len = stream_read_uint32(qtmovie.stream);
@@ -745,22 +801,36 @@ int qtmovie_read(stream_t *file, demux_res_t *demux_res)
             return 0;
         }
 
+        chunk_id = stream_read_uint32(qtmovie.stream);
+
         if (chunk_len == 1)
         {
-            //DEBUGF("need 64bit support\n");
+            /* 64-bit "largesize" follows the type, used for mdat > 4 GB */
+            chunk_len = stream_read_uint64(qtmovie.stream);
+            header_len = 16;
+        }
+        else if (chunk_len == 0 && chunk_id == MAKEFOURCC('m','d','a','t'))
+        {
+            /* mdat extends to the end of the file */
+            chunk_len = lseek64(qtmovie.stream->fd, 0, SEEK_END) - stream_tell(qtmovie.stream) + header_len;
+            lseek64(qtmovie.stream->fd, stream_tell(qtmovie.stream), SEEK_SET);
+        }
+
+        if (chunk_len < header_len ||
+            (chunk_id != MAKEFOURCC('m','d','a','t') && chunk_len - header_len > 0x7fffffff))
+        {
             return 0;
         }
-        chunk_id = stream_read_uint32(qtmovie.stream);
 #ifdef TEST
-        printf("Found a chunk %c%c%c%c, length=%d\n",SPLITFOURCC(chunk_id),chunk_len);
+        printf("Found a chunk %c%c%c%c, length=%lld\n",SPLITFOURCC(chunk_id),(long long)chunk_len);
 #endif
         switch (chunk_id)
         {
         case MAKEFOURCC('f','t','y','p'):
-            read_chunk_ftyp(&qtmovie, chunk_len);
+            read_chunk_ftyp(&qtmovie, chunk_len - header_len + 8);
             break;
         case MAKEFOURCC('m','o','o','v'):
-            if (!read_chunk_moov(&qtmovie, chunk_len)) {
+            if (!read_chunk_moov(&qtmovie, chunk_len - header_len + 8)) {
                return 0;
             }
             break;
@@ -771,18 +841,18 @@ int qtmovie_read(stream_t *file, demux_res_t *demux_res)
              * for the decoder. And we don't want to rely on fseek/ftell,
              * as they may not always be avilable */
         case MAKEFOURCC('m','d','a','t'):
-            read_chunk_mdat(&qtmovie, chunk_len);
+            read_chunk_mdat(&qtmovie, chunk_len - header_len);
             /* Keep track of start of stream in file - used for seeking */
             qtmovie.res->mdat_offset=stream_tell(qtmovie.stream);
             /* There can be empty mdats before the real one. If so, skip them */
             if (qtmovie.res->mdat_len > 0) {
-                return 1;
+                return build_sample_index(qtmovie.res);
             }
             break;
 
             /*  these following atoms can be skipped !!!! */
         case MAKEFOURCC('f','r','e','e'):
-            stream_skip(qtmovie.stream, chunk_len - 8);
+            stream_skip(qtmovie.stream, chunk_len - header_len);
             break;
         default:
 #ifdef TEST
@@ -795,4 +865,27 @@ int qtmovie_read(stream_t *file, demux_res_t *demux_res)
     return 0;
 }
 
+int qtmovie_read(stream_t *file, demux_res_t *demux_res)
+{
+    memset(demux_res, 0, sizeof(*demux_res));
 
+    if (!qtmovie_read_chunks(file, demux_res))
+    {
+        qtmovie_free(demux_res);
+        return 0;
+    }
+    return 1;
+}
+
+/* Releases the sample tables read by a successful qtmovie_read() */
+void qtmovie_free(demux_res_t *demux_res)
+{
+    free(demux_res->time_to_sample);
+    free(demux_res->sample_byte_size);
+    free(demux_res->sample_to_chunk);
+    free(demux_res->chunk_offset);
+    free(demux_res->tts_first_sample);
+    free(demux_res->tts_first_time);
+    free(demux_res->chunk_first_sample);
+    memset(demux_res, 0, sizeof(*demux_res));
+}
@@ -57,7 +57,7 @@ int32_t stream_read_int32(stream_t *stream)
     return v;
 }
 
-int32_t stream_tell(stream_t *stream)
+int64_t stream_tell(stream_t *stream)
 {
     return stream->curpos;
 }
@@ -72,6 +72,12 @@ uint32_t stream_read_uint32(stream_t *stream)
     return v;
 }
 
+uint64_t stream_read_uint64(stream_t *stream)
+{
+    uint64_t v = stream_read_uint32(stream);
+    return (v << 32) | stream_read_uint32(stream);
+}
+
 int16_t stream_read_int16(stream_t *stream)
 {
     int16_t v;
@@ -106,9 +112,9 @@ uint8_t stream_read_uint8(stream_t *stream)
     return v;
 }
 
-void stream_skip(stream_t *stream, size_t skip)
+void stream_skip(stream_t *stream, int64_t skip)
 {
-  stream->curpos = lseek(stream->fd,skip,SEEK_CUR); 
+  stream->curpos = lseek64(stream->fd,skip,SEEK_CUR); 
   if(stream->curpos < 0) stream->err = LIBLOSSLESS_ERR_OFFSET;
 //  stream->ci->advance_buffer(skip);
 }
@@ -122,55 +128,134 @@ void stream_create(stream_t *stream, msm_ctx* ctx)
 {
   //  stream->ci=ci;
     stream->fd = ctx->fd;	
-    stream->curpos = lseek(ctx->fd,0,SEEK_CUR);
+    stream->curpos = lseek64(ctx->fd,0,SEEK_CUR);
     stream->eof=0;
     stream->err = 0;	
 }
 
 /* This function was part of the original alac decoder implementation */
 
+/* Index of the last entry of a[0..n-1] that is <= v, a[] being sorted
+ * and a[0] <= v. */
+static uint32_t find_entry32(const uint32_t *a, uint32_t n, uint32_t v)
+{
+    uint32_t lo = 0, hi = n;
+
+    while (hi - lo > 1)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (a[mid] <= v) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+static uint32_t find_entry64(const uint64_t *a, uint32_t n, uint64_t v)
+{
+    uint32_t lo = 0, hi = n;
+
+    while (hi - lo > 1)
+    {
+        uint32_t mid = lo + (hi - lo) / 2;
+
+        if (a[mid] <= v) lo = mid;
+        else hi = mid;
+    }
+    return lo;
+}
+
+/* Turns the run-length coded time_to_sample and sample_to_chunk tables
+ * into cumulative ones, so that a sample's duration, time and file offset
+ * are found by binary search instead of walking the tables from the start.
+ * Returns 0 if out of memory.
+ */
+int build_sample_index(demux_res_t *demux_res)
+{
+    uint32_t i, j;
+    uint32_t sample = 0;
+    uint64_t time = 0;
+
+    demux_res->tts_first_sample = malloc((demux_res->num_time_to_samples + 1) *
+        sizeof(*demux_res->tts_first_sample));
+    demux_res->tts_first_time = malloc((demux_res->num_time_to_samples + 1) *
+        sizeof(*demux_res->tts_first_time));
+    demux_res->chunk_first_sample = malloc((demux_res->num_chunk_offsets + 1) *
+        sizeof(*demux_res->chunk_first_sample));
+
+    if (!demux_res->tts_first_sample || !demux_res->tts_first_time ||
+        !demux_res->chunk_first_sample)
+    {
+        return 0;
+    }
+
+    for (i = 0; i < demux_res->num_time_to_samples; i++)
+    {
+        demux_res->tts_first_sample[i] = sample;
+        demux_res->tts_first_time[i] = time;
+        sample += demux_res->time_to_sample[i].sample_count;
+        time += (uint64_t)demux_res->time_to_sample[i].sample_count *
+            demux_res->time_to_sample[i].sample_duration;
+    }
+    demux_res->tts_first_sample[i] = sample;
+    demux_res->tts_first_time[i] = time;
+
+    /* chunks are numbered from 1 in sample_to_chunk, entry j covers chunks
+     * first_chunk up to the next entry's first_chunk */
+    sample = 0;
+    for (i = 0, j = 0; i < demux_res->num_chunk_offsets; i++)
+    {
+        while (j + 1 < demux_res->num_sample_to_chunks &&
+               demux_res->sample_to_chunk[j + 1].first_chunk <= i + 1)
+        {
+            j++;
+        }
+        demux_res->chunk_first_sample[i] = sample;
+        if (demux_res->num_sample_to_chunks &&
+            demux_res->sample_to_chunk[j].first_chunk <= i + 1)
+        {
+            sample += demux_res->sample_to_chunk[j].num_samples;
+        }
+    }
+    demux_res->chunk_first_sample[i] = sample;
+
+    return 1;
+}
+
+/* Length of the track in sound samples */
+uint64_t get_total_sound_samples(demux_res_t *demux_res)
+{
+    return demux_res->tts_first_time[demux_res->num_time_to_samples];
+}
+
 int get_sample_info(demux_res_t *demux_res, uint32_t samplenum,
                            uint32_t *sample_duration,
                            uint32_t *sample_byte_size)
 {
-    unsigned int duration_index_accum = 0;
-    unsigned int duration_cur_index = 0;
+    uint32_t i;
 
     if (samplenum >= demux_res->num_sample_byte_sizes) { 
         return 0;
     }
 
-    if (!demux_res->num_time_to_samples) {
+    if (!demux_res->num_time_to_samples ||
+        samplenum >= demux_res->tts_first_sample[demux_res->num_time_to_samples]) {
         return 0;
     }
 
-    while ((demux_res->time_to_sample[duration_cur_index].sample_count
-            + duration_index_accum) <= samplenum) {
-        duration_index_accum +=
-        demux_res->time_to_sample[duration_cur_index].sample_count;
+    i = find_entry32(demux_res->tts_first_sample,
+                     demux_res->num_time_to_samples, samplenum);
 
-        duration_cur_index++;
-        if (duration_cur_index >= demux_res->num_time_to_samples) {
-            return 0;
-        }
-    }
-
-    *sample_duration =
-     demux_res->time_to_sample[duration_cur_index].sample_duration;
+    *sample_duration = demux_res->time_to_sample[i].sample_duration;
     *sample_byte_size = demux_res->sample_byte_size[samplenum];
 
     return 1;
 }
 
-unsigned int get_sample_offset(demux_res_t *demux_res, uint32_t sample)
+uint64_t get_sample_offset(demux_res_t *demux_res, uint32_t sample)
 {
-    uint32_t chunk = 1;
-    uint32_t range_samples = 0;
-    uint32_t total_samples = 0;
-    uint32_t chunk_sample;
-    uint32_t prev_chunk;
-    uint32_t prev_chunk_samples;
-    uint32_t file_offset;
+    uint64_t file_offset;
+    uint32_t chunk;
     uint32_t i;
     
     /* First check we have the appropriate metadata - we should always
@@ -178,62 +263,21 @@ unsigned int get_sample_offset(demux_res_t *demux_res, uint32_t sample)
      */
        
     if (sample >= demux_res->num_sample_byte_sizes ||
-        !demux_res->num_sample_to_chunks ||
-        !demux_res->num_chunk_offsets) 
+        !demux_res->num_chunk_offsets ||
+        sample >= demux_res->chunk_first_sample[demux_res->num_chunk_offsets]) 
     {
         return 0;
     }
 
-    /* Locate the chunk containing the sample */
+    /* Locate the chunk containing the sample, then add up the samples
+     * before it within the chunk */
     
-    prev_chunk = demux_res->sample_to_chunk[0].first_chunk;
-    prev_chunk_samples = demux_res->sample_to_chunk[0].num_samples;
-
-    for (i = 1; i < demux_res->num_sample_to_chunks; i++) 
-    {
-        chunk = demux_res->sample_to_chunk[i].first_chunk;
-        range_samples = (chunk - prev_chunk) * prev_chunk_samples;
+    chunk = find_entry32(demux_res->chunk_first_sample,
+                         demux_res->num_chunk_offsets, sample);
 
-        if (sample < total_samples + range_samples)
-        {
-            break;
-        }
-
-        total_samples += range_samples;
-        prev_chunk = demux_res->sample_to_chunk[i].first_chunk;
-        prev_chunk_samples = demux_res->sample_to_chunk[i].num_samples;
-    }
-
-    if (sample >= demux_res->sample_to_chunk[0].num_samples)
-    {
-        chunk = prev_chunk + (sample - total_samples) / prev_chunk_samples;
-    }
-    else
-    {
-        chunk = 1;
-    }
-    
-    /* Get sample of the first sample in the chunk */
-    
-    chunk_sample = total_samples + (chunk - prev_chunk) * prev_chunk_samples;
-    
-    /* Get offset in file */
-    
-    if (chunk > demux_res->num_chunk_offsets)
-    {
-        file_offset = demux_res->chunk_offset[demux_res->num_chunk_offsets - 1];
-    }
-    else
-    {
-        file_offset = demux_res->chunk_offset[chunk - 1];
-    }
-    
-    if (chunk_sample > sample) 
-    {
-        return 0;
-    }
+    file_offset = demux_res->chunk_offset[chunk];
  
-    for (i = chunk_sample; i < sample; i++)
+    for (i = demux_res->chunk_first_sample[chunk]; i < sample; i++)
     {
         file_offset += demux_res->sample_byte_size[i];
     }
@@ -275,8 +319,8 @@ unsigned int alac_seek(demux_res_t* demux_res, stream_t* stream,
     uint32_t j;
     uint32_t new_sample;
     uint32_t new_sound_sample;
-    uint32_t new_pos;
-    off_t ss;
+    uint64_t new_pos;
+    int64_t ss;
     /* First check we have the appropriate metadata - we should always
      * have it.
      */
@@ -288,40 +332,30 @@ unsigned int alac_seek(demux_res_t* demux_res, stream_t* stream,
     }
 
     /* Find the destination block from time_to_sample array */
-    
-    i = 0;
-    new_sample = 0;
-    new_sound_sample = 0;
 
-    while ((i < demux_res->num_time_to_samples) &&
-        (new_sound_sample < sound_sample_loc)) 
+    if (sound_sample_loc >= demux_res->tts_first_time[demux_res->num_time_to_samples])
     {
-        j = (sound_sample_loc - new_sound_sample) /
-            demux_res->time_to_sample[i].sample_duration;
-    
-        if (j <= demux_res->time_to_sample[i].sample_count)
-        {
-            new_sample += j;
-            new_sound_sample += j * 
-                demux_res->time_to_sample[i].sample_duration;
-            break;
-        } 
-        else 
-        {
-            new_sound_sample += (demux_res->time_to_sample[i].sample_duration
-                * demux_res->time_to_sample[i].sample_count);
-            new_sample += demux_res->time_to_sample[i].sample_count;
-            i++;
-        }
+        return 0;
     }
 
+    i = find_entry64(demux_res->tts_first_time,
+                     demux_res->num_time_to_samples, sound_sample_loc);
+
+    j = demux_res->time_to_sample[i].sample_duration ?
+        (sound_sample_loc - demux_res->tts_first_time[i]) /
+            demux_res->time_to_sample[i].sample_duration : 0;
+
+    new_sample = demux_res->tts_first_sample[i] + j;
+    new_sound_sample = demux_res->tts_first_time[i] +
+        (uint64_t)j * demux_res->time_to_sample[i].sample_duration;
+
     /* We know the new block, now calculate the file position. */
   
     new_pos = get_sample_offset(demux_res, new_sample);
 
     /* We know the new file position, so let's try to seek to it */
   	
-    ss = lseek(stream->fd,new_pos,SEEK_SET);
+    ss = lseek64(stream->fd,new_pos,SEEK_SET);
 //    if (stream->ci->seek_buffer(new_pos)) 
     if(ss >= 0) {
 	stream->curpos = ss;
@@ -355,48 +389,36 @@ unsigned int alac_seek(demux_res_t* demux_res, stream_t* stream,
  * calculate the sound_samples_done value.
  */
 unsigned int alac_seek_raw(demux_res_t* demux_res, stream_t* stream,
-    uint32_t file_loc, uint32_t* sound_samples_done, 
+    uint64_t file_loc, uint32_t* sound_samples_done, 
     int* current_sample)
 {
-    uint32_t chunk_sample = 0;
-    uint32_t total_samples = 0;
-    uint32_t new_sound_sample = 0;
-    uint32_t new_pos;
+    uint32_t chunk_sample;
+    uint32_t chunk_end;
+    uint32_t new_sound_sample;
+    uint64_t new_pos;
     uint32_t chunk;
     uint32_t i;
-    off_t ss;
+    int64_t ss;
     if (!demux_res->num_chunk_offsets ||
-        !demux_res->num_sample_to_chunks) 
+        !demux_res->num_time_to_samples) 
     {
         return 0;
     }
 
     /* Locate the chunk containing file_loc. */
 
-    for (i = 0; i < demux_res->num_chunk_offsets && 
-        file_loc < demux_res->chunk_offset[i]; i++)
-    {
-    }
-    
-    chunk = i + 1;
-    new_pos = demux_res->chunk_offset[chunk - 1];
-
-    /* Get the first sample of the chunk. */
-    
-    for (i = 1; i < demux_res->num_sample_to_chunks &&
-        chunk < demux_res->sample_to_chunk[i - 1].first_chunk; i++) 
-    {
-        chunk_sample += demux_res->sample_to_chunk[i - 1].num_samples *
-            (demux_res->sample_to_chunk[i].first_chunk - 
-                demux_res->sample_to_chunk[i - 1].first_chunk);
-    }
-    
-    chunk_sample += (chunk - demux_res->sample_to_chunk[i - 1].first_chunk) *
-        demux_res->sample_to_chunk[i - 1].num_samples;
+    chunk = find_entry64(demux_res->chunk_offset,
+                         demux_res->num_chunk_offsets, file_loc);
+    new_pos = demux_res->chunk_offset[chunk];
 
     /* Get the position within the chunk. */
     
-    for (; chunk_sample < demux_res->num_sample_byte_sizes; chunk_sample++)
+    chunk_sample = demux_res->chunk_first_sample[chunk];
+    chunk_end = demux_res->chunk_first_sample[chunk + 1];
+    if (chunk_end > demux_res->num_sample_byte_sizes)
+        chunk_end = demux_res->num_sample_byte_sizes;
+
+    for (; chunk_sample + 1 < chunk_end; chunk_sample++)
     {
         if (file_loc < new_pos + demux_res->sample_byte_size[chunk_sample])
         {
@@ -408,26 +430,22 @@ unsigned int alac_seek_raw(demux_res_t* demux_res, stream_t* stream,
     
     /* Get sound sample offset. */
 
-    for (i = 0; i < demux_res->num_time_to_samples; i++)
+    if (chunk_sample >= demux_res->tts_first_sample[demux_res->num_time_to_samples])
     {
-        if (chunk_sample < 
-            total_samples + demux_res->time_to_sample[i].sample_count)
-        {
-            break;
-        }
-        
-        total_samples += demux_res->time_to_sample[i].sample_count;
-        new_sound_sample += demux_res->time_to_sample[i].sample_count 
-            * demux_res->time_to_sample[i].sample_duration;
+        return 0;
     }
-    
-    new_sound_sample += (chunk_sample - total_samples) 
-        * demux_res->time_to_sample[i].sample_duration;
+
+    i = find_entry32(demux_res->tts_first_sample,
+                     demux_res->num_time_to_samples, chunk_sample);
+
+    new_sound_sample = demux_res->tts_first_time[i] +
+        (uint64_t)(chunk_sample - demux_res->tts_first_sample[i]) *
+            demux_res->time_to_sample[i].sample_duration;
 
     /* Go to the new file position. */
 
 
-    ss = lseek(stream->fd,new_pos,SEEK_SET);
+    ss = lseek64(stream->fd,new_pos,SEEK_SET);
 //    if (stream->ci->seek_buffer(new_pos))
     if(ss >= 0) {
   	stream->curpos = ss;  
@@ -60,11 +60,14 @@
 */
 
 #define MAX_CODECDATA_SIZE  64
+/* A frame holds at most 4096 samples of 8 channels of 32 bits, which with
+   the headers is far less than this; a larger stsz entry is corrupt. */
+#define MAX_SAMPLE_BYTE_SIZE  (1 << 20)
 
 typedef struct {
 //  struct msm_ctx* ctx;
   int fd;
-  int curpos;
+  int64_t curpos;
   int eof;
   int err;
 } stream_t;
@@ -85,7 +88,7 @@ typedef struct
     } *sample_to_chunk;
     uint32_t num_sample_to_chunks;
     
-    uint32_t *chunk_offset;
+    uint64_t *chunk_offset;     /* from stco or co64 */
     uint32_t num_chunk_offsets;
     
     struct {
@@ -94,20 +97,27 @@ typedef struct
     } *time_to_sample;
     uint32_t num_time_to_samples;
 
-    uint16_t *sample_byte_size;
+    uint32_t *sample_byte_size;
     uint32_t num_sample_byte_sizes;
 
+    /* built once by build_sample_index(), each has one entry more than
+       the table it indexes, the last one being the total */
+    uint32_t *tts_first_sample;   /* first sample of each time_to_sample entry */
+    uint64_t *tts_first_time;     /* ... and its time in sound samples */
+    uint32_t *chunk_first_sample; /* first sample of each chunk */
+
     uint32_t codecdata_len;
     uint8_t codecdata[MAX_CODECDATA_SIZE];
 
-    int mdat_offset;
-    uint32_t mdat_len;
+    int64_t mdat_offset;
+    uint64_t mdat_len;
 #if 0
     void *mdat;
 #endif
 } demux_res_t;
 
 int qtmovie_read(stream_t *stream, demux_res_t *demux_res);
+void qtmovie_free(demux_res_t *demux_res);
 
 #ifndef MAKEFOURCC
 #define MAKEFOURCC(ch0, ch1, ch2, ch3) ( \
@@ -128,9 +138,10 @@ int qtmovie_read(stream_t *stream, demux_res_t *demux_res);
 
 void stream_read(stream_t *stream, size_t len, void *buf);
 
-int32_t stream_tell(stream_t *stream);
+int64_t stream_tell(stream_t *stream);
 int32_t stream_read_int32(stream_t *stream);
 uint32_t stream_read_uint32(stream_t *stream);
+uint64_t stream_read_uint64(stream_t *stream);
 
 int16_t stream_read_int16(stream_t *stream);
 uint16_t stream_read_uint16(stream_t *stream);
@@ -138,18 +149,20 @@ uint16_t stream_read_uint16(stream_t *stream);
 int8_t stream_read_int8(stream_t *stream);
 uint8_t stream_read_uint8(stream_t *stream);
 
-void stream_skip(stream_t *stream, size_t skip);
+void stream_skip(stream_t *stream, int64_t skip);
 
 int stream_eof(stream_t *stream);
 
 void stream_create(stream_t *stream, msm_ctx* ci);
+int build_sample_index(demux_res_t *demux_res);
+uint64_t get_total_sound_samples(demux_res_t *demux_res);
 int get_sample_info(demux_res_t *demux_res, uint32_t sample,
     uint32_t *sample_duration, uint32_t *sample_byte_size);
-unsigned int get_sample_offset(demux_res_t *demux_res, uint32_t sample);
+uint64_t get_sample_offset(demux_res_t *demux_res, uint32_t sample);
 unsigned int alac_seek (demux_res_t* demux_res, stream_t* stream,
     uint32_t sound_sample_loc, uint32_t* sound_samples_done, 
     int* current_sample);
 unsigned int alac_seek_raw (demux_res_t* demux_res, stream_t* stream,
-    uint32_t file_loc, uint32_t* sound_samples_done, int* current_sample);
+    uint64_t file_loc, uint32_t* sound_samples_done, int* current_sample);
 
 #endif /* STREAM_H */
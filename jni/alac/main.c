@@ -41,15 +41,13 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_alacPlay(JNIEnv *env, jobject
   unsigned char bb[16];
   unsigned char *p;
   int bytes_to_write;
-  int sample32;   
+  int direct;
+  int32_t *chans[ALAC_MAX_CHANNELS];
 
   const char *file = (*env)->GetStringUTFChars(env,jfile,NULL);
-  struct timeval tstart, tstop, ttmp; // tstart -> time of the last write.
-  useconds_t  tminwrite = 0;
-  int prev_written = 0;
   unsigned char *inputbuf = 0;
-  int inputbuf_sz = 80*1024;
-  uint32_t total_samples = 0;
+  size_t inputbuf_sz = 80*1024;
+  uint64_t total_samples;
 
         if(!ctx) return LIBLOSSLESS_ERR_NOCTX;
 
@@ -90,33 +88,41 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_alacPlay(JNIEnv *env, jobject
 	create_alac(demux_res.sound_sample_size, demux_res.num_channels,&alac);
 	alac_set_info(&alac, (char *)demux_res.codecdata);
 
-	for(i = 0; i < demux_res.num_sample_byte_sizes; i++)
-	   if (get_sample_info(&demux_res, i, &sample_duration, &samplesdone)) total_samples += sample_duration;
+	if(alac.setinfo_sample_size < 8 || alac.setinfo_sample_size > 32) {
+            close(ctx->fd); ctx->fd = -1; qtmovie_free(&demux_res);
+            return LIBLOSSLESS_ERR_FORMAT;
+	}
+	for(k = 0; k < ALAC_MAX_CHANNELS; k++) chans[k] = outputbuffer[k];
+
+	total_samples = get_total_sound_samples(&demux_res);
 
 	sample_duration = 0;
 	samplesdone = 0;
 	i = 0;
 	if(start) {
+	    int64_t seek_t0 = trace_now_us();
 	    if(!alac_seek(&demux_res,&input_stream,start*demux_res.sound_sample_rate,&samplesdone,(int *)&i)) {
-	        close(ctx->fd); ctx->fd = -1;
+	        close(ctx->fd); ctx->fd = -1; qtmovie_free(&demux_res);
         	return LIBLOSSLESS_ERR_OFFSET;
 	    }	
+	    trace_span(ctx->trace, TRACE_SEEK, seek_t0, start, 0);
 	}
-	inputbuf = (uint8_t *) malloc(inputbuf_sz);
+	inputbuf = (uint8_t *) malloc(inputbuf_sz + ALAC_INPUT_PADDING);
 	if(!inputbuf) {
-		close(ctx->fd); ctx->fd = -1;
+		close(ctx->fd); ctx->fd = -1; qtmovie_free(&demux_res);
 		return LIBLOSSLESS_ERR_NOMEM;
 	}
 
-        ctx->channels = demux_res.num_channels;
+	/* what the sink gets, see audio_pack_pcm16() */
+        ctx->channels = audio_out_channels(alac.numchannels);
 	ctx->samplerate =  demux_res.sound_sample_rate; 
-	ctx->bps = demux_res.sound_sample_size;
-        ctx->written = 0;
+	ctx->bps = 16;
+        audio_written_reset(ctx);
 
         retval = audio_start(ctx, ctx->channels, ctx->samplerate);
 
         if(retval != 0) {
-             close(ctx->fd); ctx->fd = -1; free(inputbuf);
+             close(ctx->fd); ctx->fd = -1; free(inputbuf); qtmovie_free(&demux_res);
              return retval;
         }
 
@@ -127,7 +133,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_alacPlay(JNIEnv *env, jobject
         update_track_time(env,obj,ctx->track_time);
 
 	bytes_to_write = 0;
-	gettimeofday(&tstart,0);
+	direct = audio_direct_buffers(ctx);
 
 	///////////////////////////////////////////////
 	
@@ -140,16 +146,30 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_alacPlay(JNIEnv *env, jobject
 	    }
 	
 	    /* Request the required number of bytes from the input buffer */
+	    if(sample_byte_size > demux_res.mdat_len) {
+		retval = LIBLOSSLESS_ERR_DECODE;
+		goto done;
+	    }
 	    if(sample_byte_size > inputbuf_sz)	{
-		inputbuf = (uint8_t *) realloc(inputbuf, inputbuf_sz*2);
-		if(!inputbuf) {		
+		unsigned char *nb;
+		while(inputbuf_sz < sample_byte_size) {
+		    if(inputbuf_sz > (SIZE_MAX - ALAC_INPUT_PADDING) / 2) {
 			retval = LIBLOSSLESS_ERR_NOMEM;
 			goto done;
+		    }
+		    inputbuf_sz *= 2;
 		}
-		inputbuf_sz *= 2;
+		nb = (uint8_t *) realloc(inputbuf, inputbuf_sz + ALAC_INPUT_PADDING);
+		if(!nb) {		
+			retval = LIBLOSSLESS_ERR_NOMEM;
+			goto done;
+		}
+		inputbuf = nb;
 	    }		    
 	
+	    audio_stage(ctx, STAGE_READ);
 	    stream_read(&input_stream,sample_byte_size,inputbuf);
+	    audio_stage(ctx, STAGE_DECODE);
 	    if(input_stream.err != 0) { 
 		if(ctx->fd == -1) break;
 	        retval = LIBLOSSLESS_ERR_IO_READ;
@@ -159,48 +179,29 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_alacPlay(JNIEnv *env, jobject
 
 	    /* Decode one block - returned samples will be host-endian */
 	    samplesdecoded = alac_decode_frame(&alac, inputbuf, outputbuffer);
-//	    if(samplesdecoded > 100000)	{///????
-//		i++; continue;
-//	    }
+	    if(samplesdecoded < 0) {
+  		retval = LIBLOSSLESS_ERR_DECODE;
+		goto done;
+	    }
 
 //__android_log_print(ANDROID_LOG_ERROR,"liblossless", "decoded %d samples", samplesdecoded);
 
-	    p = ctx->wavbuf + bytes_to_write;
+	    if(direct) {	/* MODE_CALLBACK: pack straight into the track's buffer */
+		n = samplesdecoded * ctx->channels * 2;
+		if(audio_write_planar(ctx, chans, alac.numchannels, samplesdecoded, alac.setinfo_sample_size) < n) break;
+		samplesdone += sample_duration;
+		i++;
+		continue;
+	    }
 
-	    if(ctx->bps == 8) {
-                for(k = 0; k < samplesdecoded; k++) {
-                    *(p++) = (outputbuffer[0][k] + 0x80) & 0xff;
-                    if (ctx->channels == 2) *(p++) = (outputbuffer[1][k] + 0x80) & 0xff;
-                }
-	    } else {
-                for (k = 0; k < samplesdecoded; k++) {
-                    sample32 = outputbuffer[0][k];
-                    *(p++) = sample32 >> 13; //sample16 & 0xff;
-                    *(p++) = sample32 >> 21; //(sample16 >> 8) & 0xff;
-                    if (ctx->channels == 2) {
-                        sample32 = outputbuffer[1][k];
-                        *(p++) = sample32 >> 13; //sample16 & 0xff;
-                        *(p++) = sample32 >> 21; //(sample16 >> 8) & 0xff;
-                    }
-                }
-            }
+	    p = ctx->wavbuf + bytes_to_write;
+	    audio_stage(ctx, STAGE_CONVERT);
+	    p += audio_pack_pcm16(p, chans, alac.numchannels, samplesdecoded, alac.setinfo_sample_size);
+	    audio_stage(ctx, STAGE_DECODE);
 
 	    n = p - ctx->wavbuf;	
 
 	    if(n >= ctx->conf_size) {
-//__android_log_print(ANDROID_LOG_ERROR,"liblossless", "need write, %d >= %d, prev=%d", n, ctx->conf_size, prev_written);
-		if(prev_written && ctx->mode != MODE_CALLBACK) {
-                    gettimeofday(&tstop,0);
-                    tminwrite = ((uint64_t)((uint64_t)prev_written)*1000000)/
-                        ((uint64_t)(ctx->samplerate*ctx->channels*(ctx->bps/8)));
-                    timersub(&tstop,&tstart,&ttmp);
-                    if(tminwrite > ttmp.tv_usec) {
-				usleep((tminwrite-ttmp.tv_usec)/4);
-//__android_log_print(ANDROID_LOG_ERROR,"liblossless", "Slept %d ms, writing", (tminwrite-ttmp.tv_usec)/4000);
-		    }	
-            	}
-		if(ctx->mode != MODE_CALLBACK) gettimeofday(&tstart,0);
-		prev_written = 0;
 		p = ctx->wavbuf;
 		do {
                      pthread_mutex_lock(&ctx->mutex);
@@ -213,8 +214,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_alacPlay(JNIEnv *env, jobject
 		    	goto done;		
                      }
 	             n -= k; p += k;
-                     prev_written += k;
-                     ctx->written += k;
+                     audio_written_add(ctx, k);
             	} while(n >= ctx->conf_size);
 	        memmove(ctx->wavbuf,p,n);
 	    }
@@ -235,6 +235,7 @@ done:
 	     pthread_mutex_unlock(&ctx->mutex);
 	}
 	free(inputbuf);
+	qtmovie_free(&demux_res);
 
         audio_wait_done(ctx);
 
@@ -16,3 +16,41 @@ LOCAL_ARM_MODE := arm
 
 include $(BUILD_STATIC_LIBRARY)
 
+# The filters once per vector_math header and the C predictor, under their
+# own names, for bench/bench_ape.c. Not part of liblossless.
+ape_filters := 16_11 32_10 64_11 256_13 1280_15
+ape-filter-names = $(foreach f,$(ape_filters),-Dinit_filter_$(f)=init_filter_$(f)_$(1) -Dapply_filter_$(f)=apply_filter_$(f)_$(1))
+ape_bench_cflags := -O3 -Wall -DBUILD_STANDALONE -fomit-frame-pointer -ffreestanding
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := apefilter_generic
+LOCAL_SRC_FILES := $(patsubst %,filter_%.c,$(ape_filters))
+LOCAL_CFLAGS += $(ape_bench_cflags) -DCPU_ARM -DARM_ARCH=5 -DAPE_VECTOR_MATH=\"vector_math_generic.h\" $(call ape-filter-names,generic)
+LOCAL_ARM_MODE := arm
+include $(BUILD_STATIC_LIBRARY)
+
+include $(CLEAR_VARS)
+LOCAL_MODULE := apefilter_armv5te
+LOCAL_SRC_FILES := $(patsubst %,filter_%.c,$(ape_filters))
+LOCAL_CFLAGS += $(ape_bench_cflags) -DCPU_ARM -DARM_ARCH=5 -DAPE_VECTOR_MATH=\"vector_math16_armv5te.h\" $(call ape-filter-names,armv5te)
+LOCAL_ARM_MODE := arm
+include $(BUILD_STATIC_LIBRARY)
+
+# ssat, smlad and friends need ARMv6
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+include $(CLEAR_VARS)
+LOCAL_MODULE := apefilter_armv6
+LOCAL_SRC_FILES := $(patsubst %,filter_%.c,$(ape_filters))
+LOCAL_CFLAGS += $(ape_bench_cflags) -DCPU_ARM -DARM_ARCH=6 -DAPE_VECTOR_MATH=\"vector_math16_armv6.h\" $(call ape-filter-names,armv6)
+LOCAL_ARM_MODE := arm
+include $(BUILD_STATIC_LIBRARY)
+endif
+
+# without CPU_ARM predictor.c has the C versions of what predictor-arm.S does
+include $(CLEAR_VARS)
+LOCAL_MODULE := apepredictor_c
+LOCAL_SRC_FILES := predictor.c
+LOCAL_CFLAGS += $(ape_bench_cflags) -Dinit_predictor_decoder=init_predictor_decoder_c \
+-Dpredictor_decode_stereo=predictor_decode_stereo_c -Dpredictor_decode_mono=predictor_decode_mono_c
+LOCAL_ARM_MODE := arm
+include $(BUILD_STATIC_LIBRARY)
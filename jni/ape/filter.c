@@ -29,7 +29,10 @@ Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA 02110, USA
 #include "filter.h"
 #include "demac_config.h"
      
-#if FILTER_BITS == 32
+#ifdef APE_VECTOR_MATH
+/* kernelbench builds the filters once with each of the headers below */
+#include APE_VECTOR_MATH
+#elif FILTER_BITS == 32
 
 #if defined(CPU_ARM) && (ARM_ARCH == 4)
 #include "vector_math32_armv4.h"
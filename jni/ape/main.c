@@ -112,19 +112,12 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_apePlay(JNIEnv *env, jobject o
 
     unsigned char *p;	
 
-    struct timeval tstart, tstop, ttmp; // tstart -> time of the last write.
-    useconds_t  tminwrite;
 
     struct ape_ctx_t ape_ctx;
-    int prev_written = 0;
-
     uint32_t samplestoskip;
-    int obps;
+    int obps, direct;
+    int32_t *chans[2];
  	
-#ifdef DBG_TIME
-        uint64_t total_tminwrite = 0, total_ttmp = 0, total_sleep = 0;
-        int writes = 0, fails = 0;
-#endif
 
 
 	if(!ctx) return LIBLOSSLESS_ERR_NOCTX;
@@ -152,6 +145,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_apePlay(JNIEnv *env, jobject o
 
 	if(start) {
 	   uint32_t filepos, newframe, start_sample;
+	   int64_t seek_t0 = trace_now_us();
 
 	        ape_ctx.seektable = (uint32_t *) malloc(ape_ctx.seektablelength);
 	        if(!ape_ctx.seektable) {
@@ -190,6 +184,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_apePlay(JNIEnv *env, jobject o
                         return LIBLOSSLESS_ERR_FORMAT;
 		}
 		currentframe = newframe;
+		trace_span(ctx->trace, TRACE_SEEK, seek_t0, start, 0);
 	} else {
         	if(lseek(ctx->fd, ape_ctx.firstframe, SEEK_SET) < 0) {
                         close(ctx->fd);
@@ -209,7 +204,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_apePlay(JNIEnv *env, jobject o
         ctx->channels = ape_ctx.channels;
         ctx->samplerate = ape_ctx.samplerate;
         ctx->bps = ape_ctx.bps;
-	ctx->written = 0;
+	audio_written_reset(ctx);
 	obps = (ctx->bps == 24) ? 16 : ctx->bps;
 
 	pthread_mutex_lock(&ctx->mutex);
@@ -218,12 +213,13 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_apePlay(JNIEnv *env, jobject o
 	pthread_mutex_unlock(&ctx->mutex);
 
         update_track_time(env,obj,ctx->track_time);
+	direct = audio_direct_buffers(ctx);
 
 
 	bytes_to_write = 0;
 
     /* Initialise the buffer */
-	bytesinbuffer = read(ctx->fd, inbuffer, INPUT_CHUNKSIZE);
+	bytesinbuffer = audio_read(ctx, inbuffer, INPUT_CHUNKSIZE);
 //	firstbyte = 3;  /* Take account of the little-endian 32-bit byte ordering */
 
     /* The main decoding loop - we decode the frames a small chunk at a time */
@@ -244,7 +240,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_apePlay(JNIEnv *env, jobject o
         memmove(inbuffer,inbuffer + bytesconsumed, bytesinbuffer - bytesconsumed);
         bytesinbuffer -= bytesconsumed;
 
-        n = read(ctx->fd, inbuffer + bytesinbuffer, INPUT_CHUNKSIZE - bytesinbuffer);
+        n = audio_read(ctx, inbuffer + bytesinbuffer, INPUT_CHUNKSIZE - bytesinbuffer);
 	if(n < 0) break;
         bytesinbuffer += n;
 
@@ -264,151 +260,144 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_apePlay(JNIEnv *env, jobject o
                 }
 		return LIBLOSSLESS_ERR_DECODE;
             }
-            /* Convert the output samples to WAV format and write to output file */
-            p = ctx->wavbuf + bytes_to_write;
-
-            if (ape_ctx.bps == 8) {
-                for (i = 0 ; i < blockstodecode ; i++)
-                {
-                    /* 8 bit WAV uses unsigned samples */
-                    *(p++) = (decoded0[i] + 0x80) & 0xff;
-
-                    if (ape_ctx.channels == 2) {
-                        *(p++) = (decoded1[i] + 0x80) & 0xff;
-                    }
-                }
-            } else if (ape_ctx.bps == 16) {
-                for (i = 0 ; i < blockstodecode ; i++)
-                {
-                    sample16 = decoded0[i];
-                    *(p++) = sample16 & 0xff;
-                    *(p++) = (sample16 >> 8) & 0xff;
-
-                    if (ape_ctx.channels == 2) {
-                        sample16 = decoded1[i];
-                        *(p++) = sample16 & 0xff;
-                        *(p++) = (sample16 >> 8) & 0xff;
-                    }
-                }
-            } else if (ape_ctx.bps == 24) {
-                for (i = 0 ; i < blockstodecode ; i++)
-                {
-                    sample32 = decoded0[i];
-                 //   *(p++) = sample32 & 0xff;
-                    *(p++) = (sample32 >> 8) & 0xff;
-                    *(p++) = (sample32 >> 16) & 0xff;
-
-                    if (ape_ctx.channels == 2) {
-                        sample32 = decoded1[i];
-                 //       *(p++) = sample32 & 0xff;
-                        *(p++) = (sample32 >> 8) & 0xff;
-                        *(p++) = (sample32 >> 16) & 0xff;
-                    }
-                }
-            }
+	    if(direct) {
+		/* MODE_CALLBACK: drop what's left of a seek's skip and pack
+		   the rest straight into the track's buffer */
+		i = MIN(samplestoskip, blockstodecode);
+		samplestoskip -= i;
+		chans[0] = decoded0 + i;
+		chans[1] = decoded1 + i;
+		n = (blockstodecode - i) * ape_ctx.channels * 2;
+		if(audio_write_planar(ctx, chans, ape_ctx.channels, blockstodecode - i, ape_ctx.bps) < n) {
+		    if(ctx->state != MSM_STOPPED) {
+			if(ctx->state != MSM_PAUSED) pthread_mutex_lock(&ctx->mutex);
+			ctx->state = MSM_STOPPED;
+			pthread_mutex_unlock(&ctx->mutex);
+		    }
+		    if(ctx->fd == -1) return 0; // we were stopped from the main thread
+		    close(ctx->fd); ctx->fd = -1;
+		    return LIBLOSSLESS_ERR_IO_WRITE;
+		}
+	    } else {
+	            /* Convert the output samples to WAV format and write to output file */
+	            p = ctx->wavbuf + bytes_to_write;
+	            audio_stage(ctx, STAGE_CONVERT);
+
+	            if (ape_ctx.bps == 8) {
+	                for (i = 0 ; i < blockstodecode ; i++)
+	                {
+	                    /* 8 bit WAV uses unsigned samples */
+	                    *(p++) = (decoded0[i] + 0x80) & 0xff;
+
+	                    if (ape_ctx.channels == 2) {
+	                        *(p++) = (decoded1[i] + 0x80) & 0xff;
+	                    }
+	                }
+	            } else if (ape_ctx.bps == 16) {
+	                for (i = 0 ; i < blockstodecode ; i++)
+	                {
+	                    sample16 = decoded0[i];
+	                    *(p++) = sample16 & 0xff;
+	                    *(p++) = (sample16 >> 8) & 0xff;
+
+	                    if (ape_ctx.channels == 2) {
+	                        sample16 = decoded1[i];
+	                        *(p++) = sample16 & 0xff;
+	                        *(p++) = (sample16 >> 8) & 0xff;
+	                    }
+	                }
+	            } else if (ape_ctx.bps == 24) {
+	                for (i = 0 ; i < blockstodecode ; i++)
+	                {
+	                    sample32 = decoded0[i];
+	                 //   *(p++) = sample32 & 0xff;
+	                    *(p++) = (sample32 >> 8) & 0xff;
+	                    *(p++) = (sample32 >> 16) & 0xff;
+
+	                    if (ape_ctx.channels == 2) {
+	                        sample32 = decoded1[i];
+	                 //       *(p++) = sample32 & 0xff;
+	                        *(p++) = (sample32 >> 8) & 0xff;
+	                        *(p++) = (sample32 >> 16) & 0xff;
+	                    }
+	                }
+	            }
+	            audio_stage(ctx, STAGE_DECODE);
 
-            if(samplestoskip) {
-                uint32_t bytestoskip = 0, samples = 0;
+	            if(samplestoskip) {
+	                uint32_t bytestoskip = 0, samples = 0;
 
-                n = p - ctx->wavbuf;
+	                n = p - ctx->wavbuf;
 
-                if (obps == 8) samples = (ape_ctx.channels == 2) ? (n >> 1) : n;
-                else if (obps == 16) samples = (ape_ctx.channels == 2) ? (n >> 2) : (n >> 1);
-         //       else if (ape_ctx.bps == 24) samples = (ape_ctx.channels == 2) ? (n / 6) : (n / 3);
+	                if (obps == 8) samples = (ape_ctx.channels == 2) ? (n >> 1) : n;
+	                else if (obps == 16) samples = (ape_ctx.channels == 2) ? (n >> 2) : (n >> 1);
+	         //       else if (ape_ctx.bps == 24) samples = (ape_ctx.channels == 2) ? (n / 6) : (n / 3);
                 
-                if(samplestoskip >= samples) {
-                        samplestoskip -= samples;
-		        memmove(inbuffer,inbuffer + bytesconsumed, bytesinbuffer - bytesconsumed);
-		        bytesinbuffer -= bytesconsumed;
-		        n = read(ctx->fd, inbuffer + bytesinbuffer, INPUT_CHUNKSIZE - bytesinbuffer);
-		        if(n < 0) {
-                	   if(ctx->state != MSM_STOPPED) {
-		               if(ctx->state != MSM_PAUSED) pthread_mutex_lock(&ctx->mutex);
-		               ctx->state = MSM_STOPPED;
-		               pthread_mutex_unlock(&ctx->mutex);
-		           }
-		           if(ctx->fd == -1) return 0; // we were stopped from the main thread
-		           close(ctx->fd); ctx->fd = -1;
-		           return LIBLOSSLESS_ERR_IO_READ;
+	                if(samplestoskip >= samples) {
+	                        samplestoskip -= samples;
+			        memmove(inbuffer,inbuffer + bytesconsumed, bytesinbuffer - bytesconsumed);
+			        bytesinbuffer -= bytesconsumed;
+			        n = audio_read(ctx, inbuffer + bytesinbuffer, INPUT_CHUNKSIZE - bytesinbuffer);
+			        if(n < 0) {
+	                	   if(ctx->state != MSM_STOPPED) {
+			               if(ctx->state != MSM_PAUSED) pthread_mutex_lock(&ctx->mutex);
+			               ctx->state = MSM_STOPPED;
+			               pthread_mutex_unlock(&ctx->mutex);
+			           }
+			           if(ctx->fd == -1) return 0; // we were stopped from the main thread
+			           close(ctx->fd); ctx->fd = -1;
+			           return LIBLOSSLESS_ERR_IO_READ;
+		                }
+		                bytesinbuffer += n;
+			        nblocks -= blockstodecode;
+	                        continue;
 	                }
-	                bytesinbuffer += n;
-		        nblocks -= blockstodecode;
-                        continue;
-                }
 
-                if(obps == 8) bytestoskip = (samples - samplestoskip) * ape_ctx.channels;
-                else if (obps == 16) bytestoskip = (samples - samplestoskip) * ape_ctx.channels * 2;
-          //      else if (ape_ctx.bps == 24) bytestoskip = (samples - samplestoskip) * ape_ctx.channels * 3;
+	                if(obps == 8) bytestoskip = (samples - samplestoskip) * ape_ctx.channels;
+	                else if (obps == 16) bytestoskip = (samples - samplestoskip) * ape_ctx.channels * 2;
+	          //      else if (ape_ctx.bps == 24) bytestoskip = (samples - samplestoskip) * ape_ctx.channels * 3;
 
-//__android_log_print(ANDROID_LOG_INFO,"liblossless", "samplestoskip %d, samples %d, bytestoskip %d sz %d\n", 
-//		samplestoskip, samples, bytestoskip,n);
+	//__android_log_print(ANDROID_LOG_INFO,"liblossless", "samplestoskip %d, samples %d, bytestoskip %d sz %d\n", 
+	//		samplestoskip, samples, bytestoskip,n);
                 
-                samplestoskip = 0;
-                memmove(ctx->wavbuf, ctx->wavbuf + bytestoskip, n - bytestoskip);
-                p = ctx->wavbuf + (n - bytestoskip);
-            }
-
-	    n = p - ctx->wavbuf;
-
-	if(n >= ctx->conf_size) {
-	    if(prev_written && ctx->mode != MODE_CALLBACK) {	
-		    gettimeofday(&tstop,0);
-		    tminwrite = ((uint64_t)((uint64_t)prev_written)*1000000)/
-			((uint64_t)(ape_ctx.samplerate*ape_ctx.channels*(obps/8)));
-	            timersub(&tstop,&tstart,&ttmp);
-	            if(tminwrite > ttmp.tv_usec){
-				usleep((tminwrite-ttmp.tv_usec)/4);
-#ifdef DBG_TIME
-                        	total_sleep += (tminwrite - ttmp.tv_usec)/4;
-#endif
+	                samplestoskip = 0;
+	                memmove(ctx->wavbuf, ctx->wavbuf + bytestoskip, n - bytestoskip);
+	                p = ctx->wavbuf + (n - bytestoskip);
 	            }
-#ifdef DBG_TIME
-                else fails++;
-                writes++;
-                total_tminwrite += tminwrite;
-                total_ttmp += ttmp.tv_usec;
-#endif
-	    }	
-    	    if(ctx->mode != MODE_CALLBACK) gettimeofday(&tstart,0);
-	    prev_written = 0;	
-	    p = ctx->wavbuf;
-		    do {
-			pthread_mutex_lock(&ctx->mutex);
-			i = audio_write(ctx,p,ctx->conf_size);
-			if(i < ctx->conf_size) {
-			    ctx->state = MSM_STOPPED;	
-			    pthread_mutex_unlock(&ctx->mutex);
-	                    if(ctx->fd == -1) {
-#ifdef DBG_TIME
-        if(writes && (writes > fails)) {
-           int x = (int) (total_tminwrite/writes);
-           int y = (int) (total_ttmp/writes);
-           int z = (int) (total_sleep/(writes-fails));
-            __android_log_print(ANDROID_LOG_INFO,"liblossless","tminwrite %d ttmp %d sleep %d fails %d writes %d", x,y,z,fails,writes);
-        } else __android_log_print(ANDROID_LOG_INFO,"liblossless","fails %d writes %d", fails,writes);
-#endif
-				return 0; // we were stopped from the main thread
-			    }	
-	                    close(ctx->fd); ctx->fd = -1;
-	                    return LIBLOSSLESS_ERR_IO_WRITE;
-			}
-			pthread_mutex_unlock(&ctx->mutex);
-			//sched_yield();
-			n -= ctx->conf_size;
-			p += ctx->conf_size;
-			prev_written += ctx->conf_size;	
-			ctx->written += i;
-		    } while(n >= ctx->conf_size);
-	    memmove(ctx->wavbuf,p,n);
-	}
 
-	    bytes_to_write = n;
+		    n = p - ctx->wavbuf;
+
+		if(n >= ctx->conf_size) {
+		    p = ctx->wavbuf;
+			    do {
+				pthread_mutex_lock(&ctx->mutex);
+				i = audio_write(ctx,p,ctx->conf_size);
+				if(i < ctx->conf_size) {
+				    ctx->state = MSM_STOPPED;	
+				    pthread_mutex_unlock(&ctx->mutex);
+		                    if(ctx->fd == -1) {
+					return 0; // we were stopped from the main thread
+				    }	
+		                    close(ctx->fd); ctx->fd = -1;
+		                    return LIBLOSSLESS_ERR_IO_WRITE;
+				}
+				pthread_mutex_unlock(&ctx->mutex);
+				//sched_yield();
+				n -= ctx->conf_size;
+				p += ctx->conf_size;
+				audio_written_add(ctx, i);
+			    } while(n >= ctx->conf_size);
+		    memmove(ctx->wavbuf,p,n);
+		}
+
+		    bytes_to_write = n;
+	    }
 
             /* Update the buffer */
             memmove(inbuffer,inbuffer + bytesconsumed, bytesinbuffer - bytesconsumed);
             bytesinbuffer -= bytesconsumed;
 
-            n = read(ctx->fd, inbuffer + bytesinbuffer, INPUT_CHUNKSIZE - bytesinbuffer);
+            n = audio_read(ctx, inbuffer + bytesinbuffer, INPUT_CHUNKSIZE - bytesinbuffer);
 
        	    if(n < 0) {
 		if(ctx->state != MSM_STOPPED) {
@@ -436,14 +425,6 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_apePlay(JNIEnv *env, jobject o
         ctx->state = MSM_STOPPED;
         pthread_mutex_unlock(&ctx->mutex);
     }
-#ifdef DBG_TIME
-        if(writes && (writes > fails)) {
-           int x = (int) (total_tminwrite/writes);
-           int y = (int) (total_ttmp/writes);
-           int z = (int) (total_sleep/(writes-fails));
-            __android_log_print(ANDROID_LOG_INFO,"liblossless","tminwrite %d ttmp %d sleep %d fails %d writes %d", x,y,z,fails,writes);
-        } else __android_log_print(ANDROID_LOG_INFO,"liblossless","fails %d writes %d", fails,writes);
-#endif
       audio_wait_done(ctx);
 
     return 0;
@@ -454,10 +435,6 @@ JNIEXPORT jint JNICALL Java_com_skvalex_amplayer_apeDuration(JNIEnv *env, jobjec
     const char *file = (*env)->GetStringUTFChars(env,jfile,NULL);
     struct ape_ctx_t ape_ctx;
 
-#ifdef DBG_TIME
-        uint64_t total_tminwrite = 0, total_ttmp = 0, total_sleep = 0;
-        int writes = 0, fails = 0;
-#endif
 
 	ctx->fd = open(file,O_RDONLY);
 	(*env)->ReleaseStringUTFChars(env,jfile,file);
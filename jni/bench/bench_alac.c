@@ -0,0 +1,52 @@
+/* ALAC kernels for kernelbench.c: the adaptive FIR of
+ * predictor_decompress_fir_adapt() for the orders that have a NEON
+ * version, with 16-bit samples and a full 4096 sample frame. */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "decomp.h"
+#include "kernelbench.h"
+
+#define ALAC_SAMPLES     4096
+#define ALAC_QUANT       9
+
+static int32_t error[ALAC_SAMPLES];
+static int32_t out[ALAC_SAMPLES];
+static int16_t coefs[8];
+
+/* as an encoder might leave them, the predictor adapts them anyway */
+static const int16_t coefs_4[4] = { 1126, -552, 204, -58 };
+static const int16_t coefs_8[8] = { 1147, -743, 481, -281, 150, -77, 31, -10 };
+
+static void fir_prepare(int order)
+{
+    static int have_input;
+
+    if (!have_input)
+    {
+        bench_input(error, ALAC_SAMPLES, 10, 0);
+        have_input = 1;
+    }
+    memset(out, 0, sizeof(out));
+    memcpy(coefs, order == 4 ? coefs_4 : coefs_8, order * sizeof(int16_t));
+}
+
+static void fir_run(int order)
+{
+    predictor_decompress_fir_adapt(error, out, ALAC_SAMPLES, 16, coefs, order, ALAC_QUANT);
+}
+
+#ifdef ALAC_NEON
+#define FIR(order) \
+    { "alac predictor_decompress_fir_adapt", "C", order, 0, NULL, ALAC_SAMPLES, fir_prepare, fir_run, out, sizeof(out) }, \
+    { "alac predictor_decompress_fir_adapt", "NEON", order, 1, alac_neon_supported, ALAC_SAMPLES, fir_prepare, fir_run, out, sizeof(out) }
+#else
+#define FIR(order) \
+    { "alac predictor_decompress_fir_adapt", "C", order, 0, NULL, ALAC_SAMPLES, fir_prepare, fir_run, out, sizeof(out) }
+#endif
+
+const bench_kernel alac_kernels[] = {
+    FIR(4), FIR(8),
+    { NULL }
+};
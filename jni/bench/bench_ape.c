@@ -0,0 +1,152 @@
+/* APE kernels for kernelbench.c: the stereo filter pass of each order, as
+ * apply_filter_*() runs it over a block, with each of the vector_math
+ * headers the filters can be built with, and the stereo predictor in
+ * predictor-arm.S and in C. ape/Android.mk builds the filters and the C
+ * predictor for us under names with the implementation appended. */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "parser.h"
+#include "predictor.h"
+#include "demac_config.h"
+#include "kernelbench.h"
+
+#define APE_SAMPLES      4608   /* per channel, BLOCKS_PER_LOOP in main.c */
+#define APE_FILEVERSION  3990
+
+struct ape_filter {
+    int order;
+    void (*init)(filter_int* buf);
+    void (*apply)(int fileversion, int32_t* decoded0, int32_t* decoded1, int count);
+};
+
+#define DECLARE_FILTER(name, impl) \
+    void init_filter_##name##_##impl(filter_int* buf); \
+    void apply_filter_##name##_##impl(int fileversion, int32_t* decoded0, \
+                                      int32_t* decoded1, int count);
+
+#define FILTERS(impl) \
+    DECLARE_FILTER(16_11, impl) \
+    DECLARE_FILTER(32_10, impl) \
+    DECLARE_FILTER(64_11, impl) \
+    DECLARE_FILTER(256_13, impl) \
+    DECLARE_FILTER(1280_15, impl) \
+    static const struct ape_filter impl##_filters[] = { \
+        { 16, init_filter_16_11_##impl, apply_filter_16_11_##impl }, \
+        { 32, init_filter_32_10_##impl, apply_filter_32_10_##impl }, \
+        { 64, init_filter_64_11_##impl, apply_filter_64_11_##impl }, \
+        { 256, init_filter_256_13_##impl, apply_filter_256_13_##impl }, \
+        { 1280, init_filter_1280_15_##impl, apply_filter_1280_15_##impl }, \
+        { 0 } \
+    }; \
+    static void filter_prepare_##impl(int order) \
+    { \
+        filter_prepare(impl##_filters, order); \
+    } \
+    static void filter_run_##impl(int order) \
+    { \
+        filter_run(impl##_filters, order); \
+    }
+
+static filter_int filterbuf[(1280*3 + FILTER_HISTORY_SIZE) * 2]
+                  __attribute__((aligned(16)));
+static int32_t filter_input[APE_SAMPLES * 2];
+static int32_t decoded[APE_SAMPLES * 2];
+
+static const struct ape_filter* find_filter(const struct ape_filter* f, int order)
+{
+    while (f->order != order)
+        f++;
+    return f;
+}
+
+/* What the filters get is what the entropy decoder leaves, residuals
+   well below the range of the samples */
+static void filter_prepare(const struct ape_filter* filters, int order)
+{
+    static int have_input;
+
+    if (!have_input)
+    {
+        bench_input(filter_input, APE_SAMPLES * 2, 10, 0);
+        have_input = 1;
+    }
+    memcpy(decoded, filter_input, sizeof(decoded));
+    find_filter(filters, order)->init(filterbuf);
+}
+
+static void filter_run(const struct ape_filter* filters, int order)
+{
+    find_filter(filters, order)->apply(APE_FILEVERSION, decoded,
+                                       decoded + APE_SAMPLES, APE_SAMPLES);
+}
+
+FILTERS(generic)
+FILTERS(armv5te)
+#ifdef APE_ARMV6
+FILTERS(armv6)
+#endif
+
+void init_predictor_decoder_c(struct predictor_t* p);
+void predictor_decode_stereo_c(struct predictor_t* p, int32_t* decoded0,
+                               int32_t* decoded1, int count);
+
+static struct predictor_t predictor;
+static int32_t predictor_input[APE_SAMPLES * 2];
+
+/* and the predictor what the filters leave */
+static void predictor_prepare(void)
+{
+    static int have_input;
+
+    if (!have_input)
+    {
+        bench_input(predictor_input, APE_SAMPLES * 2, 14, 0);
+        have_input = 1;
+    }
+    memcpy(decoded, predictor_input, sizeof(decoded));
+}
+
+static void predictor_prepare_arm(int arg)
+{
+    predictor_prepare();
+    init_predictor_decoder(&predictor);
+}
+
+static void predictor_run_arm(int arg)
+{
+    predictor_decode_stereo(&predictor, decoded, decoded + APE_SAMPLES, APE_SAMPLES);
+}
+
+static void predictor_prepare_c(int arg)
+{
+    predictor_prepare();
+    init_predictor_decoder_c(&predictor);
+}
+
+static void predictor_run_c(int arg)
+{
+    predictor_decode_stereo_c(&predictor, decoded, decoded + APE_SAMPLES, APE_SAMPLES);
+}
+
+#define FILTER_IMPL(order, impl) \
+    { "ape apply_filter", #impl, order, 0, NULL, APE_SAMPLES * 2, \
+      filter_prepare_##impl, filter_run_##impl, decoded, sizeof(decoded) }
+
+#ifdef APE_ARMV6
+#define FILTER(order) \
+    FILTER_IMPL(order, generic), FILTER_IMPL(order, armv5te), FILTER_IMPL(order, armv6)
+#else
+#define FILTER(order) \
+    FILTER_IMPL(order, generic), FILTER_IMPL(order, armv5te)
+#endif
+
+const bench_kernel ape_kernels[] = {
+    FILTER(16), FILTER(32), FILTER(64), FILTER(256), FILTER(1280),
+    { "ape predictor_decode_stereo", "C", 0, 0, NULL, APE_SAMPLES * 2,
+      predictor_prepare_c, predictor_run_c, decoded, sizeof(decoded) },
+    { "ape predictor_decode_stereo", "arm", 0, 0, NULL, APE_SAMPLES * 2,
+      predictor_prepare_arm, predictor_run_arm, decoded, sizeof(decoded) },
+    { NULL }
+};
@@ -0,0 +1,185 @@
+/* FLAC kernels for kernelbench.c: decode_residuals() reading the Rice
+ * coded residual of an LPC subframe, and the LPC loop that restores the
+ * samples from it, lpc_decode_arm() and the C loop of
+ * decode_subframe_lpc(). decode_residuals() is static, so the decoder is
+ * built in here once more. Nothing in liblossless calls into the copy. */
+
+#include <string.h>
+#include <stdint.h>
+
+#include "flac_decoder.c"
+#include "kernelbench.h"
+
+#define FLAC_SAMPLES    4096    /* a block, as the reference encoder makes them */
+#define FLAC_QLEVEL     12
+#define FLAC_RICE_ORDER 4
+#define FLAC_RES_ORDER  8       /* of the subframe decode_residuals() reads */
+
+/* Any coefficients do, the residuals are worked out from them. These
+   are about what an encoder picks for tonal music. */
+static const int coeffs_8[8] = { 5212, -2781, 917, -341, 180, -109, 62, -27 };
+static const int coeffs_12[12] = { 5004, -2466, 823, -402, 260, -188, 131, -90, 57, -33, 17, -6 };
+
+static int32_t signal[FLAC_SAMPLES];
+static int32_t residual_8[FLAC_SAMPLES];
+static int32_t residual_12[FLAC_SAMPLES];
+static int32_t decoded[FLAC_SAMPLES];
+static int coeffs[32];
+
+static uint8_t stream[FLAC_SAMPLES * 4 + 8];    /* and room for the reader's lookahead */
+static int stream_len, stream_bits;
+static FLACContext context;
+
+static const int* lpc_coeffs(int order)
+{
+    return order == 8 ? coeffs_8 : coeffs_12;
+}
+
+/* What the encoder leaves of one channel for each order, the first order
+   samples being the warm up ones */
+static void lpc_input(void)
+{
+    static int have_input;
+    static int32_t stereo[FLAC_SAMPLES * 2];
+    int32_t* residual;
+    const int* c;
+    int order, i, j, sum;
+
+    if (have_input)
+        return;
+
+    /* the left channel of the input */
+    bench_input(stereo, FLAC_SAMPLES * 2, 16, 0);
+    for (i = 0; i < FLAC_SAMPLES; i++)
+        signal[i] = stereo[2 * i];
+
+    for (order = 8; order <= 12; order += 4)
+    {
+        residual = order == 8 ? residual_8 : residual_12;
+        c = lpc_coeffs(order);
+        for (i = 0; i < order; i++)
+            residual[i] = signal[i];
+        for (; i < FLAC_SAMPLES; i++)
+        {
+            sum = 0;
+            for (j = 0; j < order; j++)
+                sum += c[j] * signal[i-j-1];
+            residual[i] = signal[i] - (sum >> FLAC_QLEVEL);
+        }
+    }
+    have_input = 1;
+}
+
+static uint32_t bit_buf;
+static int bit_count;
+
+/* value has to fit in bits, at most 16 of them */
+static void put_bits(uint32_t value, int bits)
+{
+    bit_buf = (bit_buf << bits) | value;
+    bit_count += bits;
+    stream_bits += bits;
+    while (bit_count >= 8)
+    {
+        bit_count -= 8;
+        stream[stream_len++] = bit_buf >> bit_count;
+    }
+}
+
+/* The residual coding decode_residuals() reads, with a Rice parameter per
+   partition that keeps the unary parts near a bit a sample */
+static void residual_encode(const int32_t* residual, int pred_order)
+{
+    int partition, samples, i, first, k;
+    uint32_t u, sum;
+
+    memset(stream, 0, sizeof(stream));
+    stream_len = stream_bits = bit_count = 0;
+    put_bits(0, 2);
+    put_bits(FLAC_RICE_ORDER, 4);
+
+    samples = FLAC_SAMPLES >> FLAC_RICE_ORDER;
+    for (partition = 0; partition < (1 << FLAC_RICE_ORDER); partition++)
+    {
+        first = partition ? partition * samples : pred_order;
+        sum = 0;
+        for (i = first; i < (partition + 1) * samples; i++)
+            sum += (residual[i] << 1) ^ (residual[i] >> 31);
+        for (k = 0; k < 14 && (sum >> k) > (uint32_t) samples; k++)
+            ;
+        put_bits(k, 4);
+
+        for (i = first; i < (partition + 1) * samples; i++)
+        {
+            u = (residual[i] << 1) ^ (residual[i] >> 31);
+            while (u >> k >= 16)
+            {
+                put_bits(0, 16);
+                u -= 16 << k;
+            }
+            put_bits(1, (u >> k) + 1);
+            if (k)
+                put_bits(u & ((1 << k) - 1), k);
+        }
+    }
+    if (bit_count)
+        put_bits(0, 8 - bit_count);
+}
+
+static void residuals_prepare(int arg)
+{
+    static int have_stream;
+
+    if (!have_stream)
+    {
+        lpc_input();
+        residual_encode(residual_8, FLAC_RES_ORDER);
+        have_stream = 1;
+    }
+    memset(decoded, 0, sizeof(decoded));
+    context.blocksize = FLAC_SAMPLES;
+    init_get_bits(&context.gb, stream, stream_bits);
+}
+
+static void residuals_run(int arg)
+{
+    decode_residuals(&context, decoded, FLAC_RES_ORDER);
+}
+
+static void lpc_prepare(int order)
+{
+    lpc_input();
+    memcpy(decoded, order == 8 ? residual_8 : residual_12, sizeof(decoded));
+    memcpy(coeffs, lpc_coeffs(order), order * sizeof(int));
+}
+
+/* as decode_subframe_lpc() has it without CPU_ARM */
+static void lpc_run_c(int order)
+{
+    int sum, i, j;
+
+    for (i = order; i < FLAC_SAMPLES; i++)
+    {
+        sum = 0;
+        for (j = 0; j < order; j++)
+            sum += coeffs[j] * decoded[i-j-1];
+        decoded[i] += sum >> FLAC_QLEVEL;
+    }
+}
+
+static void lpc_run_arm(int order)
+{
+    lpc_decode_arm(FLAC_SAMPLES - order, FLAC_QLEVEL, order, decoded + order, coeffs);
+}
+
+#define LPC(order) \
+    { "flac lpc_decode", "C", order, 0, NULL, FLAC_SAMPLES, lpc_prepare, lpc_run_c, decoded, sizeof(decoded) }, \
+    { "flac lpc_decode", "arm", order, 0, NULL, FLAC_SAMPLES, lpc_prepare, lpc_run_arm, decoded, sizeof(decoded) }
+
+/* lpc_decode_arm() has unrolled loops up to order 9 and a generic one
+   above */
+const bench_kernel flac_kernels[] = {
+    { "flac decode_residuals", "C", 0, 0, NULL, FLAC_SAMPLES, residuals_prepare, residuals_run, decoded, sizeof(decoded) },
+    LPC(8), LPC(12),
+    { NULL }
+};
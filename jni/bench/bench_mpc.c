@@ -0,0 +1,202 @@
+/// \file bench_mpc.c
+/// Musepack kernels for kernelbench.c: the huffman decoding of the
+/// quantized samples, the new V calculation on its own, the synthesis
+/// filter for a stereo frame (36 new V vectors and the windowing per
+/// channel) and the PCM conversion that follows it.
+///
+/// mpc_decoder_huffman_decode() is static, so mpc_decoder.c is built in
+/// here once more. Nothing in liblossless calls into the copy.
+
+#include "mpc_decoder.c"
+#include "kernelbench.h"
+
+#define MPC_FRAME_SAMPLES  (MPC_FRAME_LENGTH * 2)
+
+static mpc_decoder decoder;
+static MPC_SAMPLE_FORMAT V_L[MPC_V_MEM + 960], V_R[MPC_V_MEM + 960];
+static MPC_SAMPLE_FORMAT Y_L[36][32], Y_R[36][32];
+static MPC_SAMPLE_FORMAT frame[MPC_FRAME_SAMPLES];
+static MPC_SAMPLE_FORMAT samples[MPC_FRAME_SAMPLES];
+static mpc_int16_t pcm16[MPC_FRAME_SAMPLES];
+
+// Subband samples and the V history from the input, at the scale the
+// requantization leaves them.
+static void synth_prepare(int arg)
+{
+    static mpc_bool_t have_input = FALSE;
+
+    if (!have_input) {
+        bench_input((mpc_int32_t *) V_L, MPC_V_MEM + 960, 16, 0);
+        bench_input((mpc_int32_t *) V_R, MPC_V_MEM + 960, 16, MPC_V_MEM + 960);
+        bench_input((mpc_int32_t *) Y_L, 36 * 32, 16, 2 * (MPC_V_MEM + 960));
+        bench_input((mpc_int32_t *) Y_R, 36 * 32, 16, 2 * (MPC_V_MEM + 960) + 36 * 32);
+        have_input = TRUE;
+    }
+    memcpy(decoder.V_L, V_L, sizeof(V_L));
+    memcpy(decoder.V_R, V_R, sizeof(V_R));
+    memcpy(decoder.Y_L, Y_L, sizeof(Y_L));
+    memcpy(decoder.Y_R, Y_R, sizeof(Y_R));
+}
+
+static void synth_run(int arg)
+{
+    mpc_decoder_synthese_filter_float(&decoder, frame);
+}
+
+static MPC_SAMPLE_FORMAT new_v_input[36][32];
+static MPC_SAMPLE_FORMAT new_v[36][64];
+
+static void new_v_prepare(int arg)
+{
+    static mpc_bool_t have_input = FALSE;
+
+    if (!have_input) {
+        bench_input((mpc_int32_t *) new_v_input, 36 * 32, 16, 0);
+        have_input = TRUE;
+    }
+}
+
+static void new_v_run(int arg)
+{
+    mpc_uint32_t n;
+
+    for (n = 0; n < 36; n++)
+        mpc_calculate_new_v(new_v_input[n], new_v[n]);
+}
+
+#ifdef MPC_NEON
+static void new_v_run_neon(int arg)
+{
+    mpc_uint32_t n;
+
+    for (n = 0; n < 36; n++)
+        mpc_calculate_new_v_neon(new_v_input[n], new_v[n]);
+}
+#endif
+
+// Random bits, which decode to each symbol as often as the code expects.
+// The walk down the table is what mpc_decoder_huffman_decode() did before
+// it had the lookup tables.
+
+#define HUFFMAN_SYMBOLS 4096
+
+extern const HuffmanTyp* mpc_table_HuffQ[2][8];
+
+// as mpc_decoder_read_bitstream_sv7() passes them for each resolution
+static const mpc_uint32_t huffman_max_length[8] = { 0, 9, 10, 5, 5, 8, 14, 14 };
+
+static mpc_decoder huffman_decoder;
+static mpc_int32_t symbols[HUFFMAN_SYMBOLS];
+
+static void huffman_prepare(int res)
+{
+    static mpc_bool_t have_input = FALSE;
+    mpc_decoder *d = &huffman_decoder;
+    mpc_uint32_t n, r = 1;
+
+    if (!have_input) {
+        mpc_huffman_init_sv7();
+        for (n = 0; n < MEMSIZE; n++) {
+            r = r * 1664525 + 1013904223;
+            d->Speicher[n] = r;
+        }
+        have_input = TRUE;
+    }
+    d->Zaehler = 0;
+    d->dword = SWAP(d->Speicher[0]);
+    d->pos = 0;
+    d->WordsRead = 0;
+}
+
+static mpc_int32_t
+huffman_decode_walk(mpc_decoder *d, const HuffmanTyp *Table,
+                    const mpc_uint32_t max_length)
+{
+    mpc_uint32_t code = d->dword << d->pos;
+    if (32 - d->pos < max_length)
+        code |= SWAP(d->Speicher[(d->Zaehler + 1) & MEMMASK]) >> (32 - d->pos);
+
+    while (code < Table->Code) Table++;
+
+    if ((d->pos += Table->Length) >= 32) {
+        d->pos -= 32;
+        d->dword = SWAP(d->Speicher[d->Zaehler = (d->Zaehler + 1) & MEMMASK]);
+        d->WordsRead++;
+    }
+
+    return Table->Value;
+}
+
+static void huffman_run_walk(int res)
+{
+    mpc_uint32_t n;
+
+    for (n = 0; n < HUFFMAN_SYMBOLS; n++)
+        symbols[n] = huffman_decode_walk(&huffman_decoder, mpc_table_HuffQ[1][res],
+                                         huffman_max_length[res]);
+}
+
+static void huffman_run_lut(int res)
+{
+    mpc_uint32_t n;
+
+    for (n = 0; n < HUFFMAN_SYMBOLS; n++)
+        symbols[n] = mpc_decoder_huffman_decode(&huffman_decoder, mpc_lut_HuffQ[1][res],
+                                                huffman_max_length[res]);
+}
+
+// A decoded frame, some of it clipping
+static void pcm16_prepare(int arg)
+{
+    static mpc_bool_t have_input = FALSE;
+    mpc_uint32_t n;
+
+    if (!have_input) {
+        bench_input((mpc_int32_t *) samples, MPC_FRAME_SAMPLES, 16, 0);
+        for (n = 0; n < MPC_FRAME_SAMPLES; n++)
+            samples[n] = samples[n] * 5 / 4 * (1 << MPC_FIXED_POINT_FRACTPART);
+        have_input = TRUE;
+    }
+}
+
+static void pcm16_run(int arg)
+{
+    mpc_samples_to_pcm16(samples, pcm16, MPC_FRAME_SAMPLES);
+}
+
+#ifdef MPC_NEON
+static int neon_supported(void)
+{
+    return mpc_neon_supported();
+}
+
+#define KERNEL(name, prepare, run, out) \
+    { name, "C", 0, 0, NULL, MPC_FRAME_SAMPLES, prepare, run, out, sizeof(out) }, \
+    { name, "NEON", 0, 1, neon_supported, MPC_FRAME_SAMPLES, prepare, run, out, sizeof(out) }
+#else
+#define KERNEL(name, prepare, run, out) \
+    { name, "C", 0, 0, NULL, MPC_FRAME_SAMPLES, prepare, run, out, sizeof(out) }
+#endif
+
+#ifdef MPC_NEON
+#define NEW_V \
+    { "mpc calculate_new_v", "C", 0, 0, NULL, 36 * 32, new_v_prepare, new_v_run, new_v, sizeof(new_v) }, \
+    { "mpc calculate_new_v", "NEON", 0, 1, neon_supported, 36 * 32, new_v_prepare, new_v_run_neon, new_v, sizeof(new_v) }
+#else
+#define NEW_V \
+    { "mpc calculate_new_v", "C", 0, 0, NULL, 36 * 32, new_v_prepare, new_v_run, new_v, sizeof(new_v) }
+#endif
+
+#define HUFFMAN(res) \
+    { "mpc huffman_decode", "walk", res, 0, NULL, HUFFMAN_SYMBOLS, huffman_prepare, huffman_run_walk, symbols, sizeof(symbols) }, \
+    { "mpc huffman_decode", "LUT", res, 0, NULL, HUFFMAN_SYMBOLS, huffman_prepare, huffman_run_lut, symbols, sizeof(symbols) }
+
+// the codes of resolution 5 fit the first level of the lookup table, 2 and
+// 7 have longer ones too
+const bench_kernel mpc_kernels[] = {
+    HUFFMAN(2), HUFFMAN(5), HUFFMAN(7),
+    NEW_V,
+    KERNEL("mpc synthese_filter", synth_prepare, synth_run, frame),
+    KERNEL("mpc samples_to_pcm16", pcm16_prepare, pcm16_run, pcm16),
+    { NULL }
+};
@@ -0,0 +1,137 @@
+// WavPack kernels for kernelbench.c: the entropy decoding of get_words(),
+// the stereo decorrelation pass that unpack_samples() runs for each term
+// once the first 8 samples of a block are done, and the final shift of
+// fixup_samples().
+
+#include <string.h>
+
+#include "wavpack.h"
+#include "kernelbench.h"
+
+#define WV_SAMPLES  4096    // stereo samples per run
+#define WV_HISTORY  16      // the 8 stereo samples before, which the passes read
+
+extern void decorr_stereo_pass_cont_arm (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count);
+extern void decorr_stereo_pass_cont_arml (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count);
+#ifdef WV_NEON
+extern int wv_neon_supported (void);
+extern void decorr_stereo_pass_cont_neon (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count);
+#endif
+
+static int32_t input [WV_HISTORY + WV_SAMPLES * 2];
+static int32_t buffer [WV_HISTORY + WV_SAMPLES * 2];
+static struct decorr_pass pass;
+
+// The history is decoded audio, the rest residuals, which are much smaller.
+
+static void decorr_prepare (int term)
+{
+    static int have_input;
+
+    if (!have_input) {
+        bench_input (input, WV_HISTORY, 16, 0);
+        bench_input (input + WV_HISTORY, WV_SAMPLES * 2, 10, WV_HISTORY);
+        have_input = TRUE;
+    }
+
+    memcpy (buffer, input, sizeof (buffer));
+    memset (&pass, 0, sizeof (pass));
+    pass.term = term;
+    pass.delta = 2;
+    pass.weight_A = 256;
+    pass.weight_B = -256;
+}
+
+static void decorr_arm (int term)
+{
+    decorr_stereo_pass_cont_arm (&pass, buffer + WV_HISTORY, WV_SAMPLES);
+}
+
+static void decorr_arml (int term)
+{
+    decorr_stereo_pass_cont_arml (&pass, buffer + WV_HISTORY, WV_SAMPLES);
+}
+
+#ifdef WV_NEON
+static void decorr_neon (int term)
+{
+    decorr_stereo_pass_cont_neon (&pass, buffer + WV_HISTORY, WV_SAMPLES);
+}
+#endif
+
+// The residuals as pack.c would code them into a lossless stereo block,
+// with the entropy state starting out as init_words() leaves it.
+
+static int32_t residuals [WV_SAMPLES * 2];
+static uchar words [WV_SAMPLES * 2 * sizeof (int32_t)];
+static struct words_data words_state;
+static Bitstream words_bs;
+
+static void words_prepare (int arg)
+{
+    static int have_words;
+
+    if (!have_words) {
+        struct words_data w;
+        Bitstream bs;
+
+        bench_input (residuals, WV_SAMPLES * 2, 10, WV_HISTORY);
+        CLEAR (w);
+        bs_open_write (&bs, words, words + sizeof (words));
+        send_words (residuals, WV_SAMPLES, 0, &w, &bs);
+        flush_word (&w, &bs);
+        bs_close_write (&bs);
+        have_words = TRUE;
+    }
+
+    memset (residuals, 0, sizeof (residuals));
+    CLEAR (words_state);
+    // to the end of the buffer, as running into it would overwrite it
+    bs_open_read (&words_bs, words, words + sizeof (words), NULL, NULL, 0);
+}
+
+static void words_run (int arg)
+{
+    get_words (residuals, WV_SAMPLES, 0, &words_state, &words_bs);
+}
+
+static int32_t samples [WV_SAMPLES * 2];
+
+static void shift_prepare (int shift)
+{
+    bench_input (samples, WV_SAMPLES * 2, 16, 0);
+}
+
+static void shift_run (int shift)
+{
+    shift_samples (samples, WV_SAMPLES * 2, shift);
+}
+
+#define DECORR_IMPL(term, impl, run) \
+    { "wv decorr_stereo_pass_cont", impl, term, 1, NULL, WV_SAMPLES * 2, decorr_prepare, run, buffer, sizeof (buffer) }
+
+#ifdef WV_NEON
+#define DECORR(term) \
+    DECORR_IMPL (term, "arm", decorr_arm), \
+    DECORR_IMPL (term, "arml", decorr_arml), \
+    { "wv decorr_stereo_pass_cont", "NEON", term, 1, wv_neon_supported, WV_SAMPLES * 2, decorr_prepare, decorr_neon, buffer, sizeof (buffer) }
+#define SHIFT(shift) \
+    { "wv shift_samples", "C", shift, 0, NULL, WV_SAMPLES * 2, shift_prepare, shift_run, samples, sizeof (samples) }, \
+    { "wv shift_samples", "NEON", shift, 1, wv_neon_supported, WV_SAMPLES * 2, shift_prepare, shift_run, samples, sizeof (samples) }
+#else
+#define DECORR(term) \
+    DECORR_IMPL (term, "arm", decorr_arm), \
+    DECORR_IMPL (term, "arml", decorr_arml)
+#define SHIFT(shift) \
+    { "wv shift_samples", "C", shift, 0, NULL, WV_SAMPLES * 2, shift_prepare, shift_run, samples, sizeof (samples) }
+#endif
+
+// terms 2-8 share a loop, 1, 17 and 18 have their own; shifts as for
+// 16-bit and 24-bit files
+
+const bench_kernel wv_kernels [] = {
+    { "wv get_words", "C", 0, 0, NULL, WV_SAMPLES * 2, words_prepare, words_run, residuals, sizeof (residuals) },
+    DECORR (1), DECORR (2), DECORR (8), DECORR (17), DECORR (18),
+    SHIFT (5), SHIFT (-3),
+    { NULL }
+};
@@ -0,0 +1,201 @@
+/* Kernel microbenchmarks.
+ *
+ * Times the decoder hot loops one at a time, on fixed buffers, for every
+ * implementation the build has: the WavPack entropy decoder, stereo
+ * decorrelation pass for each positive term (ARM assembly, its 64-bit
+ * multiply variant and NEON) and final shift, the ALAC adaptive FIR for
+ * orders 4 and 8, the Musepack huffman decoder (the table walk it replaced
+ * and the lookup tables), new V calculation, synthesis and PCM conversion,
+ * the APE filters of every order with each vector_math header (generic C,
+ * ARMv5TE and, on armeabi-v7a, ARMv6) and the stereo predictor in C and
+ * ARM assembly, and the FLAC residual decoder and LPC loop in C and ARM
+ * assembly. The kernels that pick NEON at runtime are run with audio_simd
+ * off and on, as audioSetSimd() would switch them.
+ * Each implementation runs RUNS times on the same input and the best run
+ * counts, in CPU cycles per sample (a sample being one channel's) from the
+ * perf cycle counter, or in ns where the kernel doesn't let us read it.
+ * The outputs of the implementations of a kernel are compared with the
+ * first one's, so a port that is fast but wrong shows.
+ *
+ * The input is two tones per channel with some noise, or with a file
+ * argument, 16-bit stereo PCM: raw, or a WAV file as MODE_FILE writes it.
+ *
+ * ndk-build builds it along with liblossless, which it links to, but it
+ * isn't packaged. To run it on a device:
+ *   adb push libs/armeabi-v7a/kernelbench libs/armeabi-v7a/liblossless.so /data/local/tmp
+ *   adb shell "cd /data/local/tmp && LD_LIBRARY_PATH=. taskset 1 ./kernelbench [file.wav]"
+ * taskset keeps it on one core, which matters on big.LITTLE CPUs. */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <math.h>
+#include <time.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#include "kernelbench.h"
+
+#define RUNS		200		// of each implementation
+#define SYNTH_SAMPLES	(1 << 16)	// stereo samples of the synthetic input
+#define MAX_SAMPLES	(1 << 22)	// of a file, at most
+
+static int16_t *pcm;		// the input, interleaved stereo
+static int pcm_len;		// samples in it, counting both channels
+
+static int synth_input(void) {
+
+    uint32_t r = 1;
+    int i;
+
+	pcm_len = SYNTH_SAMPLES * 2;
+	pcm = (int16_t *) malloc(pcm_len * sizeof(int16_t));
+	if(!pcm) return 0;
+	for(i = 0; i < pcm_len; i += 2) {
+	    r = r * 1664525 + 1013904223;
+	    pcm[i] = 9000 * sin(i * 0.0125) + 4000 * sin(i * 0.171) + (int) (r >> 24) - 128;
+	    pcm[i + 1] = 8000 * sin(i * 0.0093) + 5000 * sin(i * 0.223) + (int) ((r >> 16) & 255) - 128;
+	}
+	return 1;
+}
+
+static int load_input(const char *path) {
+
+    FILE *f = fopen(path, "rb");
+    char riff[4];
+
+	if(!f) {
+	    fprintf(stderr, "cannot open %s\n", path);
+	    return 0;
+	}
+	if(fread(riff, 1, 4, f) != 4 || fseek(f, memcmp(riff, "RIFF", 4) ? 0 : 44, SEEK_SET) != 0) {
+	    fclose(f);
+	    return 0;
+	}
+	pcm = (int16_t *) malloc(MAX_SAMPLES * sizeof(int16_t));
+	if(pcm) pcm_len = fread(pcm, sizeof(int16_t), MAX_SAMPLES, f) & ~1;
+	fclose(f);
+	if(pcm_len < 2) {
+	    fprintf(stderr, "%s: no samples\n", path);
+	    return 0;
+	}
+	return 1;
+}
+
+void bench_input(int32_t *buf, int count, int bits, int offset) {
+    int i;
+	for(i = 0; i < count; i++) buf[i] = pcm[(offset + i) % pcm_len] >> (16 - bits);
+}
+
+static int cycles_fd = -1;
+
+static void counter_open(void) {
+
+    struct perf_event_attr a;
+    uint64_t c;
+
+	memset(&a, 0, sizeof(a));
+	a.type = PERF_TYPE_HARDWARE;
+	a.size = sizeof(a);
+	a.config = PERF_COUNT_HW_CPU_CYCLES;
+	a.exclude_kernel = 1;
+	a.exclude_hv = 1;
+	cycles_fd = syscall(__NR_perf_event_open, &a, 0, -1, -1, 0);
+	if(cycles_fd >= 0 && read(cycles_fd, &c, sizeof(c)) != sizeof(c)) {
+	    close(cycles_fd);
+	    cycles_fd = -1;
+	}
+}
+
+/* cycles, or ns without the counter */
+static uint64_t counter_read(void) {
+
+    uint64_t c;
+    struct timespec t;
+
+	if(cycles_fd >= 0 && read(cycles_fd, &c, sizeof(c)) == sizeof(c)) return c;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (uint64_t) t.tv_sec * 1000000000ULL + t.tv_nsec;
+}
+
+static uint64_t overhead;	// of the two counter_read()s around a run
+
+static void counter_calibrate(void) {
+
+    uint64_t t;
+    int i;
+
+	overhead = ~0ULL;
+	for(i = 0; i < RUNS; i++) {
+	    t = counter_read();
+	    t = counter_read() - t;
+	    if(t < overhead) overhead = t;
+	}
+}
+
+static double per_sample(const bench_kernel *k) {
+
+    uint64_t t, best = ~0ULL;
+    int i;
+
+	audio_simd = k->simd;
+	for(i = 0; i < RUNS; i++) {
+	    k->prepare(k->arg);
+	    t = counter_read();
+	    k->run(k->arg);
+	    t = counter_read() - t;
+	    if(t < best) best = t;
+	}
+	audio_simd = 1;
+	return (double) (best > overhead ? best - overhead : 0) / k->samples;
+}
+
+static void run_kernels(const bench_kernel *k) {
+
+    const bench_kernel *ref = 0;
+    unsigned char *ref_out = 0;
+    char name[64];
+    double t;
+
+	for(; k->name; k++) {
+	    if(ref && (strcmp(k->name, ref->name) || k->arg != ref->arg)) ref = 0;
+	    if(k->arg) snprintf(name, sizeof(name), "%s(%d)", k->name, k->arg);
+	    else snprintf(name, sizeof(name), "%s", k->name);
+	    if(k->supported && !k->supported()) {
+		printf("%-40s %-6s  not supported on this CPU\n", name, k->impl);
+		continue;
+	    }
+	    t = per_sample(k);
+	    printf("%-40s %-6s %8.2f", name, k->impl, t);
+	    if(!ref) {
+		free(ref_out);
+		ref_out = (unsigned char *) malloc(k->size);
+		if(ref_out) {
+		    memcpy(ref_out, k->out, k->size);
+		    ref = k;
+		}
+	    } else if(k->size != ref->size || memcmp(ref_out, k->out, k->size))
+		printf("  output differs from %s", ref->impl);
+	    putchar('\n');
+	}
+	free(ref_out);
+}
+
+int main(int argc, char **argv) {
+
+	if(argc > 2) {
+	    fprintf(stderr, "usage: %s [16-bit stereo .wav or .raw]\n", argv[0]);
+	    return 1;
+	}
+	if(argc == 2 ? !load_input(argv[1]) : !synth_input()) return 1;
+	counter_open();
+	counter_calibrate();
+	printf("%s per sample, best of %d runs\n", cycles_fd >= 0 ? "cycles" : "ns (no cycle counter)", RUNS);
+	run_kernels(wv_kernels);
+	run_kernels(alac_kernels);
+	run_kernels(mpc_kernels);
+	run_kernels(ape_kernels);
+	run_kernels(flac_kernels);
+	if(cycles_fd >= 0) close(cycles_fd);
+	return 0;
+}
@@ -0,0 +1,38 @@
+#ifndef _KERNELBENCH_H_INCLUDED
+#define _KERNELBENCH_H_INCLUDED
+
+#include <stddef.h>
+#include <stdint.h>
+
+/* One implementation of a kernel, see kernelbench.c. prepare() puts the
+   fixed input in place, outside the timing, and run() calls the kernel
+   on it once. The implementations of a kernel share its name and arg and
+   are expected to leave the same size bytes at out. */
+typedef struct bench_kernel {
+    const char *name;
+    const char *impl;
+    int arg;			// passed to prepare() and run(), e.g. the filter order
+    int simd;			// audio_simd while it runs, for the kernels that dispatch on it
+    int (*supported)(void);	// NULL if it always is
+    int samples;		// per run()
+    void (*prepare)(int arg);
+    void (*run)(int arg);
+    const void *out;
+    size_t size;
+} bench_kernel;
+
+/* Each ends with an entry of name 0. */
+extern const bench_kernel wv_kernels[];
+extern const bench_kernel alac_kernels[];
+extern const bench_kernel mpc_kernels[];
+extern const bench_kernel ape_kernels[];
+extern const bench_kernel flac_kernels[];
+
+/* Fills buf with count samples of the input, as signed values of the
+   given bits, starting at the input's offset'th sample. */
+void bench_input(int32_t *buf, int count, int bits, int offset);
+
+/* in liblossless, see audioSetSimd() */
+extern volatile int audio_simd;
+
+#endif
@@ -30,7 +30,6 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
-#include <sys/time.h>
 #include <sys/select.h>
 #include <pthread.h>
 #include <sched.h>
@@ -566,16 +565,10 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_flacPlay(JNIEnv *env, jobject
     int32_t decoded0[MAX_BLOCKSIZE];
     int32_t decoded1[MAX_BLOCKSIZE];
     unsigned char *p;	
+    int32_t *chans[2] = { decoded0, decoded1 };
     FLACContext fc[1];
-    struct timeval tstart, tstop, ttmp; // tstart -> time of the last write.
-    useconds_t  tminwrite;
-    int prev_written = 0;
     flac_seek_t seek_lo, seek_hi;
-    int obps; 
-#ifdef DBG_TIME
-	uint64_t total_tminwrite = 0, total_ttmp = 0, total_sleep = 0;
-	int writes = 0, fails = 0;	
-#endif
+    int obps, direct; 
 
 
 	if(!ctx) return LIBLOSSLESS_ERR_NOCTX;
@@ -598,9 +591,11 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_flacPlay(JNIEnv *env, jobject
 //  __android_log_print(ANDROID_LOG_INFO,"liblossless","flac_init() exited, calling flac_seek()");
 
 	if(start) {
+	   int64_t seek_t0 = trace_now_us();
 	   if(!flac_seek(fc,ctx,time2sample(start,fc),&seek_lo,&seek_hi,decoded0,decoded1)) {
 	   	if(!flac_seek(fc,ctx,time2sample(start+1,fc),&seek_lo,&seek_hi,decoded0,decoded1)) return LIBLOSSLESS_ERR_OFFSET;
 	   } 		
+	   trace_span(ctx->trace, TRACE_SEEK, seek_t0, start, 0);
 	}
 
 //  __android_log_print(ANDROID_LOG_INFO,"liblossless","flac_seek() exited, starting playback");
@@ -615,17 +610,17 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_flacPlay(JNIEnv *env, jobject
         ctx->channels = fc->channels;
         ctx->samplerate = fc->samplerate;
         ctx->bps = fc->bps;
-        ctx->written = 0;
+        audio_written_reset(ctx);
 	pthread_mutex_lock(&ctx->mutex);
 	ctx->state = MSM_PLAYING;
 	ctx->track_time = fc->totalsamples / fc->samplerate;
 	pthread_mutex_unlock(&ctx->mutex);
 	obps = (fc->bps == 24) ? 16:fc->bps;
 	update_track_time(env,obj,ctx->track_time); 
+	direct = audio_direct_buffers(ctx);
  
 
-	bytesleft = read(ctx->fd,buf,sizeof(buf));
-//        gettimeofday(&tstart,0);
+	bytesleft = audio_read(ctx,buf,sizeof(buf));
    	
     while (bytesleft && (ctx->state != MSM_STOPPED)) 
     { 
@@ -636,96 +631,77 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_flacPlay(JNIEnv *env, jobject
                     pthread_mutex_unlock(&ctx->mutex);
                 }
                 if(ctx->fd == -1) return 0; // we were stopped from the main thread
-		if(ctx->written/(ctx->channels * ctx->samplerate * (obps/8))+2 > ctx->track_time) break;
+		if(audio_written(ctx)/(ctx->channels * ctx->samplerate * (obps/8))+2 > ctx->track_time) break;
                 close(ctx->fd); ctx->fd = -1;
 		return LIBLOSSLESS_ERR_DECODE;
 	}
 	consumed = fc->gb.index/8;
-        scale = FLAC_OUTPUT_DEPTH - fc->bps;
-
-        p = ctx->wavbuf + bytes_to_write;
-
-        for (i=0; i < fc->blocksize; i++) {
-             /* Left sample */
-             decoded0[i] = decoded0[i]>>scale;
-             if (fc->bps == 24) {
-        	 *(p++) = (decoded0[i]&0xff00)>>8;
-		 *(p++)=(decoded0[i]&0xff0000)>>16; 
-	     } else {	
-	         *(p++) = decoded0[i]&0xff;
-        	 *(p++) = (decoded0[i]&0xff00)>>8;
-	     }	 	
-             if (fc->channels == 2) {
-                 /* Right sample */
-                 decoded1[i]=decoded1[i]>>scale;
-                 if (fc->bps==24) {
-        	 	 *(p++) = (decoded1[i]&0xff00)>>8;
-			 *(p++)=(decoded1[i]&0xff0000)>>16;
-		 } else {
-	                 *(p++)=decoded1[i]&0xff;
-	        	 *(p++) = (decoded1[i]&0xff00)>>8;
-		 }
-             }
-        }
-
-        n = fc->blocksize * fc->channels * (obps/8);
-
-	if(n + bytes_to_write >= ctx->conf_size) {
-	    p = ctx->wavbuf; n += bytes_to_write;	
 
-	    if(prev_written && ctx->mode != MODE_CALLBACK) {	
-		tminwrite = ((uint64_t)((uint64_t)(prev_written))*1000000)/((uint64_t)(fc->samplerate*fc->channels*(obps/8)));
-	        gettimeofday(&tstop,0);
-		timersub(&tstop,&tstart,&ttmp);
-		if(tminwrite > ttmp.tv_usec) {
-			usleep((tminwrite-ttmp.tv_usec)/4);
-#ifdef DBG_TIME
-			total_sleep += (tminwrite - ttmp.tv_usec)/4;
-#endif
-		}
-#ifdef DBG_TIME
-  	        else fails++;
-	        writes++;
-        	total_tminwrite += tminwrite;
-		total_ttmp += ttmp.tv_usec;
-#endif
-	    }	
-	    if(ctx->mode != MODE_CALLBACK) gettimeofday(&tstart,0);
-	    prev_written = 0; 		    	
-	    do {
-		pthread_mutex_lock(&ctx->mutex);
-		i = audio_write(ctx,p,ctx->conf_size);
-		if(i < ctx->conf_size) {
-		    ctx->state = MSM_STOPPED;	
-		    pthread_mutex_unlock(&ctx->mutex);
-		    if(ctx->fd == -1) {
-#ifdef DBG_TIME
-        if(writes && (writes > fails)) {
-           int x = (int) (total_tminwrite/writes);
-           int y = (int) (total_ttmp/writes);
-	   int z = (int) (total_sleep/(writes-fails));	
-            __android_log_print(ANDROID_LOG_INFO,"liblossless","tminwrite %d ttmp %d sleep %d fails %d writes %d", x,y,z,fails,writes);
-        } else __android_log_print(ANDROID_LOG_INFO,"liblossless","fails %d writes %d", fails,writes);
-#endif
-			return 0; // we were stopped from the main thread
-		    }		
-		    close(ctx->fd); ctx->fd = -1;
-	            return LIBLOSSLESS_ERR_IO_WRITE;
-		}
-		pthread_mutex_unlock(&ctx->mutex);
-		n -= ctx->conf_size;
-		p += ctx->conf_size;
-		prev_written += ctx->conf_size;
-		ctx->written += i;
-	    } while(n >= ctx->conf_size);
-	    memmove(ctx->wavbuf,p,n);
-	    bytes_to_write = n;
-	} else bytes_to_write += n;
+	/* MODE_CALLBACK: pack straight into the track's buffer; the decoder's
+	   samples are FLAC_OUTPUT_DEPTH bits whatever fc->bps is */
+	if(direct) {
+	    n = fc->blocksize * fc->channels * 2;
+	    if(audio_write_planar(ctx, chans, fc->channels, fc->blocksize, FLAC_OUTPUT_DEPTH) < n) break;
+	} else {
+	        scale = FLAC_OUTPUT_DEPTH - fc->bps;
+	        p = ctx->wavbuf + bytes_to_write;
+
+	        audio_stage(ctx, STAGE_CONVERT);
+	        for (i=0; i < fc->blocksize; i++) {
+	             /* Left sample */
+	             decoded0[i] = decoded0[i]>>scale;
+	             if (fc->bps == 24) {
+	        	 *(p++) = (decoded0[i]&0xff00)>>8;
+			 *(p++)=(decoded0[i]&0xff0000)>>16; 
+		     } else {	
+		         *(p++) = decoded0[i]&0xff;
+	        	 *(p++) = (decoded0[i]&0xff00)>>8;
+		     }	 	
+	             if (fc->channels == 2) {
+	                 /* Right sample */
+	                 decoded1[i]=decoded1[i]>>scale;
+	                 if (fc->bps==24) {
+	        	 	 *(p++) = (decoded1[i]&0xff00)>>8;
+				 *(p++)=(decoded1[i]&0xff0000)>>16;
+			 } else {
+		                 *(p++)=decoded1[i]&0xff;
+		        	 *(p++) = (decoded1[i]&0xff00)>>8;
+			 }
+	             }
+	        }
+	        audio_stage(ctx, STAGE_DECODE);
+
+	        n = fc->blocksize * fc->channels * (obps/8);
+
+		if(n + bytes_to_write >= ctx->conf_size) {
+		    p = ctx->wavbuf; n += bytes_to_write;	
+
+		    do {
+			pthread_mutex_lock(&ctx->mutex);
+			i = audio_write(ctx,p,ctx->conf_size);
+			if(i < ctx->conf_size) {
+			    ctx->state = MSM_STOPPED;	
+			    pthread_mutex_unlock(&ctx->mutex);
+			    if(ctx->fd == -1) {
+				return 0; // we were stopped from the main thread
+			    }		
+			    close(ctx->fd); ctx->fd = -1;
+		            return LIBLOSSLESS_ERR_IO_WRITE;
+			}
+			pthread_mutex_unlock(&ctx->mutex);
+			n -= ctx->conf_size;
+			p += ctx->conf_size;
+			audio_written_add(ctx, i);
+		    } while(n >= ctx->conf_size);
+		    memmove(ctx->wavbuf,p,n);
+		    bytes_to_write = n;
+		} else bytes_to_write += n;
+	}
 
         memmove(buf,&buf[consumed],bytesleft-consumed);
         bytesleft -= consumed;
 
-        n = read(ctx->fd,&buf[bytesleft],sizeof(buf)-bytesleft);
+        n = audio_read(ctx,&buf[bytesleft],sizeof(buf)-bytesleft);
         if (n > 0) bytesleft+=n;
 	else if(n < 0) {
 		if(ctx->state != MSM_STOPPED) {
@@ -750,14 +726,6 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_flacPlay(JNIEnv *env, jobject
 	pthread_mutex_unlock(&ctx->mutex);
     }
 
-#ifdef DBG_TIME
-        if(writes && (writes > fails)) {
-           int x = (int) (total_tminwrite/writes);
-           int y = (int) (total_ttmp/writes);
-           int z = (int) (total_sleep/(writes-fails));
-            __android_log_print(ANDROID_LOG_INFO,"liblossless","tminwrite %d ttmp %d sleep %d fails %d writes %d", x,y,z,fails,writes);
-        } else __android_log_print(ANDROID_LOG_INFO,"liblossless","fails %d writes %d", fails,writes);
-#endif
       audio_wait_done(ctx);		
     return 0;
 }
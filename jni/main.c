@@ -7,6 +7,8 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <time.h>
+#include <sys/syscall.h>
 #include <jni.h>
 #include <pthread.h>
 #include <dlfcn.h>
@@ -14,6 +16,7 @@
 #include "main.h"
 #include "msm_audio.h"
 #include "std_audio.h"
+#include "sink.h"
 
 #define MSM_DEVICE "/dev/msm_pcm_out"
 
@@ -68,22 +71,410 @@ static void msm_stop(msm_ctx *ctx) {
     }	
 }
 
-int audio_start(msm_ctx *ctx, int channels, int samplerate) {
+static ssize_t msm_write(msm_ctx *ctx, const void *buf, size_t count) {
+    return write(ctx->afd, buf, count);
+}
 
-    if(!ctx) return LIBLOSSLESS_ERR_NOCTX;
-    switch(ctx->mode) {
+static const audio_sink msm_sink = {
+    .name = "msm_pcm_out",
+    .start = msm_start,
+    .stop = msm_stop,
+    .write = msm_write,
+};
+
+/* The libmedia outputs live in the atrack libraries, so these are filled in
+   by libinit() once one of them is loaded. */
+static audio_sink libmedia_sink = { .name = "libmedia" };
+static audio_sink libmediacb_sink = { .name = "libmedia callback" };
+
+static const audio_sink *sink_for_mode(int mode) {
+    switch(mode) {
         case MODE_DIRECT:
-           return msm_start(ctx, channels, samplerate);
+           return &msm_sink;
         case MODE_LIBMEDIA:
-           return libmedia_start(ctx, channels, samplerate);
-	case MODE_CALLBACK:
-           return libmediacb_start(ctx, channels, samplerate);
+           return &libmedia_sink;
+        case MODE_CALLBACK:
+           return &libmediacb_sink;
+        case MODE_OPENSL:
+           return &opensl_sink;
+        case MODE_AAUDIO:
+           return &aaudio_sink;
+        case MODE_NULL:
+           return &null_sink;
+        case MODE_FILE:
+           return &file_sink;
         default:
            break;
     }
     return 0;
 }
 
+/* Write pacing. audio_write() lets a decoder run at most ctx->pace_ms of
+   audio ahead of the output, and waits out the rest on ctx->pacecond with
+   ctx->mutex released, so that pause and stop get through at once. What is
+   still queued comes from the sink if it can tell, or else from the audio
+   written against the monotonic clock since the output started; on an
+   underrun the clock starts over. With MODE_FLAG_POWER_SAVING a decoder
+   that got ahead sleeps until only BURST_LOW_WATER percent of that is
+   left, and then fills it up again in one go. Not for MODE_CALLBACK, whose
+   ring paces the decoder by itself, nor for the offline outputs that
+   should go as fast as possible. */
+static int audio_paced(msm_ctx *ctx) {
+    return ctx->mode != MODE_CALLBACK && ctx->mode != MODE_NULL && ctx->mode != MODE_FILE;
+}
+
+static int64_t now_us(void) {
+    struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static int64_t now_ms(void) {
+	return now_us() / 1000;
+}
+
+/* What the output still holds going by the clock, see audio_write() */
+static int64_t clock_queued_ms(msm_ctx *ctx) {
+    int64_t now = ctx->state == MSM_PAUSED ? ctx->pace_paused : now_ms();
+	return ctx->pace_bytes * 1000 / ctx->pace_rate - (now - ctx->pace_t0);
+}
+
+static int queued_ms(msm_ctx *ctx) {
+
+    int64_t q;
+
+	if(ctx->sink->latency) return ctx->sink->latency(ctx);
+	if(!ctx->pace_rate) return 0;
+	q = clock_queued_ms(ctx);
+	if(q < 0) {
+	    ctx->pace_t0 = now_ms();
+	    ctx->pace_bytes = 0;
+	    q = 0;
+	}
+	return q;
+}
+
+/* Milliseconds of the track played so far: the output's own position if
+   it has one, or else the audio decoders have written less what is still
+   queued. ctx->written counts the 16-bit PCM the output gets, whatever
+   ctx->bps the file has. This runs on the caller's thread, so the clock
+   estimate mustn't touch pace_t0. */
+static int64_t audio_position_ms(msm_ctx *ctx) {
+
+    int64_t ms, q, played = -1;
+
+	if(!ctx->sink || !ctx->pace_rate) return 0;
+	ms = audio_written(ctx) * 1000 / ctx->pace_rate;
+	if(ctx->sink->played) played = ctx->sink->played(ctx);
+	if(played >= 0) return played < ms ? played : ms;
+	q = ctx->sink->latency ? ctx->sink->latency(ctx) : clock_queued_ms(ctx);
+	if(q > 0) ms -= q;
+	return ms > 0 ? ms : 0;
+}
+
+static void audio_event(int event, int arg);
+
+/* Refreshes ctx->status for the UI: at once when the state or the track
+   changes, and otherwise at most every STATUS_PERIOD_MS. The changes are
+   pushed to the UI as well, once the block has them. */
+static void status_publish(msm_ctx *ctx) {
+
+    audio_status *s = ctx->status;
+    int state = ctx->state, tracks = ctx->tracks;
+    int64_t now;
+
+	now = now_ms();
+	if(state == ctx->event_state && tracks == ctx->event_tracks
+		&& (!s || now - s->pos_time < STATUS_PERIOD_MS)) return;
+	if(s) {
+	    status_lock(ctx);
+	    s->state = state;
+	    s->pos_ms = audio_position_ms(ctx);
+	    s->pos_time = now;
+	    s->track_time = ctx->track_time;
+	    s->underruns = ctx->underruns;
+	    s->buf_ms = ctx->buf_ms;
+	    s->samplerate = ctx->samplerate;
+	    s->channels = ctx->channels;
+	    s->bps = ctx->bps;
+	    status_unlock(ctx);
+	}
+	if(tracks != ctx->event_tracks) {
+	    ctx->event_tracks = tracks;
+	    audio_event(AUDIO_EVENT_TRACK, tracks);
+	}
+	if(state != ctx->event_state) {
+	    ctx->event_state = state;
+	    audio_event(AUDIO_EVENT_STATE, state);
+	}
+}
+
+/* Called with ctx->mutex held; returns false if playback was stopped meanwhile. */
+static int pace_write(msm_ctx *ctx) {
+
+    struct timespec ts;
+    int q, target = ctx->pace_ms;
+
+	if(ctx->state != MSM_PLAYING || queued_ms(ctx) <= target) return 1;
+	if(ctx->mode_flags & MODE_FLAG_POWER_SAVING) target = target * BURST_LOW_WATER / 100;
+	while(ctx->state == MSM_PLAYING && (q = queued_ms(ctx)) > target) {
+	    clock_gettime(CLOCK_REALTIME, &ts);
+	    ts.tv_sec += (q - target) / 1000;
+	    ts.tv_nsec += ((q - target) % 1000) * 1000000;
+	    if(ts.tv_nsec >= 1000000000) {
+		ts.tv_sec++; ts.tv_nsec -= 1000000000;
+	    }
+	    pthread_cond_timedwait(&ctx->pacecond, &ctx->mutex, &ts);
+	}
+	return ctx->state != MSM_STOPPED;
+}
+
+/* readahead(2), which the NDK's libc only has from android-21 on. On ARM
+   EABI the 64-bit offset goes in an even register pair, after a pad. */
+static void read_ahead(int fd, off_t pos, size_t count) {
+#ifdef __arm__
+	syscall(__NR_readahead, fd, 0, (uint32_t) pos, (uint32_t) ((uint64_t) pos >> 32), count);
+#else
+	syscall(__NR_readahead, fd, (int64_t) pos, count);
+#endif
+}
+
+/* Power figures. The time a decoder spends blocked in the output is
+   summed up per track, and every block counts as a wakeup, so track_done()
+   can log wakeups per minute and the share of time the decoder thread
+   was busy. In the power saving mode the input for the next burst is read
+   into the page cache at once when the decoder wakes up, so that the card
+   too does its work in one go. The PCM of a buffer is more than the file
+   holds for it, but that only reads a little further ahead. */
+static void output_slept(msm_ctx *ctx, int64_t t0) {
+
+    int64_t us = now_us() - t0;
+    off_t pos;
+
+	if(us < 1000) return;	// didn't block
+	ctx->wakeups++;
+	ctx->blocked_us += us;
+	if(!(ctx->mode_flags & MODE_FLAG_POWER_SAVING) || ctx->fd < 0) return;
+	pos = lseek(ctx->fd, 0, SEEK_CUR);
+	if(pos >= 0) read_ahead(ctx->fd, pos, (int64_t) ctx->pace_rate * ctx->buf_ms / 1000);
+}
+
+static void log_power(msm_ctx *ctx) {
+
+    int64_t us = now_us() - ctx->busy_t0;
+
+	if(!ctx->busy_t0 || us < 1000000) return;
+	__android_log_print(ANDROID_LOG_INFO,"liblossless","%s: %d s, %d wakeups/min, decoder busy %d%%",
+		ctx->sink ? ctx->sink->name : "no output", (int) (us / 1000000),
+		(int) (ctx->wakeups * 60000000LL / us), (int) (100 - ctx->blocked_us * 100 / us));
+	ctx->busy_t0 = 0;
+}
+
+/* Statistics of a track, see audioGetStats(). The decoder thread is always
+   in one of the STAGE_*s, and audio_stage() charges the time since the
+   last switch to the one it leaves. audio_read(), the writes and the
+   packing into 16-bit PCM here mark their own stages and go back to the
+   one they found, so that a decoder only has to mark its own conversion
+   loops. How full the output is gets sampled before each write once the
+   first buf_ms went out, and the thread's CPU time after it. Pauses don't
+   count, audioResume() moves the clocks on past them. While a track plays
+   every stage left also goes to the trace as a span, with the bytes read or
+   written if any. */
+static void stage_switch(msm_ctx *ctx, int stage, int bytes) {
+    int64_t now = now_us();
+	ctx->stage_us[ctx->stage] += now - ctx->stage_t0;
+	if(ctx->track_t0 && !ctx->track_t1)
+	    trace_add(ctx->trace, ctx->stage, ctx->stage_t0, (int) (now - ctx->stage_t0), bytes, 0);
+	if(ctx->atrace || ctx->atrace_open) trace_atrace_stage(ctx, stage);
+	ctx->stage_t0 = now;
+	ctx->stage = stage;
+}
+
+void audio_stage(msm_ctx *ctx, int stage) {
+	stage_switch(ctx, stage, 0);
+}
+
+static int64_t thread_cpu_us(void) {
+    struct timespec t;
+	clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t);
+	return (int64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+static void stats_start(msm_ctx *ctx) {
+	memset(ctx->stage_us, 0, sizeof(ctx->stage_us));
+	ctx->stage = STAGE_DECODE;
+	ctx->stage_t0 = ctx->track_t0 = now_us();
+	ctx->track_t1 = 0;
+	ctx->cpu_t0 = thread_cpu_us();
+	ctx->cpu_us = 0;
+	ctx->underruns_t0 = ctx->underruns;
+	ctx->lags = 0;
+	ctx->fill_min = 100;
+	ctx->fill_n = 0;
+	ctx->fill_sum = 0;
+}
+
+static void stats_fill(msm_ctx *ctx) {
+    int q, f;
+	if(!ctx->buf_ms || audio_written(ctx) * 1000 < (int64_t) ctx->buf_ms * ctx->pace_rate) return;
+	q = queued_ms(ctx);
+	if(ctx->atrace) trace_atrace_fill(ctx, q);
+	f = q * 100 / ctx->buf_ms;
+	if(f > 100) f = 100;
+	if(f < ctx->fill_min) ctx->fill_min = f;
+	ctx->fill_sum += f;
+	ctx->fill_n++;
+}
+
+static void stats_get(msm_ctx *ctx, jint *st) {
+
+    int64_t end = ctx->track_t1 ? ctx->track_t1 : now_us(), busy;
+    int k;
+
+	memset(st, 0, STATS * sizeof(jint));
+	if(!ctx->track_t0) return;
+	st[STAT_UNDERRUNS] = ctx->underruns - ctx->underruns_t0;
+	st[STAT_LAGS] = ctx->lags;
+	st[STAT_FILL_MIN] = ctx->fill_n ? ctx->fill_min : 0;
+	st[STAT_FILL_AVG] = ctx->fill_n ? ctx->fill_sum / ctx->fill_n : 0;
+	for(k = 0; k < STAGES; k++) st[STAT_DECODE_MS + k] = ctx->stage_us[k] / 1000;
+	st[STAT_CPU_MS] = ctx->cpu_us / 1000;
+	st[STAT_AUDIO_MS] = ctx->pace_rate ? audio_written(ctx) * 1000 / ctx->pace_rate : 0;
+	st[STAT_ELAPSED_MS] = (end - ctx->track_t0) / 1000;
+	busy = end - ctx->track_t0 - ctx->stage_us[STAGE_WRITE];
+	if(busy > 0) st[STAT_SPEED] = (int64_t) st[STAT_AUDIO_MS] * 100000 / busy;
+}
+
+static void log_stats(msm_ctx *ctx) {
+    jint st[STATS];
+	stats_get(ctx, st);
+	if(st[STAT_ELAPSED_MS] < 1000) return;
+	__android_log_print(ANDROID_LOG_INFO,"liblossless","stats: %d underruns, %d lags, filled %d%% min %d%% avg, "
+		"decode %d read %d convert %d write %d ms, cpu %d ms, x%d.%02d",
+		st[STAT_UNDERRUNS], st[STAT_LAGS], st[STAT_FILL_MIN], st[STAT_FILL_AVG],
+		st[STAT_DECODE_MS], st[STAT_READ_MS], st[STAT_CONVERT_MS], st[STAT_WRITE_MS],
+		st[STAT_CPU_MS], st[STAT_SPEED] / 100, st[STAT_SPEED] % 100);
+}
+
+/* read() of the input, for the decoders */
+ssize_t audio_read(msm_ctx *ctx, void *buf, size_t count) {
+
+    int prev = ctx->stage;
+    ssize_t n;
+
+	audio_stage(ctx, STAGE_READ);
+	n = read(ctx->fd, buf, count);
+	stage_switch(ctx, prev, n);
+	return n;
+}
+
+/* Buffering policy. audioInit() sets ctx->buf_ms, the audio the output is
+   kept filled with. Each track starts with one write period queued and the
+   decoder's lead doubles with every write up to buf_ms, so playback starts
+   at once without a long first fill. The write period is a BUFFER_PERIODS
+   part of buf_ms, so that it lasts about the same whatever the format.
+   The sinks count underruns; on one buf_ms grows by half, up to
+   BUFFER_MAX_MS, and stays grown for the next tracks. Outputs that keep
+   a buffer of their own (MODE_CALLBACK's ring, the OpenSL ES queue) size it
+   from buf_ms and conf_size when they start. */
+/* The buffering policy: audioInit()'s buffer_ms, or the default of the
+   mode flags without one. Power saving buffers seconds whatever was asked
+   for, a short buffer_ms would keep the decoder waking at the foreground
+   rate with the screen off. */
+static void buffer_policy(msm_ctx *ctx) {
+
+    int ms = ctx->buf_pref_ms;
+
+	if(ctx->mode_flags & MODE_FLAG_POWER_SAVING) {
+	    if(ms < BUFFER_POWER_SAVING_MS) ms = BUFFER_POWER_SAVING_MS;
+	} else if(ms <= 0) ms = (ctx->mode_flags & MODE_FLAG_LOW_LATENCY) ? BUFFER_LOW_LATENCY_MS : BUFFER_DEFAULT_MS;
+	if(ms < BUFFER_MIN_MS) ms = BUFFER_MIN_MS;
+	if(ms > BUFFER_MAX_MS) ms = BUFFER_MAX_MS;
+	if(ms != ctx->buf_req_ms) {	// else keep what underruns made of it
+	    ctx->buf_req_ms = ms;
+	    ctx->buf_ms = ms;
+	}
+}
+
+/* Takes up the power saving mode audioSetPowerSaving() asked for, on the
+   decoder thread, so that buf_ms only ever changes there. */
+static void check_power_saving(msm_ctx *ctx) {
+
+    int on = __sync_lock_test_and_set(&ctx->power_saving_req, -1), flags;
+
+	if(on < 0) return;
+	flags = on ? ctx->mode_flags | MODE_FLAG_POWER_SAVING : ctx->mode_flags & ~MODE_FLAG_POWER_SAVING;
+	if(flags == ctx->mode_flags) return;
+	ctx->mode_flags = flags;
+	buffer_policy(ctx);
+	if(ctx->pace_ms > ctx->buf_ms) ctx->pace_ms = ctx->buf_ms;
+	__android_log_print(ANDROID_LOG_INFO,"liblossless","power saving %s, buffering %d ms from now on",
+		on ? "on" : "off", ctx->buf_ms);
+}
+
+static void check_underruns(msm_ctx *ctx) {
+
+    int n = ctx->underruns;
+
+	if(n == ctx->underruns_seen) return;
+	ctx->underruns_seen = n;
+	trace_instant(ctx->trace, TRACE_UNDERRUN, n, 0);
+	audio_event(AUDIO_EVENT_UNDERRUN, n);
+	if(ctx->buf_ms < BUFFER_MAX_MS) {
+	    ctx->buf_ms += ctx->buf_ms / 2;
+	    if(ctx->buf_ms > BUFFER_MAX_MS) ctx->buf_ms = BUFFER_MAX_MS;
+	    __android_log_print(ANDROID_LOG_INFO,"liblossless","underrun, buffering %d ms from now on", ctx->buf_ms);
+	}
+	ctx->pace_ms = ctx->buf_ms;
+}
+
+int audio_start(msm_ctx *ctx, int channels, int samplerate) {
+
+    int frame = channels * 2, conf;
+
+    if(!ctx) return LIBLOSSLESS_ERR_NOCTX;
+    if(!ctx->sink) return 0;
+    if(!ctx->sink->start) return LIBLOSSLESS_ERR_INIT;	// atrack library not loaded
+    ctx->pace_rate = samplerate * frame;
+    ctx->pace_bytes = 0;
+    ctx->pace_t0 = now_ms();
+    ctx->underruns_seen = ctx->underruns;
+    ctx->busy_t0 = now_us();
+    ctx->wakeups = 0;
+    ctx->blocked_us = 0;
+    stats_start(ctx);
+    trace_instant(ctx->trace, TRACE_START, channels, samplerate);
+
+    conf = (int64_t) ctx->pace_rate * ctx->buf_ms / (1000 * BUFFER_PERIODS);
+    if(conf > DEFAULT_CONF_BUFSZ) conf = DEFAULT_CONF_BUFSZ;
+    if(conf < MIN_CONF_FRAMES * frame) conf = MIN_CONF_FRAMES * frame;
+    ctx->conf_size = conf - conf % 4;	// whole frames for 1 or 2 channels
+    ctx->pace_ms = (int64_t) ctx->conf_size * 1000 / ctx->pace_rate;
+
+    ctx->tracks++;
+    if(ctx->status) {
+	status_lock(ctx);
+	ctx->status->tracks = ctx->tracks;
+	ctx->status->pos_ms = 0;
+	ctx->status->pos_time = now_ms();
+	ctx->status->track_time = 0;
+	status_unlock(ctx);
+    }
+    return ctx->sink->start(ctx, channels, samplerate);
+}
+
+/* The end of a track, whether it was stopped (audio_stop()) or played to
+   the end (audio_wait_done(), after the decoder set MSM_STOPPED itself).
+   Only the first call after audio_start() counts. */
+static void track_done(msm_ctx *ctx) {
+	if(!ctx->track_t0 || ctx->track_t1) return;
+	ctx->track_t1 = now_us();
+	trace_instant(ctx->trace, TRACE_STOP, 0, 0);
+	log_power(ctx);
+	log_stats(ctx);
+	status_publish(ctx);
+}
+
 void audio_stop(msm_ctx *ctx) {
 	
     if(!ctx || ctx->state == MSM_STOPPED) return;
@@ -91,38 +482,217 @@ void audio_stop(msm_ctx *ctx) {
     if(ctx->fd >= 0) {
 	close(ctx->fd); ctx->fd = -1;
     }	
-    switch(ctx->mode) {
-        case MODE_DIRECT:
-           msm_stop(ctx); break;
-        case MODE_LIBMEDIA:
-           libmedia_stop(ctx); break;
-        case MODE_CALLBACK:
-           libmediacb_stop(ctx); break;
-        default:
-           break;
-    }
+    if(ctx->sink && ctx->sink->stop) ctx->sink->stop(ctx);
+    /* what is still queued is from where we were, and a seek starts over
+       with audio_start() */
+    if(ctx->sink && ctx->sink->flush) ctx->sink->flush(ctx);
     ctx->state = MSM_STOPPED;	
+    track_done(ctx);
+    pthread_cond_broadcast(&ctx->pacecond);
     pthread_mutex_unlock(&ctx->mutex);
 }
 
 void audio_wait_done(msm_ctx *ctx) {
-    if(ctx->mode == MODE_CALLBACK) libmediacb_wait_done(ctx);	
+    if(!ctx) return;
+    if(ctx->sink && ctx->sink->wait_done) ctx->sink->wait_done(ctx);	
+    track_done(ctx);
 }
 
+/* Called with ctx->mutex held, see pace_write(). */
 ssize_t audio_write(msm_ctx *ctx, const void *buf, size_t count) {
 
+    ssize_t n = 0;
+    int64_t t0;
+    int prev;
+
     if(!ctx) return LIBLOSSLESS_ERR_NOCTX;
-    switch(ctx->mode) {
-        case MODE_DIRECT:
-           return write(ctx->afd, buf, count);
-        case MODE_LIBMEDIA:
-           return libmedia_write(ctx, buf, count);
-	case MODE_CALLBACK:
-           return libmediacb_write(ctx, buf, count);
-        default:
-           break;
+    if(!ctx->sink || !ctx->sink->write) return -1;
+    check_power_saving(ctx);
+    check_underruns(ctx);
+    status_publish(ctx);
+    stats_fill(ctx);
+    prev = ctx->stage;
+    audio_stage(ctx, STAGE_WRITE);
+    t0 = now_us();
+    if(!audio_paced(ctx) || pace_write(ctx)) {
+	n = ctx->sink->write(ctx, buf, count);
+	output_slept(ctx, t0);
+	if(n > 0) ctx->pace_bytes += n;
+	if(ctx->pace_ms < ctx->buf_ms) {
+	    ctx->pace_ms *= 2;
+	    if(ctx->pace_ms > ctx->buf_ms) ctx->pace_ms = ctx->buf_ms;
+	}
     }
-    return -1;
+    ctx->cpu_us = thread_cpu_us() - ctx->cpu_t0;
+    stage_switch(ctx, prev, n);
+    return n;
+}
+
+/* Plays count bytes of PCM in the sink's format straight from buf, which
+   has to stay valid until this returns. Only MODE_CALLBACK can do this: the
+   AudioTrack callback copies from buf itself, so nothing goes through
+   cbbuf. Returns once all of it went to the track or playback was stopped,
+   with the number of bytes played; -1 if the sink can't play a buffer, the
+   caller then has to audio_write() it. */
+ssize_t audio_play_buffer(msm_ctx *ctx, const void *buf, size_t count) {
+
+    ssize_t n;
+    int64_t t0 = now_us();
+    int prev;
+
+    if(!ctx || !ctx->sink || !ctx->sink->play) return -1;
+    prev = ctx->stage;
+    audio_stage(ctx, STAGE_WRITE);
+    n = ctx->sink->play(ctx, buf, count);
+    output_slept(ctx, t0);
+    ctx->cpu_us = thread_cpu_us() - ctx->cpu_t0;
+    stage_switch(ctx, prev, n);
+    return n;
+}
+
+/* Sinks with a pull model (MODE_CALLBACK, MODE_OPENSL) let a decoder store
+   its output straight in the buffers they play from, instead of packing it
+   into wavbuf for audio_write() to copy. audio_obtain_buffer() waits for
+   room and returns where up to *size bytes go, with *size cut to the whole
+   frames that fit in one piece; audio_release_buffer() queues them. NULL
+   means playback was stopped. ctx->mutex needn't be held: a paused output
+   takes no data, so the decoder blocks here anyway. */
+int audio_direct_buffers(msm_ctx *ctx) {
+    return ctx && ctx->sink && ctx->sink->obtain && ctx->sink->release;
+}
+
+unsigned char *audio_obtain_buffer(msm_ctx *ctx, int *size) {
+
+    size_t count = *size;
+    unsigned char *p;
+    int64_t t0;
+    int prev;
+
+	if(!audio_direct_buffers(ctx) || *size <= 0) return 0;
+	stats_fill(ctx);
+	prev = ctx->stage;
+	audio_stage(ctx, STAGE_WRITE);
+	t0 = now_us();
+	p = ctx->sink->obtain(ctx, &count);
+	output_slept(ctx, t0);
+	stage_switch(ctx, prev, 0);
+	*size = p ? (int) count : 0;
+	return p;
+}
+
+void audio_release_buffer(msm_ctx *ctx, int size) {
+    int prev = ctx->stage;
+	check_power_saving(ctx);
+	check_underruns(ctx);
+	audio_stage(ctx, STAGE_WRITE);
+	ctx->sink->release(ctx, size);
+	audio_written_add(ctx, size);
+	ctx->cpu_us = thread_cpu_us() - ctx->cpu_t0;
+	stage_switch(ctx, prev, size);
+	status_publish(ctx);
+}
+
+/* audio_pack_pcm16() into the buffers of audio_obtain_buffer(). Returns
+   the bytes queued, fewer than the samples make if playback was stopped. */
+int audio_write_planar(msm_ctx *ctx, int32_t * const *in, int channels, int samples, int depth) {
+
+    int32_t *part[AUDIO_MAX_CHANNELS];
+    int frame = audio_out_channels(channels) * 2;
+    int done = 0, size, n, k, prev = ctx->stage;
+    unsigned char *p;
+
+	if(channels < 1 || channels > AUDIO_MAX_CHANNELS) return 0;
+	while(done < samples) {
+	    size = (samples - done) * frame;
+	    p = audio_obtain_buffer(ctx, &size);
+	    if(!p) break;
+	    n = size / frame;
+	    for(k = 0; k < channels; k++) part[k] = in[k] + done;
+	    audio_stage(ctx, STAGE_CONVERT);
+	    audio_pack_pcm16(p, part, channels, n, depth);
+	    audio_stage(ctx, prev);
+	    audio_release_buffer(ctx, n * frame);
+	    done += n;
+	}
+	return done * frame;
+}
+
+/* Left and right gains (Q15) of each WAV-order channel when a stream with
+   more than two channels is folded down for the sink: centre and
+   surrounds at -3dB, LFE dropped. Rows are normalised in audio_pack_pcm16()
+   so the sum can't clip. */
+static const uint16_t downmix_gains[AUDIO_MAX_CHANNELS-2][AUDIO_MAX_CHANNELS][2] = {
+   /* L R C */
+   { {32768,0}, {0,32768}, {23170,23170} },
+   /* L R C Cs */
+   { {32768,0}, {0,32768}, {23170,23170}, {23170,23170} },
+   /* L R C Ls Rs */
+   { {32768,0}, {0,32768}, {23170,23170}, {23170,0}, {0,23170} },
+   /* L R C LFE Ls Rs */
+   { {32768,0}, {0,32768}, {23170,23170}, {0,0}, {23170,0}, {0,23170} },
+   /* L R C LFE Ls Rs Cs */
+   { {32768,0}, {0,32768}, {23170,23170}, {0,0}, {23170,0}, {0,23170}, {23170,23170} },
+   /* L R C LFE Ls Rs Lc Rc */
+   { {32768,0}, {0,32768}, {23170,23170}, {0,0}, {23170,0}, {0,23170}, {23170,0}, {0,23170} },
+};
+
+int audio_out_channels(int channels) {
+    return channels > 2 ? 2 : channels;
+}
+
+static inline int32_t scale_to16(int32_t s, int shift) {
+    return shift >= 0 ? s >> shift : s << -shift;
+}
+
+/* Converts planar samples of the given bit depth to the interleaved
+   little-endian 16-bit PCM the sinks take, folding more than two channels
+   down to stereo. Returns the number of bytes stored. */
+int audio_pack_pcm16(unsigned char *out, int32_t * const *in, int channels, int samples, int depth) {
+
+    unsigned char *p = out;
+    int32_t s, gain[AUDIO_MAX_CHANNELS][2];
+    int64_t l, r;
+    int shift = depth - 16;
+    int i, k, sum_l = 0, sum_r = 0;
+
+	if(channels == 1) {
+	    for(i = 0; i < samples; i++) {
+		s = scale_to16(in[0][i], shift);
+		*p++ = s; *p++ = s >> 8;
+	    }
+	    return p - out;
+	}
+	if(channels == 2) {
+	    for(i = 0; i < samples; i++) {
+		s = scale_to16(in[0][i], shift);
+		*p++ = s; *p++ = s >> 8;
+		s = scale_to16(in[1][i], shift);
+		*p++ = s; *p++ = s >> 8;
+	    }
+	    return p - out;
+	}
+	if(channels < 1 || channels > AUDIO_MAX_CHANNELS) return 0;
+
+	for(k = 0; k < channels; k++) {
+	    sum_l += downmix_gains[channels-3][k][0];
+	    sum_r += downmix_gains[channels-3][k][1];
+	}
+	for(k = 0; k < channels; k++) {
+	    gain[k][0] = ((int64_t) downmix_gains[channels-3][k][0] << 15) / sum_l;
+	    gain[k][1] = ((int64_t) downmix_gains[channels-3][k][1] << 15) / sum_r;
+	}
+	for(i = 0; i < samples; i++) {
+	    l = r = 0;
+	    for(k = 0; k < channels; k++) {
+		l += (int64_t) in[k][i] * gain[k][0];
+		r += (int64_t) in[k][i] * gain[k][1];
+	    }
+	    s = scale_to16(l >> 15, shift);
+	    *p++ = s; *p++ = s >> 8;
+	    s = scale_to16(r >> 15, shift);
+	    *p++ = s; *p++ = s >> 8;
+	}
+	return p - out;
 }
 
 JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioStop(JNIEnv *env, jobject obj, msm_ctx *ctx) {
@@ -136,14 +706,25 @@ JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioPause(JNIEnv *env, jo
     if(!ctx || ctx->state != MSM_PLAYING) return false;
     pthread_mutex_lock(&ctx->mutex);
     ctx->state = MSM_PAUSED;
-    if(ctx->mode == MODE_LIBMEDIA || ctx->mode == MODE_CALLBACK) libmedia_pause(ctx);
+    ctx->pace_paused = now_ms();
+    if(ctx->sink && ctx->sink->pause) ctx->sink->pause(ctx);
+    trace_instant(ctx->trace, TRACE_PAUSE, 0, 0);
+    status_publish(ctx);
     return true;		
 }
 
 JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioResume(JNIEnv *env, jobject obj, msm_ctx *ctx) {
+    int64_t paused;
+
     if(!ctx || ctx->state != MSM_PAUSED) return false;
-    if(ctx->mode == MODE_LIBMEDIA || ctx->mode == MODE_CALLBACK ) libmedia_resume(ctx);
+    paused = now_ms() - ctx->pace_paused;
+    ctx->stage_t0 += paused * 1000;	// the decoder is blocked till resumed
+    ctx->track_t0 += paused * 1000;
+    if(ctx->sink && ctx->sink->resume) ctx->sink->resume(ctx);
+    ctx->pace_t0 += paused;
     ctx->state = MSM_PLAYING;	
+    trace_instant(ctx->trace, TRACE_RESUME, 0, 0);
+    status_publish(ctx);
     pthread_mutex_unlock(&ctx->mutex);
     return true;	
 }
@@ -154,12 +735,16 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioGetDuration(JNIEnv *env,
 }
 
 JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioGetCurPosition(JNIEnv *env, jobject obj, msm_ctx *ctx) {
-   if(!ctx || (ctx->state != MSM_PLAYING && ctx->state != MSM_PAUSED) 
-		|| !ctx->channels || !ctx->samplerate || !ctx->bps) return 0;
-   return ctx->written/(ctx->channels * ctx->samplerate * (ctx->bps/8));
+   if(!ctx || (ctx->state != MSM_PLAYING && ctx->state != MSM_PAUSED)) return 0;
+   return audio_position_ms(ctx) / 1000;
+}
+
+JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioGetCurPositionMs(JNIEnv *env, jobject obj, msm_ctx *ctx) {
+   if(!ctx || (ctx->state != MSM_PLAYING && ctx->state != MSM_PAUSED)) return 0;
+   return audio_position_ms(ctx);
 }
 
-JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioInit(JNIEnv *env, jobject obj, msm_ctx *prev_ctx, jint mode) {
+JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioInit(JNIEnv *env, jobject obj, msm_ctx *prev_ctx, jint mode, jint buffer_ms) {
 
   msm_ctx *ctx;
 
@@ -180,8 +765,18 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioInit(JNIEnv *env, jobject
 	pthread_mutex_init(&ctx->cbmutex,0);
 	pthread_cond_init(&ctx->cbcond,0);
 	pthread_cond_init(&ctx->cbdone,0);
+	pthread_cond_init(&ctx->pacecond,0);
+	pthread_mutex_init(&ctx->statmutex,0);
+	status_init(ctx);
+	trace_init(ctx);
     }	
-    ctx->mode = mode;
+    if(ctx->sink && ctx->sink != sink_for_mode(mode & MODE_MASK) && ctx->sink->exit) ctx->sink->exit(ctx);
+    ctx->mode = mode & MODE_MASK;
+    ctx->mode_flags = mode & ~MODE_MASK;
+    ctx->sink = sink_for_mode(ctx->mode);
+    ctx->power_saving_req = -1;
+    ctx->buf_pref_ms = buffer_ms;
+    buffer_policy(ctx);
     ctx->state = MSM_STOPPED;
     ctx->track_time = 0;	
     __android_log_print(ANDROID_LOG_INFO,"liblossless","audio_init: return ctx=%p",ctx);
@@ -192,11 +787,17 @@ JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioExit(JNIEnv *env, job
     if(!ctx) return false;
     __android_log_print(ANDROID_LOG_INFO,"liblossless","audio_exit: ctx=%p",ctx);
     audio_stop(ctx);
+    if(ctx->sink && ctx->sink->exit) ctx->sink->exit(ctx);
+    free(ctx->outfile);
     if(ctx->fd >= 0)  close(ctx->fd);
     pthread_mutex_destroy(&ctx->mutex);
     pthread_mutex_destroy(&ctx->cbmutex);
     pthread_cond_destroy(&ctx->cbcond);
     pthread_cond_destroy(&ctx->cbdone);
+    pthread_cond_destroy(&ctx->pacecond);
+    status_exit(ctx);
+    pthread_mutex_destroy(&ctx->statmutex);
+    trace_exit(ctx);
     if(ctx->wavbuf) free(ctx->wavbuf);
     if(ctx->cbbuf) free(ctx->cbbuf);		
     free(ctx);	
@@ -209,9 +810,108 @@ JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetVolume(JNIEnv *env
     pthread_mutex_lock(&ctx->mutex);
     ioctl(ctx->afd, AUDIO_SET_VOLUME, vol);
     pthread_mutex_unlock(&ctx->mutex);
-    return true;	
+    return true;
 }
 
+/* The descriptor of the status block (see status.c), -1 if there is none.
+   It stays ctx's, the caller has to dup() it to pass it on. */
+JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioGetStatusFd(JNIEnv *env, jobject obj, msm_ctx *ctx) {
+    return ctx && ctx->status ? ctx->status_fd : -1;
+}
+
+/* What only the service knows about the track, for the status block */
+JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetTrackInfo(JNIEnv *env, jobject obj, msm_ctx *ctx,
+		jint index, jint offset, jint track_start, jint track_len) {
+    if(!ctx || !ctx->status) return false;
+    status_lock(ctx);
+    ctx->status->index = index;
+    ctx->status->offset = offset;
+    ctx->status->track_start = track_start;
+    ctx->status->track_len = track_len;
+    status_unlock(ctx);
+    return true;
+}
+
+/* Statistics of the track playing, or of the last one once stopped: an
+   array indexed by STAT_*, see audio_stage(). null without a context. */
+JNIEXPORT jintArray JNICALL Java_net_avs234_AndLessSrv_audioGetStats(JNIEnv *env, jobject obj, msm_ctx *ctx) {
+
+  jint st[STATS];
+  jintArray ret;
+
+    if(!ctx) return 0;
+    stats_get(ctx, st);
+    ret = (*env)->NewIntArray(env, STATS);
+    if(!ret) return 0;
+    (*env)->SetIntArrayRegion(env, ret, 0, STATS, st);
+    return ret;
+}
+
+/* Writes the trace ring to jfile, see trace.c. Returns the number of
+   events written, -1 on error. */
+JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioTraceDump(JNIEnv *env, jobject obj, msm_ctx *ctx, jstring jfile) {
+
+  const char *file;
+  int n;
+
+    if(!ctx || !jfile) return -1;
+    file = (*env)->GetStringUTFChars(env,jfile,NULL);
+    if(!file) return -1;
+    n = trace_dump(ctx, file);
+    (*env)->ReleaseStringUTFChars(env,jfile,file);
+    return n;
+}
+
+/* Switches the power saving mode of the track playing, for the screen
+   going off or on; the next track gets it from audioInit(). The decoder
+   takes it up on its next write, see check_power_saving(). */
+JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetPowerSaving(JNIEnv *env, jobject obj, msm_ctx *ctx, jboolean on) {
+    if(!ctx) return false;
+    __sync_lock_test_and_set(&ctx->power_saving_req, on ? 1 : 0);
+    pthread_cond_broadcast(&ctx->pacecond);
+    return true;
+}
+
+/* Mirrors the trace to ATrace while on; false if there is no ATrace. */
+JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetAtrace(JNIEnv *env, jobject obj, msm_ctx *ctx, jboolean on) {
+    if(!ctx) return false;
+    return trace_set_atrace(ctx, on) ? true : false;
+}
+
+/* MODE_FILE writes each track to jfile, replacing what was there. */
+JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetOutputFile(JNIEnv *env, jobject obj, msm_ctx *ctx, jstring jfile) {
+
+  const char *file;
+  char *copy;
+
+    if(!ctx || !jfile) return false;
+    file = (*env)->GetStringUTFChars(env,jfile,NULL);
+    if(!file) return false;
+    copy = strdup(file);
+    (*env)->ReleaseStringUTFChars(env,jfile,file);
+    if(!copy) return false;
+    free(ctx->outfile);
+    ctx->outfile = copy;
+    return true;
+}
+
+
+/* Kernel comparisons. With audioSetSimd(false) the decoders use their
+   plain C kernels instead of the NEON ones (WavPack decorrelation and
+   shifts, the ALAC adaptive FIR, Musepack synthesis and PCM conversion),
+   from the next block on. Playing the same files with MODE_NULL both ways
+   and comparing the decode times of audioGetStats() shows what each port
+   gains on the device at hand, with real input. The ARMv5TE/ARMv6 and
+   assembly versions are picked at build time and aren't switched. The
+   service exposes this as set_simd(); bench/kernelbench.c times the
+   kernels one by one instead, on fixed input. */
+volatile int audio_simd = 1;
+
+JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetSimd(JNIEnv *env, jobject obj, jboolean on) {
+    __android_log_print(ANDROID_LOG_INFO,"liblossless","SIMD kernels %s", on ? "on" : "off");
+    audio_simd = on ? 1 : 0;
+    return true;
+}
 
 static void *libhandle = 0;
 
@@ -235,10 +935,34 @@ static jboolean libinit(JNIEnv *env, jobject obj, jint sdk) {
 		libmedia_start = (typeof(libmedia_start)) dlsym(libhandle,"libmedia_start");
 		libmedia_stop = (typeof(libmedia_stop)) dlsym(libhandle,"libmedia_stop");
 		libmedia_write = (typeof(libmedia_write)) dlsym(libhandle,"libmedia_write");
+		libmedia_played = (typeof(libmedia_played)) dlsym(libhandle,"libmedia_played");
 		libmediacb_start = (typeof(libmediacb_start)) dlsym(libhandle,"libmediacb_start");
 		libmediacb_stop = (typeof(libmediacb_stop)) dlsym(libhandle,"libmediacb_stop");
 		libmediacb_write = (typeof(libmediacb_write)) dlsym(libhandle,"libmediacb_write");
                 libmediacb_wait_done = (typeof(libmediacb_wait_done)) dlsym(libhandle,"libmediacb_wait_done");
+		libmediacb_play = (typeof(libmediacb_play)) dlsym(libhandle,"libmediacb_play");
+		libmediacb_obtain = (typeof(libmediacb_obtain)) dlsym(libhandle,"libmediacb_obtain");
+		libmediacb_release = (typeof(libmediacb_release)) dlsym(libhandle,"libmediacb_release");
+		libmediacb_latency = (typeof(libmediacb_latency)) dlsym(libhandle,"libmediacb_latency");
+
+		libmedia_sink.start = libmedia_start;
+		libmedia_sink.stop = libmedia_stop;
+		libmedia_sink.write = libmedia_write;
+		libmedia_sink.pause = libmedia_pause;
+		libmedia_sink.resume = libmedia_resume;
+		libmedia_sink.played = libmedia_played;
+
+		libmediacb_sink.start = libmediacb_start;
+		libmediacb_sink.stop = libmediacb_stop;
+		libmediacb_sink.write = libmediacb_write;
+		libmediacb_sink.pause = libmedia_pause;
+		libmediacb_sink.resume = libmedia_resume;
+		libmediacb_sink.played = libmedia_played;
+		libmediacb_sink.wait_done = libmediacb_wait_done;
+		libmediacb_sink.latency = libmediacb_latency;
+		libmediacb_sink.obtain = libmediacb_obtain;
+		libmediacb_sink.release = libmediacb_release;
+		libmediacb_sink.play = libmediacb_play;
 	}
     }
     __android_log_print(ANDROID_LOG_INFO,"liblossless","libinit: handle=%p",libhandle);
@@ -251,12 +975,33 @@ static jboolean libexit(JNIEnv *env, jobject obj) {
     if(libhandle) {
         ret = dlclose(libhandle) ? 0 : 1;
         libhandle = 0;
+        libmedia_sink = (audio_sink) { .name = "libmedia" };
+        libmediacb_sink = (audio_sink) { .name = "libmedia callback" };
     }
     return ret;
 }
 
 static JavaVM *gvm;
 static jobject giface; 
+static jclass gclass;			// AndLessSrv
+static jmethodID mid_track_len;		// its updateTrackLen(), looked up once by JNI_OnLoad()
+static jmethodID mid_event;		// and onEvent()
+
+/* The calling thread's JNIEnv, attaching the thread to the VM if it has to;
+   *attached then tells the caller to detach it when done. */
+static JNIEnv *thread_env(bool *attached) {
+
+    JNIEnv *env;
+
+	*attached = false;
+	if((*gvm)->GetEnv(gvm, (void **)&env, JNI_VERSION_1_4) == JNI_OK) return env;
+	if((*gvm)->AttachCurrentThread(gvm, &env, NULL) != JNI_OK) {
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","AttachCurrentThread FAILED");
+	    return NULL;
+	}
+	*attached = true;
+	return env;
+}
 
 void update_track_time(JNIEnv *env, jobject obj, int time) {
 //     jclass cls = (*env)->GetObjectClass(env, obj);
@@ -270,55 +1015,77 @@ void update_track_time(JNIEnv *env, jobject obj, int time) {
      }
     (*env)->CallStaticVoidMethod(env,cls,mid,time);
 #else
-     jclass cls;
-     jmethodID mid;
-     bool attached = false;
+     bool attached;
      JNIEnv *envy;
-	if((*gvm)->GetEnv(gvm, (void **)&envy, JNI_VERSION_1_4) != JNI_OK) {
-            __android_log_print(ANDROID_LOG_ERROR,"liblossless","update_track_time: GetEnv FAILED");
-	     if((*gvm)->AttachCurrentThread(gvm, &envy, NULL) != JNI_OK) {
-            	__android_log_print(ANDROID_LOG_ERROR,"liblossless","AttachCurrentThread FAILED");
-		     return;
-	     }	
-	     attached = true;	
-	}
-	cls = (*envy)->GetObjectClass(envy,giface);
-	if(!cls) {
-          __android_log_print(ANDROID_LOG_ERROR,"liblossless","failed to get class iface");
-	  return;  	
-	}
-        mid = (*env)->GetStaticMethodID(envy, cls, "updateTrackLen", "(I)V");
-        if(mid == NULL) {
-	  __android_log_print(ANDROID_LOG_ERROR,"liblossless","Cannot find java callback to update time");
-         return; 
-        }
-	(*envy)->CallStaticVoidMethod(envy,cls,mid,time);
+	if(!mid_track_len || !(envy = thread_env(&attached))) return;
+	(*envy)->CallStaticVoidMethod(envy,gclass,mid_track_len,time);
 	if(attached) (*gvm)->DetachCurrentThread(gvm);
 #endif
 }
 
+/* Pushes an AUDIO_EVENT_* to AndLessSrv.onEvent(), which only hands it on
+   to its own thread: this runs on the decoder thread, on binder threads in
+   audioPause()/audioResume(), and with ctx->mutex held. */
+static void audio_event(int event, int arg) {
+
+    bool attached;
+    JNIEnv *env;
+
+	if(!mid_event || !(env = thread_env(&attached))) return;
+	(*env)->CallStaticVoidMethod(env,gclass,mid_event,event,arg);
+	if((*env)->ExceptionCheck(env)) (*env)->ExceptionClear(env);
+	if(attached) (*gvm)->DetachCurrentThread(gvm);
+}
 
 #ifdef AVSREMOTE
+/* The xxxPlay() functions as registered below, which report errors with
+   an AUDIO_EVENT_ERROR besides returning them; all but retry, which the
+   service takes to try the file with MediaPlayer. */
+#define PLAY_EVENTS(name, retry) \
+static jint name##_events(JNIEnv *env, jobject obj, msm_ctx *ctx, jstring file, jint start) { \
+    jint ret = Java_net_avs234_AndLessSrv_##name(env, obj, ctx, file, start); \
+	if(ret && ret != retry) audio_event(AUDIO_EVENT_ERROR, ret); \
+	return ret; \
+}
+
+PLAY_EVENTS(alacPlay, LIBLOSSLESS_ERR_FORMAT)
+PLAY_EVENTS(flacPlay, 0)
+PLAY_EVENTS(apePlay, 0)
+PLAY_EVENTS(wavPlay, 0)
+PLAY_EVENTS(wvPlay, 0)
+PLAY_EVENTS(mpcPlay, 0)
+
 static const char *classPathName = "net/avs234/AndLessSrv";
 
 static JNINativeMethod methods[] = {
- { "audioInit", "(II)I", (void *) Java_net_avs234_AndLessSrv_audioInit },
+ { "audioInit", "(III)I", (void *) Java_net_avs234_AndLessSrv_audioInit },
  { "audioExit", "(I)Z", (void *) Java_net_avs234_AndLessSrv_audioExit },
  { "audioStop", "(I)Z", (void *) Java_net_avs234_AndLessSrv_audioStop },
  { "audioPause", "(I)Z", (void *) Java_net_avs234_AndLessSrv_audioPause },
  { "audioResume", "(I)Z", (void *) Java_net_avs234_AndLessSrv_audioResume },
  { "audioGetDuration", "(I)I", (void *) Java_net_avs234_AndLessSrv_audioGetDuration },
  { "audioGetCurPosition", "(I)I", (void *) Java_net_avs234_AndLessSrv_audioGetCurPosition },
+ { "audioGetCurPositionMs", "(I)I", (void *) Java_net_avs234_AndLessSrv_audioGetCurPositionMs },
  { "audioSetVolume", "(II)Z", (void *) Java_net_avs234_AndLessSrv_audioSetVolume },
- { "alacPlay", "(ILjava/lang/String;I)I", (void *) Java_net_avs234_AndLessSrv_alacPlay },
- { "flacPlay", "(ILjava/lang/String;I)I", (void *) Java_net_avs234_AndLessSrv_flacPlay },
- { "apePlay", "(ILjava/lang/String;I)I", (void *) Java_net_avs234_AndLessSrv_apePlay },
- { "wavPlay", "(ILjava/lang/String;I)I", (void *) Java_net_avs234_AndLessSrv_wavPlay },
- { "wvPlay", "(ILjava/lang/String;I)I", (void *) Java_net_avs234_AndLessSrv_wvPlay },
- { "mpcPlay", "(ILjava/lang/String;I)I", (void *) Java_net_avs234_AndLessSrv_mpcPlay },
+ { "audioSetOutputFile", "(ILjava/lang/String;)Z", (void *) Java_net_avs234_AndLessSrv_audioSetOutputFile },
+ { "audioGetStatusFd", "(I)I", (void *) Java_net_avs234_AndLessSrv_audioGetStatusFd },
+ { "audioSetTrackInfo", "(IIIII)Z", (void *) Java_net_avs234_AndLessSrv_audioSetTrackInfo },
+ { "audioGetStats", "(I)[I", (void *) Java_net_avs234_AndLessSrv_audioGetStats },
+ { "audioTraceDump", "(ILjava/lang/String;)I", (void *) Java_net_avs234_AndLessSrv_audioTraceDump },
+ { "audioSetAtrace", "(IZ)Z", (void *) Java_net_avs234_AndLessSrv_audioSetAtrace },
+ { "audioSetSimd", "(Z)Z", (void *) Java_net_avs234_AndLessSrv_audioSetSimd },
+ { "audioSetPowerSaving", "(IZ)Z", (void *) Java_net_avs234_AndLessSrv_audioSetPowerSaving },
+ { "alacPlay", "(ILjava/lang/String;I)I", (void *) alacPlay_events },
+ { "flacPlay", "(ILjava/lang/String;I)I", (void *) flacPlay_events },
+ { "apePlay", "(ILjava/lang/String;I)I", (void *) apePlay_events },
+ { "wavPlay", "(ILjava/lang/String;I)I", (void *) wavPlay_events },
+ { "wvPlay", "(ILjava/lang/String;I)I", (void *) wvPlay_events },
+ { "mpcPlay", "(ILjava/lang/String;I)I", (void *) mpcPlay_events },
  { "extractFlacCUE", "(Ljava/lang/String;)[I", (void *) extract_flac_cue },
  { "wvDuration", "(ILjava/lang/String;)I", (void *) Java_com_skvalex_amplayer_wvDuration },
  { "apeDuration", "(ILjava/lang/String;)I", (void *) Java_com_skvalex_amplayer_apeDuration },
+ { "wvArchive", "(Ljava/lang/String;I)I", (void *) Java_net_avs234_AndLessSrv_wvArchive },
+ { "wvArchiveCancel", "()Z", (void *) Java_net_avs234_AndLessSrv_wvArchiveCancel },
  { "libInit", "(I)Z", (void *) libinit },
  { "libExit", "()Z", (void *) libexit },
 
@@ -360,6 +1127,17 @@ jint JNI_OnLoad(JavaVM* vm, void* reserved) {
         __android_log_print(ANDROID_LOG_ERROR,"liblossless","Registration failed for '%s'", classPathName);
         return -1;
       }
+      gclass = (*env)->NewGlobalRef(env,clazz);
+      mid_track_len = (*env)->GetStaticMethodID(env, clazz, "updateTrackLen", "(I)V");
+      if(!mid_track_len) {
+        __android_log_print(ANDROID_LOG_ERROR,"liblossless","Cannot find java callback to update time");
+	(*env)->ExceptionClear(env);
+      }
+      mid_event = (*env)->GetStaticMethodID(env, clazz, "onEvent", "(II)V");
+      if(!mid_event) {
+        __android_log_print(ANDROID_LOG_ERROR,"liblossless","Cannot find java callback for events");
+	(*env)->ExceptionClear(env);
+      }
     
    return JNI_VERSION_1_4;
 }
@@ -1,6 +1,8 @@
 
 #include <jni.h>
 #include <pthread.h>
+#include <stdint.h>
+#include "trace.h"
 
 #ifndef _MAIN_H_INCLUDED
 #define _MAIN_H_INCLUDED
@@ -9,6 +11,46 @@
 extern "C" {
 #endif
 
+// Where a decoder's time goes, see audio_stage()
+enum {
+   STAGE_DECODE = 0,		// anything not below
+   STAGE_READ,			// audio_read()
+   STAGE_CONVERT,		// packing into the sink's 16-bit PCM
+   STAGE_WRITE,			// in the sink, waiting for room included
+   STAGES
+};
+
+// What audioGetStats() returns, the same as AndLessSrv.STAT_*
+enum {
+   STAT_UNDERRUNS = 0,		// reported by the sink
+   STAT_LAGS,			// MODE_CALLBACK: callbacks the ring couldn't fill
+   STAT_FILL_MIN, STAT_FILL_AVG,	// queued audio before each write, percent of buf_ms
+   STAT_DECODE_MS, STAT_READ_MS, STAT_CONVERT_MS, STAT_WRITE_MS,	// STAGE_*
+   STAT_CPU_MS,			// decoder thread CPU time
+   STAT_AUDIO_MS,		// audio decoded
+   STAT_ELAPSED_MS,
+   STAT_SPEED,			// times realtime x100, leaving out STAGE_WRITE
+   STATS
+};
+
+/* Playback status the UI process maps read only, see status.c. The layout
+   is repeated in AndLessSrv.StatusBlock, keep the two in step. */
+typedef struct audio_status {
+   volatile int32_t seq;	// odd while being updated
+   int32_t state;		// MSM_*
+   int32_t tracks;		// bumped by every audio_start()
+   int32_t pos_ms;		// position in the file at pos_time, see audioGetCurPositionMs()
+   int64_t pos_time;		// CLOCK_MONOTONIC ms, SystemClock.uptimeMillis() in Java
+   int32_t track_time;		// seconds, 0 if not known yet
+   int32_t underruns;
+   int32_t buf_ms;
+   int32_t samplerate, channels, bps;
+   // set by the service with audioSetTrackInfo()
+   int32_t index;		// playlist position
+   int32_t offset;		// seconds added to pos_ms
+   int32_t track_start, track_len;	// seconds, the CUE track within the file
+} audio_status;
+
 typedef struct {
    enum _msm_state_t {
         MSM_STOPPED = 0,
@@ -21,31 +63,124 @@ typedef struct {
 	MODE_LIBMEDIA = 2,
 	MODE_CALLBACK = 3,
 //	MODE_JAVA = 4
+	MODE_OPENSL = 5,
+	MODE_AAUDIO = 6,
+	MODE_NULL = 7,
+	MODE_FILE = 8
    } mode; 	 	
+   int  mode_flags;	// MODE_FLAG_*, passed to audioInit() along with the mode
+   const struct audio_sink *sink;	// see sink.h
+   void *sink_data;	// the sink's own state
+   char *outfile;	// MODE_FILE: WAV file to write, see audioSetOutputFile()
    int afd, fd, conf_size, cbbuf_size;
    unsigned char *wavbuf, *cbbuf;
    void *track; 	
    int  track_time;	
-   int  channels, samplerate, bps, written;
+   int  channels, samplerate, bps;
+   int64_t written;	// bytes of 16-bit PCM handed to the output since the track started, see audio_written()
    int  cbstart, cbend;	
    pthread_mutex_t mutex, cbmutex;
    pthread_cond_t  cbcond, cbdone;
+   // MODE_CALLBACK: PCM the callback copies from directly instead of cbbuf, see audio_play_buffer()
+   const unsigned char *cbsrc;
+   size_t cbsrc_size, cbsrc_pos;
+   // write pacing, see audio_write()
+   pthread_cond_t pacecond;
+   int  pace_ms;		// how far ahead of the output a decoder may run now, ramps up to buf_ms
+   int  pace_rate;		// output bytes per second
+   int64_t pace_bytes;		// written since pace_t0
+   int64_t pace_t0, pace_paused;	// CLOCK_MONOTONIC ms
+   // buffering policy, see audio_start()
+   int  buf_ms;			// audio the output is kept filled with, grows on underruns
+   int  buf_req_ms;		// what buffer_policy() made of buf_pref_ms
+   int  buf_pref_ms;		// audioInit()'s buffer_ms, 0 for the default of the mode
+   volatile int power_saving_req;	// audioSetPowerSaving() for the decoder thread, -1 if none
+   int  underruns;		// reported by the sink, bumped from its own threads
+   int  underruns_seen;
+   int  cblow;			// MODE_CALLBACK: a full ring drains to this many bytes before the decoder goes on
+   // power figures of the current track, logged by audio_stop()
+   int  wakeups;		// times the decoder slept on the output
+   int64_t busy_t0, blocked_us;	// track start (CLOCK_MONOTONIC us), time spent asleep
+   // statistics of the current or last track, see audioGetStats()
+   int  stage;			// STAGE_* the decoder thread is in
+   int64_t stage_t0;		// since when, CLOCK_MONOTONIC us
+   int64_t stage_us[STAGES];
+   int64_t track_t0, track_t1;	// CLOCK_MONOTONIC us, track_t1 is 0 while playing
+   int64_t cpu_t0, cpu_us;	// decoder thread CPU time, refreshed on every write
+   int  underruns_t0;		// ctx->underruns when the track started
+   int  lags;			// bumped by the AudioTrack callback
+   int  fill_min, fill_n;
+   int64_t fill_sum;
+   // shared with the UI, see status.c
+   audio_status *status;
+   int  status_fd;
+   pthread_mutex_t statmutex;
+   int  tracks;			// bumped by every audio_start()
+   int  event_state, event_tracks;	// as last pushed to AndLessSrv.onEvent(), see status_publish()
+   // see trace.c
+   trace_ring *trace;
+   int  atrace;			// mirror to ATrace
+   int  atrace_open;		// a section of the decoder thread is open
 } msm_ctx;
 
+/* ctx->written is bumped on the decoder thread or in the AudioTrack
+   callback and read on the binder threads, and a plain 64-bit access can
+   tear on 32-bit ARM. */
+static inline int64_t audio_written(msm_ctx *ctx) {
+	return __sync_fetch_and_add(&ctx->written, 0);
+}
+
+static inline void audio_written_add(msm_ctx *ctx, int64_t n) {
+	__sync_fetch_and_add(&ctx->written, n);
+}
+
+static inline void audio_written_reset(msm_ctx *ctx) {
+	__sync_fetch_and_and(&ctx->written, 0);
+}
+
 extern int  audio_start(msm_ctx *ctx, int channels, int samplerate);
 extern void audio_stop(msm_ctx *ctx);
 extern ssize_t  audio_write(msm_ctx *ctx, const void *buf, size_t count);
+extern ssize_t  audio_play_buffer(msm_ctx *ctx, const void *buf, size_t count);
+extern int  audio_direct_buffers(msm_ctx *ctx);
+extern unsigned char *audio_obtain_buffer(msm_ctx *ctx, int *size);
+extern void audio_release_buffer(msm_ctx *ctx, int size);
+extern int  audio_write_planar(msm_ctx *ctx, int32_t * const *in, int channels, int samples, int depth);
 extern void update_track_time(JNIEnv *env, jobject obj, int time);
 extern void audio_wait_done(msm_ctx *ctx);
+extern int  audio_out_channels(int channels);
+extern int  audio_pack_pcm16(unsigned char *out, int32_t * const *in, int channels, int samples, int depth);
+extern void audio_stage(msm_ctx *ctx, int stage);
+extern ssize_t  audio_read(msm_ctx *ctx, void *buf, size_t count);
+extern int  status_init(msm_ctx *ctx);
+extern void status_exit(msm_ctx *ctx);
+extern int  trace_init(msm_ctx *ctx);
+extern void trace_exit(msm_ctx *ctx);
+extern int  trace_dump(msm_ctx *ctx, const char *path);
+extern int  trace_set_atrace(msm_ctx *ctx, int on);
+extern void trace_atrace_stage(msm_ctx *ctx, int stage);
+extern void trace_atrace_fill(msm_ctx *ctx, int ms);
+extern void status_lock(msm_ctx *ctx);
+extern void status_unlock(msm_ctx *ctx);
 
-extern JNIEXPORT jint	  JNICALL Java_net_avs234_AndLessSrv_audioInit(JNIEnv *env, jobject obj, msm_ctx *prev_ctx, jint mode);
+extern JNIEXPORT jint	  JNICALL Java_net_avs234_AndLessSrv_audioInit(JNIEnv *env, jobject obj, msm_ctx *prev_ctx, jint mode, jint buffer_ms);
 extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioExit(JNIEnv *env, jobject obj, msm_ctx *ctx);
 extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioPause(JNIEnv *env, jobject obj, msm_ctx *ctx);
 extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioResume(JNIEnv *env, jobject obj, msm_ctx *ctx);
 extern JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioGetDuration(JNIEnv *env, jobject obj, msm_ctx *ctx);
 extern JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioGetCurPosition(JNIEnv *env, jobject obj, msm_ctx *ctx);
+extern JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioGetCurPositionMs(JNIEnv *env, jobject obj, msm_ctx *ctx);
 extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetVolume(JNIEnv *env, jobject obj, msm_ctx *ctx, jint vol);
 extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioStop(JNIEnv *env, jobject obj, msm_ctx *ctx);
+extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetOutputFile(JNIEnv *env, jobject obj, msm_ctx *ctx, jstring jfile);
+extern JNIEXPORT jintArray JNICALL Java_net_avs234_AndLessSrv_audioGetStats(JNIEnv *env, jobject obj, msm_ctx *ctx);
+extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetSimd(JNIEnv *env, jobject obj, jboolean on);
+extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetPowerSaving(JNIEnv *env, jobject obj, msm_ctx *ctx, jboolean on);
+extern JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioTraceDump(JNIEnv *env, jobject obj, msm_ctx *ctx, jstring jfile);
+extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetAtrace(JNIEnv *env, jobject obj, msm_ctx *ctx, jboolean on);
+extern JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_audioGetStatusFd(JNIEnv *env, jobject obj, msm_ctx *ctx);
+extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_audioSetTrackInfo(JNIEnv *env, jobject obj, msm_ctx *ctx,
+		jint index, jint offset, jint track_start, jint track_len);
 
 extern JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wavPlay(JNIEnv *env, jobject obj, msm_ctx* ctx, jstring jfile, jint start);
 extern JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_alacPlay(JNIEnv *env, jobject obj, msm_ctx* ctx, jstring jfile, jint start);
@@ -59,15 +194,47 @@ extern JNIEXPORT jintArray JNICALL extract_flac_cue(JNIEnv *env, jobject obj, js
 extern JNIEXPORT jint JNICALL Java_com_skvalex_amplayer_wvDuration(JNIEnv *env, jobject obj, msm_ctx* ctx, jstring jfile);
 extern JNIEXPORT jint JNICALL Java_com_skvalex_amplayer_apeDuration(JNIEnv *env, jobject obj, msm_ctx* ctx, jstring jfile);
 
+extern JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wvArchive(JNIEnv *env, jobject obj, jstring jdir, jint threads);
+extern JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_wvArchiveCancel(JNIEnv *env, jobject obj);
+
+
+// audioInit() mode is one of MODE_* or'ed with these
+#define MODE_MASK			0xff
+#define MODE_FLAG_LOW_LATENCY		0x100	// little buffering; AAudio: low latency instead of power saving
+#define MODE_FLAG_POWER_SAVING		0x200	// seconds of buffering, for screen-off playback
+
+// Output buffering in ms of audio when audioInit() is given none, by profile;
+// power saving buffers at least BUFFER_POWER_SAVING_MS in any case
+#define BUFFER_DEFAULT_MS		1000
+#define BUFFER_LOW_LATENCY_MS		100
+#define BUFFER_POWER_SAVING_MS		4000
+#define BUFFER_MIN_MS			20
+#define BUFFER_MAX_MS			8000	// growth on underruns stops here
+// A write (ctx->conf_size) is this fraction of the buffer, within MIN_CONF_FRAMES..DEFAULT_CONF_BUFSZ
+#define BUFFER_PERIODS			4
+#define MIN_CONF_FRAMES			256
+// MODE_FLAG_POWER_SAVING: once the buffer is full the decoder sleeps until
+// only this percentage of it is left, then decodes the rest in one burst
+#define BURST_LOW_WATER			25
+// How often a playing decoder refreshes the position in ctx->status
+#define STATUS_PERIOD_MS		250
+
+// Events pushed to AndLessSrv.onEvent(event, arg), keep in step with its EVENT_*
+#define AUDIO_EVENT_STATE		1	// arg: MSM_*
+#define AUDIO_EVENT_TRACK		2	// arg: audio_status.tracks
+#define AUDIO_EVENT_UNDERRUN		3	// arg: underruns so far
+#define AUDIO_EVENT_ERROR		4	// arg: LIBLOSSLESS_ERR_* an xxxPlay() returned
+
+// Most channels a decoder may hand to audio_pack_pcm16()
+#define AUDIO_MAX_CHANNELS		8
 
+// Largest write, decoders collect this much in wavbuf
 #define DEFAULT_CONF_BUFSZ 		(4800*4*4)
 #define DEFAULT_WAV_BUFSZ 		(128*1024)
 
 // For initialization of AudioTrack in MODE_CALLBACK, affects the track latency
 #define DEFAULT_ATRACK_CONF_BUFSZ 	DEFAULT_CONF_BUFSZ
 
-// Callback buffer size, must be larger than (but shouldn't be a multiple of) DEFAULT*CONF_BUFSZ
-#define DEFAULT_CB_BUFSZ		(8*DEFAULT_CONF_BUFSZ+2)
 
 #define LIBLOSSLESS_ERR_NOCTX		1
 #define LIBLOSSLESS_ERR_INV_PARM	2
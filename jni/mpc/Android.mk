@@ -4,13 +4,23 @@ include $(CLEAR_VARS)
 LOCAL_MODULE := mpc 
 
 #LOCAL_SRC_FILES += synth_filter_arm.S huffsv46.c huffsv7.c idtag.c main.c mpc_decoder.c requant.c streaminfo.c synth_filter.c 
-LOCAL_SRC_FILES += huffsv46.c  huffsv7.c  idtag.c  main.c  mpc_decoder.c requant.c  streaminfo.c  synth_filter.c
-LOCAL_CFLAGS += -O2 -Wall -DBUILD_STANDALONE -DCPU_ARM -finline-functions -fPIC -I. -DMPC_LITTLE_ENDIAN -DMPC_FIXED_POINT 
+LOCAL_SRC_FILES += huffman.c huffsv46.c  huffsv7.c  idtag.c  main.c  mpc_decoder.c requant.c  streaminfo.c  synth_filter.c
+LOCAL_CFLAGS += -O2 -Wall -DBUILD_STANDALONE -finline-functions -fPIC -I. -DMPC_LITTLE_ENDIAN -DMPC_FIXED_POINT 
 #-DDBG_TIME 
 #-DMPC_FIXED_POINT
 
+LOCAL_CFLAGS += -DCPU_ARM
 LOCAL_ARM_MODE := arm
-
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+# NEON is optional on v7, synth_filter_neon.c checks for it at runtime
+LOCAL_SRC_FILES += synth_filter_neon.c.neon
+LOCAL_CFLAGS += -DMPC_NEON
+LOCAL_STATIC_LIBRARIES += cpufeatures
+endif
 
 include $(BUILD_STATIC_LIBRARY)
 # include $(BUILD_SHARED_LIBRARY)
+
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+$(call import-module,android/cpufeatures)
+endif
@@ -0,0 +1,118 @@
+/*
+  Copyright (c) 2005, The Musepack Development Team
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+  * Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above
+  copyright notice, this list of conditions and the following
+  disclaimer in the documentation and/or other materials provided
+  with the distribution.
+
+  * Neither the name of the The Musepack Development Team nor the
+  names of its contributors may be used to endorse or promote
+  products derived from this software without specific prior
+  written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/// \file huffman.c
+/// Lookup tables for huffman decoding.
+///
+/// The HuffmanTyp tables are sorted by Code, largest first, and the
+/// decoder takes the first entry whose Code is not above the next 32 bits
+/// of the stream. The lookup tables hold the result of that search for
+/// every value of the next MPC_HUFFMAN_LUT_BITS bits, so that a symbol
+/// costs one or two loads instead of a walk down the table. They are
+/// built from the same tables the first time a stream is opened.
+
+#include <mpcdec/mpcdec.h>
+#include <mpcdec/huffman.h>
+
+static HuffmanLut   lut_pool [MPC_HUFFMAN_LUT_POOL];
+static mpc_uint32_t lut_used;
+
+static const HuffmanTyp *
+huffman_find(const HuffmanTyp *Table, mpc_uint32_t code)
+{
+    // the last entry of every table has Code 0
+    while (code < Table->Code) Table++;
+    return Table;
+}
+
+// number of bits needed after the first level for codes starting with prefix
+static mpc_uint32_t
+huffman_sub_bits(const HuffmanTyp *Table, mpc_uint32_t prefix)
+{
+    const mpc_uint32_t span = 1u << (32 - MPC_HUFFMAN_LUT_BITS);
+    const HuffmanTyp *e = huffman_find(Table, prefix);
+    mpc_uint32_t length = e->Length;
+
+    // codes sharing the prefix come right before the one matching it
+    while (e > Table && (e - 1)->Code - prefix < span) {
+        e--;
+        if (e->Length > length) length = e->Length;
+    }
+
+    return length - MPC_HUFFMAN_LUT_BITS;
+}
+
+const HuffmanLut *
+mpc_huffman_build_lut(const HuffmanTyp *Table)
+{
+    const mpc_uint32_t first = 1u << MPC_HUFFMAN_LUT_BITS;
+    const mpc_uint32_t shift = 32 - MPC_HUFFMAN_LUT_BITS;
+    HuffmanLut *Lut = lut_pool + lut_used;
+    mpc_uint32_t size = first, i, j;
+
+    if (lut_used + first > MPC_HUFFMAN_LUT_POOL)
+        return NULL;
+
+    for (i = 0; i < first; i++) {
+        const mpc_uint32_t prefix = i << shift;
+        const HuffmanTyp *e = huffman_find(Table, prefix);
+        mpc_uint32_t bits;
+
+        if (e->Length <= MPC_HUFFMAN_LUT_BITS) {
+            Lut[i].Value  = e->Value;
+            Lut[i].Length = (unsigned char) e->Length;
+            Lut[i].Bits   = 0;
+            continue;
+        }
+
+        bits = huffman_sub_bits(Table, prefix);
+        if (lut_used + size + (1u << bits) > MPC_HUFFMAN_LUT_POOL)
+            return NULL;
+
+        Lut[i].Value  = (mpc_int16_t) size;
+        Lut[i].Length = 0;
+        Lut[i].Bits   = (unsigned char) bits;
+
+        for (j = 0; j < (1u << bits); j++) {
+            e = huffman_find(Table, prefix | (j << (shift - bits)));
+            Lut[size + j].Value  = e->Value;
+            Lut[size + j].Length = (unsigned char) e->Length;
+            Lut[size + j].Bits   = 0;
+        }
+        size += 1u << bits;
+    }
+
+    lut_used += size;
+    return Lut;
+}
@@ -72,4 +72,35 @@ const HuffmanTyp*   mpc_table_SampleHuff [18] = {
 	NULL,mpc_table_Entropie_1,mpc_table_Entropie_2,mpc_table_Entropie_3,mpc_table_Entropie_4,mpc_table_Entropie_5,mpc_table_Entropie_6,mpc_table_Entropie_7,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL,NULL
 };
 
+const HuffmanLut*   mpc_lut_SCFI_Bundle;
+const HuffmanLut*   mpc_lut_DSCF_Entropie;
+const HuffmanLut*   mpc_lut_Region_A;
+const HuffmanLut*   mpc_lut_Region_B;
+const HuffmanLut*   mpc_lut_Region_C;
+const HuffmanLut*   mpc_lut_SampleHuff [18];
+
+mpc_bool_t mpc_huffman_init_sv6(void)
+{
+    static mpc_bool_t done = FALSE;
+    int i;
+
+    if (done) return TRUE;
+
+    if (!(mpc_lut_SCFI_Bundle   = mpc_huffman_build_lut(mpc_table_SCFI_Bundle))   ||
+        !(mpc_lut_DSCF_Entropie = mpc_huffman_build_lut(mpc_table_DSCF_Entropie)) ||
+        !(mpc_lut_Region_A      = mpc_huffman_build_lut(mpc_table_Region_A))      ||
+        !(mpc_lut_Region_B      = mpc_huffman_build_lut(mpc_table_Region_B))      ||
+        !(mpc_lut_Region_C      = mpc_huffman_build_lut(mpc_table_Region_C)))
+        return FALSE;
+
+    // entries without a table stay NULL, as in mpc_table_SampleHuff
+    for (i = 0; i < 18; i++)
+        if (mpc_table_SampleHuff[i] &&
+            !(mpc_lut_SampleHuff[i] = mpc_huffman_build_lut(mpc_table_SampleHuff[i])))
+            return FALSE;
+
+    done = TRUE;
+    return TRUE;
+}
+
 #endif //#ifdef MPC_SUPPORT_SV456
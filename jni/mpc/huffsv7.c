@@ -79,3 +79,29 @@ const HuffmanTyp*   mpc_table_HuffQ [2] [8] = {
 	{0,mpc_table_HuffQ1[0],mpc_table_HuffQ2[0],mpc_table_HuffQ3[0],mpc_table_HuffQ4[0],mpc_table_HuffQ5[0],mpc_table_HuffQ6[0],mpc_table_HuffQ7[0]},
 	{0,mpc_table_HuffQ1[1],mpc_table_HuffQ2[1],mpc_table_HuffQ3[1],mpc_table_HuffQ4[1],mpc_table_HuffQ5[1],mpc_table_HuffQ6[1],mpc_table_HuffQ7[1]},
 };
+
+const HuffmanLut*   mpc_lut_HuffHdr;
+const HuffmanLut*   mpc_lut_HuffSCFI;
+const HuffmanLut*   mpc_lut_HuffDSCF;
+const HuffmanLut*   mpc_lut_HuffQ [2] [8];
+
+mpc_bool_t mpc_huffman_init_sv7(void)
+{
+    static mpc_bool_t done = FALSE;
+    int i, n;
+
+    if (done) return TRUE;
+
+    if (!(mpc_lut_HuffHdr  = mpc_huffman_build_lut(mpc_table_HuffHdr))  ||
+        !(mpc_lut_HuffSCFI = mpc_huffman_build_lut(mpc_table_HuffSCFI)) ||
+        !(mpc_lut_HuffDSCF = mpc_huffman_build_lut(mpc_table_HuffDSCF)))
+        return FALSE;
+
+    for (i = 0; i < 2; i++)
+        for (n = 1; n < 8; n++)
+            if (!(mpc_lut_HuffQ[i][n] = mpc_huffman_build_lut(mpc_table_HuffQ[i][n])))
+                return FALSE;
+
+    done = TRUE;
+    return TRUE;
+}
@@ -24,7 +24,6 @@
 #include <fcntl.h>
 #include <stdint.h>
 #include <pthread.h>
-#include <sys/time.h>
 #include <sys/stat.h>
 #include <unistd.h>
 #include <fcntl.h>
@@ -43,7 +42,7 @@
 static mpc_int32_t read_impl(void *data, void *ptr, mpc_int32_t size)
 {
     msm_ctx *ctx = (msm_ctx *)data;
-    return (mpc_int32_t) read(ctx->fd,ptr,size);
+    return (mpc_int32_t) audio_read(ctx,ptr,size);
 }
 
 static mpc_bool_t seek_impl(void *data, mpc_int32_t offset)
@@ -74,7 +73,137 @@ static mpc_bool_t canseek_impl(void *data)
 }
 
 
+// Seek tables are kept across mpcPlay() calls, so that seeking in a file
+// played before costs one read. A missing table is built by a thread of its
+// own, reading a dup() of the file with pread() so that it doesn't move the
+// player's file offset.
+#define SEEK_CACHE_SIZE 4
 
+typedef struct {
+    dev_t dev;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    mpc_seek_table table;
+    mpc_streaminfo info;
+    mpc_reader reader;
+    int fd;
+    off_t offset;
+    pthread_t thread;
+    int running;
+    volatile int cancel;
+    unsigned int used;
+} seek_cache_entry;
+
+static seek_cache_entry seek_cache[SEEK_CACHE_SIZE];
+static pthread_mutex_t seek_cache_mutex = PTHREAD_MUTEX_INITIALIZER;
+static unsigned int seek_cache_clock;
+
+static mpc_int32_t scan_read_impl(void *data, void *ptr, mpc_int32_t size)
+{
+    seek_cache_entry *e = (seek_cache_entry *)data;
+    ssize_t n = pread(e->fd, ptr, size, e->offset);
+    if(n > 0) e->offset += n;
+    return (mpc_int32_t) n;
+}
+
+static mpc_bool_t scan_seek_impl(void *data, mpc_int32_t offset)
+{
+    seek_cache_entry *e = (seek_cache_entry *)data;
+    e->offset = offset;
+    return 1;
+}
+
+static mpc_int32_t scan_tell_impl(void *data)
+{
+    return (mpc_int32_t) ((seek_cache_entry *)data)->offset;
+}
+
+static mpc_int32_t scan_get_size_impl(void *data)
+{
+    return (mpc_int32_t) ((seek_cache_entry *)data)->size;
+}
+
+static void *seek_cache_build(void *arg)
+{
+    seek_cache_entry *e = (seek_cache_entry *)arg;
+    mpc_seek_table_build(&e->table, &e->reader, &e->info, &e->cancel);
+    close(e->fd);
+    e->fd = -1;
+    return 0;
+}
+
+// called with seek_cache_mutex held
+static void seek_cache_drop(seek_cache_entry *e)
+{
+    if(e->running) {
+        e->cancel = 1;
+        pthread_join(e->thread, 0);
+        e->running = 0;
+    }
+    mpc_seek_table_free(&e->table);
+}
+
+// Returns the seek table of the file open at fd, starting to build it if
+// there is none yet. NULL if there can't be one.
+static mpc_seek_table *seek_cache_get(int fd, mpc_streaminfo *info)
+{
+    struct stat st;
+    seek_cache_entry *e = 0;
+    mpc_seek_table table;
+    int i;
+
+    if(fstat(fd, &st) != 0) return 0;
+
+    pthread_mutex_lock(&seek_cache_mutex);
+    for(i = 0; i < SEEK_CACHE_SIZE; i++) {
+        seek_cache_entry *c = &seek_cache[i];
+        if(c->table.bits && c->dev == st.st_dev && c->ino == st.st_ino &&
+           c->size == st.st_size && c->mtime == st.st_mtime) {
+            c->used = ++seek_cache_clock;
+            pthread_mutex_unlock(&seek_cache_mutex);
+            return &c->table;
+        }
+        // reuse a free slot, or the one unused for longest
+        if(!e || (e->table.bits && (!c->table.bits || c->used < e->used))) e = c;
+    }
+    if(!mpc_seek_table_init(&table, info)) {
+        mpc_seek_table_free(&table);
+        pthread_mutex_unlock(&seek_cache_mutex);
+        return 0;
+    }
+    seek_cache_drop(e);
+
+    e->table = table;
+    e->fd = dup(fd);
+    if(e->fd < 0) goto fail;
+    e->offset = 0;
+    e->info = *info;
+    e->reader.read = scan_read_impl;
+    e->reader.seek = scan_seek_impl;
+    e->reader.tell = scan_tell_impl;
+    e->reader.get_size = scan_get_size_impl;
+    e->reader.canseek = canseek_impl;
+    e->reader.data = e;
+    e->cancel = 0;
+    if(pthread_create(&e->thread, 0, seek_cache_build, e) != 0) {
+        close(e->fd);
+        goto fail;
+    }
+    e->running = 1;
+    e->dev = st.st_dev;
+    e->ino = st.st_ino;
+    e->size = st.st_size;
+    e->mtime = st.st_mtime;
+    e->used = ++seek_cache_clock;
+    pthread_mutex_unlock(&seek_cache_mutex);
+    return &e->table;
+
+fail:
+    mpc_seek_table_free(&e->table);
+    pthread_mutex_unlock(&seek_cache_mutex);
+    return 0;
+}
 
 #if 0
 static int  shift_signed(MPC_SAMPLE_FORMAT val, int shift) {
@@ -120,27 +249,40 @@ mpc_bool_t WriteInt(unsigned int p_val, unsigned p_width_bits) {
 
 
 mpc_decoder decoder;
+static MPC_SAMPLE_FORMAT sample_buffer[MPC_DECODER_BUFFER_LENGTH];
+
+/* Converts count samples straight into the track's buffer, see
+   audio_obtain_buffer(). Returns the number queued. */
+static int write_direct(msm_ctx *ctx, const MPC_SAMPLE_FORMAT *in, int count) {
+
+    int done = 0, size;
+    unsigned char *p;
+
+    while (done < count) {
+        size = (count - done) * 2;
+        p = audio_obtain_buffer(ctx, &size);
+        if (!p) break;
+        audio_stage(ctx, STAGE_CONVERT);
+        mpc_samples_to_pcm16(in + done, (mpc_int16_t *) p, size / 2);
+        audio_stage(ctx, STAGE_DECODE);
+        audio_release_buffer(ctx, size);
+        done += size / 2;
+    }
+    return done;
+}
 
 JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_mpcPlay(JNIEnv *env, jobject obj, msm_ctx* ctx, jstring jfile, jint start) {
     const char *file = (*env)->GetStringUTFChars(env,jfile,NULL);
     int i, n;
-    struct timeval tstart, tstop, ttmp;
-    useconds_t  tminwrite;
-
-    int prev_written = 0;
 
-#ifdef DBG_TIME
-        uint64_t total_tminwrite = 0, total_ttmp = 0, total_sleep = 0;
-        int writes = 0, fails = 0;
-#endif
 
 
     unsigned int status;
     mpc_reader reader;
     mpc_streaminfo info;
     unsigned char *p;
-    MPC_SAMPLE_FORMAT *pp; 
     int bytes_to_write = 0;	
+    int direct;
 
     if(!ctx) return LIBLOSSLESS_ERR_NOCTX;
 
@@ -177,11 +319,14 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_mpcPlay(JNIEnv *env, jobject o
 	close(ctx->fd);
 	return LIBLOSSLESS_ERR_FORMAT;
     }	
+    mpc_decoder_set_seek_table(&decoder, seek_cache_get(ctx->fd, &info));
     if (start)	{
+	int64_t seek_t0 = trace_now_us();
 	if(!mpc_decoder_seek_sample(&decoder,start*info.sample_freq)) {
 	    close(ctx->fd);	
 	    return LIBLOSSLESS_ERR_OFFSET;
 	}
+	trace_span(ctx->trace, TRACE_SEEK, seek_t0, start, 0);
     }	
 
     i = audio_start(ctx, info.channels, info.sample_freq);
@@ -193,7 +338,8 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_mpcPlay(JNIEnv *env, jobject o
     ctx->channels = info.channels;
     ctx->samplerate = info.sample_freq;
     ctx->bps = 16;
-    ctx->written = 0;
+    audio_written_reset(ctx);
+    direct = audio_direct_buffers(ctx);
 	
     pthread_mutex_lock(&ctx->mutex);
     ctx->state = MSM_PLAYING;
@@ -203,12 +349,11 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_mpcPlay(JNIEnv *env, jobject o
     update_track_time(env,obj,ctx->track_time);
 
 
-//   gettimeofday(&tstart,0);
 
 // MPC_DECODER_BUFFER_LENGTH = 36*32*2*4 = 9216
     while (ctx->state != MSM_STOPPED) {
 
-        status = mpc_decoder_decode(&decoder,(MPC_SAMPLE_FORMAT *) (ctx->wavbuf+bytes_to_write), NULL, NULL);
+        status = mpc_decoder_decode(&decoder, sample_buffer, NULL, NULL);
 
         if (status == 0) break; /* end of file reached */
 
@@ -222,26 +367,14 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_mpcPlay(JNIEnv *env, jobject o
              return LIBLOSSLESS_ERR_DECODE;
         } 
 
-	pp = (MPC_SAMPLE_FORMAT *) (ctx->wavbuf+bytes_to_write);
-	p = ctx->wavbuf+bytes_to_write;
-        for (n = 0; n < status*2; n++, p += 2) {
-#ifndef MPC_FIXED_POINT
-	   int fscale = 1 << 15;
-#endif
-          int val;
-#ifdef MPC_FIXED_POINT
-	    val = (pp[n] >> 14);
-#else
-	    val = pp[n] * fscale;	
-#endif
-            if (val < -32768)  val = -32768;
-            else if (val > 32767) val = 32767;
-            p[0] = (unsigned char) ((unsigned int)val & 0xFF);
-            p[1] = (unsigned char) ((((unsigned int)val) >> 8) & 0xFF);
-	    	
+        if (direct) {   /* MODE_CALLBACK: no wavbuf, see write_direct() */
+            if (write_direct(ctx, sample_buffer, status*2) < status*2) break;
+            continue;
         }
 
-
+	audio_stage(ctx, STAGE_CONVERT);
+	mpc_samples_to_pcm16(sample_buffer, (mpc_int16_t *) (ctx->wavbuf+bytes_to_write), status*2);
+	audio_stage(ctx, STAGE_DECODE);
 
        n = status*4;
 
@@ -249,25 +382,6 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_mpcPlay(JNIEnv *env, jobject o
             p = ctx->wavbuf; n += bytes_to_write;
 
 
-            if(prev_written && ctx->mode != MODE_CALLBACK) {
-                tminwrite = ((uint64_t)((uint64_t)(prev_written))*1000000)/((uint64_t)(info.sample_freq*4));
-                gettimeofday(&tstop,0);
-                timersub(&tstop,&tstart,&ttmp);
-                if(tminwrite > ttmp.tv_usec) {
-                        usleep((tminwrite-ttmp.tv_usec)/4);
-#ifdef DBG_TIME
-                        total_sleep += (tminwrite - ttmp.tv_usec)/4;
-#endif
-                }
-#ifdef DBG_TIME
-                else fails++;
-                writes++;
-                total_tminwrite += tminwrite;
-                total_ttmp += ttmp.tv_usec;
-#endif
-            }
-            if(ctx->mode != MODE_CALLBACK) gettimeofday(&tstart,0);
-	    prev_written = 0;	
             do {
                 pthread_mutex_lock(&ctx->mutex);
                 i = audio_write(ctx,p,ctx->conf_size);
@@ -275,14 +389,6 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_mpcPlay(JNIEnv *env, jobject o
                     ctx->state = MSM_STOPPED;
                     pthread_mutex_unlock(&ctx->mutex);
                     if(ctx->fd == -1) {
-#ifdef DBG_TIME
-        if(writes && (writes > fails)) {
-           int x = (int) (total_tminwrite/writes);
-           int y = (int) (total_ttmp/writes);
-           int z = (int) (total_sleep/(writes-fails));
-            __android_log_print(ANDROID_LOG_INFO,"liblossless","tminwrite %d ttmp %d sleep %d fails %d writes %d", x,y,z,fails,writes);
-        } else __android_log_print(ANDROID_LOG_INFO,"liblossless","fails %d writes %d", fails,writes);
-#endif
 			return 0; // we were stopped from the main thread
 		    }	
                     close(ctx->fd); ctx->fd = -1;
@@ -291,8 +397,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_mpcPlay(JNIEnv *env, jobject o
                 pthread_mutex_unlock(&ctx->mutex);
                 n -= ctx->conf_size;
                 p += ctx->conf_size;
-		prev_written += ctx->conf_size;
-		ctx->written += i;
+		audio_written_add(ctx, i);
             } while(n >= ctx->conf_size);
             memmove(ctx->wavbuf,p,n);
             bytes_to_write = n;
@@ -309,14 +414,6 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_mpcPlay(JNIEnv *env, jobject o
         pthread_mutex_unlock(&ctx->mutex);
     }
 
-#ifdef DBG_TIME
-        if(writes && (writes > fails)) {
-           int x = (int) (total_tminwrite/writes);
-           int y = (int) (total_ttmp/writes);
-           int z = (int) (total_sleep/(writes-fails));
-            __android_log_print(ANDROID_LOG_INFO,"liblossless","tminwrite %d ttmp %d sleep %d fails %d writes %d", x,y,z,fails,writes);
-        } else __android_log_print(ANDROID_LOG_INFO,"liblossless","fails %d writes %d", fails,writes);
-#endif
       audio_wait_done(ctx);
 
    return 0;
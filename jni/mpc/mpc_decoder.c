@@ -41,20 +41,20 @@
 #include <mpcdec/huffman.h>
 
 //SV7 tables
-extern const HuffmanTyp*   mpc_table_HuffQ [2] [8];
-extern const HuffmanTyp    mpc_table_HuffHdr  [10];
-extern const HuffmanTyp    mpc_table_HuffSCFI [ 4];
-extern const HuffmanTyp    mpc_table_HuffDSCF [16];
+extern const HuffmanLut*   mpc_lut_HuffQ [2] [8];
+extern const HuffmanLut*   mpc_lut_HuffHdr;
+extern const HuffmanLut*   mpc_lut_HuffSCFI;
+extern const HuffmanLut*   mpc_lut_HuffDSCF;
 
 
 #ifdef MPC_SUPPORT_SV456
 //SV4/5/6 tables
-extern const HuffmanTyp*   mpc_table_SampleHuff [18];
-extern const HuffmanTyp    mpc_table_SCFI_Bundle   [ 8];
-extern const HuffmanTyp    mpc_table_DSCF_Entropie [13];
-extern const HuffmanTyp    mpc_table_Region_A [16];
-extern const HuffmanTyp    mpc_table_Region_B [ 8];
-extern const HuffmanTyp    mpc_table_Region_C [ 4];
+extern const HuffmanLut*   mpc_lut_SampleHuff [18];
+extern const HuffmanLut*   mpc_lut_SCFI_Bundle;
+extern const HuffmanLut*   mpc_lut_DSCF_Entropie;
+extern const HuffmanLut*   mpc_lut_Region_A;
+extern const HuffmanLut*   mpc_lut_Region_B;
+extern const HuffmanLut*   mpc_lut_Region_C;
 
 #endif
 
@@ -179,10 +179,10 @@ mpc_decoder_bitstream_read(mpc_decoder *d, const mpc_uint32_t bits)
     return out & ((1 << bits) - 1);
 }
 
-// basic huffman decoding routine
+// basic huffman decoding routine, see huffman.c for the tables
 // works with maximum lengths up to max_length
 static mpc_int32_t
-mpc_decoder_huffman_decode(mpc_decoder *d, const HuffmanTyp *Table,
+mpc_decoder_huffman_decode(mpc_decoder *d, const HuffmanLut *Lut,
                            const mpc_uint32_t max_length)
 {
     // load preview and decode
@@ -190,24 +190,26 @@ mpc_decoder_huffman_decode(mpc_decoder *d, const HuffmanTyp *Table,
     if (32 - d->pos < max_length)
         code |= SWAP(d->Speicher[(d->Zaehler + 1) & MEMMASK]) >> (32 - d->pos);
 
-    while (code < Table->Code) Table++;
+    const HuffmanLut *e = &Lut[code >> (32 - MPC_HUFFMAN_LUT_BITS)];
+    if (!e->Length)
+        e = &Lut[e->Value + ((code << MPC_HUFFMAN_LUT_BITS) >> (32 - e->Bits))];
 
     // set the new position within bitstream without performing a dummy-read
-    if ((d->pos += Table->Length) >= 32) {
+    if ((d->pos += e->Length) >= 32) {
         d->pos -= 32;
         d->dword = SWAP(d->Speicher[d->Zaehler = (d->Zaehler + 1) & MEMMASK]);
         d->WordsRead++;
     }
 
-    return Table->Value;
+    return e->Value;
 }
 
 // decode SCFI-bundle (sv4,5,6)
 static void
-mpc_decoder_scfi_bundle_read(mpc_decoder *d, const HuffmanTyp* Table,
+mpc_decoder_scfi_bundle_read(mpc_decoder *d, const HuffmanLut* Lut,
                              mpc_int32_t* SCFI, mpc_bool_t* DSCF)
 {
-    mpc_uint32_t value = mpc_decoder_huffman_decode(d, Table, 6);
+    mpc_uint32_t value = mpc_decoder_huffman_decode(d, Lut, 6);
 
     *SCFI = value >> 1;
     *DSCF = value &  1;
@@ -627,9 +629,9 @@ mpc_decoder_read_bitstream_sv6(mpc_decoder *d, mpc_bool_t seeking)
 {
     mpc_int32_t n,k;
     mpc_int32_t Max_used_Band=0;
-    const HuffmanTyp *Table;
-    const HuffmanTyp *x1;
-    const HuffmanTyp *x2;
+    const HuffmanLut *Lut;
+    const HuffmanLut *x1;
+    const HuffmanLut *x2;
     mpc_int32_t *L;
     mpc_int32_t *R;
     mpc_int32_t *ResL = d->Res_L;
@@ -640,15 +642,15 @@ mpc_decoder_read_bitstream_sv6(mpc_decoder *d, mpc_bool_t seeking)
     ResR = d->Res_R;
     for (n=0; n <= d->Max_Band; ++n, ++ResL, ++ResR)
     {
-        if      (n<11)           Table = mpc_table_Region_A;
-        else if (n>=11 && n<=22) Table = mpc_table_Region_B;
-        else /*if (n>=23)*/      Table = mpc_table_Region_C;
+        if      (n<11)           Lut = mpc_lut_Region_A;
+        else if (n>=11 && n<=22) Lut = mpc_lut_Region_B;
+        else /*if (n>=23)*/      Lut = mpc_lut_Region_C;
 
-        *ResL = Q_res[n][mpc_decoder_huffman_decode(d, Table, 14)];
+        *ResL = Q_res[n][mpc_decoder_huffman_decode(d, Lut, 14)];
         if (d->MS_used) {
             d->MS_Flag[n] = mpc_decoder_bitstream_read(d,  1);
         }
-        *ResR = Q_res[n][mpc_decoder_huffman_decode(d, Table, 14)];
+        *ResR = Q_res[n][mpc_decoder_huffman_decode(d, Lut, 14)];
 
         // only perform the following procedure up to the maximum non-zero subband
         if (*ResL || *ResR) Max_used_Band = n;
@@ -658,8 +660,8 @@ mpc_decoder_read_bitstream_sv6(mpc_decoder *d, mpc_bool_t seeking)
     ResL = d->Res_L;
     ResR = d->Res_R;
     for (n=0; n<=Max_used_Band; ++n, ++ResL, ++ResR) {
-        if (*ResL) mpc_decoder_scfi_bundle_read(d, mpc_table_SCFI_Bundle, &(d->SCFI_L[n]), &(d->DSCF_Flag_L[n]));
-        if (*ResR) mpc_decoder_scfi_bundle_read(d, mpc_table_SCFI_Bundle, &(d->SCFI_R[n]), &(d->DSCF_Flag_R[n]));
+        if (*ResL) mpc_decoder_scfi_bundle_read(d, mpc_lut_SCFI_Bundle, &(d->SCFI_L[n]), &(d->DSCF_Flag_L[n]));
+        if (*ResR) mpc_decoder_scfi_bundle_read(d, mpc_lut_SCFI_Bundle, &(d->SCFI_R[n]), &(d->DSCF_Flag_R[n]));
     }
 
     /***************************** SCFI ********************************/
@@ -677,24 +679,24 @@ mpc_decoder_read_bitstream_sv6(mpc_decoder *d, mpc_bool_t seeking)
                 switch (d->SCFI_L[n])
                 {
                 case 3:
-                    L[0] = L[2] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
+                    L[0] = L[2] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
                     L[1] = L[0];
                     L[2] = L[1];
                     break;
                 case 1:
-                    L[0] = L[2] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
-                    L[1] = L[0] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
+                    L[0] = L[2] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
+                    L[1] = L[0] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
                     L[2] = L[1];
                     break;
                 case 2:
-                    L[0] = L[2] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
+                    L[0] = L[2] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
                     L[1] = L[0];
-                    L[2] = L[1] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
+                    L[2] = L[1] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
                     break;
                 case 0:
-                    L[0] = L[2] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
-                    L[1] = L[0] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
-                    L[2] = L[1] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
+                    L[0] = L[2] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
+                    L[1] = L[0] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
+                    L[2] = L[1] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
                     break;
                 default:
                     return;
@@ -744,24 +746,24 @@ mpc_decoder_read_bitstream_sv6(mpc_decoder *d, mpc_bool_t seeking)
                 switch (d->SCFI_R[n])
                 {
                 case 3:
-                    R[0] = R[2] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
+                    R[0] = R[2] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
                     R[1] = R[0];
                     R[2] = R[1];
                     break;
                 case 1:
-                    R[0] = R[2] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
-                    R[1] = R[0] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
+                    R[0] = R[2] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
+                    R[1] = R[0] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
                     R[2] = R[1];
                     break;
                 case 2:
-                    R[0] = R[2] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
+                    R[0] = R[2] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
                     R[1] = R[0];
-                    R[2] = R[1] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
+                    R[2] = R[1] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
                     break;
                 case 0:
-                    R[0] = R[2] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
-                    R[1] = R[0] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
-                    R[2] = R[1] + mpc_decoder_huffman_decode(d,  mpc_table_DSCF_Entropie, 6);
+                    R[0] = R[2] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
+                    R[1] = R[0] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
+                    R[2] = R[1] + mpc_decoder_huffman_decode(d,  mpc_lut_DSCF_Entropie, 6);
                     break;
                 default:
                     return;
@@ -815,8 +817,8 @@ mpc_decoder_read_bitstream_sv6(mpc_decoder *d, mpc_bool_t seeking)
     for (n=0; n <= Max_used_Band; ++n, ++ResL, ++ResR)
     {
         // setting pointers
-        x1 = mpc_table_SampleHuff[*ResL];
-        x2 = mpc_table_SampleHuff[*ResR];
+        x1 = mpc_lut_SampleHuff[*ResL];
+        x2 = mpc_lut_SampleHuff[*ResR];
         L = d->Q[n].L;
         R = d->Q[n].R;
 
@@ -849,7 +851,7 @@ mpc_decoder_read_bitstream_sv7(mpc_decoder *d, mpc_bool_t seeking)
 
     mpc_int32_t n,k;
     mpc_int32_t Max_used_Band=0;
-    const HuffmanTyp *Table;
+    const HuffmanLut *Lut;
     mpc_int32_t idx;
     mpc_int32_t *L   ,*R;
     mpc_int32_t *ResL,*ResR;
@@ -870,10 +872,10 @@ mpc_decoder_read_bitstream_sv7(mpc_decoder *d, mpc_bool_t seeking)
     ++ResL; ++ResR; // increase pointers
     for (n=1; n <= d->Max_Band; ++n, ++ResL, ++ResR)
     {
-        idx   = mpc_decoder_huffman_decode(d, mpc_table_HuffHdr, 9);
+        idx   = mpc_decoder_huffman_decode(d, mpc_lut_HuffHdr, 9);
         *ResL = (idx!=4) ? *(ResL-1) + idx : (int) mpc_decoder_bitstream_read(d, 4);
 
-        idx   = mpc_decoder_huffman_decode(d, mpc_table_HuffHdr, 9);
+        idx   = mpc_decoder_huffman_decode(d, mpc_lut_HuffHdr, 9);
         *ResR = (idx!=4) ? *(ResR-1) + idx : (int) mpc_decoder_bitstream_read(d, 4);
 
         if (d->MS_used && !(*ResL==0 && *ResR==0)) {
@@ -891,8 +893,8 @@ mpc_decoder_read_bitstream_sv7(mpc_decoder *d, mpc_bool_t seeking)
     ResL  = d->Res_L;
     ResR  = d->Res_R;
     for (n=0; n <= Max_used_Band; ++n, ++L, ++R, ++ResL, ++ResR) {
-        if (*ResL) *L = mpc_decoder_huffman_decode(d, mpc_table_HuffSCFI, 3);
-        if (*ResR) *R = mpc_decoder_huffman_decode(d, mpc_table_HuffSCFI, 3);
+        if (*ResL) *L = mpc_decoder_huffman_decode(d, mpc_lut_HuffSCFI, 3);
+        if (*ResR) *R = mpc_decoder_huffman_decode(d, mpc_lut_HuffSCFI, 3);
     }
 
     /**************************** SCF/DSCF ****************************/
@@ -906,31 +908,31 @@ mpc_decoder_read_bitstream_sv7(mpc_decoder *d, mpc_bool_t seeking)
             switch (d->SCFI_L[n])
             {
             case 1:
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 L[0] = (idx!=8) ? L[2] + idx : (int) mpc_decoder_bitstream_read(d, 6);
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 L[1] = (idx!=8) ? L[0] + idx : (int) mpc_decoder_bitstream_read(d, 6);
                 L[2] = L[1];
                 break;
             case 3:
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 L[0] = (idx!=8) ? L[2] + idx : (int) mpc_decoder_bitstream_read(d, 6);
                 L[1] = L[0];
                 L[2] = L[1];
                 break;
             case 2:
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 L[0] = (idx!=8) ? L[2] + idx : (int) mpc_decoder_bitstream_read(d, 6);
                 L[1] = L[0];
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 L[2] = (idx!=8) ? L[1] + idx : (int) mpc_decoder_bitstream_read(d, 6);
                 break;
             case 0:
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 L[0] = (idx!=8) ? L[2] + idx : (int) mpc_decoder_bitstream_read(d, 6);
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 L[1] = (idx!=8) ? L[0] + idx : (int) mpc_decoder_bitstream_read(d, 6);
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 L[2] = (idx!=8) ? L[1] + idx : (int) mpc_decoder_bitstream_read(d, 6);
                 break;
             default:
@@ -948,31 +950,31 @@ mpc_decoder_read_bitstream_sv7(mpc_decoder *d, mpc_bool_t seeking)
             switch (d->SCFI_R[n])
             {
             case 1:
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 R[0] = (idx!=8) ? R[2] + idx : (int) mpc_decoder_bitstream_read(d, 6);
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 R[1] = (idx!=8) ? R[0] + idx : (int) mpc_decoder_bitstream_read(d, 6);
                 R[2] = R[1];
                 break;
             case 3:
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 R[0] = (idx!=8) ? R[2] + idx : (int) mpc_decoder_bitstream_read(d, 6);
                 R[1] = R[0];
                 R[2] = R[1];
                 break;
             case 2:
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 R[0] = (idx!=8) ? R[2] + idx : (int) mpc_decoder_bitstream_read(d, 6);
                 R[1] = R[0];
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 R[2] = (idx!=8) ? R[1] + idx : (int) mpc_decoder_bitstream_read(d, 6);
                 break;
             case 0:
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 R[0] = (idx!=8) ? R[2] + idx : (int) mpc_decoder_bitstream_read(d, 6);
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 R[1] = (idx!=8) ? R[0] + idx : (int) mpc_decoder_bitstream_read(d, 6);
-                idx  = mpc_decoder_huffman_decode(d, mpc_table_HuffDSCF, 6);
+                idx  = mpc_decoder_huffman_decode(d, mpc_lut_HuffDSCF, 6);
                 R[2] = (idx!=8) ? R[1] + idx : (int) mpc_decoder_bitstream_read(d, 6);
                 break;
             default:
@@ -1014,40 +1016,40 @@ mpc_decoder_read_bitstream_sv7(mpc_decoder *d, mpc_bool_t seeking)
             L += 36;// increase pointer
             break;
         case 1:
-            Table = mpc_table_HuffQ[mpc_decoder_bitstream_read(d, 1)][1];
+            Lut = mpc_lut_HuffQ[mpc_decoder_bitstream_read(d, 1)][1];
             for (k=0; k<12; ++k)
             {
-                idx = mpc_decoder_huffman_decode(d, Table, 9);
+                idx = mpc_decoder_huffman_decode(d, Lut, 9);
                 *L++ = idx30[idx];
                 *L++ = idx31[idx];
                 *L++ = idx32[idx];
             }
             break;
         case 2:
-            Table = mpc_table_HuffQ[mpc_decoder_bitstream_read(d, 1)][2];
+            Lut = mpc_lut_HuffQ[mpc_decoder_bitstream_read(d, 1)][2];
             for (k=0; k<18; ++k)
             {
-                idx = mpc_decoder_huffman_decode(d, Table, 10);
+                idx = mpc_decoder_huffman_decode(d, Lut, 10);
                 *L++ = idx50[idx];
                 *L++ = idx51[idx];
             }
             break;
         case 3:
         case 4:
-            Table = mpc_table_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResL];
+            Lut = mpc_lut_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResL];
             for (k=0; k<36; ++k)
-                *L++ = mpc_decoder_huffman_decode(d, Table, 5);
+                *L++ = mpc_decoder_huffman_decode(d, Lut, 5);
             break;
         case 5:
-            Table = mpc_table_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResL];
+            Lut = mpc_lut_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResL];
             for (k=0; k<36; ++k)
-                *L++ = mpc_decoder_huffman_decode(d, Table, 8);
+                *L++ = mpc_decoder_huffman_decode(d, Lut, 8);
             break;
         case 6:
         case 7:
-            Table = mpc_table_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResL];
+            Lut = mpc_lut_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResL];
             for (k=0; k<36; ++k)
-                *L++ = mpc_decoder_huffman_decode(d, Table, 14);
+                *L++ = mpc_decoder_huffman_decode(d, Lut, 14);
             break;
         case 8: case 9: case 10: case 11: case 12: case 13: case 14: case 15: case 16: case 17:
             tmp = Dc[*ResL];
@@ -1074,40 +1076,40 @@ mpc_decoder_read_bitstream_sv7(mpc_decoder *d, mpc_bool_t seeking)
                 R += 36;// increase pointer
                 break;
             case 1:
-                Table = mpc_table_HuffQ[mpc_decoder_bitstream_read(d, 1)][1];
+                Lut = mpc_lut_HuffQ[mpc_decoder_bitstream_read(d, 1)][1];
                 for (k=0; k<12; ++k)
                 {
-                    idx = mpc_decoder_huffman_decode(d, Table, 9);
+                    idx = mpc_decoder_huffman_decode(d, Lut, 9);
                     *R++ = idx30[idx];
                     *R++ = idx31[idx];
                     *R++ = idx32[idx];
                 }
                 break;
             case 2:
-                Table = mpc_table_HuffQ[mpc_decoder_bitstream_read(d, 1)][2];
+                Lut = mpc_lut_HuffQ[mpc_decoder_bitstream_read(d, 1)][2];
                 for (k=0; k<18; ++k)
                 {
-                    idx = mpc_decoder_huffman_decode(d, Table, 10);
+                    idx = mpc_decoder_huffman_decode(d, Lut, 10);
                     *R++ = idx50[idx];
                     *R++ = idx51[idx];
                 }
                 break;
             case 3:
             case 4:
-                Table = mpc_table_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResR];
+                Lut = mpc_lut_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResR];
                 for (k=0; k<36; ++k)
-                    *R++ = mpc_decoder_huffman_decode(d, Table, 5);
+                    *R++ = mpc_decoder_huffman_decode(d, Lut, 5);
                 break;
             case 5:
-                Table = mpc_table_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResR];
+                Lut = mpc_lut_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResR];
                 for (k=0; k<36; ++k)
-                    *R++ = mpc_decoder_huffman_decode(d, Table, 8);
+                    *R++ = mpc_decoder_huffman_decode(d, Lut, 8);
                 break;
             case 6:
             case 7:
-                Table = mpc_table_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResR];
+                Lut = mpc_lut_HuffQ[mpc_decoder_bitstream_read(d, 1)][*ResR];
                 for (k=0; k<36; ++k)
-                    *R++ = mpc_decoder_huffman_decode(d, Table, 14);
+                    *R++ = mpc_decoder_huffman_decode(d, Lut, 14);
                 break;
             case 8: case 9: case 10: case 11: case 12: case 13: case 14: case 15: case 16: case 17:
                 tmp = Dc[*ResR];
@@ -1139,19 +1141,16 @@ void mpc_decoder_setup(mpc_decoder *d, mpc_reader *r)
 
   d->Max_Band = 0;
   d->seeking_window = FAST_SEEKING_WINDOW;
+  d->seek_table = NULL;
 
   mpc_decoder_reset_bitstream_decode(d);
   mpc_decoder_initialisiere_quantisierungstabellen(d, 1.0f);
-#if 0
-  mpc_decoder_init_huffman_sv6(d);
-  mpc_decoder_init_huffman_sv7(d);
-#endif
 }
 
-static mpc_uint32_t get_initial_fpos(mpc_decoder *d)
+static mpc_uint32_t initial_fpos(mpc_uint32_t StreamVersion)
 {
     mpc_uint32_t fpos = 0;
-    switch ( d->StreamVersion ) {   // setting position to the beginning of the data-bitstream
+    switch ( StreamVersion ) {   // setting position to the beginning of the data-bitstream
     case  0x04: fpos =  48; break;
     case  0x05:
     case  0x06: fpos =  64; break;
@@ -1161,6 +1160,11 @@ static mpc_uint32_t get_initial_fpos(mpc_decoder *d)
     return fpos;
 }
 
+static mpc_uint32_t get_initial_fpos(mpc_decoder *d)
+{
+    return initial_fpos(d->StreamVersion);
+}
+
 void mpc_decoder_set_streaminfo(mpc_decoder *d, mpc_streaminfo *si)
 {
     mpc_decoder_reset_synthesis(d);
@@ -1181,6 +1185,13 @@ mpc_bool_t mpc_decoder_initialize(mpc_decoder *d, mpc_streaminfo *si)
 {
     mpc_decoder_set_streaminfo(d, si);
 
+    if (!mpc_huffman_init_sv7())
+        return FALSE;
+#ifdef MPC_SUPPORT_SV456
+    if (d->StreamVersion < 7 && !mpc_huffman_init_sv6())
+        return FALSE;
+#endif
+
     // AB: setting position to the beginning of the data-bitstream
     mpc_decoder_seek(d, get_initial_fpos(d));
 
@@ -1193,6 +1204,85 @@ mpc_bool_t mpc_decoder_initialize(mpc_decoder *d, mpc_streaminfo *si)
     return TRUE;
 }
 
+mpc_bool_t mpc_seek_table_init(mpc_seek_table *t, mpc_streaminfo *si)
+{
+    memset(t, 0, sizeof *t);
+
+    if (si->frames == 0)
+        return FALSE;
+
+    while (((si->frames - 1) >> t->pwr) >= MPC_SEEK_TABLE_MAX_ENTRIES)
+        t->pwr++;
+    t->size = ((si->frames - 1) >> t->pwr) + 1;
+    t->bits = (mpc_uint32_t *) malloc(t->size * sizeof *t->bits);
+
+    return t->bits != NULL;
+}
+
+void mpc_seek_table_free(mpc_seek_table *t)
+{
+    free(t->bits);
+    memset(t, 0, sizeof *t);
+}
+
+mpc_uint32_t mpc_seek_table_count(mpc_seek_table *t)
+{
+    return __atomic_load_n(&t->count, __ATOMIC_ACQUIRE);
+}
+
+enum { SCAN_WORDS = 1024 };
+
+mpc_bool_t mpc_seek_table_build(mpc_seek_table *t, mpc_reader *r, mpc_streaminfo *si,
+                                volatile int *cancel)
+{
+    mpc_uint32_t buff[SCAN_WORDS + 1];
+    mpc_uint32_t first = 0, words = 0;   // buff[0] is word 'first' of the stream
+    mpc_uint32_t pos = initial_fpos(si->stream_version);
+    mpc_uint32_t mask = (1 << t->pwr) - 1;
+    mpc_uint32_t frame;
+
+    // every frame starts with 20 bits telling the size of the rest of it
+    for (frame = 0; frame < si->frames; frame++) {
+        mpc_uint32_t w = pos >> 5, bit = pos & 31, jump;
+
+        if ((frame & mask) == 0) {
+            t->bits[frame >> t->pwr] = pos;
+            __atomic_store_n(&t->count, (frame >> t->pwr) + 1, __ATOMIC_RELEASE);
+        }
+        if (*cancel)
+            return FALSE;
+
+        if (w < first || w + 1 >= first + words) {
+            mpc_int32_t n;
+
+            if (!r->seek(r->data, si->header_position + w * 4))
+                return FALSE;
+            n = r->read(r->data, buff, SCAN_WORDS * 4);
+            if (n < 4)
+                return FALSE;
+            first = w;
+            words = n >> 2;
+            buff[words] = 0;
+        }
+
+        jump = SWAP(buff[w - first]) << bit;
+        if (bit > 12)
+            jump |= SWAP(buff[w - first + 1]) >> (32 - bit);
+        jump >>= 12;
+
+        if (pos + 20 + jump < pos)
+            return FALSE;
+        pos += 20 + jump;
+    }
+
+    return TRUE;
+}
+
+void mpc_decoder_set_seek_table(mpc_decoder *d, mpc_seek_table *t)
+{
+    d->seek_table = t;
+}
+
 void mpc_decoder_set_seeking(mpc_decoder *d, mpc_streaminfo *si, mpc_bool_t fast_seeking)
 {
     d->seeking_window = FAST_SEEKING_WINDOW;
@@ -1209,6 +1299,7 @@ mpc_bool_t mpc_decoder_seek_sample(mpc_decoder *d, mpc_int64_t destsample)
 {
     mpc_uint32_t fpos;
     mpc_uint32_t fwd;
+    mpc_uint32_t n;
 
     fwd = (mpc_uint32_t) (destsample / MPC_FRAME_LENGTH);
     d->samples_to_skip = MPC_DECODER_SYNTH_DELAY + (mpc_uint32_t)(destsample % MPC_FRAME_LENGTH);
@@ -1224,7 +1315,19 @@ mpc_bool_t mpc_decoder_seek_sample(mpc_decoder *d, mpc_int64_t destsample)
         memset(d->SCF_Index_R, 1, sizeof d->SCF_Index_R );
     }
 
-    if (d->seeking_table_frames > d->DecodedFrames || fwd < d->DecodedFrames) {
+    if (d->seek_table && (n = mpc_seek_table_count(d->seek_table)) > 0) {
+        // jump to the last entry before the scalefactor window
+        mpc_seek_table *t = d->seek_table;
+        mpc_uint32_t idx = (fwd > d->seeking_window ? fwd - d->seeking_window : 0) >> t->pwr;
+
+        if (idx >= n)
+            idx = n - 1;
+        if ((idx << t->pwr) > d->DecodedFrames || fwd < d->DecodedFrames) {
+            d->DecodedFrames = idx << t->pwr;
+            mpc_decoder_seek(d, t->bits[idx]);
+        }
+    }
+    else if (d->seeking_table_frames > d->DecodedFrames || fwd < d->DecodedFrames) {
         d->DecodedFrames = 0;
         if (fwd > d->seeking_window)
             d->DecodedFrames = (fwd - d->seeking_window) & (-1 << d->seeking_pwr);
@@ -56,6 +56,19 @@ enum {
     MPC_DECODER_MEMSIZE = 16384,  // overall buffer size
 };
 
+// most entries in a mpc_seek_table, seek_table_pwr grows to stay below
+#define MPC_SEEK_TABLE_MAX_ENTRIES  65536u
+
+/// Seek table with an entry for every 2^pwr-th frame of a stream. It is
+/// filled from the front by mpc_seek_table_build(), possibly in another
+/// thread while decoders use the entries below count.
+typedef struct mpc_seek_table_t {
+    mpc_uint32_t *bits;          ///< bit position of frame i << pwr, as for mpc_decoder_seek()
+    mpc_uint32_t  pwr;
+    mpc_uint32_t  size;          ///< entries needed for the whole stream
+    mpc_uint32_t  count;         ///< entries filled so far, see mpc_seek_table_count()
+} mpc_seek_table;
+
 typedef struct {
     mpc_int32_t  L [36];
     mpc_int32_t  R [36];
@@ -97,6 +110,7 @@ typedef struct mpc_decoder_t {
     mpc_uint32_t  seeking_pwr;                // distance between 2 frames in seeking_table = 2^seeking_pwr
     mpc_uint32_t  seeking_table_frames;       // last frame in seaking table
     mpc_uint32_t  seeking_window;             // number of frames to look for scalefactors
+    mpc_seek_table *seek_table;               // optional full table, see mpc_decoder_set_seek_table()
 
     mpc_int32_t   SCF_Index_L [32] [3];
     mpc_int32_t   SCF_Index_R [32] [3];       // holds scalefactor-indices
@@ -55,4 +55,28 @@ typedef struct huffman_type_t {
     mpc_int16_t   Value;
 } HuffmanTyp;
 
+enum {
+    MPC_HUFFMAN_LUT_BITS = 8,       ///< bits indexing the first level of a lookup table
+    MPC_HUFFMAN_LUT_POOL = 8192     ///< entries for all lookup tables together
+};
+
+/// Lookup table entry. The first level of a table has one entry for every
+/// value of the next MPC_HUFFMAN_LUT_BITS bits of the stream. Codes that are
+/// longer than that go through a second level table indexed by the bits
+/// that follow.
+typedef struct huffman_lut_t {
+    mpc_int16_t   Value;            ///< decoded value, or offset of the second level table
+    unsigned char Length;           ///< code length, 0 for a second level table
+    unsigned char Bits;             ///< index bits of the second level table
+} HuffmanLut;
+
+/// Builds the lookup table for a HuffmanTyp table, see huffman.c.
+/// \return the table, NULL if the pool is used up
+const HuffmanLut *mpc_huffman_build_lut(const HuffmanTyp *Table);
+
+/// Build the lookup tables once per process.
+/// \return FALSE if they could not be built
+mpc_bool_t mpc_huffman_init_sv7(void);
+mpc_bool_t mpc_huffman_init_sv6(void);
+
 #endif // _mpcdec_huffman_h_
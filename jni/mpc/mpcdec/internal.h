@@ -43,6 +43,10 @@ enum {
     MPC_DECODER_SYNTH_DELAY = 481
 };
 
+/// Headroom of the second half of the fixed point new V calculation,
+/// synth_filter.c and synth_filter_neon.c.
+#define MPC_FIXED_POINT_SYNTH_FIX 2
+
 /// Big/little endian 32 bit byte swapping routine.
 static __inline
 mpc_uint32_t mpc_swap32(mpc_uint32_t val) {
@@ -56,8 +60,27 @@ mpc_uint32_t mpc_swap32(mpc_uint32_t val) {
 /// \return -1 on errors of any kind
 mpc_int32_t JumpID3v2(mpc_reader* fp);
 
+#ifdef MPC_NEON
+/// @name NEON synthesis (synth_filter_neon.c)
+//@{
+/// True if the NEON functions may be used on this CPU.
+mpc_bool_t mpc_neon_supported(void);
+/// Windows one time slot of both channels into 64 interleaved samples.
+/// D is Di_opt transposed to [16][32].
+void mpc_synthese_window_neon(MPC_SAMPLE_FORMAT *OutData, const MPC_SAMPLE_FORMAT *V_L,
+                              const MPC_SAMPLE_FORMAT *V_R, const MPC_SAMPLE_FORMAT *D);
+void mpc_samples_to_pcm16_neon(const MPC_SAMPLE_FORMAT *in, mpc_int16_t *out, mpc_uint32_t count);
+#ifdef MPC_FIXED_POINT
+/// mpc_calculate_new_v().
+void mpc_calculate_new_v_neon(const MPC_SAMPLE_FORMAT *Sample, MPC_SAMPLE_FORMAT *V);
+#endif
+//@}
+#endif
+
 /// helper functions used by multiple files
 mpc_uint32_t mpc_random_int(mpc_decoder *d); // in synth_filter.c
+/// New V values of one time slot from its 32 subband samples, in synth_filter.c
+void mpc_calculate_new_v(const MPC_SAMPLE_FORMAT *Sample, MPC_SAMPLE_FORMAT *V);
 void mpc_decoder_initialisiere_quantisierungstabellen(mpc_decoder *d, double scale_factor);
 void mpc_decoder_synthese_filter_float(mpc_decoder *d, MPC_SAMPLE_FORMAT* OutData);
 
@@ -107,6 +107,27 @@ void mpc_decoder_set_seeking(mpc_decoder *d, mpc_streaminfo *si, mpc_bool_t fast
 
 void mpc_decoder_set_streaminfo(mpc_decoder *d, mpc_streaminfo *si);
 
+/// Allocates a seek table for the stream si. The table starts empty.
+/// \return FALSE if out of memory or the stream can't be scanned
+mpc_bool_t mpc_seek_table_init(mpc_seek_table *t, mpc_streaminfo *si);
+
+/// Frees the entries of t.
+void mpc_seek_table_free(mpc_seek_table *t);
+
+/// Fills t by walking the frame headers of the stream read by r, without
+/// decoding. May run in its own thread (with its own reader) while decoders
+/// use t; it stops early once *cancel is set.
+/// \return TRUE if the whole table was filled
+mpc_bool_t mpc_seek_table_build(mpc_seek_table *t, mpc_reader *r, mpc_streaminfo *si,
+                                volatile int *cancel);
+
+/// Number of entries of t that may be used.
+mpc_uint32_t mpc_seek_table_count(mpc_seek_table *t);
+
+/// Lets seeks jump straight to the entries of t (NULL to detach). The
+/// table must outlive its use by the decoder.
+void mpc_decoder_set_seek_table(mpc_decoder *d, mpc_seek_table *t);
+
 /// Sets decoder sample scaling factor.  All decoded samples will be multiplied
 /// by this factor.
 /// \param scale_factor multiplicative scaling factor
@@ -132,6 +153,13 @@ mpc_uint32_t mpc_decoder_decode_frame(
     mpc_uint32_t in_len,
     MPC_SAMPLE_FORMAT *out_buffer);
 
+/// Converts decoded samples to 16-bit PCM in host byte order, clipping
+/// them to its range.
+/// \param in samples from mpc_decoder_decode()
+/// \param out destination, must not overlap in
+/// \param count number of samples (2 per frame of stereo output)
+void mpc_samples_to_pcm16(const MPC_SAMPLE_FORMAT *in, mpc_int16_t *out, mpc_uint32_t count);
+
 /// Seeks to the specified sample in the source stream.
 mpc_bool_t mpc_decoder_seek_sample(mpc_decoder *d, mpc_int64_t destsample);
 
@@ -42,8 +42,6 @@
 /* C O N S T A N T S */
 #undef _
 
-#define MPC_FIXED_POINT_SYNTH_FIX 2
-
 #ifdef MPC_FIXED_POINT
 #define _(value)  MPC_MAKE_FRACT_CONST((double)value/(double)(0x40000))
 #else
@@ -88,7 +86,7 @@ static const MPC_SAMPLE_FORMAT  Di_opt [32] [16] = {
 
 #undef  _
 
-static void Calculate_New_V ( const MPC_SAMPLE_FORMAT * Sample, MPC_SAMPLE_FORMAT * V )
+void mpc_calculate_new_v ( const MPC_SAMPLE_FORMAT * Sample, MPC_SAMPLE_FORMAT * V )
 {
     // Calculating new V-buffer values for left channel
     // calculate new V-values (ISO-11172-3, p. 39)
@@ -333,7 +331,7 @@ static void Synthese_Filter_float_internal(MPC_SAMPLE_FORMAT * OutData,MPC_SAMPL
     mpc_uint32_t n;
     for ( n = 0; n < 36; n++, Y += 32 ) {
         V -= 64;
-        Calculate_New_V ( Y, V );
+        mpc_calculate_new_v ( Y, V );
         {
             MPC_SAMPLE_FORMAT * Data = OutData;
             const MPC_SAMPLE_FORMAT *  D = (const MPC_SAMPLE_FORMAT *) &Di_opt;
@@ -358,9 +356,55 @@ static void Synthese_Filter_float_internal(MPC_SAMPLE_FORMAT * OutData,MPC_SAMPL
     }
 }
 
+#ifdef MPC_NEON
+static MPC_SAMPLE_FORMAT  Di_opt_t [16] [32];   // Di_opt transposed
+
+static void Synthese_Filter_neon(MPC_SAMPLE_FORMAT * OutData,MPC_SAMPLE_FORMAT * V_L,MPC_SAMPLE_FORMAT * V_R,
+                                 const MPC_SAMPLE_FORMAT * Y_L,const MPC_SAMPLE_FORMAT * Y_R)
+{
+    static mpc_bool_t transposed = FALSE;
+    mpc_uint32_t n, k;
+
+    if (!transposed) {
+        for ( n = 0; n < 16; n++ )
+            for ( k = 0; k < 32; k++ )
+                Di_opt_t[n][k] = Di_opt[k][n];
+        transposed = TRUE;
+    }
+
+    for ( n = 0; n < 36; n++, Y_L += 32, Y_R += 32, OutData += 64 ) {
+        V_L -= 64;
+        V_R -= 64;
+#ifdef MPC_FIXED_POINT
+        mpc_calculate_new_v_neon ( Y_L, V_L );
+        mpc_calculate_new_v_neon ( Y_R, V_R );
+#else
+        mpc_calculate_new_v ( Y_L, V_L );
+        mpc_calculate_new_v ( Y_R, V_R );
+#endif
+        mpc_synthese_window_neon(OutData, V_L, V_R, &Di_opt_t[0][0]);
+    }
+}
+#endif
+
 void
 mpc_decoder_synthese_filter_float(mpc_decoder *d, MPC_SAMPLE_FORMAT* OutData) 
 {
+#ifdef MPC_NEON
+    if (mpc_neon_supported()) {
+        memmove(d->V_L + MPC_V_MEM, d->V_L, 960 * sizeof(MPC_SAMPLE_FORMAT) );
+        memmove(d->V_R + MPC_V_MEM, d->V_R, 960 * sizeof(MPC_SAMPLE_FORMAT) );
+
+        Synthese_Filter_neon(
+            OutData,
+            (MPC_SAMPLE_FORMAT *)(d->V_L + MPC_V_MEM),
+            (MPC_SAMPLE_FORMAT *)(d->V_R + MPC_V_MEM),
+            (MPC_SAMPLE_FORMAT *)(d->Y_L [0]),
+            (MPC_SAMPLE_FORMAT *)(d->Y_R [0]));
+        return;
+    }
+#endif
+
     /********* left channel ********/
     memmove(d->V_L + MPC_V_MEM, d->V_L, 960 * sizeof(MPC_SAMPLE_FORMAT) );
 
@@ -378,6 +422,30 @@ mpc_decoder_synthese_filter_float(mpc_decoder *d, MPC_SAMPLE_FORMAT* OutData)
         (MPC_SAMPLE_FORMAT *)(d->Y_R [0]));
 }
 
+void
+mpc_samples_to_pcm16(const MPC_SAMPLE_FORMAT *in, mpc_int16_t *out, mpc_uint32_t count)
+{
+    mpc_uint32_t n = 0;
+
+#ifdef MPC_NEON
+    if (mpc_neon_supported()) {
+        n = count & ~7u;
+        mpc_samples_to_pcm16_neon(in, out, n);
+    }
+#endif
+
+    for ( ; n < count; n++ ) {
+#ifdef MPC_FIXED_POINT
+        mpc_int32_t val = in[n] >> MPC_FIXED_POINT_FRACTPART;
+#else
+        mpc_int32_t val = (mpc_int32_t) (in[n] * (1 << 15));
+#endif
+        if (val < -32768) val = -32768;
+        else if (val > 32767) val = 32767;
+        out[n] = (mpc_int16_t) val;
+    }
+}
+
 /*******************************************/
 /*                                         */
 /*            dithered synthesis           */
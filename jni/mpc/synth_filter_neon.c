@@ -0,0 +1,298 @@
+/*
+  Copyright (c) 2005, The Musepack Development Team
+  All rights reserved.
+
+  Redistribution and use in source and binary forms, with or without
+  modification, are permitted provided that the following conditions are
+  met:
+
+  * Redistributions of source code must retain the above copyright
+  notice, this list of conditions and the following disclaimer.
+
+  * Redistributions in binary form must reproduce the above
+  copyright notice, this list of conditions and the following
+  disclaimer in the documentation and/or other materials provided
+  with the distribution.
+
+  * Neither the name of the The Musepack Development Team nor the
+  names of its contributors may be used to endorse or promote
+  products derived from this software without specific prior
+  written permission.
+
+  THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+  "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+  LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+  A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+  OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+  SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+  LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+  DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+  THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+  (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+  OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+*/
+
+/// \file synth_filter_neon.c
+/// NEON versions of the new V calculation, of the synthesis windowing and
+/// of the conversion to 16-bit PCM, see synth_filter.c.
+///
+/// The window runs across four subbands at a time, so the coefficients are
+/// read from Di_opt transposed (one row per tap). Both channels are done in
+/// one pass so that the output can be stored interleaved.
+///
+/// In fixed point the C code takes ((int64)V * D) >> 32 for every tap.
+/// vqdmulh gives ((int64)V * D * 2) >> 32, which shifted right once more is
+/// the same value: the window coefficients are far from the one input that
+/// saturates. The output is bit-exact.
+///
+/// The new V calculation is fixed point only. Its constants come with
+/// shifts from 27 to 32 bits, and those above 1.0 don't fit a common scale
+/// that vqdmulh could use, so each lane takes the full 64-bit product
+/// (vmull) and is shifted by its own amount (vshl) before narrowing. That
+/// is what the C macros do, so this is bit-exact too.
+
+#include <mpcdec/mpcdec.h>
+#include <mpcdec/internal.h>
+
+#include <arm_neon.h>
+
+#include <cpu-features.h>
+
+extern volatile int audio_simd;    // see audioSetSimd() in ../main.c
+
+mpc_bool_t mpc_neon_supported(void)
+{
+    static int neon = -1;
+
+    if (neon < 0)
+        neon = (android_getCpuFamily() == ANDROID_CPU_FAMILY_ARM &&
+            (android_getCpuFeatures() & ANDROID_CPU_ARM_FEATURE_NEON)) ? 1 : 0;
+
+    return (mpc_bool_t) (neon && audio_simd);
+}
+
+// position in V of the 16 taps of subband 0
+static const mpc_uint32_t Di_offset [16] = {
+    0, 96, 128, 224, 256, 352, 384, 480, 512, 608, 640, 736, 768, 864, 896, 992
+};
+
+void mpc_synthese_window_neon(MPC_SAMPLE_FORMAT *OutData, const MPC_SAMPLE_FORMAT *V_L,
+                              const MPC_SAMPLE_FORMAT *V_R, const MPC_SAMPLE_FORMAT *D)
+{
+    mpc_uint32_t k, j;
+
+    for (k = 0; k < 32; k += 4, OutData += 8) {
+#ifdef MPC_FIXED_POINT
+        int32x4_t l = vdupq_n_s32(0), r = vdupq_n_s32(0);
+        int32x4x2_t out;
+
+        for (j = 0; j < 16; j++) {
+            int32x4_t c = vld1q_s32(D + 32 * j + k);
+
+            l = vaddq_s32(l, vshrq_n_s32(vqdmulhq_s32(vld1q_s32(V_L + Di_offset[j] + k), c), 1));
+            r = vaddq_s32(r, vshrq_n_s32(vqdmulhq_s32(vld1q_s32(V_R + Di_offset[j] + k), c), 1));
+        }
+        out.val[0] = vshlq_n_s32(l, 2);
+        out.val[1] = vshlq_n_s32(r, 2);
+        vst2q_s32(OutData, out);
+#else
+        float32x4_t l = vdupq_n_f32(0), r = vdupq_n_f32(0);
+        float32x4x2_t out;
+
+        for (j = 0; j < 16; j++) {
+            float32x4_t c = vld1q_f32(D + 32 * j + k);
+
+            l = vmlaq_f32(l, vld1q_f32(V_L + Di_offset[j] + k), c);
+            r = vmlaq_f32(r, vld1q_f32(V_R + Di_offset[j] + k), c);
+        }
+        out.val[0] = l;
+        out.val[1] = r;
+        vst2q_f32(OutData, out);
+#endif
+    }
+}
+
+#ifdef MPC_FIXED_POINT
+/// Four products of the new V calculation: lane i is
+/// ((int64) x[i] * c[i]) >> -shift[i], as MPC_SCALE_CONST() and the other
+/// macros of synth_filter.c compute it for their constant and shift.
+typedef struct {
+    MPC_SAMPLE_FORMAT c [4];
+    mpc_int64_t shift [4];
+} new_v_scale;
+
+#define SCALE(c, z)        MAKE_MPC_SAMPLE_EX(c, z)
+#define FRACT(c, z)        MPC_MAKE_FRACT_CONST(c / (1 << (z)))
+
+// the Ai - A(15-i) butterflies, shared by both halves
+static const new_v_scale scale_b [2] = {
+    { { SCALE(0.5024192929f, 31), SCALE(0.5224986076f, 31), SCALE(0.5669440627f, 31), SCALE(0.6468217969f, 31) },
+      { -31, -31, -31, -31 } },
+    { { SCALE(0.7881546021f, 31), SCALE(1.0606776476f, 30), SCALE(1.7224471569f, 30), SCALE(5.1011486053f, 28) },
+      { -31, -30, -30, -28 } }
+};
+// the Bi - B(7-i) butterflies
+static const new_v_scale scale_a = {
+    { SCALE(0.5097956061f, 31), SCALE(0.6013448834f, 31), SCALE(0.8999761939f, 31), SCALE(2.5629155636f, 29) },
+    { -31, -31, -31, -29 }
+};
+// Sample[i] - Sample[31-i] of the second half, MPC_MULTIPLY_FRACT_CONST_SHR()
+// and MPC_SCALE_CONST_SHR() with MPC_FIXED_POINT_SYNTH_FIX 2
+static const new_v_scale scale_diff [4] = {
+    { { FRACT(0.5006030202f, 2), FRACT(0.5054709315f, 2), FRACT(0.5154473186f, 2), FRACT(0.5310425758f, 2) },
+      { -32, -32, -32, -32 } },
+    { { FRACT(0.5531039238f, 2), FRACT(0.5829349756f, 2), FRACT(0.6225041151f, 2), FRACT(0.6748083234f, 2) },
+      { -32, -32, -32, -32 } },
+    { { FRACT(0.7445362806f, 2), FRACT(0.8393496275f, 2), FRACT(0.9725682139f, 2), FRACT(1.1694399118f, 2) },
+      { -32, -32, -32, -32 } },
+    { { FRACT(1.4841645956f, 2), SCALE(2.0577809811f, 29), SCALE(3.4076085091f, 29), SCALE(10.1900081635f, 27) },
+      { -32, -31, -31, -29 } }
+};
+
+#undef SCALE
+#undef FRACT
+
+static inline int32x4_t new_v_mul(int32x4_t x, const new_v_scale *k)
+{
+    int32x4_t c = vld1q_s32(k->c);
+    int64x2_t lo = vshlq_s64(vmull_s32(vget_low_s32(x), vget_low_s32(c)), vld1q_s64(k->shift));
+    int64x2_t hi = vshlq_s64(vmull_s32(vget_high_s32(x), vget_high_s32(c)), vld1q_s64(k->shift + 2));
+
+    return vcombine_s32(vmovn_s64(lo), vmovn_s64(hi));
+}
+
+// the same for one constant in every lane, shifting by z
+#define NEW_V_MUL_N(x, c, z) \
+    vcombine_s32(vshrn_n_s64(vmull_s32(vget_low_s32(x), vdup_n_s32(c)), z), \
+                 vshrn_n_s64(vmull_s32(vget_high_s32(x), vdup_n_s32(c)), z))
+
+static inline int32x4_t new_v_rev(int32x4_t x)
+{
+    x = vrev64q_s32(x);
+    return vcombine_s32(vget_high_s32(x), vget_low_s32(x));
+}
+
+/// The 16-point transform of one half of mpc_calculate_new_v(), from x = its
+/// A00..A15 to A, where the C code starts writing V. The butterflies pair
+/// element i with 15-i, then 7-i, so the first two stages work on whole
+/// vectors against reversed ones. The last two pair neighbours within each
+/// group of four; transposing the groups makes those whole vectors again.
+static inline void new_v_half(int32x4_t x0, int32x4_t x1, int32x4_t x2, int32x4_t x3,
+                              mpc_bool_t second, MPC_SAMPLE_FORMAT *A)
+{
+    int32x4_t b0, b1, b2, b3, t0, t1, t2, t3;
+    int32x4x2_t lo, hi, even, odd;
+    int32x4x4_t out;
+
+    b0 = vaddq_s32(x0, new_v_rev(x3));
+    b1 = vaddq_s32(x1, new_v_rev(x2));
+    b2 = new_v_mul(vsubq_s32(x0, new_v_rev(x3)), &scale_b[0]);
+    b3 = new_v_mul(vsubq_s32(x1, new_v_rev(x2)), &scale_b[1]);
+
+    x0 = vaddq_s32(b0, new_v_rev(b1));
+    x1 = new_v_mul(vsubq_s32(b0, new_v_rev(b1)), &scale_a);
+    x2 = vaddq_s32(b2, new_v_rev(b3));
+    x3 = new_v_mul(vsubq_s32(b2, new_v_rev(b3)), &scale_a);
+
+    // t0 = A00 A04 A08 A12, t1 = A01 A05 ..., t2 = A02 ..., t3 = A03 ...
+    lo = vuzpq_s32(x0, x1);
+    hi = vuzpq_s32(x2, x3);
+    even = vuzpq_s32(lo.val[0], hi.val[0]);
+    odd = vuzpq_s32(lo.val[1], hi.val[1]);
+    t0 = even.val[0];
+    t1 = odd.val[0];
+    t2 = even.val[1];
+    t3 = odd.val[1];
+
+    b0 = vaddq_s32(t0, t3);
+    b1 = vaddq_s32(t1, t2);
+    if (!second) {
+        b2 = vshlq_n_s32(NEW_V_MUL_N(vsubq_s32(t0, t3), MPC_MAKE_FRACT_CONST(0.5411961079f / (1 << 1)), 32), 1);
+        b3 = vshlq_n_s32(NEW_V_MUL_N(vsubq_s32(t1, t2), MPC_MAKE_FRACT_CONST(1.3065630198f / (1 << 2)), 32), 2);
+
+        out.val[0] = vaddq_s32(b0, b1);
+        out.val[1] = vshlq_n_s32(NEW_V_MUL_N(vsubq_s32(b0, b1), MPC_MAKE_FRACT_CONST(0.7071067691f / (1 << 1)), 32), 1);
+        out.val[2] = vaddq_s32(b2, b3);
+        out.val[3] = vshlq_n_s32(NEW_V_MUL_N(vsubq_s32(b2, b3), MPC_MAKE_FRACT_CONST(0.7071067691f / (1 << 1)), 32), 1);
+    } else {
+        b2 = NEW_V_MUL_N(vsubq_s32(t0, t3), MAKE_MPC_SAMPLE_EX(0.5411961079f, 31), 31);
+        b3 = NEW_V_MUL_N(vsubq_s32(t1, t2), MAKE_MPC_SAMPLE_EX(1.3065630198f, 30), 30);
+
+        out.val[0] = vshlq_n_s32(vaddq_s32(b0, b1), MPC_FIXED_POINT_SYNTH_FIX);
+        out.val[1] = NEW_V_MUL_N(vsubq_s32(b0, b1), MAKE_MPC_SAMPLE_EX(0.7071067691f, 31), 31 - MPC_FIXED_POINT_SYNTH_FIX);
+        out.val[2] = vshlq_n_s32(vaddq_s32(b2, b3), MPC_FIXED_POINT_SYNTH_FIX);
+        out.val[3] = NEW_V_MUL_N(vsubq_s32(b2, b3), MAKE_MPC_SAMPLE_EX(0.7071067691f, 31), 31 - MPC_FIXED_POINT_SYNTH_FIX);
+    }
+    vst4q_s32(A, out);
+}
+
+void mpc_calculate_new_v_neon(const MPC_SAMPLE_FORMAT *Sample, MPC_SAMPLE_FORMAT *V)
+{
+    MPC_SAMPLE_FORMAT A [16], tmp;
+    int32x4_t s0 = vld1q_s32(Sample), r0 = new_v_rev(vld1q_s32(Sample + 28));
+    int32x4_t s1 = vld1q_s32(Sample + 4), r1 = new_v_rev(vld1q_s32(Sample + 24));
+    int32x4_t s2 = vld1q_s32(Sample + 8), r2 = new_v_rev(vld1q_s32(Sample + 20));
+    int32x4_t s3 = vld1q_s32(Sample + 12), r3 = new_v_rev(vld1q_s32(Sample + 16));
+
+    new_v_half(vaddq_s32(s0, r0), vaddq_s32(s1, r1), vaddq_s32(s2, r2), vaddq_s32(s3, r3), FALSE, A);
+
+    V[48] = -A[0];
+    V[ 0] =  A[1];
+    V[40] = -A[2] - (V[ 8] = A[3]);
+    V[36] = -((V[ 4] = A[5] + (V[12] = A[7])) + A[6]);
+    V[44] = - A[4] - A[6] - A[7];
+    V[ 6] = (V[10] = A[11] + (V[14] = A[15])) + A[13];
+    V[38] = (V[34] = -(V[ 2] = A[9] + A[13] + A[15]) - A[14]) + A[9] - A[10] - A[11];
+    V[46] = (tmp = -(A[12] + A[14] + A[15])) - A[8];
+    V[42] = tmp - A[10] - A[11];
+
+    new_v_half(new_v_mul(vsubq_s32(s0, r0), &scale_diff[0]), new_v_mul(vsubq_s32(s1, r1), &scale_diff[1]),
+               new_v_mul(vsubq_s32(s2, r2), &scale_diff[2]), new_v_mul(vsubq_s32(s3, r3), &scale_diff[3]), TRUE, A);
+
+    V[ 5] = (V[11] = (V[13] = A[7] + (V[15] = A[15])) + A[11]) + A[5] + A[13];
+    V[ 7] = (V[ 9] = A[3] + A[11] + A[15]) + A[13];
+    V[33] = -(V[ 1] = A[1] + A[9] + A[13] + A[15]) - A[14];
+    V[35] = -(V[ 3] = A[5] + A[7] + A[9] + A[13] + A[15]) - A[6] - A[14];
+    V[37] = (tmp = -(A[10] + A[11] + A[13] + A[14] + A[15])) - A[5] - A[6] - A[7];
+    V[39] = tmp - A[2] - A[3];
+    V[41] = (tmp += A[13] - A[12]) - A[2] - A[3];
+    V[43] = tmp - A[4] - A[6] - A[7];
+    V[47] = (tmp = -(A[8] + A[12] + A[14] + A[15])) - A[0];
+    V[45] = tmp - A[4] - A[6] - A[7];
+
+    // V[17..32] = -V[15..0], V[48..63] = V[48..33]
+    s0 = vnegq_s32(new_v_rev(vld1q_s32(V)));
+    s1 = vnegq_s32(new_v_rev(vld1q_s32(V + 4)));
+    s2 = vnegq_s32(new_v_rev(vld1q_s32(V + 8)));
+    s3 = vnegq_s32(new_v_rev(vld1q_s32(V + 12)));
+    r0 = new_v_rev(vld1q_s32(V + 33));
+    r1 = new_v_rev(vld1q_s32(V + 37));
+    r2 = new_v_rev(vld1q_s32(V + 41));
+    r3 = new_v_rev(vld1q_s32(V + 45));
+    vst1q_s32(V + 29, s0);
+    vst1q_s32(V + 25, s1);
+    vst1q_s32(V + 21, s2);
+    vst1q_s32(V + 17, s3);
+    vst1q_s32(V + 60, r0);
+    vst1q_s32(V + 56, r1);
+    vst1q_s32(V + 52, r2);
+    vst1q_s32(V + 48, r3);
+}
+#endif
+
+/// Converts count samples (a multiple of 8) like mpc_samples_to_pcm16().
+void mpc_samples_to_pcm16_neon(const MPC_SAMPLE_FORMAT *in, mpc_int16_t *out, mpc_uint32_t count)
+{
+    mpc_uint32_t n;
+
+    for (n = 0; n < count; n += 8) {
+#ifdef MPC_FIXED_POINT
+        int16x4_t lo = vqshrn_n_s32(vld1q_s32(in + n), MPC_FIXED_POINT_FRACTPART);
+        int16x4_t hi = vqshrn_n_s32(vld1q_s32(in + n + 4), MPC_FIXED_POINT_FRACTPART);
+#else
+        int16x4_t lo = vqmovn_s32(vcvtq_n_s32_f32(vld1q_f32(in + n), 15));
+        int16x4_t hi = vqmovn_s32(vcvtq_n_s32_f32(vld1q_f32(in + n + 4), 15));
+#endif
+        vst1q_s16(out + n, vcombine_s16(lo, hi));
+    }
+}
@@ -0,0 +1,56 @@
+#ifndef _SINK_H_INCLUDED
+#define _SINK_H_INCLUDED
+
+#include <sys/types.h>
+#include "main.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* An audio output, picked by audioInit() from the mode. start and write
+   are required, anything else may be NULL if the output can't do it. */
+typedef struct audio_sink {
+    const char *name;
+    /* Opens the output (or reuses the open one) for 16-bit PCM of the given
+       format. ctx->conf_size comes set from the buffering policy, a sink may
+       change it if the output needs another write size. Returns 0 or
+       LIBLOSSLESS_ERR_*. Underruns go to ctx->underruns. */
+    int     (*start)(msm_ctx *ctx, int channels, int samplerate);
+    void    (*stop)(msm_ctx *ctx);
+    /* Queues count bytes, blocking while the output is full. Returns the
+       bytes taken, less than count if stopped or failed. */
+    ssize_t (*write)(msm_ctx *ctx, const void *buf, size_t count);
+    void    (*pause)(msm_ctx *ctx);
+    void    (*resume)(msm_ctx *ctx);
+    /* Drops whatever is queued, called by audio_stop() after stop. */
+    void    (*flush)(msm_ctx *ctx);
+    /* Milliseconds of queued audio not yet played. */
+    int     (*latency)(msm_ctx *ctx);
+    /* Milliseconds played since start(), from the output's own position
+       or timestamp. Negative if it can't tell right now. */
+    int64_t (*played)(msm_ctx *ctx);
+    /* Waits until the queued audio has been played. */
+    void    (*wait_done)(msm_ctx *ctx);
+    /* Pull model, see audio_obtain_buffer() and audio_play_buffer(). */
+    unsigned char *(*obtain)(msm_ctx *ctx, size_t *count);
+    void    (*release)(msm_ctx *ctx, size_t count);
+    ssize_t (*play)(msm_ctx *ctx, const void *buf, size_t count);
+    /* Frees all the output holds in ctx, called by audioExit() and when
+       audioInit() switches to another output. */
+    void    (*exit)(msm_ctx *ctx);
+} audio_sink;
+
+/* OpenSL ES buffer queue (Android 2.3+), sink_opensl.c */
+extern const audio_sink opensl_sink;
+/* AAudio (Android 8.0+), sink_aaudio.c */
+extern const audio_sink aaudio_sink;
+/* no output / WAV file, for benchmarks and tests, sink_offline.c */
+extern const audio_sink null_sink;
+extern const audio_sink file_sink;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -0,0 +1,310 @@
+/* AAudio output, see sink.h.
+ *
+ * A plain blocking AAudioStream_write() stream. By default it asks for
+ * AAUDIO_PERFORMANCE_MODE_POWER_SAVING, which lets the device use its deep
+ * buffer output and sleep between bursts; with MODE_FLAG_LOW_LATENCY it
+ * asks for the low latency path and keeps two bursts queued.
+ *
+ * libaaudio only exists on Android 8.0 and later, so it is loaded with
+ * dlopen() and the few declarations we need are repeated here instead of
+ * requiring the API 26 headers. */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <unistd.h>
+#include <time.h>
+#include <dlfcn.h>
+#include <android/log.h>
+#include "main.h"
+#include "sink.h"
+
+/* from <aaudio/AAudio.h> */
+typedef int32_t aaudio_result_t;
+typedef struct AAudioStreamStruct AAudioStream;
+typedef struct AAudioStreamBuilderStruct AAudioStreamBuilder;
+#define AAUDIO_OK				0
+#define AAUDIO_FORMAT_PCM_I16			1
+#define AAUDIO_PERFORMANCE_MODE_POWER_SAVING	11
+#define AAUDIO_PERFORMANCE_MODE_LOW_LATENCY	12
+#define AAUDIO_STREAM_STATE_PAUSING		5
+
+#define AAUDIO_WRITE_TIMEOUT_NS		2000000000LL
+#define AAUDIO_WAIT_DONE_MS		5000
+#define AAUDIO_PAUSE_TIMEOUT_NS		200000000LL
+
+static void *libaaudio = 0;
+static struct {
+    aaudio_result_t (*createStreamBuilder)(AAudioStreamBuilder **);
+    void (*setChannelCount)(AAudioStreamBuilder *, int32_t);
+    void (*setSampleRate)(AAudioStreamBuilder *, int32_t);
+    void (*setFormat)(AAudioStreamBuilder *, int32_t);
+    void (*setPerformanceMode)(AAudioStreamBuilder *, int32_t);
+    aaudio_result_t (*openStream)(AAudioStreamBuilder *, AAudioStream **);
+    aaudio_result_t (*builderDelete)(AAudioStreamBuilder *);
+    aaudio_result_t (*requestStart)(AAudioStream *);
+    aaudio_result_t (*requestPause)(AAudioStream *);
+    aaudio_result_t (*requestFlush)(AAudioStream *);
+    aaudio_result_t (*requestStop)(AAudioStream *);
+    aaudio_result_t (*close)(AAudioStream *);
+    aaudio_result_t (*waitForStateChange)(AAudioStream *, int32_t, int32_t *, int64_t);
+    aaudio_result_t (*write)(AAudioStream *, const void *, int32_t, int64_t);
+    aaudio_result_t (*setBufferSizeInFrames)(AAudioStream *, int32_t);
+    int32_t (*getFramesPerBurst)(AAudioStream *);
+    int32_t (*getSampleRate)(AAudioStream *);
+    int64_t (*getFramesWritten)(AAudioStream *);
+    int64_t (*getFramesRead)(AAudioStream *);
+    int32_t (*getXRunCount)(AAudioStream *);
+    aaudio_result_t (*getTimestamp)(AAudioStream *, clockid_t, int64_t *, int64_t *);
+} aa;
+
+typedef struct {
+    AAudioStream *stream;
+    int channels, samplerate, perf;
+    volatile int stopped;	// set by aa_stop() on another thread, see aa_stopped()
+    int xruns;			// underruns of stream already added to ctx->underruns
+    int64_t frames0;		// frames written to stream before this track
+} aa_state;
+
+/* The decoder thread polls stopped in aa_write() and aa_wait_done() while
+   audioStop() sets it, so it goes through full barriers both ways. */
+static inline int aa_stopped(aa_state *st) {
+	return __sync_fetch_and_add(&st->stopped, 0);
+}
+
+static inline void aa_set_stopped(aa_state *st, int stopped) {
+	__sync_lock_test_and_set(&st->stopped, stopped);
+	__sync_synchronize();
+}
+
+static int aa_load(void) {
+
+    static const struct { const char *name; void **fn; } syms[] = {
+	{ "AAudio_createStreamBuilder", (void **) &aa.createStreamBuilder },
+	{ "AAudioStreamBuilder_setChannelCount", (void **) &aa.setChannelCount },
+	{ "AAudioStreamBuilder_setSampleRate", (void **) &aa.setSampleRate },
+	{ "AAudioStreamBuilder_setFormat", (void **) &aa.setFormat },
+	{ "AAudioStreamBuilder_setPerformanceMode", (void **) &aa.setPerformanceMode },
+	{ "AAudioStreamBuilder_openStream", (void **) &aa.openStream },
+	{ "AAudioStreamBuilder_delete", (void **) &aa.builderDelete },
+	{ "AAudioStream_requestStart", (void **) &aa.requestStart },
+	{ "AAudioStream_requestPause", (void **) &aa.requestPause },
+	{ "AAudioStream_requestFlush", (void **) &aa.requestFlush },
+	{ "AAudioStream_requestStop", (void **) &aa.requestStop },
+	{ "AAudioStream_close", (void **) &aa.close },
+	{ "AAudioStream_waitForStateChange", (void **) &aa.waitForStateChange },
+	{ "AAudioStream_write", (void **) &aa.write },
+	{ "AAudioStream_setBufferSizeInFrames", (void **) &aa.setBufferSizeInFrames },
+	{ "AAudioStream_getFramesPerBurst", (void **) &aa.getFramesPerBurst },
+	{ "AAudioStream_getSampleRate", (void **) &aa.getSampleRate },
+	{ "AAudioStream_getFramesWritten", (void **) &aa.getFramesWritten },
+	{ "AAudioStream_getFramesRead", (void **) &aa.getFramesRead },
+	{ "AAudioStream_getXRunCount", (void **) &aa.getXRunCount },
+	{ "AAudioStream_getTimestamp", (void **) &aa.getTimestamp },
+    };
+    unsigned k;
+
+	if(libaaudio) return 1;
+	libaaudio = dlopen("libaaudio.so", RTLD_NOW);
+	if(!libaaudio) {
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","aaudio: cannot load libaaudio.so");
+	    return 0;
+	}
+	for(k = 0; k < sizeof(syms) / sizeof(syms[0]); k++) {
+	    *syms[k].fn = dlsym(libaaudio, syms[k].name);
+	    if(!*syms[k].fn) {
+		__android_log_print(ANDROID_LOG_ERROR,"liblossless","aaudio: %s missing", syms[k].name);
+		dlclose(libaaudio); libaaudio = 0;
+		return 0;
+	    }
+	}
+	return 1;
+}
+
+static void aa_close(aa_state *st) {
+	if(!st->stream) return;
+	aa.requestStop(st->stream);
+	aa.close(st->stream);
+	st->stream = 0;
+}
+
+/* requestPause() only starts pausing, and a flush needs it finished */
+static void aa_pause_wait(aa_state *st) {
+    int32_t state;
+	aa.requestPause(st->stream);
+	aa.waitForStateChange(st->stream, AAUDIO_STREAM_STATE_PAUSING, &state, AAUDIO_PAUSE_TIMEOUT_NS);
+}
+
+static void aa_exit(msm_ctx *ctx) {
+    aa_state *st = (aa_state *) ctx->sink_data;
+	if(!st) return;
+	aa_close(st);
+	free(st);
+	ctx->sink_data = 0;
+}
+
+static int aa_start(msm_ctx *ctx, int channels, int samplerate) {
+
+    aa_state *st = (aa_state *) ctx->sink_data;
+    AAudioStreamBuilder *builder;
+    aaudio_result_t r;
+    int k, perf = (ctx->mode_flags & MODE_FLAG_LOW_LATENCY) ?
+		AAUDIO_PERFORMANCE_MODE_LOW_LATENCY : AAUDIO_PERFORMANCE_MODE_POWER_SAVING;
+
+	if(!aa_load()) return LIBLOSSLESS_ERR_INIT;
+	if(!st) {
+	    st = (aa_state *) calloc(1, sizeof(aa_state));
+	    if(!st) return LIBLOSSLESS_ERR_NOMEM;
+	    ctx->sink_data = st;
+	}
+	if(st->stream && (st->channels != channels || st->samplerate != samplerate || st->perf != perf))
+	    aa_close(st);
+
+	if(!st->stream) {
+	    if(aa.createStreamBuilder(&builder) != AAUDIO_OK) return LIBLOSSLESS_ERR_INIT;
+	    aa.setChannelCount(builder, channels);
+	    aa.setSampleRate(builder, samplerate);
+	    aa.setFormat(builder, AAUDIO_FORMAT_PCM_I16);
+	    aa.setPerformanceMode(builder, perf);
+	    r = aa.openStream(builder, &st->stream);
+	    aa.builderDelete(builder);
+	    if(r != AAUDIO_OK) {
+		__android_log_print(ANDROID_LOG_ERROR,"liblossless","aaudio: cannot open %d channels at %d Hz, error %d",
+			channels, samplerate, r);
+		st->stream = 0;
+		return LIBLOSSLESS_ERR_AU_SETCONF;
+	    }
+	    /* we don't resample, the device has to take the rate as it is */
+	    if(aa.getSampleRate(st->stream) != samplerate) {
+		aa_close(st);
+		return LIBLOSSLESS_ERR_AU_SETCONF;
+	    }
+	    if(perf == AAUDIO_PERFORMANCE_MODE_LOW_LATENCY)
+		aa.setBufferSizeInFrames(st->stream, 2 * aa.getFramesPerBurst(st->stream));
+	    st->channels = channels;
+	    st->samplerate = samplerate;
+	    st->perf = perf;
+	    st->xruns = 0;
+	} else {
+	    aa_pause_wait(st);
+	    aa.requestFlush(st->stream);
+	}
+
+	/* low latency: write a few bursts at a time so the decoder wakes up
+	   often enough; otherwise the period audio_start() chose */
+	if(perf == AAUDIO_PERFORMANCE_MODE_LOW_LATENCY) {
+	    k = 4 * aa.getFramesPerBurst(st->stream) * channels * 2;
+	    if(k > 0 && k < ctx->conf_size) ctx->conf_size = k;
+	}
+
+	st->frames0 = aa.getFramesWritten(st->stream);
+	aa_set_stopped(st, 0);
+	if(aa.requestStart(st->stream) != AAUDIO_OK) return LIBLOSSLESS_ERR_AU_START;
+	return 0;
+}
+
+static void aa_stop(msm_ctx *ctx) {
+    aa_state *st = (aa_state *) ctx->sink_data;
+	if(!st || !st->stream) return;
+	aa_set_stopped(st, 1);
+	aa_pause_wait(st);
+}
+
+static ssize_t aa_write(msm_ctx *ctx, const void *buf, size_t count) {
+
+    aa_state *st = (aa_state *) ctx->sink_data;
+    int frame, frames, done = 0;
+    aaudio_result_t r;
+
+	if(!st || !st->stream) return -1;
+	frame = st->channels * 2;
+	frames = count / frame;
+	while(done < frames && !aa_stopped(st)) {
+	    r = aa.write(st->stream, (const unsigned char *) buf + done * frame, frames - done, AAUDIO_WRITE_TIMEOUT_NS);
+	    if(r < 0) {
+		__android_log_print(ANDROID_LOG_ERROR,"liblossless","aaudio: write error %d", r);
+		break;
+	    }
+	    done += r;
+	}
+	r = aa.getXRunCount(st->stream);
+	if(r > st->xruns) {
+	    ctx->underruns += r - st->xruns;
+	    st->xruns = r;
+	}
+	return done * frame;
+}
+
+static void aa_pause(msm_ctx *ctx) {
+    aa_state *st = (aa_state *) ctx->sink_data;
+	if(st && st->stream) aa.requestPause(st->stream);
+}
+
+static void aa_resume(msm_ctx *ctx) {
+    aa_state *st = (aa_state *) ctx->sink_data;
+	if(st && st->stream) aa.requestStart(st->stream);
+}
+
+/* only takes effect while paused, as AAudio wants: after aa_stop() or
+   aa_pause() */
+static void aa_flush(msm_ctx *ctx) {
+    aa_state *st = (aa_state *) ctx->sink_data;
+	if(st && st->stream) aa.requestFlush(st->stream);
+}
+
+static int aa_latency(msm_ctx *ctx) {
+
+    aa_state *st = (aa_state *) ctx->sink_data;
+    int64_t queued;
+
+	if(!st || !st->stream) return 0;
+	queued = aa.getFramesWritten(st->stream) - aa.getFramesRead(st->stream);
+	return queued > 0 ? queued * 1000 / st->samplerate : 0;
+}
+
+/* The frame the device presented at the time of the last timestamp, moved
+   on to now. Without a timestamp, as while paused, the frames it has read. */
+static int64_t aa_played(msm_ctx *ctx) {
+
+    aa_state *st = (aa_state *) ctx->sink_data;
+    int64_t pos, t, written;
+    struct timespec now;
+
+	if(!st || !st->stream) return -1;
+	written = aa.getFramesWritten(st->stream);
+	if(aa.getTimestamp(st->stream, CLOCK_MONOTONIC, &pos, &t) == AAUDIO_OK) {
+	    clock_gettime(CLOCK_MONOTONIC, &now);
+	    t = (int64_t) now.tv_sec * 1000000000LL + now.tv_nsec - t;
+	    if(t > 0) pos += t * st->samplerate / 1000000000LL;
+	    if(pos > written) pos = written;
+	} else pos = aa.getFramesRead(st->stream);
+	pos -= st->frames0;
+	return pos > 0 ? pos * 1000 / st->samplerate : 0;
+}
+
+/* AAudio has no drain, so poll until the device has read what we wrote */
+static void aa_wait_done(msm_ctx *ctx) {
+
+    aa_state *st = (aa_state *) ctx->sink_data;
+    int ms, waited = 0;
+
+	if(!st || !st->stream) return;
+	while(!aa_stopped(st) && (ms = aa_latency(ctx)) > 0 && waited < AAUDIO_WAIT_DONE_MS) {
+	    if(ms > 100) ms = 100;
+	    usleep(ms * 1000);
+	    waited += ms;
+	}
+}
+
+const audio_sink aaudio_sink = {
+    .name = "AAudio",
+    .start = aa_start,
+    .stop = aa_stop,
+    .write = aa_write,
+    .pause = aa_pause,
+    .resume = aa_resume,
+    .flush = aa_flush,
+    .latency = aa_latency,
+    .played = aa_played,
+    .wait_done = aa_wait_done,
+    .exit = aa_exit,
+};
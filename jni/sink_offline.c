@@ -0,0 +1,213 @@
+/* Offline outputs, see sink.h.
+ *
+ * MODE_NULL throws the PCM away and MODE_FILE writes it to a WAV file set
+ * with audioSetOutputFile(). Neither blocks, so a decoder runs as fast as
+ * the CPU allows (audio_paced() is false for both); everything else, from
+ * seeking to pause and stop, goes through the usual playback code. When
+ * the output is stopped, or the track played to the end, the amount
+ * written and the decode speed are logged, with the CRC-32 of the PCM
+ * (zlib's) for checking a decoder bit for bit against a reference, e.g.
+ *   ffmpeg -i file -f s16le - | gzip -c | tail -c8 | od -An -tx4 -N4
+ * These outputs run on the device, inside the app or from a test driving
+ * the service over adb; there is no host build of the decoders to run them
+ * in CI. */
+
+#include <stdlib.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <time.h>
+#include <android/log.h>
+#include "main.h"
+#include "sink.h"
+
+#define WAV_HEADER_SIZE		44
+
+typedef struct {
+    int fd;			// MODE_FILE: output file, or -1
+    int channels, samplerate;
+    uint64_t bytes;		// written since start
+    uint32_t crc;		// of those bytes, see crc32_update()
+    struct timespec t0;		// when started
+    unsigned char buf[DEFAULT_CONF_BUFSZ];	// for audio_obtain_buffer()
+} offline_state;
+
+static uint32_t crc_table[256];
+
+static void crc32_init(void) {
+    uint32_t c;
+    int n, k;
+	if(crc_table[1]) return;
+	for(n = 0; n < 256; n++) {
+	    for(c = n, k = 0; k < 8; k++) c = (c & 1) ? 0xedb88320U ^ (c >> 1) : c >> 1;
+	    crc_table[n] = c;
+	}
+}
+
+static uint32_t crc32_update(uint32_t crc, const unsigned char *p, size_t count) {
+	crc = ~crc;
+	while(count--) crc = crc_table[(crc ^ *p++) & 0xff] ^ (crc >> 8);
+	return ~crc;
+}
+
+static void put_le(unsigned char *p, uint32_t v, int n) {
+	while(n--) { *p++ = v; v >>= 8; }
+}
+
+static void wav_header(unsigned char *h, int channels, int samplerate, uint64_t bytes) {
+    uint32_t data = bytes > 0xffffffffULL - WAV_HEADER_SIZE ? 0xffffffffU - WAV_HEADER_SIZE : (uint32_t) bytes;
+	memcpy(h, "RIFF", 4); put_le(h + 4, data + WAV_HEADER_SIZE - 8, 4);
+	memcpy(h + 8, "WAVEfmt ", 8); put_le(h + 16, 16, 4);
+	put_le(h + 20, 1, 2);				// PCM
+	put_le(h + 22, channels, 2);
+	put_le(h + 24, samplerate, 4);
+	put_le(h + 28, samplerate * channels * 2, 4);	// byte rate
+	put_le(h + 32, channels * 2, 2);		// block align
+	put_le(h + 34, 16, 2);				// bits per sample
+	memcpy(h + 36, "data", 4); put_le(h + 40, data, 4);
+}
+
+static int write_full(int fd, const void *buf, size_t count) {
+    const unsigned char *p = (const unsigned char *) buf;
+    ssize_t n;
+	while(count) {
+	    n = write(fd, p, count);
+	    if(n <= 0) return -1;
+	    p += n; count -= n;
+	}
+	return 0;
+}
+
+/* Rewrites the header with the final sizes and closes the file. */
+static void close_file(offline_state *st) {
+    unsigned char h[WAV_HEADER_SIZE];
+	if(st->fd < 0) return;
+	wav_header(h, st->channels, st->samplerate, st->bytes);
+	if(lseek(st->fd, 0, SEEK_SET) != 0 || write_full(st->fd, h, sizeof(h)) != 0)
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","file output: cannot update header");
+	close(st->fd);
+	st->fd = -1;
+}
+
+static int offline_start(msm_ctx *ctx, int channels, int samplerate) {
+
+    offline_state *st = (offline_state *) ctx->sink_data;
+    unsigned char h[WAV_HEADER_SIZE];
+
+	if(!st) {
+	    st = (offline_state *) malloc(sizeof(offline_state));
+	    if(!st) return LIBLOSSLESS_ERR_NOMEM;
+	    st->fd = -1;
+	    st->samplerate = 0;
+	    ctx->sink_data = st;
+	}
+	close_file(st);
+	st->channels = channels;
+	st->samplerate = samplerate;
+	st->bytes = 0;
+	st->crc = 0;
+	crc32_init();
+
+	if(ctx->mode == MODE_FILE) {
+	    if(!ctx->outfile) return LIBLOSSLESS_ERR_INV_PARM;
+	    st->fd = open(ctx->outfile, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+	    if(st->fd < 0) {
+		__android_log_print(ANDROID_LOG_ERROR,"liblossless","file output: cannot create %s", ctx->outfile);
+		return LIBLOSSLESS_ERR_IO_WRITE;
+	    }
+	    wav_header(h, channels, samplerate, 0);
+	    if(write_full(st->fd, h, sizeof(h)) != 0) {
+		close(st->fd); st->fd = -1;
+		return LIBLOSSLESS_ERR_IO_WRITE;
+	    }
+	}
+	clock_gettime(CLOCK_MONOTONIC, &st->t0);
+	return 0;
+}
+
+static void offline_stop(msm_ctx *ctx) {
+
+    offline_state *st = (offline_state *) ctx->sink_data;
+    struct timespec t;
+    int64_t ms, played_ms;
+
+	if(!st || !st->samplerate) return;	// not started, or stopped already
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	ms = (int64_t) (t.tv_sec - st->t0.tv_sec) * 1000 + (t.tv_nsec - st->t0.tv_nsec) / 1000000;
+	played_ms = st->bytes * 1000 / (st->channels * 2 * st->samplerate);
+	__android_log_print(ANDROID_LOG_INFO,"liblossless","%s output: %lld bytes, crc32 %08x, %lld ms of audio in %lld ms (x%lld)",
+		ctx->mode == MODE_FILE ? "file" : "null", (long long) st->bytes, st->crc, (long long) played_ms,
+		(long long) ms, (long long) (ms ? played_ms / ms : 0));
+	close_file(st);
+	st->samplerate = 0;
+}
+
+static ssize_t offline_write(msm_ctx *ctx, const void *buf, size_t count) {
+
+    offline_state *st = (offline_state *) ctx->sink_data;
+
+	if(!st) return -1;
+	if(st->fd >= 0 && write_full(st->fd, buf, count) != 0) {
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","file output: write failed");
+	    return -1;
+	}
+	st->crc = crc32_update(st->crc, (const unsigned char *) buf, count);
+	st->bytes += count;
+	return count;
+}
+
+static unsigned char *offline_obtain(msm_ctx *ctx, size_t *count) {
+
+    offline_state *st = (offline_state *) ctx->sink_data;
+    int frame;
+
+	if(!st || ctx->state == MSM_STOPPED) return 0;
+	frame = st->channels * 2;
+	if(*count > sizeof(st->buf)) *count = sizeof(st->buf);
+	*count -= *count % frame;
+	if(!*count) *count = frame;
+	return st->buf;
+}
+
+static void offline_release(msm_ctx *ctx, size_t count) {
+	offline_write(ctx, ((offline_state *) ctx->sink_data)->buf, count);
+}
+
+static ssize_t offline_play(msm_ctx *ctx, const void *buf, size_t count) {
+    ssize_t n = offline_write(ctx, buf, count);
+	if(n > 0) audio_written_add(ctx, n);
+	return n;
+}
+
+static void offline_exit(msm_ctx *ctx) {
+    offline_state *st = (offline_state *) ctx->sink_data;
+	if(!st) return;
+	close_file(st);
+	free(st);
+	ctx->sink_data = 0;
+}
+
+const audio_sink null_sink = {
+    .name = "null",
+    .start = offline_start,
+    .stop = offline_stop,
+    .write = offline_write,
+    .wait_done = offline_stop,
+    .obtain = offline_obtain,
+    .release = offline_release,
+    .play = offline_play,
+    .exit = offline_exit,
+};
+
+const audio_sink file_sink = {
+    .name = "WAV file",
+    .start = offline_start,
+    .stop = offline_stop,
+    .write = offline_write,
+    .wait_done = offline_stop,
+    .obtain = offline_obtain,
+    .release = offline_release,
+    .play = offline_play,
+    .exit = offline_exit,
+};
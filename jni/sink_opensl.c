@@ -0,0 +1,359 @@
+/* OpenSL ES output, see sink.h.
+ *
+ * PCM goes to an Android simple buffer queue of SL_BUFFERS buffers of
+ * ctx->conf_size bytes each, which together hold about ctx->buf_ms. Decoders either audio_write() into them (one
+ * copy, like MODE_LIBMEDIA) or fill them in place through
+ * audio_obtain_buffer(). A buffer is enqueued once it is full; the queue
+ * callback only counts the buffers that have been played.
+ *
+ * libOpenSLES is loaded with dlopen() so that liblossless still loads on
+ * Android versions without it; the headers need APP_PLATFORM android-9 or
+ * later. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <dlfcn.h>
+#include <android/log.h>
+#include <SLES/OpenSLES.h>
+#include <SLES/OpenSLES_Android.h>
+#include "main.h"
+#include "sink.h"
+
+#define SL_BUFFERS	(BUFFER_PERIODS + 1)
+
+typedef struct {
+    SLObjectItf engine_obj, mix_obj, player_obj;
+    SLEngineItf engine;
+    SLPlayItf play;
+    SLAndroidSimpleBufferQueueItf queue;
+    int channels, samplerate;	// format of player_obj
+    unsigned char *buf[SL_BUFFERS];
+    int size;			// bytes in each buffer
+    int head;			// buffer being filled
+    int fill;			// bytes stored in it so far
+    int queued;			// buffers enqueued and not played yet
+    int low;			// once all are queued, wait until no more than this are left
+    int stopped;
+    int draining;		// wait_done(): an empty queue isn't an underrun
+    msm_ctx *ctx;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} sl_state;
+
+static void *libsl = 0;
+static SLresult (*sl_create_engine)(SLObjectItf *, SLuint32, const SLEngineOption *,
+		SLuint32, const SLInterfaceID *, const SLboolean *);
+static SLInterfaceID iid_engine, iid_play, iid_queue;
+
+static int sl_iid(const char *name, SLInterfaceID *iid) {
+    SLInterfaceID *p = (SLInterfaceID *) dlsym(libsl, name);
+	if(!p) return 0;
+	*iid = *p;
+	return 1;
+}
+
+static int sl_load(void) {
+
+	if(libsl) return 1;
+	libsl = dlopen("libOpenSLES.so", RTLD_NOW);
+	if(!libsl) {
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","opensl: cannot load libOpenSLES.so");
+	    return 0;
+	}
+	sl_create_engine = (typeof(sl_create_engine)) dlsym(libsl, "slCreateEngine");
+	if(!sl_create_engine || !sl_iid("SL_IID_ENGINE", &iid_engine) || !sl_iid("SL_IID_PLAY", &iid_play)
+		|| !sl_iid("SL_IID_ANDROIDSIMPLEBUFFERQUEUE", &iid_queue)) {
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","opensl: symbols missing");
+	    dlclose(libsl); libsl = 0;
+	    return 0;
+	}
+	return 1;
+}
+
+static void sl_callback(SLAndroidSimpleBufferQueueItf queue, void *context) {
+    sl_state *st = (sl_state *) context;
+	pthread_mutex_lock(&st->mutex);
+	if(st->queued > 0) st->queued--;
+	if(!st->queued && !st->stopped && !st->draining) __sync_fetch_and_add(&st->ctx->underruns, 1);
+	if(st->queued <= st->low) pthread_cond_broadcast(&st->cond);
+	pthread_mutex_unlock(&st->mutex);
+}
+
+/* Queues the buffer being filled, called with st->mutex held. The mutex is
+   let go meanwhile: only the decoder thread enqueues, but the callback
+   mustn't wait for us while OpenSL holds its own locks. */
+static void sl_enqueue(sl_state *st) {
+
+    unsigned char *b = st->buf[st->head];
+    int n = st->fill;
+
+	st->queued++;
+	st->head = (st->head + 1) % SL_BUFFERS;
+	st->fill = 0;
+	pthread_mutex_unlock(&st->mutex);
+	if((*st->queue)->Enqueue(st->queue, b, n) != SL_RESULT_SUCCESS) {
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","opensl: Enqueue failed");
+	    pthread_mutex_lock(&st->mutex);
+	    st->queued--;
+	    return;
+	}
+	pthread_mutex_lock(&st->mutex);
+}
+
+/* Waits for a buffer to fill, called with st->mutex held. 0 if stopped.
+   With MODE_FLAG_POWER_SAVING a full queue has to drain to st->low first,
+   so the decoder refills it in one burst rather than a buffer at a time. */
+static int sl_wait_buffer(sl_state *st) {
+	if(st->queued == SL_BUFFERS)
+	    while(!st->stopped && st->queued > st->low) pthread_cond_wait(&st->cond, &st->mutex);
+	return !st->stopped;
+}
+
+static void sl_destroy_player(sl_state *st) {
+	if(st->player_obj) (*st->player_obj)->Destroy(st->player_obj);
+	st->player_obj = 0; st->play = 0; st->queue = 0;
+}
+
+static void sl_exit(msm_ctx *ctx) {
+
+    sl_state *st = (sl_state *) ctx->sink_data;
+    int k;
+
+	if(!st) return;
+	sl_destroy_player(st);
+	if(st->mix_obj) (*st->mix_obj)->Destroy(st->mix_obj);
+	if(st->engine_obj) (*st->engine_obj)->Destroy(st->engine_obj);
+	for(k = 0; k < SL_BUFFERS; k++) free(st->buf[k]);
+	pthread_mutex_destroy(&st->mutex);
+	pthread_cond_destroy(&st->cond);
+	free(st);
+	ctx->sink_data = 0;
+}
+
+static int sl_create_player(sl_state *st, int channels, int samplerate) {
+
+    SLDataLocator_AndroidSimpleBufferQueue loc_queue = { SL_DATALOCATOR_ANDROIDSIMPLEBUFFERQUEUE, SL_BUFFERS };
+    SLDataFormat_PCM format = { SL_DATAFORMAT_PCM, channels, samplerate * 1000,
+		SL_PCMSAMPLEFORMAT_FIXED_16, SL_PCMSAMPLEFORMAT_FIXED_16,
+		channels == 2 ? SL_SPEAKER_FRONT_LEFT | SL_SPEAKER_FRONT_RIGHT : SL_SPEAKER_FRONT_CENTER,
+		SL_BYTEORDER_LITTLEENDIAN };
+    SLDataSource src = { &loc_queue, &format };
+    SLDataLocator_OutputMix loc_mix = { SL_DATALOCATOR_OUTPUTMIX, st->mix_obj };
+    SLDataSink snk = { &loc_mix, 0 };
+    const SLInterfaceID ids[1] = { iid_queue };
+    const SLboolean req[1] = { SL_BOOLEAN_TRUE };
+
+	if((*st->engine)->CreateAudioPlayer(st->engine, &st->player_obj, &src, &snk, 1, ids, req) != SL_RESULT_SUCCESS) {
+	    st->player_obj = 0;
+	    return LIBLOSSLESS_ERR_AU_SETCONF;
+	}
+	if((*st->player_obj)->Realize(st->player_obj, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS
+		|| (*st->player_obj)->GetInterface(st->player_obj, iid_play, &st->play) != SL_RESULT_SUCCESS
+		|| (*st->player_obj)->GetInterface(st->player_obj, iid_queue, &st->queue) != SL_RESULT_SUCCESS
+		|| (*st->queue)->RegisterCallback(st->queue, sl_callback, st) != SL_RESULT_SUCCESS) {
+	    sl_destroy_player(st);
+	    return LIBLOSSLESS_ERR_AU_SETUP;
+	}
+	st->channels = channels;
+	st->samplerate = samplerate;
+	return 0;
+}
+
+static int sl_start(msm_ctx *ctx, int channels, int samplerate) {
+
+    sl_state *st = (sl_state *) ctx->sink_data;
+    int k;
+
+	if(!sl_load()) return LIBLOSSLESS_ERR_INIT;
+
+	if(!st) {
+	    st = (sl_state *) calloc(1, sizeof(sl_state));
+	    if(!st) return LIBLOSSLESS_ERR_NOMEM;
+	    pthread_mutex_init(&st->mutex, 0);
+	    pthread_cond_init(&st->cond, 0);
+	    st->ctx = ctx;
+	    ctx->sink_data = st;
+	    if(sl_create_engine(&st->engine_obj, 0, 0, 0, 0, 0) != SL_RESULT_SUCCESS) {
+		st->engine_obj = 0;
+		sl_exit(ctx);
+		return LIBLOSSLESS_ERR_INIT;
+	    }
+	    if((*st->engine_obj)->Realize(st->engine_obj, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS
+		    || (*st->engine_obj)->GetInterface(st->engine_obj, iid_engine, &st->engine) != SL_RESULT_SUCCESS
+		    || (*st->engine)->CreateOutputMix(st->engine, &st->mix_obj, 0, 0, 0) != SL_RESULT_SUCCESS) {
+		sl_exit(ctx);
+		return LIBLOSSLESS_ERR_INIT;
+	    }
+	    if((*st->mix_obj)->Realize(st->mix_obj, SL_BOOLEAN_FALSE) != SL_RESULT_SUCCESS) {
+		sl_exit(ctx);
+		return LIBLOSSLESS_ERR_INIT;
+	    }
+	}
+
+	if(st->player_obj && (st->channels != channels || st->samplerate != samplerate)) sl_destroy_player(st);
+	if(st->player_obj) {
+	    (*st->play)->SetPlayState(st->play, SL_PLAYSTATE_STOPPED);
+	    (*st->queue)->Clear(st->queue);
+	} else if((k = sl_create_player(st, channels, samplerate)) != 0) {
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","opensl: cannot play %d channels at %d Hz", channels, samplerate);
+	    return k;
+	}
+
+	/* the queue is empty now, so the buffers can follow ctx->conf_size */
+	if(st->size != ctx->conf_size) {
+	    for(k = 0; k < SL_BUFFERS; k++) {
+		free(st->buf[k]);
+		st->buf[k] = (unsigned char *) malloc(ctx->conf_size);
+		if(!st->buf[k]) {
+		    st->size = 0;
+		    return LIBLOSSLESS_ERR_NOMEM;
+		}
+	    }
+	    st->size = ctx->conf_size;
+	}
+
+	pthread_mutex_lock(&st->mutex);
+	st->queued = 0; st->head = 0; st->fill = 0;
+	st->stopped = 0; st->draining = 0;
+	st->low = (ctx->mode_flags & MODE_FLAG_POWER_SAVING) ? SL_BUFFERS * BURST_LOW_WATER / 100 : SL_BUFFERS - 1;
+	pthread_mutex_unlock(&st->mutex);
+
+	if((*st->play)->SetPlayState(st->play, SL_PLAYSTATE_PLAYING) != SL_RESULT_SUCCESS) return LIBLOSSLESS_ERR_AU_START;
+	return 0;
+}
+
+static void sl_stop(msm_ctx *ctx) {
+
+    sl_state *st = (sl_state *) ctx->sink_data;
+
+	if(!st || !st->player_obj) return;
+	pthread_mutex_lock(&st->mutex);
+	st->stopped = 1;
+	pthread_cond_broadcast(&st->cond);
+	pthread_mutex_unlock(&st->mutex);
+	(*st->play)->SetPlayState(st->play, SL_PLAYSTATE_STOPPED);
+}
+
+static ssize_t sl_write(msm_ctx *ctx, const void *buf, size_t count) {
+
+    sl_state *st = (sl_state *) ctx->sink_data;
+    size_t done = 0, n;
+
+	if(!st || !st->player_obj) return -1;
+	pthread_mutex_lock(&st->mutex);
+	while(done < count && sl_wait_buffer(st)) {
+	    n = st->size - st->fill;
+	    if(n > count - done) n = count - done;
+	    memcpy(st->buf[st->head] + st->fill, (const unsigned char *) buf + done, n);
+	    st->fill += n;
+	    done += n;
+	    if(st->fill == st->size) sl_enqueue(st);
+	}
+	pthread_mutex_unlock(&st->mutex);
+	return done;
+}
+
+static unsigned char *sl_obtain(msm_ctx *ctx, size_t *count) {
+
+    sl_state *st = (sl_state *) ctx->sink_data;
+    int frame;
+    unsigned char *p = 0;
+
+	if(!st || !st->player_obj) return 0;
+	frame = st->channels * 2;
+	pthread_mutex_lock(&st->mutex);
+	if(sl_wait_buffer(st)) {
+	    if(*count > (size_t) (st->size - st->fill)) *count = st->size - st->fill;
+	    *count -= *count % frame;
+	    if(!*count) *count = frame;
+	    p = st->buf[st->head] + st->fill;
+	}
+	pthread_mutex_unlock(&st->mutex);
+	return p;
+}
+
+static void sl_release(msm_ctx *ctx, size_t count) {
+
+    sl_state *st = (sl_state *) ctx->sink_data;
+
+	pthread_mutex_lock(&st->mutex);
+	if(!st->stopped) {
+	    st->fill += count;
+	    if(st->fill >= st->size) sl_enqueue(st);
+	}
+	pthread_mutex_unlock(&st->mutex);
+}
+
+static void sl_pause(msm_ctx *ctx) {
+    sl_state *st = (sl_state *) ctx->sink_data;
+	if(st && st->player_obj) (*st->play)->SetPlayState(st->play, SL_PLAYSTATE_PAUSED);
+}
+
+static void sl_resume(msm_ctx *ctx) {
+    sl_state *st = (sl_state *) ctx->sink_data;
+	if(st && st->player_obj) (*st->play)->SetPlayState(st->play, SL_PLAYSTATE_PLAYING);
+}
+
+static void sl_flush(msm_ctx *ctx) {
+
+    sl_state *st = (sl_state *) ctx->sink_data;
+
+	if(!st || !st->player_obj) return;
+	(*st->queue)->Clear(st->queue);
+	pthread_mutex_lock(&st->mutex);
+	st->queued = 0; st->head = 0; st->fill = 0;
+	pthread_cond_broadcast(&st->cond);
+	pthread_mutex_unlock(&st->mutex);
+}
+
+/* SL_PLAYSTATE_STOPPED in sl_start() sets the position back to 0 */
+static int64_t sl_played(msm_ctx *ctx) {
+
+    sl_state *st = (sl_state *) ctx->sink_data;
+    SLmillisecond ms;
+
+	if(!st || !st->player_obj || (*st->play)->GetPosition(st->play, &ms) != SL_RESULT_SUCCESS) return -1;
+	return ms;
+}
+
+/* The buffer being played counts as whole, so this is an upper bound */
+static int sl_latency(msm_ctx *ctx) {
+
+    sl_state *st = (sl_state *) ctx->sink_data;
+    int64_t bytes;
+
+	if(!st || !st->player_obj) return 0;
+	pthread_mutex_lock(&st->mutex);
+	bytes = (int64_t) st->queued * st->size + st->fill;
+	pthread_mutex_unlock(&st->mutex);
+	return bytes * 1000 / (st->samplerate * st->channels * 2);
+}
+
+static void sl_wait_done(msm_ctx *ctx) {
+
+    sl_state *st = (sl_state *) ctx->sink_data;
+
+	if(!st || !st->player_obj) return;
+	pthread_mutex_lock(&st->mutex);
+	st->draining = 1;
+	if(st->fill && !st->stopped) sl_enqueue(st);	// the last one isn't full
+	while(!st->stopped && st->queued > 0) pthread_cond_wait(&st->cond, &st->mutex);
+	pthread_mutex_unlock(&st->mutex);
+}
+
+const audio_sink opensl_sink = {
+    .name = "OpenSL ES",
+    .start = sl_start,
+    .stop = sl_stop,
+    .write = sl_write,
+    .pause = sl_pause,
+    .resume = sl_resume,
+    .flush = sl_flush,
+    .latency = sl_latency,
+    .played = sl_played,
+    .wait_done = sl_wait_done,
+    .obtain = sl_obtain,
+    .release = sl_release,
+    .exit = sl_exit,
+};
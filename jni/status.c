@@ -0,0 +1,94 @@
+/* Playback status for the UI process.
+ *
+ * The UI used to ask the service for the position, duration and state over
+ * binder twice a second. Now each context keeps an audio_status block (see
+ * main.h) in ashmem; audioGetStatusFd() gives its descriptor to the service,
+ * which passes it to the UI as a ParcelFileDescriptor, and the UI maps it
+ * read only and reads it without any IPC.
+ *
+ * The block is a seqlock: a writer makes seq odd, updates the fields and
+ * makes it even again, and a reader retries while seq is odd or has changed
+ * under it. Writers are serialized by ctx->statmutex. The UI's reader is in
+ * status_read.c. The position is stored
+ * along with the time it was taken, so the UI moves it on by itself and the
+ * decoder only needs to refresh it every STATUS_PERIOD_MS. */
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dlfcn.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <android/log.h>
+#include "main.h"
+
+/* from <linux/ashmem.h> */
+#define ASHMEM_NAME_LEN		256
+#define ASHMEM_SET_NAME		_IOW(0x77, 1, char[ASHMEM_NAME_LEN])
+#define ASHMEM_SET_SIZE		_IOW(0x77, 3, size_t)
+
+#define STATUS_NAME		"liblossless-status"
+
+/* ASharedMemory_create() on Android 8.0 and later, where apps may lose
+   access to /dev/ashmem; the device node before that. */
+static int ashmem_create(const char *name, size_t size) {
+
+    static int (*create)(const char *, size_t) = 0;
+    void *lib;
+    int fd;
+
+	if(!create && (lib = dlopen("libandroid.so", RTLD_NOW)) != 0) {
+	    create = (typeof(create)) dlsym(lib, "ASharedMemory_create");
+	    if(!create) dlclose(lib);
+	}
+	if(create) return create(name, size);
+	fd = open("/dev/ashmem", O_RDWR);
+	if(fd < 0) return -1;
+	if(ioctl(fd, ASHMEM_SET_NAME, name) < 0 || ioctl(fd, ASHMEM_SET_SIZE, size) < 0) {
+	    close(fd);
+	    return -1;
+	}
+	return fd;
+}
+
+/* Maps a new status block for ctx; without one, the UI falls back to binder calls. */
+int status_init(msm_ctx *ctx) {
+
+    void *p;
+
+	ctx->status = 0;
+	ctx->status_fd = ashmem_create(STATUS_NAME, sizeof(audio_status));
+	if(ctx->status_fd < 0) {
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","status: cannot create shared memory");
+	    return 0;
+	}
+	p = mmap(0, sizeof(audio_status), PROT_READ | PROT_WRITE, MAP_SHARED, ctx->status_fd, 0);
+	if(p == MAP_FAILED) {
+	    close(ctx->status_fd);
+	    ctx->status_fd = -1;
+	    return 0;
+	}
+	memset(p, 0, sizeof(audio_status));
+	ctx->status = (audio_status *) p;
+	return 1;
+}
+
+void status_exit(msm_ctx *ctx) {
+	if(ctx->status) munmap(ctx->status, sizeof(audio_status));
+	if(ctx->status_fd >= 0) close(ctx->status_fd);
+	ctx->status = 0;
+	ctx->status_fd = -1;
+}
+
+void status_lock(msm_ctx *ctx) {
+	pthread_mutex_lock(&ctx->statmutex);
+	ctx->status->seq++;
+	__sync_synchronize();
+}
+
+void status_unlock(msm_ctx *ctx) {
+	__sync_synchronize();
+	ctx->status->seq++;
+	pthread_mutex_unlock(&ctx->statmutex);
+}
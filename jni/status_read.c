@@ -0,0 +1,43 @@
+/* The UI's side of the status block, see status.c.
+ *
+ * Java can't order its reads of a mapped ByteBuffer: a volatile field read
+ * next to them fences neither the compiler nor the CPU for the buffer, so
+ * AndLessSrv.StatusBlock copies the block through here, with the barriers
+ * the seqlock needs around the payload. This is a library of its own,
+ * libstatusblock.so, so that the UI process doesn't load the decoders. */
+
+#include <string.h>
+#include <stdbool.h>
+#include <sched.h>
+#include "main.h"
+
+#define READ_TRIES	100
+
+/* Copies the block mapped at block into out, whole ints in native order.
+   Returns false if it kept changing under us. */
+JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_00024StatusBlock_readBlock(JNIEnv *env, jclass cls,
+		jobject block, jintArray out) {
+
+    const audio_status *s = (const audio_status *) (*env)->GetDirectBufferAddress(env, block);
+    audio_status copy;
+    int32_t seq;
+    int k;
+
+	if(!s || (*env)->GetDirectBufferCapacity(env, block) < (jlong) sizeof(audio_status)
+		|| (*env)->GetArrayLength(env, out) < (jsize) (sizeof(audio_status) / sizeof(jint))) return false;
+	for(k = 0; k < READ_TRIES; k++) {
+	    seq = s->seq;
+	    if(seq & 1) {
+		sched_yield();
+		continue;
+	    }
+	    __sync_synchronize();	// the payload after seq, pairs with status_unlock()
+	    memcpy(&copy, (const void *) s, sizeof(copy));
+	    __sync_synchronize();	// and before seq again, pairs with status_lock()
+	    if(s->seq == seq) {
+		(*env)->SetIntArrayRegion(env, out, 0, sizeof(copy) / sizeof(jint), (const jint *) &copy);
+		return true;
+	    }
+	}
+	return false;
+}
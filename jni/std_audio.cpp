@@ -80,7 +80,6 @@ int libmedia_start(msm_ctx *ctx, int channels, int samplerate) {
   }
 #endif
   __android_log_print(ANDROID_LOG_INFO,"liblossless","AudioTrack setup OK, starting audio!");
-   ctx->conf_size = DEFAULT_CONF_BUFSZ; 	
    atrack->start();	
   __android_log_print(ANDROID_LOG_INFO,"liblossless","playback started!");
    return 0; 
@@ -120,6 +119,13 @@ ssize_t libmedia_write(msm_ctx *ctx, const void *buf, size_t count) {
   else return -1;
 }
 
+// Both start functions flush() a track they reuse, which sets its position back to 0.
+int64_t libmedia_played(msm_ctx *ctx) {
+  uint32_t pos;
+  if(!ctx || !ctx->track || !ctx->samplerate || ((AudioTrack *) ctx->track)->getPosition(&pos) != NO_ERROR) return -1;
+  return (int64_t) pos * 1000 / ctx->samplerate;
+}
+
 ////////////////////////////////////
 ////////// MODE_CALLBACK ///////////
 
@@ -131,6 +137,27 @@ static void print_priority(const char *c) {
 
 static void cbf(int event, void* user, void *info);
 
+// The ring holds ctx->buf_ms of audio, and at least two writes. Its size has
+// to be a multiple of 4 so that libmediacb_obtain() never splits a frame, and
+// not a multiple of ctx->conf_size. Also sets the low-water mark, see
+// wait_room(). Called while the callback is stopped.
+static bool alloc_ring(msm_ctx *ctx, int channels, int samplerate) {
+
+   int size = (int64_t) channels * 2 * samplerate * ctx->buf_ms / 1000;
+
+	if(size < 2 * ctx->conf_size) size = 2 * ctx->conf_size;
+	size = (size & ~3) + 4;
+	if(size % ctx->conf_size == 0) size += 4;
+	ctx->cblow = (ctx->mode_flags & MODE_FLAG_POWER_SAVING) ? size / 100 * BURST_LOW_WATER : size;
+	if(ctx->cbbuf && ctx->cbbuf_size == size) return true;
+	pthread_mutex_lock(&ctx->cbmutex);
+	free(ctx->cbbuf);
+	ctx->cbbuf = (unsigned char *) malloc(size);
+	ctx->cbbuf_size = ctx->cbbuf ? size : 0;
+	pthread_mutex_unlock(&ctx->cbmutex);
+	return ctx->cbbuf != 0;
+}
+
 int libmediacb_start(msm_ctx *ctx, int channels, int samplerate) {
 
    status_t status;
@@ -143,20 +170,19 @@ int libmediacb_start(msm_ctx *ctx, int channels, int samplerate) {
 
    AudioTrack* atrack = (AudioTrack *) ctx->track;
 
+   ctx->cbsrc = 0;
+
    if(atrack && ctx->samplerate == samplerate && ctx->channels == channels) {
   __android_log_print(ANDROID_LOG_INFO,"liblossless","same audio track parameters, restarting");
 	atrack->stop();
 	atrack->flush();
+	if(!alloc_ring(ctx, channels, samplerate)) return LIBLOSSLESS_ERR_NOMEM;
 	ctx->cbstart = 0; ctx->cbend = 0;
 	atrack->start();
 	return 0; 
    }	
 
-   if(!ctx->cbbuf) {
-	ctx->cbbuf = (unsigned char *) malloc(DEFAULT_CB_BUFSZ);
-	if(!ctx->cbbuf) return LIBLOSSLESS_ERR_NOMEM;
-	ctx->cbbuf_size = DEFAULT_CB_BUFSZ;
-   }		
+   if(!alloc_ring(ctx, channels, samplerate)) return LIBLOSSLESS_ERR_NOMEM;
 
    ctx->cbstart = 0; ctx->cbend = 0;	
 
@@ -204,7 +230,6 @@ int libmediacb_start(msm_ctx *ctx, int channels, int samplerate) {
    }		
 
   __android_log_print(ANDROID_LOG_INFO,"liblossless","AudioTrack setup OK, starting audio!");
-   ctx->conf_size = DEFAULT_CONF_BUFSZ; 	
    atrack->start();	
   __android_log_print(ANDROID_LOG_INFO,"liblossless","playback started!");
 
@@ -237,6 +262,17 @@ static inline int get_free_bytes(msm_ctx *ctx) {
    return (ctx->cbend >= ctx->cbstart) ?  ctx->cbbuf_size - (ctx->cbend - ctx->cbstart) : ctx->cbstart - ctx->cbend;
 }
 
+// Waits, with cbmutex held, until more than count bytes are free. A ring that
+// is full drains to ctx->cblow first: in the power saving mode the decoder
+// then fills it in one burst and sleeps for seconds in between, instead of
+// waking up for every callback.
+static void wait_room(msm_ctx *ctx, int count) {
+	if(get_free_bytes(ctx) > count) return;
+	while(ctx->cbstart >= 0 && (get_free_bytes(ctx) <= count
+		|| ctx->cbbuf_size - get_free_bytes(ctx) > ctx->cblow))
+	    pthread_cond_wait(&ctx->cbcond,&ctx->cbmutex);
+}
+
 
 void libmediacb_wait_done(msm_ctx *ctx) {
 	if(!ctx || ctx->cbstart == -1) return;
@@ -258,6 +294,16 @@ void libmediacb_wait_done(msm_ctx *ctx) {
 	pthread_mutex_unlock(&ctx->cbmutex);
 }
 
+// Milliseconds of audio in the ring, not counting what AudioTrack holds.
+int libmediacb_latency(msm_ctx *ctx) {
+    int k;
+	if(!ctx || ctx->cbstart < 0 || !ctx->pace_rate) return 0;
+	pthread_mutex_lock(&ctx->cbmutex);
+	k = ctx->cbbuf_size - get_free_bytes(ctx);
+	pthread_mutex_unlock(&ctx->cbmutex);
+	return (int64_t) k * 1000 / ctx->pace_rate;
+}
+
 ssize_t libmediacb_write(msm_ctx *ctx, const void *buf, size_t cnt) {
 
     int k;
@@ -266,12 +312,7 @@ ssize_t libmediacb_write(msm_ctx *ctx, const void *buf, size_t cnt) {
 	if(!ctx || !ctx->track || count > ctx->cbbuf_size || ctx->cbstart < 0) return -1;	
 	
 	pthread_mutex_lock(&ctx->cbmutex);
-	k = get_free_bytes(ctx); 	
-	while(k <= count && ctx->cbstart >=0) { // prohibit k==count to prevent from cbstart==cbend after write
-//	    __android_log_print(ANDROID_LOG_INFO,"liblossless","libmediacb_write: decoder is ahead, waiting for callback");
-	    pthread_cond_wait(&ctx->cbcond,&ctx->cbmutex);
-	    k = get_free_bytes(ctx);
-	}
+	wait_room(ctx, count);	// prohibit free == count to prevent from cbstart==cbend after write
 	if(ctx->cbstart < 0) {	// we have been stopped from libmediacb_stop
 		pthread_mutex_unlock(&ctx->cbmutex);
 		return -1;
@@ -297,6 +338,69 @@ ssize_t libmediacb_write(msm_ctx *ctx, const void *buf, size_t cnt) {
     return count; 	
 }
 
+// Where the decoder may store up to *count bytes for the callback, so that
+// nothing has to be copied into cbbuf. Waits until more than *count bytes
+// are free, then cuts *count to what fits before the end of the ring (whole
+// frames, cbbuf_size is a multiple of 4). The bytes are queued by
+// libmediacb_release(). NULL once we were stopped.
+unsigned char *libmediacb_obtain(msm_ctx *ctx, size_t *count) {
+
+    int frame, k;
+
+	if(!ctx || !ctx->track || !ctx->cbbuf || ctx->cbstart < 0 || !ctx->channels) return 0;
+	frame = ctx->channels * 2;
+	if(*count > (size_t) ctx->cbbuf_size / 2) *count = ctx->cbbuf_size / 2;
+	*count -= *count % frame;
+	if(!*count) *count = frame;
+
+	pthread_mutex_lock(&ctx->cbmutex);
+	wait_room(ctx, (int) *count);
+	if(ctx->cbstart < 0) {	// we have been stopped from libmediacb_stop
+	    pthread_mutex_unlock(&ctx->cbmutex);
+	    return 0;
+	}
+	// as in libmediacb_write, cbend mustn't catch up with cbstart
+	if(ctx->cbend >= ctx->cbstart) k = ctx->cbbuf_size - ctx->cbend - (ctx->cbstart ? 0 : frame);
+	else k = ctx->cbstart - ctx->cbend - frame;
+	pthread_mutex_unlock(&ctx->cbmutex);
+
+	if(*count > (size_t) k) *count = k;
+    return ctx->cbbuf + ctx->cbend;
+}
+
+void libmediacb_release(msm_ctx *ctx, size_t count) {
+	pthread_mutex_lock(&ctx->cbmutex);
+	if(ctx->cbstart >= 0) {
+	    ctx->cbend += count;
+	    if(ctx->cbend == ctx->cbbuf_size) ctx->cbend = 0;
+	}
+	pthread_mutex_unlock(&ctx->cbmutex);
+}
+
+// Lets the callback copy straight from buf until all of it was played or
+// we were stopped, see audio_play_buffer(). The ring buffer is not used
+// meanwhile, whatever is left in it is played first.
+ssize_t libmediacb_play(msm_ctx *ctx, const void *buf, size_t count) {
+
+    ssize_t played;
+
+	if(!ctx || !ctx->track || ctx->cbstart < 0) return -1;
+
+	pthread_mutex_lock(&ctx->cbmutex);
+	while(get_free_bytes(ctx) < ctx->cbbuf_size && ctx->cbstart >= 0)
+	    pthread_cond_wait(&ctx->cbcond,&ctx->cbmutex);
+	ctx->cbsrc = (const unsigned char *) buf;
+	ctx->cbsrc_size = count;
+	ctx->cbsrc_pos = 0;
+	while(ctx->cbsrc_pos < count && ctx->cbstart >= 0)
+	    pthread_cond_wait(&ctx->cbcond,&ctx->cbmutex);
+	played = ctx->cbsrc_pos;
+	ctx->cbsrc = 0;
+	pthread_mutex_unlock(&ctx->cbmutex);
+
+    return played;
+}
+
 
 
 // Callback for AudioTrack. 
@@ -304,13 +408,17 @@ ssize_t libmediacb_write(msm_ctx *ctx, const void *buf, size_t cnt) {
 
 static void cbf(int event, void* user, void *info) {
   if(event != AudioTrack::EVENT_MORE_DATA) {
-  	if(event == AudioTrack::EVENT_UNDERRUN) __android_log_print(ANDROID_LOG_ERROR,"liblossless","callback: EVENT_UNDERRUN");
+  	if(event == AudioTrack::EVENT_UNDERRUN) {
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","callback: EVENT_UNDERRUN");
+	    trace_instant(((msm_ctx *) user)->trace, TRACE_UNDERRUN,
+		__sync_add_and_fetch(&((msm_ctx *) user)->underruns, 1), 0);
+	}
 	return;
   } 	
   msm_ctx *ctx = (msm_ctx *) user;
   AudioTrack::Buffer *buff = (AudioTrack::Buffer *) info;
   unsigned char *c = (unsigned char *)	buff->raw;
-  unsigned int k;
+  unsigned int k, asked = buff->size;
 
 	if(!buff->size) {
            __android_log_print(ANDROID_LOG_ERROR,"liblossless","callback: audiotrack requested zero bytes");
@@ -321,14 +429,28 @@ static void cbf(int event, void* user, void *info) {
                 pthread_mutex_unlock(&ctx->cbmutex);
                 return;
         }
+	if(ctx->cbsrc) {	// playing from libmediacb_play(), one copy only
+	   size_t left = ctx->cbsrc_size - ctx->cbsrc_pos;
+	   k = (left > buff->size) ? buff->size : left;
+	   buff->size = k;
+	   if(k) {
+		memcpy(c,ctx->cbsrc+ctx->cbsrc_pos,k);
+		ctx->cbsrc_pos += k;
+		audio_written_add(ctx, k);
+	   } else pthread_cond_signal(&ctx->cbdone);
+	   pthread_cond_signal(&ctx->cbcond);
+	   pthread_mutex_unlock(&ctx->cbmutex);
+	   trace_instant(ctx->trace, TRACE_CALLBACK, asked, k);
+	   return;
+	}
         k = ctx->cbbuf_size - get_free_bytes(ctx); // k == bytes available for output
-	if(k < buff->size) {
-           __android_log_print(ANDROID_LOG_INFO,"liblossless",
-		"callback: decoder lags, audiotrack requested too much (%d, avail %d)",buff->size, k);
+	if(k < buff->size) {	// decoder lags, see audioGetStats()
+	   if(ctx->state == MSM_PLAYING) __sync_fetch_and_add(&ctx->lags, 1);
 	   buff->size  = k; // update if we write less	
 	   if(k == 0) {
 		pthread_cond_signal(&ctx->cbdone);
 		pthread_mutex_unlock(&ctx->cbmutex);
+		trace_instant(ctx->trace, TRACE_CALLBACK, asked, 0);
 		return;
 	   }	 
 	}
@@ -345,8 +467,9 @@ static void cbf(int event, void* user, void *info) {
 	    memcpy(c,ctx->cbbuf+ctx->cbstart,buff->size);
 	    ctx->cbstart = 0;			
 	}
-	pthread_cond_signal(&ctx->cbcond);
+	if(ctx->cbbuf_size - get_free_bytes(ctx) <= ctx->cblow) pthread_cond_signal(&ctx->cbcond);
 	pthread_mutex_unlock(&ctx->cbmutex);
+	trace_instant(ctx->trace, TRACE_CALLBACK, asked, buff->size);
 
    static int s = 0;
    if(!s) {
@@ -0,0 +1,133 @@
+/* Trace of the audio pipeline.
+ *
+ * Every context keeps the last TRACE_EVENTS events in a ring (see trace.h),
+ * from the moment it is created: the decoder's stages as spans (a decode
+ * span per frame, every read with the time it took, every write), seeks,
+ * each AudioTrack callback with the bytes asked for and served, underruns,
+ * and the track starting, pausing and stopping. Adding an event takes a
+ * clock read and an atomic increment, so it is always on.
+ *
+ * audioTraceDump() writes the ring to a file in the Chrome trace event
+ * format, which chrome://tracing and ui.perfetto.dev open. With
+ * audioSetAtrace() the stages other than decoding are also mirrored to
+ * ATrace sections and the buffer fill to an ATrace counter, to be seen
+ * along with the rest of the system in systrace (Android 6.0 and later,
+ * counters 10 and later). */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <dlfcn.h>
+#include <android/log.h>
+#include "main.h"
+
+static const struct {
+    const char *name;
+    int span;
+    const char *a, *b;		// names of the arguments, if any
+} trace_types[TRACE_TYPES] = {
+    [TRACE_DECODE]   = { "decode",	1, 0, 0 },
+    [TRACE_READ]     = { "read",	1, "bytes", 0 },
+    [TRACE_CONVERT]  = { "convert",	1, 0, 0 },
+    [TRACE_WRITE]    = { "write",	1, "bytes", 0 },
+    [TRACE_SEEK]     = { "seek",	1, "second", 0 },
+    [TRACE_CALLBACK] = { "callback",	0, "asked", "served" },
+    [TRACE_UNDERRUN] = { "underrun",	0, "underruns", 0 },
+    [TRACE_START]    = { "start",	0, "channels", "samplerate" },
+    [TRACE_STOP]     = { "stop",	0, 0, 0 },
+    [TRACE_PAUSE]    = { "pause",	0, 0, 0 },
+    [TRACE_RESUME]   = { "resume",	0, 0, 0 },
+};
+
+int trace_init(msm_ctx *ctx) {
+	ctx->trace = (trace_ring *) calloc(1, sizeof(trace_ring));
+	return ctx->trace != 0;
+}
+
+void trace_exit(msm_ctx *ctx) {
+	free(ctx->trace);
+	ctx->trace = 0;
+}
+
+/* Writes what the ring holds to path. Events still being added, or
+   overwritten while this runs, are left out. Returns the number written,
+   or -1. */
+int trace_dump(msm_ctx *ctx, const char *path) {
+
+    trace_ring *r = ctx->trace;
+    trace_event *p, e;
+    uint32_t i, head;
+    int n = 0, pid = getpid();
+    FILE *f;
+
+	if(!r) return -1;
+	f = fopen(path, "w");
+	if(!f) {
+	    __android_log_print(ANDROID_LOG_ERROR,"liblossless","trace: cannot create %s", path);
+	    return -1;
+	}
+	head = r->head;
+	fputs("{\"displayTimeUnit\":\"ms\",\"traceEvents\":[", f);
+	for(i = head > TRACE_EVENTS ? head - TRACE_EVENTS : 0; i != head; i++) {
+	    p = &r->ev[i & (TRACE_EVENTS - 1)];
+	    if(p->seq != i + 1) continue;
+	    __sync_synchronize();
+	    e = *p;
+	    __sync_synchronize();
+	    if(p->seq != i + 1 || e.type < 0 || e.type >= TRACE_TYPES) continue;
+	    fprintf(f, "%s\n{\"name\":\"%s\",\"cat\":\"audio\",\"pid\":%d,\"tid\":%d,\"ts\":%lld,",
+		n++ ? "," : "", trace_types[e.type].name, pid, e.tid, (long long) e.t);
+	    if(trace_types[e.type].span) fprintf(f, "\"ph\":\"X\",\"dur\":%d", e.dur);
+	    else fputs("\"ph\":\"i\",\"s\":\"t\"", f);
+	    if(trace_types[e.type].a) {
+		fprintf(f, ",\"args\":{\"%s\":%d", trace_types[e.type].a, e.a);
+		if(trace_types[e.type].b) fprintf(f, ",\"%s\":%d", trace_types[e.type].b, e.b);
+		fputc('}', f);
+	    }
+	    fputc('}', f);
+	}
+	fputs("\n]}\n", f);
+	if(fclose(f) != 0) return -1;
+	__android_log_print(ANDROID_LOG_INFO,"liblossless","trace: %d events to %s", n, path);
+	return n;
+}
+
+/* ATrace, from libandroid.so */
+static void (*atrace_begin)(const char *name);
+static void (*atrace_end)(void);
+static int  (*atrace_enabled)(void);
+static void (*atrace_counter)(const char *name, int64_t value);
+
+/* Returns false if there is no ATrace to mirror to. */
+int trace_set_atrace(msm_ctx *ctx, int on) {
+
+    static void *lib = 0;
+
+	if(on && !lib && (lib = dlopen("libandroid.so", RTLD_NOW)) != 0) {
+	    atrace_begin = (typeof(atrace_begin)) dlsym(lib, "ATrace_beginSection");
+	    atrace_end = (typeof(atrace_end)) dlsym(lib, "ATrace_endSection");
+	    atrace_enabled = (typeof(atrace_enabled)) dlsym(lib, "ATrace_isEnabled");
+	    atrace_counter = (typeof(atrace_counter)) dlsym(lib, "ATrace_setCounter");
+	}
+	if(!atrace_begin || !atrace_end || !atrace_enabled) on = 0;
+	ctx->atrace = on;
+	return on;
+}
+
+/* From audio_stage(), on the decoder thread: ends the section of the stage
+   left, if one was begun, and begins one for the next unless that is
+   STAGE_DECODE, so the thread has one section open at most. */
+void trace_atrace_stage(msm_ctx *ctx, int stage) {
+	if(ctx->atrace_open) {
+	    atrace_end();
+	    ctx->atrace_open = 0;
+	}
+	if(ctx->atrace && stage != STAGE_DECODE && atrace_enabled()) {
+	    atrace_begin(trace_types[stage].name);
+	    ctx->atrace_open = 1;
+	}
+}
+
+void trace_atrace_fill(msm_ctx *ctx, int ms) {
+	if(ctx->atrace && atrace_counter && atrace_enabled()) atrace_counter("liblossless queued ms", ms);
+}
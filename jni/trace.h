@@ -0,0 +1,87 @@
+#ifndef _TRACE_H_INCLUDED
+#define _TRACE_H_INCLUDED
+
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Trace ring, see trace.c. Inline so that the atrack libraries, which
+   don't link against liblossless, can add to it from the callback. */
+
+#define TRACE_EVENTS	4096	// a power of 2
+
+enum {
+   TRACE_DECODE = 0,		// spans, the same as STAGE_*
+   TRACE_READ,			// bytes read
+   TRACE_CONVERT,
+   TRACE_WRITE,			// bytes written
+   TRACE_SEEK,			// span, to the second given
+   TRACE_CALLBACK,		// bytes AudioTrack asked for, bytes served
+   TRACE_UNDERRUN,		// underruns so far
+   TRACE_START,			// channels, samplerate
+   TRACE_STOP,
+   TRACE_PAUSE,
+   TRACE_RESUME,
+   TRACE_TYPES
+};
+
+typedef struct trace_event {
+   volatile uint32_t seq;	// its index + 1 once complete
+   int32_t type, tid;
+   int32_t dur;			// us, spans only
+   int32_t a, b;
+   int64_t t;			// CLOCK_MONOTONIC us
+} trace_event;
+
+typedef struct trace_ring {
+   volatile uint32_t head;	// events ever added
+   trace_event ev[TRACE_EVENTS];
+} trace_ring;
+
+static inline int64_t trace_now_us(void) {
+    struct timespec t;
+	clock_gettime(CLOCK_MONOTONIC, &t);
+	return (int64_t) t.tv_sec * 1000000 + t.tv_nsec / 1000;
+}
+
+/* Any thread may add, each takes a slot of its own. The slot's seq is
+   cleared while it is filled in, so that trace_dump() skips it. */
+static inline void trace_add(trace_ring *r, int type, int64_t t, int dur, int a, int b) {
+
+    uint32_t i;
+    trace_event *e;
+
+	if(!r) return;
+	i = __sync_fetch_and_add(&r->head, 1);
+	e = &r->ev[i & (TRACE_EVENTS - 1)];
+	e->seq = 0;
+	__sync_synchronize();
+	e->type = type;
+	e->tid = gettid();
+	e->dur = dur;
+	e->a = a;
+	e->b = b;
+	e->t = t;
+	__sync_synchronize();
+	e->seq = i + 1;
+}
+
+static inline void trace_instant(trace_ring *r, int type, int a, int b) {
+	trace_add(r, type, trace_now_us(), 0, a, b);
+}
+
+/* A span from t0 till now */
+static inline void trace_span(trace_ring *r, int type, int64_t t0, int a, int b) {
+    int64_t t = trace_now_us();
+	trace_add(r, type, t0, (int) (t - t0), a, b);
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif
@@ -1,14 +1,18 @@
 /* Copyright (C) 2008 The Android Open Source Project
  */
 
+#define _LARGEFILE64_SOURCE
+
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <stdint.h>
 #include <pthread.h>
 //#include <sys/select.h>
-#include <sys/time.h>
-//#include <unistd.h>
+#include <sys/mman.h>
+#include <unistd.h>
 #include "../main.h"
 #include <android/log.h>
 
@@ -19,76 +23,255 @@ struct msm_audio_stats {
 
 
 #define ID_RIFF 0x46464952
+#define ID_RF64 0x34364652
+#define ID_BW64 0x34365742
 #define ID_WAVE 0x45564157
+#define ID_DS64 0x34367364
 #define ID_FMT  0x20746d66
 #define ID_DATA 0x61746164
 
-#define FORMAT_PCM 1
-
-struct wav_header {
-	uint32_t riff_id;
-	uint32_t riff_sz;
-	uint32_t riff_fmt;
-	uint32_t fmt_id;
-	uint32_t fmt_sz;
-	uint16_t audio_format;
-	uint16_t num_channels;
-	uint32_t sample_rate;
-	uint32_t byte_rate;       /* sample_rate * num_channels * bps / 8 */
-	uint16_t block_align;     /* num_channels * bps / 8 */
-	uint16_t bits_per_sample;
-	uint32_t data_id;
-	uint32_t data_sz;
+#define FORMAT_PCM		1
+#define FORMAT_IEEE_FLOAT	3
+#define FORMAT_EXTENSIBLE	0xfffe
+
+/* frames converted at a time when the sink can't take the data as it is */
+#define WAV_BLOCK_FRAMES	1024
+
+struct wav_info {
+	unsigned rate, channels;
+	unsigned bps;		/* container bits per sample */
+	unsigned format;	/* FORMAT_PCM or FORMAT_IEEE_FLOAT */
+	unsigned frame;		/* bytes per frame of all channels */
+	uint64_t data_offs, data_sz;
 };
 
+static inline uint16_t le16(const unsigned char *p) {
+	return p[0] | (p[1] << 8);
+}
 
-static int wav_hdr(int fd, unsigned *rate, unsigned *channels, unsigned *bps) {
+static inline uint32_t le32(const unsigned char *p) {
+	return p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+}
 
-    struct wav_header hdr;
+static inline uint64_t le64(const unsigned char *p) {
+	return le32(p) | ((uint64_t) le32(p + 4) << 32);
+}
 
-    
-    if(read(fd, &hdr, sizeof(hdr)) != sizeof(hdr)) {
+/* Walks the RIFF (or RF64/BW64) chunks up to "data". Chunks other than
+   "fmt " and "ds64" (LIST, fact, bext, ...) are skipped. */
+static int wav_hdr(int fd, struct wav_info *wi) {
+
+    unsigned char b[40];
+    uint32_t id, sz, n;
+    uint64_t pos, fsize, ds64_data = 0;
+    int rf64, have_fmt = 0;
+
+	fsize = lseek64(fd, 0, SEEK_END);
+	if(lseek64(fd, 0, SEEK_SET) != 0 || read(fd, b, 12) != 12) return -1;
+
+	id = le32(b);
+	rf64 = (id == ID_RF64 || id == ID_BW64);
+	if((id != ID_RIFF && !rf64) || le32(b + 8) != ID_WAVE) return -1;
+
+	for(pos = 12; ; ) {
+	    if(read(fd, b, 8) != 8) return -1;	/* no data chunk */
+	    id = le32(b); sz = le32(b + 4);
+	    pos += 8;
+
+	    if(id == ID_DATA) break;
+
+	    if(id == ID_DS64 && rf64) {
+		/* riff size, data size, sample count, table... */
+		if(sz < 24 || read(fd, b, 24) != 24) return -1;
+		ds64_data = le64(b + 8);
+	    } else if(id == ID_FMT) {
+		n = sz < sizeof(b) ? sz : sizeof(b);
+		if(sz < 16 || read(fd, b, n) != n) return -1;
+		wi->format = le16(b);
+		wi->channels = le16(b + 2);
+		wi->rate = le32(b + 4);
+		wi->bps = le16(b + 14);
+		/* the real format is in the first bytes of the SubFormat GUID */
+		if(wi->format == FORMAT_EXTENSIBLE) {
+		    if(n < 40) return -1;
+		    wi->format = le16(b + 24);
+		}
+		have_fmt = 1;
+	    }
+	    /* chunks are word aligned */
+	    pos += (uint64_t) sz + (sz & 1);
+	    if(lseek64(fd, pos, SEEK_SET) != pos) return -1;
+	}
+	if(!have_fmt) return -1;
+
+	wi->data_offs = pos;
+	wi->data_sz = (rf64 && sz == 0xffffffff) ? ds64_data : sz;
+	/* files still being written or cut short */
+	if(fsize < pos) return -1;
+	if(wi->data_sz > fsize - pos) wi->data_sz = fsize - pos;
+
+	if(wi->channels < 1 || wi->channels > AUDIO_MAX_CHANNELS || !wi->rate) return -1;
+	switch(wi->format) {
+	    case FORMAT_PCM:
+		if(wi->bps != 8 && wi->bps != 16 && wi->bps != 24 && wi->bps != 32) return -1;
+		break;
+	    case FORMAT_IEEE_FLOAT:
+		if(wi->bps != 32 && wi->bps != 64) return -1;
+		break;
+	    default:
 		return -1;
 	}
-    
-    if ((hdr.riff_id != ID_RIFF) ||
-        (hdr.riff_fmt != ID_WAVE) ||
-        (hdr.fmt_id != ID_FMT)) {
+	wi->frame = wi->channels * (wi->bps / 8);
 
-        return -1;
-    }
-    if ((hdr.audio_format != FORMAT_PCM) /*||
-        (hdr.fmt_sz != 16) */) {
-        return -1;
-    }
-    if (hdr.bits_per_sample != 16) {
+    return 0;
+}
 
-        return -1;
-    }
-    *rate =  hdr.sample_rate;
-    *channels = hdr.num_channels;
-    *bps = hdr.bits_per_sample;
+static inline int32_t float_to_s32(double x) {
+	x *= 2147483648.0;
+	if(x >= 2147483647.0) return INT32_MAX;
+	if(x > -2147483648.0) return (int32_t) x;
+	return x == x ? INT32_MIN : 0;
+}
 
-    return 0;
+/* Splits n interleaved frames into chans[]. Returns the bit depth
+   audio_pack_pcm16() has to scale them from. */
+static int wav_unpack(const struct wav_info *wi, const unsigned char *in, int32_t * const *chans, int n) {
+
+    int i, k, c = wi->channels;
+
+	switch(wi->bps | (wi->format == FORMAT_IEEE_FLOAT ? 0x100 : 0)) {
+	    case 8:	/* unsigned */
+		for(i = 0; i < n; i++)
+		    for(k = 0; k < c; k++, in++) chans[k][i] = (int32_t) in[0] - 128;
+		return 8;
+	    case 16:
+		for(i = 0; i < n; i++)
+		    for(k = 0; k < c; k++, in += 2) chans[k][i] = (int16_t) le16(in);
+		return 16;
+	    case 24:
+		for(i = 0; i < n; i++)
+		    for(k = 0; k < c; k++, in += 3)
+			chans[k][i] = (int32_t) (((uint32_t) in[0] << 8) | ((uint32_t) in[1] << 16) | ((uint32_t) in[2] << 24)) >> 8;
+		return 24;
+	    case 32:
+		for(i = 0; i < n; i++)
+		    for(k = 0; k < c; k++, in += 4) chans[k][i] = (int32_t) le32(in);
+		return 32;
+	    case 0x100 | 32:
+		for(i = 0; i < n; i++)
+		    for(k = 0; k < c; k++, in += 4) {
+			union { uint32_t u; float f; } v;
+			v.u = le32(in);
+			chans[k][i] = float_to_s32(v.f);
+		    }
+		return 32;
+	    case 0x100 | 64:
+		for(i = 0; i < n; i++)
+		    for(k = 0; k < c; k++, in += 8) {
+			union { uint64_t u; double d; } v;
+			v.u = le64(in);
+			chans[k][i] = float_to_s32(v.d);
+		    }
+		return 32;
+	}
+	return 0;
+}
+
+static ssize_t read_full(msm_ctx *ctx, unsigned char *buf, size_t count) {
+
+    size_t got = 0;
+    ssize_t n;
+
+	while(got < count) {
+	    n = audio_read(ctx, buf + got, count - got);
+	    if(n < 0) {
+		if(errno == EINTR) continue;
+		return -1;
+	    }
+	    if(n == 0) break;
+	    got += n;
+	}
+	return got;
+}
+
+/* Maps size bytes of the file from offs read-only for sequential reading.
+   Returns the address of offs, or NULL if it couldn't be mapped (no room in
+   a 32-bit address space for a large RF64 file, say); *base and *len are
+   what munmap() wants. */
+static const unsigned char *wav_map(int fd, uint64_t offs, uint64_t size, void **base, size_t *len) {
+
+    uint64_t skip = offs % sysconf(_SC_PAGESIZE);
+    void *p;
+
+	if(!size || size + skip > SIZE_MAX || (uint64_t)(off_t)(offs - skip) != offs - skip) return NULL;
+	p = mmap(NULL, size + skip, PROT_READ, MAP_SHARED, fd, (off_t)(offs - skip));
+	if(p == MAP_FAILED) return NULL;
+	madvise(p, size + skip, MADV_SEQUENTIAL);
+	*base = p;
+	*len = size + skip;
+	return (const unsigned char *) p + skip;
+}
+
+/* Fills out with up to size bytes of what the sink takes: the data itself
+   if in is NULL, otherwise converted by audio_pack_pcm16() a block at a
+   time. If out is NULL, the bytes go straight into the track's buffer, see
+   audio_obtain_buffer(). Returns the bytes stored, 0 at the end of the data
+   (or once stopped), -1 if reading failed. */
+static int wav_fill(msm_ctx *ctx, const struct wav_info *wi, uint64_t *left,
+		unsigned char *out, int size, unsigned char *in, int32_t * const *chans) {
+
+    int out_frame = audio_out_channels(wi->channels) * 2;
+    int frames, done = 0, n, depth;
+    ssize_t k, want;
+    unsigned char *p = out;
+
+	if(!in) {
+	    if(!out && !(p = audio_obtain_buffer(ctx, &size))) return 0;
+	    frames = size / out_frame;
+	    want = (uint64_t) frames * wi->frame > *left ? (ssize_t) *left : frames * wi->frame;
+	    k = read_full(ctx, p, want);
+	    if(k < 0) return -1;
+	    *left = (k < want) ? 0 : *left - k;
+	    k -= k % wi->frame;
+	    if(!out) audio_release_buffer(ctx, k);
+	    return k;
+	}
+	frames = size / out_frame;
+	while(done < frames && *left >= wi->frame) {
+	    n = frames - done;
+	    if(n > WAV_BLOCK_FRAMES) n = WAV_BLOCK_FRAMES;
+	    if(n > *left / wi->frame) n = *left / wi->frame;
+	    k = read_full(ctx, in, n * wi->frame);
+	    if(k < 0) return -1;
+	    /* a short read is the end of a truncated file */
+	    *left = (k < n * wi->frame) ? 0 : *left - k;
+	    n = k / wi->frame;
+	    if(!n) break;
+	    audio_stage(ctx, STAGE_CONVERT);
+	    depth = wav_unpack(wi, in, chans, n);
+	    if(out) out += audio_pack_pcm16(out, chans, wi->channels, n, depth);
+	    audio_stage(ctx, STAGE_DECODE);
+	    if(!out && audio_write_planar(ctx, chans, wi->channels, n, depth) < n * out_frame) break;
+	    done += n;
+	}
+	return done * out_frame;
 }
 
 JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wavPlay(JNIEnv *env, jobject obj, msm_ctx* ctx, jstring jfile, jint start) {
 
     const char *file = (*env)->GetStringUTFChars(env,jfile,NULL);
-    int i, n;
-    unsigned rate, channels, bps;
-    unsigned char *buff;
+    int i, k, n, convert, direct;
+    struct wav_info wi;
+    unsigned char *buff, *conv = 0, *in = 0;
+    const unsigned char *map = 0, *src;
+    void *map_base = 0;
+    size_t map_len = 0;
+    int32_t *chans[AUDIO_MAX_CHANNELS];
+    uint64_t left, start_offs = 0;
 //    fd_set fds;
 
-    struct timeval tstart, tstop, ttmp; 	
-    useconds_t  tminwrite;		
     int writes = 0;
-    off_t fsize;
 	
-#ifdef DBG_TIME
-        uint64_t total_tminwrite = 0, total_ttmp = 0, total_sleep = 0;
-        int  fails = 0;
-#endif
 
 
 	if(!ctx) return LIBLOSSLESS_ERR_NOCTX;
@@ -103,91 +286,105 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wavPlay(JNIEnv *env, jobject o
 
 	if(ctx->fd < 0) return LIBLOSSLESS_ERR_NOFILE;
 
-	fsize = lseek(ctx->fd,0,SEEK_END) - sizeof(wav_hdr);
-	lseek(ctx->fd,0,SEEK_SET);
-
-	if(wav_hdr(ctx->fd, &rate, &channels, &bps) != 0) return LIBLOSSLESS_ERR_FORMAT;
+	if(wav_hdr(ctx->fd, &wi) != 0) {
+		close(ctx->fd); ctx->fd = -1;
+		return LIBLOSSLESS_ERR_FORMAT;
+	}
 
+	left = wi.data_sz;
 	if(start) {
-		int start_offs = start * (bps/8) * channels * rate;
-		if(lseek(ctx->fd,start_offs,SEEK_CUR) < 0) return LIBLOSSLESS_ERR_OFFSET;
+		start_offs = (uint64_t) start * wi.rate * wi.frame;
+		if(start_offs >= left || lseek64(ctx->fd, wi.data_offs + start_offs, SEEK_SET) < 0) {
+			close(ctx->fd); ctx->fd = -1;
+			return LIBLOSSLESS_ERR_OFFSET;
+		}
+		left -= start_offs;
+		trace_instant(ctx->trace, TRACE_SEEK, start, 0);
 	}
 
-	i = audio_start(ctx, channels, rate);
+	/* what the sink gets, see audio_pack_pcm16() */
+        ctx->channels = audio_out_channels(wi.channels);
+        ctx->samplerate = wi.rate;
+        ctx->bps = 16;
+	audio_written_reset(ctx);
+
+	i = audio_start(ctx, ctx->channels, ctx->samplerate);
 	if(i != 0) {
-	        close(ctx->fd);
+	        close(ctx->fd); ctx->fd = -1;
 	        return i;
 	}
+	/* 16-bit mono and stereo go to the sink as they are, straight from a
+	   mapping of the file */
+	convert = wi.format != FORMAT_PCM || wi.bps != 16 || wi.channels > 2;
+	if(!convert) {
+		left -= left % wi.frame;
+		map = wav_map(ctx->fd, wi.data_offs + start_offs, left, &map_base, &map_len);
+	}
 	buff = (unsigned char *) malloc(ctx->conf_size);
-	if(!buff) {
-		close(ctx->fd);
+	if(convert) conv = (unsigned char *) malloc(WAV_BLOCK_FRAMES * (wi.channels * sizeof(int32_t) + wi.frame));
+	if(!buff || (convert && !conv)) {
+		free(buff); free(conv);
+		if(map_base) munmap(map_base, map_len);
+		close(ctx->fd); ctx->fd = -1;
 		return LIBLOSSLESS_ERR_NOMEM;
 	}
-
-	tminwrite = ((long long)((long long)ctx->conf_size)*1000000)/((long long)rate*channels*(bps/8));
-	
-
-#if 0
-	sprintf(buff,"*******TMINWRITEEEEE = %d %d %d %d %d",tminwrite,ctx->conf_size,rate,channels,bps);
-	__android_log_print(ANDROID_LOG_INFO,"liblossless",buff);
-#endif
-        ctx->channels = channels;
-        ctx->samplerate = rate;
-        ctx->bps = bps;
-	ctx->written = 0;
+	if(convert) {
+		for(k = 0; k < wi.channels; k++) chans[k] = (int32_t *) conv + k * WAV_BLOCK_FRAMES;
+		in = conv + WAV_BLOCK_FRAMES * wi.channels * sizeof(int32_t);
+	}
 
 	pthread_mutex_lock(&ctx->mutex);
 	ctx->state = MSM_PLAYING;
-	ctx->track_time = fsize /(rate*channels*(bps/8));
+	ctx->track_time = wi.data_sz / wi.frame / wi.rate;
 	pthread_mutex_unlock(&ctx->mutex);
         update_track_time(env,obj,ctx->track_time);
 
+	/* In MODE_CALLBACK the track copies from the mapping itself, and this
+	   thread just waits for it to finish. If it can't, the data is still
+	   read or converted straight into the track's buffer. */
+	direct = audio_direct_buffers(ctx);
+	if(map && audio_play_buffer(ctx, map, left) >= 0) left = 0;
+
 
 	while(ctx->state != MSM_STOPPED) {
 
-		n = read(ctx->fd,buff, ctx->conf_size);
-		if(n != ctx->conf_size) {
+		if(map) {
+			n = (left < ctx->conf_size) ? (int) left : ctx->conf_size;
+			src = map; map += n; left -= n;
+		} else if(direct) {
+			n = wav_fill(ctx, &wi, &left, NULL, ctx->conf_size, in, chans);
+			if(n > 0) continue;
+			src = buff;
+		} else {
+			n = wav_fill(ctx, &wi, &left, buff, ctx->conf_size, in, chans);
+			src = buff;
+		}
+		if(n < 0) {
 			if(ctx->state != MSM_STOPPED) {
 			   if(ctx->state != MSM_PAUSED) pthread_mutex_lock(&ctx->mutex);
 	        	   ctx->state = MSM_STOPPED;
 		           pthread_mutex_unlock(&ctx->mutex);
 			}
-			free(buff);
+			free(buff); free(conv);
 	                if(ctx->fd == -1) return 0; // we were stopped from the main thread
 	                close(ctx->fd); ctx->fd = -1;
 	                return 	LIBLOSSLESS_ERR_IO_READ;
 		}
-	   if(ctx->mode != MODE_CALLBACK) {
-		gettimeofday(&tstop,0);
-		timersub(&tstop,&tstart,&ttmp);
-		if(tminwrite > ttmp.tv_usec) { 
-			usleep((tminwrite-ttmp.tv_usec)/4);		
-#ifdef DBG_TIME
-                        total_sleep += (tminwrite - ttmp.tv_usec)/4;
-#endif
-                }
-#ifdef DBG_TIME
-            else fails++;
-            total_tminwrite += tminwrite;
-            total_ttmp += ttmp.tv_usec;
-#endif
-		gettimeofday(&tstart,0);
-	   }
+		if(n == 0) break;	// end of data
+		/* the last buffer is padded with silence */
+		if(n < ctx->conf_size) {
+			if(src != buff) memcpy(buff, src, n);
+			memset(buff + n, 0, ctx->conf_size - n);
+			src = buff;
+		}
 		pthread_mutex_lock(&ctx->mutex);
-		i = audio_write(ctx,buff,ctx->conf_size);
+		i = audio_write(ctx,src,ctx->conf_size);
 		if(i < ctx->conf_size) {
 	            ctx->state = MSM_STOPPED;
                     pthread_mutex_unlock(&ctx->mutex);
-		    free(buff); 	
+		    free(buff); free(conv);
+		    if(map_base) munmap(map_base, map_len);
                     if(ctx->fd == -1) { 
-#ifdef DBG_TIME
-        if(writes && (writes > fails)) {
-           int x = (int) (total_tminwrite/writes);
-           int y = (int) (total_ttmp/writes);
-           int z = (int) (total_sleep/(writes-fails));
-            __android_log_print(ANDROID_LOG_INFO,"liblossless","tminwrite %d ttmp %d sleep %d fails %d writes %d", x,y,z,fails,writes);
-        } else __android_log_print(ANDROID_LOG_INFO,"liblossless","fails %d writes %d", fails,writes);
-#endif
 
 			return 0; // we were stopped from the main thread
 		    }	
@@ -195,7 +392,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wavPlay(JNIEnv *env, jobject o
                     return LIBLOSSLESS_ERR_IO_WRITE;
 		}
 		pthread_mutex_unlock(&ctx->mutex);
-		ctx->written += i;
+		audio_written_add(ctx, i);
 	  writes++;
 	}
 
@@ -208,15 +405,8 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wavPlay(JNIEnv *env, jobject o
         pthread_mutex_unlock(&ctx->mutex);
     }
 
-#ifdef DBG_TIME
-        if(writes && (writes > fails)) {
-           int x = (int) (total_tminwrite/writes);
-           int y = (int) (total_ttmp/writes);
-           int z = (int) (total_sleep/(writes-fails));
-            __android_log_print(ANDROID_LOG_INFO,"liblossless","tminwrite %d ttmp %d sleep %d fails %d writes %d", x,y,z,fails,writes);
-        } else __android_log_print(ANDROID_LOG_INFO,"liblossless","fails %d writes %d", fails,writes);
-#endif
-   free(buff);
+   free(buff); free(conv);
+   if(map_base) munmap(map_base, map_len);
    audio_wait_done(ctx);
 
    return 0;	
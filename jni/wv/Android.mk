@@ -1,13 +1,25 @@
-
 LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
-LOCAL_MODULE := wv 
+LOCAL_MODULE := wv
 
-LOCAL_SRC_FILES += arm.S arml.S main.c float.c metadata.c unpack.c pack.c words.c wputils.c
-LOCAL_CFLAGS += -O2 -Wall -DBUILD_STANDALONE -DCPU_ARM -finline-functions -fPIC 
+LOCAL_SRC_FILES += main.c float.c metadata.c unpack.c pack.c words.c wputils.c archive.c
+LOCAL_CFLAGS += -O2 -Wall -DBUILD_STANDALONE -finline-functions -fPIC
 #-DDBG_TIME
+
+LOCAL_SRC_FILES += arm.S arml.S
+LOCAL_CFLAGS += -DCPU_ARM
 LOCAL_ARM_MODE := arm
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+# NEON is optional on v7, unpack_neon.c checks for it at runtime
+LOCAL_SRC_FILES += unpack_neon.c.neon
+LOCAL_CFLAGS += -DWV_NEON
+LOCAL_STATIC_LIBRARIES += cpufeatures
+endif
 
 include $(BUILD_STATIC_LIBRARY)
 # include $(BUILD_SHARED_LIBRARY)
+
+ifeq ($(TARGET_ARCH_ABI),armeabi-v7a)
+$(call import-module,android/cpufeatures)
+endif
@@ -0,0 +1,568 @@
+////////////////////////////////////////////////////////////////////////////
+//                           **** WAVPACK ****                            //
+//                  Hybrid Lossless Wavefile Compressor                   //
+//              Copyright (c) 1998 - 2004 Conifer Software.               //
+//                          All Rights Reserved.                          //
+//      Distributed under the BSD Software License (see license.txt)      //
+////////////////////////////////////////////////////////////////////////////
+
+// archive.c
+
+// Converts the .wav files in a folder to .wv, one file at a time. The audio
+// is cut into "runs" of ARC_RUN_BLOCKS blocks; since every WavPack block
+// carries its own decorrelation and entropy state, the runs can be packed by
+// separate threads and simply concatenated. The result goes to name.wv.tmp,
+// which is then decoded back (again one run per thread) and compared with
+// the original samples. Only if that matches is it renamed to name.wv and
+// the .wav removed. The workers run at background cpu and i/o priority.
+
+// Only plain PCM files with 8, 16 or 24 bit mono or stereo samples are
+// handled, and only when nothing follows the data chunk (the trailing
+// chunks would be lost). Everything up to the samples is stored in the
+// first block as the RIFF wrapper, as the desktop WavPack does.
+
+#include "wavpack.h"
+
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <limits.h>
+#include <dirent.h>
+#include <strings.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#include <android/log.h>
+
+#define ARC_RUN_BLOCKS      8           // blocks per run (each 1/2 second)
+#define ARC_MAX_THREADS     4
+#define ARC_MAX_HEADER      (64*1024)   // largest RIFF wrapper we'll store
+
+#define log_info(fmt, args...)  __android_log_print(ANDROID_LOG_INFO, "liblossless", fmt, ##args)
+#define log_err(fmt, args...)   __android_log_print(ANDROID_LOG_ERROR, "liblossless", fmt, ##args)
+
+typedef struct {
+    int channels, bytes, block_align;
+    uint32_t sample_rate, num_samples;
+    off_t data_offset;
+} wav_fmt;
+
+typedef struct {
+    int wfd, ofd;
+    wav_fmt fmt;
+    uchar *header;                  // RIFF wrapper, one spare byte at the end
+    uint32_t block_samples, run_samples, nruns;
+    uint32_t next_run, write_run;   // next run to pick up / to be written
+    off_t *run_offs;                // nruns + 1 offsets of the runs in .wv.tmp
+    int error;
+    pthread_mutex_t mutex;
+    pthread_cond_t cond;
+} arc_job;
+
+// reader for WavpackOpenStreamInput() over one run of .wv.tmp
+
+typedef struct {
+    int fd;
+    off_t pos, end;
+} run_reader;
+
+static volatile int arc_cancel;
+static pthread_mutex_t arc_lock = PTHREAD_MUTEX_INITIALIZER;
+static int arc_busy;
+
+static uint32_t get32 (uchar *p) { return p [0] | (p [1] << 8) | (p [2] << 16) | ((uint32_t) p [3] << 24); }
+static int get16 (uchar *p) { return p [0] | (p [1] << 8); }
+
+// Walk the RIFF chunks up to "data". Returns FALSE for anything we
+// can't (or shouldn't) pack losslessly.
+
+static int parse_wav (int fd, wav_fmt *fmt)
+{
+    uchar hdr [40];
+    off_t pos = 12, fsize = lseek (fd, 0, SEEK_END);
+    uint32_t size;
+    int got_fmt = FALSE;
+
+    if (pread (fd, hdr, 12, 0) != 12 || memcmp (hdr, "RIFF", 4) || memcmp (hdr + 8, "WAVE", 4))
+        return FALSE;
+
+    while (pos + 8 <= fsize && pos < ARC_MAX_HEADER) {
+        if (pread (fd, hdr, 8, pos) != 8)
+            return FALSE;
+
+        size = get32 (hdr + 4);
+
+        if (!memcmp (hdr, "fmt ", 4)) {
+            int tag;
+
+            if (size < 16 || pread (fd, hdr, size < 40 ? size : 40, pos + 8) < 16)
+                return FALSE;
+
+            tag = get16 (hdr);
+
+            if (tag == 0xfffe && size >= 40)
+                tag = get16 (hdr + 24);         // WAVE_FORMAT_EXTENSIBLE subformat
+
+            fmt->channels = get16 (hdr + 2);
+            fmt->sample_rate = get32 (hdr + 4);
+            fmt->block_align = get16 (hdr + 12);
+            fmt->bytes = (get16 (hdr + 14) + 7) / 8;
+
+            if (tag != 1 || fmt->channels < 1 || fmt->channels > 2 || fmt->bytes < 1 ||
+                fmt->bytes > 3 || fmt->block_align != fmt->channels * fmt->bytes || !fmt->sample_rate)
+                    return FALSE;
+
+            got_fmt = TRUE;
+        }
+        else if (!memcmp (hdr, "data", 4)) {
+            fmt->data_offset = pos + 8;
+
+            // nothing but a pad byte may follow the samples
+
+            if (!got_fmt || fmt->data_offset + size + (size & 1) < fsize ||
+                fmt->data_offset + size > fsize)
+                    return FALSE;
+
+            fmt->num_samples = size / fmt->block_align;
+            return fmt->num_samples != 0;
+        }
+
+        pos += 8 + size + (size & 1);
+    }
+
+    return FALSE;
+}
+
+// Convert "count" samples of little-endian PCM to right-justified int32_ts,
+// which is what both WavpackPackSamples() expects and (shifted up to 28 bits)
+// what WavpackUnpackSamples() gives back.
+
+static void pcm_to_int32 (uchar *src, int32_t *dst, uint32_t count, int bytes)
+{
+    switch (bytes) {
+        case 1:
+            while (count--)
+                *dst++ = *src++ - 128;
+
+            break;
+
+        case 2:
+            for (; count--; src += 2)
+                *dst++ = (int16_t) (src [0] | (src [1] << 8));
+
+            break;
+
+        case 3:
+            for (; count--; src += 3)
+                *dst++ = (int32_t) ((src [0] << 8) | (src [1] << 16) | ((uint32_t) src [2] << 24)) >> 8;
+
+            break;
+    }
+}
+
+static int read_run_pcm (arc_job *job, uint32_t run, uchar *pcm, uint32_t *count)
+{
+    uint32_t start = run * job->run_samples;
+    ssize_t bytes;
+
+    *count = job->fmt.num_samples - start;
+
+    if (*count > job->run_samples)
+        *count = job->run_samples;
+
+    bytes = (ssize_t) *count * job->fmt.block_align;
+    return pread (job->wfd, pcm, bytes, job->fmt.data_offset + (off_t) start * job->fmt.block_align) == bytes;
+}
+
+static void set_background_priority (void)
+{
+    // on Linux both of these apply to the calling thread only
+
+    setpriority (PRIO_PROCESS, 0, 10);
+#ifdef __NR_ioprio_set
+    syscall (__NR_ioprio_set, 1 /* IOPRIO_WHO_PROCESS */, 0, 3 << 13 /* IOPRIO_CLASS_IDLE */);
+#endif
+}
+
+static void job_fail (arc_job *job)
+{
+    pthread_mutex_lock (&job->mutex);
+    job->error = TRUE;
+    pthread_cond_broadcast (&job->cond);
+    pthread_mutex_unlock (&job->mutex);
+}
+
+// Returns the next run to work on, or -1 when done (or cancelled).
+
+static int32_t claim_run (arc_job *job)
+{
+    int32_t run = -1;
+
+    pthread_mutex_lock (&job->mutex);
+
+    if (!job->error && !arc_cancel && job->next_run < job->nruns)
+        run = job->next_run++;
+
+    pthread_mutex_unlock (&job->mutex);
+    return run;
+}
+
+// Room for one packed block. Even white noise can't grow much past the raw
+// size, the rest is headers and metadata (and the wrapper in the first one).
+
+static size_t block_buffer_size (arc_job *job)
+{
+    return (size_t) job->block_samples * job->fmt.channels * (job->fmt.bytes + 1) +
+        1024 + job->fmt.data_offset + 1;
+}
+
+// Pack one run into "out". Each block is built in "block" first: the packer
+// writes the block header through a WavpackHeader pointer, so it has to be
+// aligned, and the blocks themselves can be any (even) length.
+
+static uint32_t pack_run (arc_job *job, uint32_t run, uchar *pcm, uint32_t count, int32_t *samples,
+    uchar *block, size_t block_size, uchar *out, size_t out_size)
+{
+    WavpackContext *wpc = WavpackOpenFileOutput ();
+    WavpackConfig config;
+    uint32_t done, n, bytes, bcount = 0;
+
+    if (!wpc)
+        return 0;
+
+    CLEAR (config);
+    config.bytes_per_sample = job->fmt.bytes;
+    config.bits_per_sample = job->fmt.bytes * 8;
+    config.num_channels = job->fmt.channels;
+    config.sample_rate = job->fmt.sample_rate;
+
+    if (!WavpackSetConfiguration (wpc, &config, job->fmt.num_samples)) {
+        WavpackCloseFile (wpc);
+        return 0;
+    }
+
+    // pack_init() starts at sample 0, move this run to where it belongs
+
+    wpc->stream.sample_index = run * job->run_samples;
+
+    if (!run)
+        WavpackAddWrapper (wpc, job->header, job->fmt.data_offset);
+
+    for (done = 0; done < count; done += n) {
+        n = count - done;
+
+        if (n > job->block_samples)
+            n = job->block_samples;
+
+        pcm_to_int32 (pcm + done * job->fmt.block_align, samples, n * job->fmt.channels, job->fmt.bytes);
+
+        if (!WavpackStartBlock (wpc, block, block + block_size) ||
+            !WavpackPackSamples (wpc, samples, n) ||
+            (bytes = WavpackFinishBlock (wpc)) > out_size - bcount) {
+                bcount = 0;
+                break;
+        }
+
+        memcpy (out + bcount, block, bytes);
+        bcount += bytes;
+    }
+
+    WavpackCloseFile (wpc);
+    return bcount;
+}
+
+static void *pack_thread (void *arg)
+{
+    arc_job *job = (arc_job *) arg;
+    size_t block_size = block_buffer_size (job), out_size = block_size * ARC_RUN_BLOCKS;
+    uchar *pcm = malloc ((size_t) job->run_samples * job->fmt.block_align);
+    int32_t *samples = malloc (job->block_samples * job->fmt.channels * sizeof (int32_t));
+    uchar *block = malloc (block_size), *out = malloc (out_size);
+    uint32_t count, bcount;
+    int32_t run;
+
+    set_background_priority ();
+
+    if (!pcm || !samples || !block || !out)
+        job_fail (job);
+
+    while ((run = claim_run (job)) >= 0) {
+        if (!read_run_pcm (job, run, pcm, &count) ||
+            !(bcount = pack_run (job, run, pcm, count, samples, block, block_size, out, out_size))) {
+                job_fail (job);
+                break;
+        }
+
+        // runs must land in the file in order, wait for our turn
+
+        pthread_mutex_lock (&job->mutex);
+
+        while (job->write_run != (uint32_t) run && !job->error)
+            pthread_cond_wait (&job->cond, &job->mutex);
+
+        pthread_mutex_unlock (&job->mutex);
+
+        if (job->error)
+            break;
+
+        if (pwrite (job->ofd, out, bcount, job->run_offs [run]) != (ssize_t) bcount) {
+            job_fail (job);
+            break;
+        }
+
+        pthread_mutex_lock (&job->mutex);
+        job->run_offs [run + 1] = job->run_offs [run] + bcount;
+        job->write_run++;
+        pthread_cond_broadcast (&job->cond);
+        pthread_mutex_unlock (&job->mutex);
+    }
+
+    free (pcm);
+    free (samples);
+    free (block);
+    free (out);
+    return NULL;
+}
+
+static int32_t read_run (void *id, void *buffer, int32_t bytes)
+{
+    run_reader *rd = (run_reader *) id;
+    ssize_t got;
+
+    if (bytes > rd->end - rd->pos)
+        bytes = rd->end - rd->pos;
+
+    if (bytes <= 0 || (got = pread (rd->fd, buffer, bytes, rd->pos)) <= 0)
+        return 0;
+
+    rd->pos += got;
+    return got;
+}
+
+static int verify_run (arc_job *job, uint32_t run, uchar *pcm, int32_t *samples, int32_t *decoded, WavpackContext *wpc)
+{
+    int shift = 21 - (job->fmt.bytes - 1) * 8;
+    run_reader rd = { job->ofd, job->run_offs [run], job->run_offs [run + 1] };
+    uint32_t count, done, n, i;
+    char error [80];
+
+    if (!read_run_pcm (job, run, pcm, &count) ||
+        !WavpackOpenStreamInput (wpc, read_run, &rd, error) ||
+        WavpackGetSampleIndex (wpc) != run * job->run_samples)
+            return FALSE;
+
+    for (done = 0; done < count; done += n) {
+        n = count - done;
+
+        if (n > job->block_samples)
+            n = job->block_samples;
+
+        if (WavpackUnpackSamples (wpc, decoded, n) != n)
+            return FALSE;
+
+        pcm_to_int32 (pcm + done * job->fmt.block_align, samples, n * job->fmt.channels, job->fmt.bytes);
+
+        for (i = 0; i < n * job->fmt.channels; i++)
+            if (decoded [i] != samples [i] * (1 << shift))
+                return FALSE;
+    }
+
+    return !WavpackGetNumErrors (wpc);
+}
+
+static void *verify_thread (void *arg)
+{
+    arc_job *job = (arc_job *) arg;
+    uchar *pcm = malloc ((size_t) job->run_samples * job->fmt.block_align);
+    int32_t *samples = malloc (job->block_samples * job->fmt.channels * sizeof (int32_t));
+    int32_t *decoded = malloc (job->block_samples * job->fmt.channels * sizeof (int32_t));
+    WavpackContext *wpc = malloc (sizeof (WavpackContext));
+    int32_t run;
+
+    set_background_priority ();
+
+    if (!pcm || !samples || !decoded || !wpc)
+        job_fail (job);
+
+    while ((run = claim_run (job)) >= 0)
+        if (!verify_run (job, run, pcm, samples, decoded, wpc)) {
+            log_err("wvArchive: run %d does not match the source", run);
+            job_fail (job);
+            break;
+        }
+
+    free (pcm);
+    free (samples);
+    free (decoded);
+    free (wpc);
+    return NULL;
+}
+
+// Start "nthreads" copies of "func" on the job and wait for all of them.
+
+static int run_workers (arc_job *job, void *(*func)(void *), int nthreads)
+{
+    pthread_t tids [ARC_MAX_THREADS];
+    int i, started = 0;
+
+    job->next_run = job->write_run = 0;
+
+    for (i = 0; i < nthreads; i++)
+        if (!pthread_create (&tids [i], NULL, func, job))
+            started++;
+        else
+            break;
+
+    if (!started)
+        job->error = TRUE;
+
+    for (i = 0; i < started; i++)
+        pthread_join (tids [i], NULL);
+
+    return !job->error && !arc_cancel && job->next_run >= job->nruns;
+}
+
+static void sync_dir (const char *dir)
+{
+    int fd = open (dir, O_RDONLY);
+
+    if (fd >= 0) {
+        fsync (fd);
+        close (fd);
+    }
+}
+
+// Pack "wav" into "wv". Returns TRUE if the .wav was replaced.
+
+static int archive_file (const char *dir, const char *wav, const char *wv, int nthreads)
+{
+    char tmp [PATH_MAX];
+    arc_job job;
+    int ok = FALSE;
+
+    memset (&job, 0, sizeof (job));
+    snprintf (tmp, sizeof (tmp), "%s.tmp", wv);
+
+    if ((job.wfd = open (wav, O_RDONLY)) < 0)
+        return FALSE;
+
+    if (!parse_wav (job.wfd, &job.fmt)) {
+        log_info("wvArchive: skipping %s, unsupported format", wav);
+        close (job.wfd);
+        return FALSE;
+    }
+
+    job.block_samples = job.fmt.sample_rate / 2;
+    job.run_samples = job.block_samples * ARC_RUN_BLOCKS;
+    job.nruns = (job.fmt.num_samples + job.run_samples - 1) / job.run_samples;
+
+    if (nthreads > (int) job.nruns)
+        nthreads = job.nruns;
+
+    job.header = malloc (job.fmt.data_offset + 1);
+    job.run_offs = calloc (job.nruns + 1, sizeof (off_t));
+
+    if (!job.header || !job.run_offs ||
+        pread (job.wfd, job.header, job.fmt.data_offset, 0) != job.fmt.data_offset) {
+            free (job.header);
+            free (job.run_offs);
+            close (job.wfd);
+            return FALSE;
+    }
+
+    job.ofd = open (tmp, O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    if (job.ofd >= 0) {
+        pthread_mutex_init (&job.mutex, NULL);
+        pthread_cond_init (&job.cond, NULL);
+
+        ok = run_workers (&job, pack_thread, nthreads) && !fsync (job.ofd) &&
+            run_workers (&job, verify_thread, nthreads);
+
+        pthread_cond_destroy (&job.cond);
+        pthread_mutex_destroy (&job.mutex);
+        close (job.ofd);
+
+        // the .wv has to be on disk before the .wav goes away
+
+        if (ok && !rename (tmp, wv)) {
+            sync_dir (dir);
+            unlink (wav);
+            sync_dir (dir);
+            log_info("wvArchive: %s -> %s, %ld -> %ld bytes", wav, wv,
+                (long) (job.fmt.data_offset + (off_t) job.fmt.num_samples * job.fmt.block_align),
+                (long) job.run_offs [job.nruns]);
+        }
+        else {
+            ok = FALSE;
+            unlink (tmp);
+        }
+    }
+
+    free (job.header);
+    free (job.run_offs);
+    close (job.wfd);
+    return ok;
+}
+
+// Archive all .wav files in "jdir" (not recursively) with up to "threads"
+// threads, 0 meaning one per cpu. Blocks until done or cancelled, so call it
+// from a background thread. Returns the number of files replaced, or a
+// negative LIBLOSSLESS_ERR_* code.
+
+JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wvArchive(JNIEnv *env, jobject obj, jstring jdir, jint threads) {
+
+    const char *dir = (*env)->GetStringUTFChars(env,jdir,NULL);
+    char wav [PATH_MAX], wv [PATH_MAX];
+    struct dirent *de;
+    struct stat st;
+    DIR *d;
+    int len, files = 0;
+
+	if(!dir) return -LIBLOSSLESS_ERR_INV_PARM;
+
+	pthread_mutex_lock(&arc_lock);
+	if(arc_busy) {
+	    pthread_mutex_unlock(&arc_lock);
+	    (*env)->ReleaseStringUTFChars(env,jdir,dir);
+	    return -LIBLOSSLESS_ERR_INV_PARM;
+	}
+	arc_busy = 1;
+	arc_cancel = 0;
+	pthread_mutex_unlock(&arc_lock);
+
+	if(threads <= 0) threads = sysconf(_SC_NPROCESSORS_ONLN);
+	if(threads <= 0) threads = 1;
+	if(threads > ARC_MAX_THREADS) threads = ARC_MAX_THREADS;
+
+	d = opendir(dir);
+	if(!d) files = -LIBLOSSLESS_ERR_NOFILE;
+
+	while(d && !arc_cancel && (de = readdir(d)) != NULL) {
+	    len = strlen(de->d_name);
+	    if(len < 5 || strcasecmp(de->d_name + len - 4, ".wav")) continue;
+	    snprintf(wav, sizeof(wav), "%s/%s", dir, de->d_name);
+	    snprintf(wv, sizeof(wv), "%s/%.*s.wv", dir, len - 4, de->d_name);
+	    if(stat(wav, &st) || !S_ISREG(st.st_mode) || !stat(wv, &st)) continue;	// never overwrite an existing .wv
+	    if(archive_file(dir, wav, wv, threads)) files++;
+	}
+
+	if(d) closedir(d);
+	(*env)->ReleaseStringUTFChars(env,jdir,dir);
+
+	pthread_mutex_lock(&arc_lock);
+	arc_busy = 0;
+	pthread_mutex_unlock(&arc_lock);
+
+	return files;
+}
+
+// Ask a running wvArchive() to stop. The file being packed is abandoned and
+// its .wav left in place.
+
+JNIEXPORT jboolean JNICALL Java_net_avs234_AndLessSrv_wvArchiveCancel(JNIEnv *env, jobject obj) {
+	arc_cancel = 1;
+	return arc_busy ? JNI_TRUE : JNI_FALSE;
+}
@@ -34,11 +34,12 @@
 #include <pthread.h>
 #include <sched.h>
 #include <sys/select.h>
-#include <sys/time.h>
 
 #include "../main.h"
 #include <android/log.h>
 
+/* MODE_CALLBACK splits the channels into the 32k of wavbuf below temp_buffer */
+#define DIRECT_SAMPLES	(32*1024/(2*sizeof(int32_t)))
 
 JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wvPlay(JNIEnv *env, jobject obj, msm_ctx* ctx, jstring jfile, jint start) {
 
@@ -48,15 +49,10 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wvPlay(JNIEnv *env, jobject ob
     char error [80];
     int bps, nchans, samplerate;
     int32_t * temp_buffer; 	
+    int32_t * chans[2];
+    int direct;
 //    fd_set fds;
-    struct timeval tstart, tstop, ttmp; // tstart -> time of the last write.
-    useconds_t  tminwrite;
-    int prev_written = 0;
     uint32_t num_samples;
-#ifdef DBG_TIME
-     uint64_t total_tminwrite = 0, total_ttmp = 0, total_sleep = 0;
-     int writes = 0, fails = 0;
-#endif
 
 
       if(!ctx) return LIBLOSSLESS_ERR_NOCTX;
@@ -83,6 +79,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wvPlay(JNIEnv *env, jobject ob
 
 	    off_t     seek_offs, fsize = lseek(ctx->fd,0,SEEK_END);
 	    uint32_t  j, idx = 0, need_sample = start * samplerate;
+	    int64_t   seek_t0 = trace_now_us();
 
  		seek_offs = ((int64_t) need_sample*fsize)/num_samples;
 	        if(lseek(ctx->fd,seek_offs,SEEK_SET) < 0) return LIBLOSSLESS_ERR_OFFSET;
@@ -110,6 +107,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wvPlay(JNIEnv *env, jobject ob
 
 //    __android_log_print(ANDROID_LOG_INFO,"liblossless", "cycles=%d: needed %d, got %d, delta sec=%d\n",
 //			j,need_sample, idx, ((int)idx-(int)need_sample)/samplerate);
+		trace_span(ctx->trace, TRACE_SEEK, seek_t0, start, 0);
 	}
 
         i = audio_start(ctx, nchans, samplerate);
@@ -123,7 +121,7 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wvPlay(JNIEnv *env, jobject ob
         ctx->channels = nchans;
         ctx->samplerate = samplerate;
         ctx->bps = bps*8;
-	ctx->written = 0;
+	audio_written_reset(ctx);
 
         pthread_mutex_lock(&ctx->mutex);
         ctx->state = MSM_PLAYING;
@@ -131,47 +129,59 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wvPlay(JNIEnv *env, jobject ob
         pthread_mutex_unlock(&ctx->mutex);
 
         update_track_time(env,obj,ctx->track_time);
+	direct = audio_direct_buffers(ctx);
 
 
-//        gettimeofday(&tstart,0);
-
     while (ctx->state != MSM_STOPPED) {
 	uint32_t *p = (uint32_t *) temp_buffer;
         unsigned char *c = ctx->wavbuf;
 
         int32_t nsamples;
 
+	if(direct) {
+	    nsamples = ctx->conf_size / (2*nchans);
+	    if(nsamples > DIRECT_SAMPLES) nsamples = DIRECT_SAMPLES;
+	    nsamples = WavpackUnpackSamples(wpc, temp_buffer, nsamples);
+	    if(!nsamples) break;
+
+	    /* pack straight into the track's buffer, the samples are 29 bits */
+	    chans[0] = temp_buffer;
+	    if(nchans == 2) {
+		audio_stage(ctx, STAGE_CONVERT);
+		chans[0] = (int32_t *) ctx->wavbuf;
+		chans[1] = chans[0] + DIRECT_SAMPLES;
+		for(i = 0; i < nsamples; i++) {
+		    chans[0][i] = temp_buffer[2*i];
+		    chans[1][i] = temp_buffer[2*i+1];
+		}
+		audio_stage(ctx, STAGE_DECODE);
+	    }
+	    if(audio_write_planar(ctx, chans, nchans, nsamples, 29) != nsamples*2*nchans) {
+		if(ctx->state != MSM_STOPPED) {
+		    if(ctx->state != MSM_PAUSED) pthread_mutex_lock(&ctx->mutex);
+		    ctx->state = MSM_STOPPED;
+		    pthread_mutex_unlock(&ctx->mutex);
+		}
+		if(ctx->fd == -1) return 0; // we were stopped from the main thread
+		close(ctx->fd); ctx->fd = -1;
+		return LIBLOSSLESS_ERR_IO_WRITE;
+	    }
+	    continue;
+	}
+
 	nsamples = WavpackUnpackSamples(wpc, temp_buffer, ctx->conf_size / (2*nchans));  
 
         if (!nsamples) break;
 
+	audio_stage(ctx, STAGE_CONVERT);
 	for(i = 0; i < nsamples; i++) {
 	    for(k = 0; k < nchans; k++, p++, c+= 2)	{
 		c[0] = 	(p[0] >> 13);
                 c[1] =  (p[0] >> 21);
 	    }	
 	}
+	audio_stage(ctx, STAGE_DECODE);
 
-	if(prev_written && ctx->mode != MODE_CALLBACK) {
-	   tminwrite = ((uint64_t)((uint64_t)prev_written)*1000000)/((uint64_t)(samplerate*bps*nchans));
-           gettimeofday(&tstop,0);
-           timersub(&tstop,&tstart,&ttmp);
-           if(tminwrite > ttmp.tv_usec) {
-		usleep((tminwrite-ttmp.tv_usec)/4);
-#ifdef DBG_TIME
-                        total_sleep += (tminwrite - ttmp.tv_usec)/4;
-#endif
-           }
-#ifdef DBG_TIME
-           else fails++;
-           writes++;
-           total_tminwrite += tminwrite;
-           total_ttmp += ttmp.tv_usec;
-#endif
-        }
-
-        if(ctx->mode != MODE_CALLBACK) gettimeofday(&tstart,0);
-	prev_written = nsamples*2*nchans;
 
 	pthread_mutex_lock(&ctx->mutex);
 	i = audio_write(ctx,ctx->wavbuf,nsamples*2*nchans);
@@ -179,22 +189,13 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wvPlay(JNIEnv *env, jobject ob
             ctx->state = MSM_STOPPED;
             pthread_mutex_unlock(&ctx->mutex);
             if(ctx->fd == -1) {
-#ifdef DBG_TIME
-	        if(writes && (writes > fails)) {
-        	   int x = (int) (total_tminwrite/writes);
-	           int y = (int) (total_ttmp/writes);
-	           int z = (int) (total_sleep/(writes-fails));
-	            __android_log_print(ANDROID_LOG_INFO,"liblossless",
-			"tminwrite %d ttmp %d sleep %d fails %d writes %d", x,y,z,fails,writes);
-	        } else __android_log_print(ANDROID_LOG_INFO,"liblossless","fails %d writes %d", fails,writes);
-#endif
 
 		return 0; // we were stopped from the main thread
 	    }	
             close(ctx->fd); ctx->fd = -1;
             return LIBLOSSLESS_ERR_IO_WRITE;
         }
-	ctx->written += i;
+	audio_written_add(ctx, i);
         pthread_mutex_unlock(&ctx->mutex);
     }
 
@@ -208,14 +209,6 @@ JNIEXPORT jint JNICALL Java_net_avs234_AndLessSrv_wvPlay(JNIEnv *env, jobject ob
         pthread_mutex_unlock(&ctx->mutex);
     }
 
-#ifdef DBG_TIME
-        if(writes && (writes > fails)) {
-           int x = (int) (total_tminwrite/writes);
-           int y = (int) (total_ttmp/writes);
-           int z = (int) (total_sleep/(writes-fails));
-            __android_log_print(ANDROID_LOG_INFO,"liblossless","tminwrite %d ttmp %d sleep %d fails %d writes %d", x,y,z,fails,writes);
-        } else __android_log_print(ANDROID_LOG_INFO,"liblossless","fails %d writes %d", fails,writes);
-#endif
     audio_wait_done(ctx);
 
     return 0;
@@ -228,10 +221,6 @@ JNIEXPORT jint JNICALL Java_com_skvalex_amplayer_wvDuration(JNIEnv *env, jobject
 	    int bps, nchans, samplerate;
 	//    fd_set fds;
 	    uint32_t num_samples;
-	#ifdef DBG_TIME
-	     uint64_t total_tminwrite = 0, total_ttmp = 0, total_sleep = 0;
-	     int writes = 0, fails = 0;
-	#endif
 
 
 	      if(!ctx) return -1;
@@ -19,7 +19,7 @@ int read_metadata_buff (WavpackContext *wpc, WavpackMetadata *wpmd)
     uint32_t bytes_to_read;
     uchar tchar;
 
-    if (!wpc->infile (&wpmd->id, 1) || !wpc->infile (&tchar, 1))
+    if (!wpc->infile (wpc->infile_id, &wpmd->id, 1) || !wpc->infile (wpc->infile_id, &tchar, 1))
         return FALSE;
 
     wpmd->byte_length = tchar << 1;
@@ -27,12 +27,12 @@ int read_metadata_buff (WavpackContext *wpc, WavpackMetadata *wpmd)
     if (wpmd->id & ID_LARGE) {
         wpmd->id &= ~ID_LARGE;
 
-        if (!wpc->infile (&tchar, 1))
+        if (!wpc->infile (wpc->infile_id, &tchar, 1))
             return FALSE;
 
         wpmd->byte_length += (int32_t) tchar << 9; 
 
-        if (!wpc->infile (&tchar, 1))
+        if (!wpc->infile (wpc->infile_id, &tchar, 1))
             return FALSE;
 
         wpmd->byte_length += (int32_t) tchar << 17;
@@ -54,7 +54,7 @@ int read_metadata_buff (WavpackContext *wpc, WavpackMetadata *wpmd)
         wpmd->data = NULL;
 
         while (bytes_to_read > sizeof (wpc->read_buffer))
-            if (wpc->infile (wpc->read_buffer, sizeof (wpc->read_buffer)) == sizeof (wpc->read_buffer))
+            if (wpc->infile (wpc->infile_id, wpc->read_buffer, sizeof (wpc->read_buffer)) == sizeof (wpc->read_buffer))
                 bytes_to_read -= sizeof (wpc->read_buffer);
             else
                 return FALSE;
@@ -62,7 +62,7 @@ int read_metadata_buff (WavpackContext *wpc, WavpackMetadata *wpmd)
     else
         wpmd->data = wpc->read_buffer;
 
-    if (bytes_to_read && wpc->infile (wpc->read_buffer, bytes_to_read) != (int32_t) bytes_to_read) {
+    if (bytes_to_read && wpc->infile (wpc->infile_id, wpc->read_buffer, bytes_to_read) != (int32_t) bytes_to_read) {
         wpmd->data = NULL;
         return FALSE;
     }
@@ -310,7 +310,7 @@ int pack_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample_count)
                     dpp->samples_A [(m + dpp->term) & (MAX_TERM - 1)] = code;
                 }
 
-                code -= apply_weight_i (dpp->weight_A, sam);
+                code -= apply_weight (dpp->weight_A, sam);
                 update_weight (dpp->weight_A, 2, sam, code);
             }
 
@@ -357,11 +357,13 @@ static void decorr_stereo_pass (struct decorr_pass *dpp, int32_t *bptr, int32_t
 
     while (bptr < eptr) {
         dpp->samples_A [k] = bptr [0];
-        bptr [0] -= apply_weight_i (dpp->weight_A, (sam = dpp->samples_A [m]));
+        sam = dpp->samples_A [m];
+        bptr [0] -= apply_weight (dpp->weight_A, sam);
         update_weight (dpp->weight_A, 2, sam, bptr [0]);
         bptr++;
         dpp->samples_B [k] = bptr [0];
-        bptr [0] -= apply_weight_i (dpp->weight_B, (sam = dpp->samples_B [m]));
+        sam = dpp->samples_B [m];
+        bptr [0] -= apply_weight (dpp->weight_B, sam);
         update_weight (dpp->weight_B, 2, sam, bptr [0]);
         bptr++;
         m = (m + 1) & (MAX_TERM - 1);
@@ -377,13 +379,13 @@ static void decorr_stereo_pass_18 (struct decorr_pass *dpp, int32_t *bptr, int32
         sam = (3 * dpp->samples_A [0] - dpp->samples_A [1]) >> 1;
         dpp->samples_A [1] = dpp->samples_A [0];
         dpp->samples_A [0] = bptr [0];
-        bptr [0] -= apply_weight_i (dpp->weight_A, sam);
+        bptr [0] -= apply_weight (dpp->weight_A, sam);
         update_weight (dpp->weight_A, 2, sam, bptr [0]);
         bptr++;
         sam = (3 * dpp->samples_B [0] - dpp->samples_B [1]) >> 1;
         dpp->samples_B [1] = dpp->samples_B [0];
         dpp->samples_B [0] = bptr [0];
-        bptr [0] -= apply_weight_i (dpp->weight_B, sam);
+        bptr [0] -= apply_weight (dpp->weight_B, sam);
         update_weight (dpp->weight_B, 2, sam, bptr [0]);
         bptr++;
     }
@@ -397,9 +399,9 @@ static void decorr_stereo_pass_m2 (struct decorr_pass *dpp, int32_t *bptr, int32
         sam_A = bptr [1];
         sam_B = dpp->samples_B [0];
         dpp->samples_B [0] = bptr [0];
-        bptr [0] -= apply_weight_i (dpp->weight_A, sam_A);
+        bptr [0] -= apply_weight (dpp->weight_A, sam_A);
         update_weight_clip (dpp->weight_A, 2, sam_A, bptr [0]);
-        bptr [1] -= apply_weight_i (dpp->weight_B, sam_B);
+        bptr [1] -= apply_weight (dpp->weight_B, sam_B);
         update_weight_clip (dpp->weight_B, 2, sam_B, bptr [1]);
     }
 }
@@ -412,13 +414,13 @@ static void decorr_stereo_pass_17 (struct decorr_pass *dpp, int32_t *bptr, int32
 	sam = 2 * dpp->samples_A [0] - dpp->samples_A [1];
         dpp->samples_A [1] = dpp->samples_A [0];
         dpp->samples_A [0] = bptr [0];
-        bptr [0] -= apply_weight_i (dpp->weight_A, sam);
+        bptr [0] -= apply_weight (dpp->weight_A, sam);
         update_weight (dpp->weight_A, 2, sam, bptr [0]);
         bptr++;
 	sam = 2 * dpp->samples_B [0] - dpp->samples_B [1];
         dpp->samples_B [1] = dpp->samples_B [0];
         dpp->samples_B [0] = bptr [0];
-        bptr [0] -= apply_weight_i (dpp->weight_B, sam);
+        bptr [0] -= apply_weight (dpp->weight_B, sam);
         update_weight (dpp->weight_B, 2, sam, bptr [0]);
         bptr++;
     }
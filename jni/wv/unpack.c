@@ -79,10 +79,10 @@ int init_wv_bitstream (WavpackContext *wpc, WavpackMetadata *wpmd)
     WavpackStream *wps = &wpc->stream;
 
     if (wpmd->data)
-        bs_open_read (&wps->wvbits, wpmd->data, (unsigned char *) wpmd->data + wpmd->byte_length, NULL, 0);
+        bs_open_read (&wps->wvbits, wpmd->data, (unsigned char *) wpmd->data + wpmd->byte_length, NULL, NULL, 0);
     else if (wpmd->byte_length)
         bs_open_read (&wps->wvbits, wpc->read_buffer, wpc->read_buffer + sizeof (wpc->read_buffer),
-            wpc->infile, wpmd->byte_length + (wpmd->byte_length & 1));
+            wpc->infile, wpc->infile_id, wpmd->byte_length + (wpmd->byte_length & 1));
 
     return TRUE;
 }
@@ -311,6 +311,12 @@ extern void decorr_stereo_pass_cont_arml (struct decorr_pass *dpp, int32_t *buff
 static void decorr_stereo_pass_cont (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count);
 #endif
 
+#ifdef WV_NEON
+extern int wv_neon_supported (void);
+extern void decorr_stereo_pass_cont_neon (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count);
+extern void shift_samples_neon (int32_t *buffer, uint32_t count, int shift);
+#endif
+
 static void decorr_mono_pass (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count);
 static void decorr_stereo_pass (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count);
 static void fixup_samples (WavpackStream *wps, int32_t *buffer, uint32_t sample_count);
@@ -367,6 +373,12 @@ int32_t unpack_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample_co
         else
             for (tcount = wps->num_terms, dpp = wps->decorr_passes; tcount--; dpp++) {
                 decorr_stereo_pass (dpp, buffer, 8);
+#ifdef WV_NEON
+                if (dpp->term > 0 && wv_neon_supported ()) {
+                    decorr_stereo_pass_cont_neon (dpp, buffer + 16, sample_count - 8);
+                    continue;
+                }
+#endif
 #if defined(CPU_COLDFIRE)
                 decorr_stereo_pass_cont_mcf5249 (dpp, buffer + 16, sample_count - 8);
 #elif defined(CPU_ARM)
@@ -743,20 +755,30 @@ static void fixup_samples (WavpackStream *wps, int32_t *buffer, uint32_t sample_
             shift += zeros + sent_bits + ones + dups;
     }
 
-    if (shift > 0) {
-        if (!(flags & MONO_DATA))
-            sample_count *= 2;
+    if (shift)
+        shift_samples (buffer, (flags & MONO_DATA) ? sample_count : sample_count * 2, shift);
+}
+
+// The final shift of fixup_samples(), left for a positive shift and right
+// for a negative one. Not static so that jni/bench/kernelbench.c can time it.
 
-        while (sample_count--)
+void shift_samples (int32_t *buffer, uint32_t count, int shift)
+{
+#ifdef WV_NEON
+    if (wv_neon_supported ()) {
+        shift_samples_neon (buffer, count, shift);
+        return;
+    }
+#endif
+
+    if (shift > 0) {
+        while (count--)
             *buffer++ <<= shift;
     }
     else if (shift < 0) {
         shift = -shift;
 
-        if (!(flags & MONO_DATA))
-            sample_count *= 2;
-
-        while (sample_count--)
+        while (count--)
             *buffer++ >>= shift;
     }
 }
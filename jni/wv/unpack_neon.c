@@ -0,0 +1,178 @@
+////////////////////////////////////////////////////////////////////////////
+//                           **** WAVPACK ****                            //
+//                  Hybrid Lossless Wavefile Compressor                   //
+//              Copyright (c) 1998 - 2004 Conifer Software.               //
+//                          All Rights Reserved.                          //
+//      Distributed under the BSD Software License (see license.txt)      //
+////////////////////////////////////////////////////////////////////////////
+
+// unpack_neon.c
+
+// NEON versions of the stereo decorrelation pass and the final shift in
+// fixup_samples(). For the positive terms (1-8, 17 and 18) the two channels
+// don't depend on each other, so the left and right samples are carried in
+// the two lanes of a 64-bit vector and each loop iteration handles a whole
+// stereo sample. The negative terms cross-feed the channels and stay with
+// the scalar code. The weight is applied with a full 32x32->64 multiply, so
+// unlike decorr_stereo_pass_cont_arm() this is exact for 24-bit files too.
+
+// The mono pass is not here: every sample depends on the weight updated by
+// the one before it, so there is nothing to put in the second lane.
+
+#include "wavpack.h"
+
+#include <arm_neon.h>
+
+#include <cpu-features.h>
+
+extern volatile int audio_simd;    // see audioSetSimd() in ../main.c
+
+// Returns TRUE if the NEON routines below may be used. NEON is optional
+// on ARMv7, so we have to ask the kernel.
+
+int wv_neon_supported (void)
+{
+    static int neon = -1;
+
+    if (neon < 0)
+        neon = (android_getCpuFamily () == ANDROID_CPU_FAMILY_ARM &&
+            (android_getCpuFeatures () & ANDROID_CPU_ARM_FEATURE_NEON)) ? TRUE : FALSE;
+
+    return neon && audio_simd;
+}
+
+// (weight * sample + 512) >> 10 for both channels, same as apply_weight()
+
+static inline int32x2_t apply_weight_x2 (int32x2_t weight, int32x2_t sample)
+{
+    return vrshrn_n_s64 (vmull_s32 (weight, sample), 10);
+}
+
+// Same as update_weight(): if both source and result are non-zero, add
+// delta to the weight when their signs agree and subtract it otherwise.
+
+static inline int32x2_t update_weight_x2 (int32x2_t weight, int32x2_t delta, int32x2_t source, int32x2_t result)
+{
+    uint32x2_t nonzero = vand_u32 (vtst_s32 (source, source), vtst_s32 (result, result));
+    int32x2_t sign = vshr_n_s32 (veor_s32 (source, result), 31);
+    int32x2_t step = vsub_s32 (veor_s32 (delta, sign), sign);
+
+    return vadd_s32 (weight, vand_s32 (step, vreinterpret_s32_u32 (nonzero)));
+}
+
+// Drop-in replacement for decorr_stereo_pass_cont() for terms 1-8, 17 and
+// 18. As with the assembly versions, the 8 previous stereo samples must be
+// visible (and correct) in the buffer before the first sample processed,
+// and the history is copied back to the decorr_pass structure on exit.
+
+void decorr_stereo_pass_cont_neon (struct decorr_pass *dpp, int32_t *buffer, int32_t sample_count)
+{
+    int32x2_t weight = { dpp->weight_A, dpp->weight_B };
+    int32x2_t delta = vdup_n_s32 (dpp->delta);
+    int32x2_t sam, in, out, prev1, prev2;
+    int32_t *bptr, *tptr, *eptr = buffer + (sample_count * 2);
+    int k, i;
+
+    switch (dpp->term) {
+
+        case 17:
+            prev1 = vld1_s32 (buffer - 2);
+            prev2 = vld1_s32 (buffer - 4);
+
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                sam = vsub_s32 (vshl_n_s32 (prev1, 1), prev2);
+                in = vld1_s32 (bptr);
+                out = vadd_s32 (apply_weight_x2 (weight, sam), in);
+                weight = update_weight_x2 (weight, delta, sam, in);
+                vst1_s32 (bptr, out);
+                prev2 = prev1;
+                prev1 = out;
+            }
+
+            dpp->samples_B [0] = bptr [-1];
+            dpp->samples_A [0] = bptr [-2];
+            dpp->samples_B [1] = bptr [-3];
+            dpp->samples_A [1] = bptr [-4];
+            break;
+
+        case 18:
+            prev1 = vld1_s32 (buffer - 2);
+            prev2 = vld1_s32 (buffer - 4);
+
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                sam = vshr_n_s32 (vsub_s32 (vadd_s32 (vshl_n_s32 (prev1, 1), prev1), prev2), 1);
+                in = vld1_s32 (bptr);
+                out = vadd_s32 (apply_weight_x2 (weight, sam), in);
+                weight = update_weight_x2 (weight, delta, sam, in);
+                vst1_s32 (bptr, out);
+                prev2 = prev1;
+                prev1 = out;
+            }
+
+            dpp->samples_B [0] = bptr [-1];
+            dpp->samples_A [0] = bptr [-2];
+            dpp->samples_B [1] = bptr [-3];
+            dpp->samples_A [1] = bptr [-4];
+            break;
+
+        case 1:
+            // keep the previous sample in a register rather than reading
+            // back the one we just stored
+
+            prev1 = vld1_s32 (buffer - 2);
+
+            for (bptr = buffer; bptr < eptr; bptr += 2) {
+                in = vld1_s32 (bptr);
+                out = vadd_s32 (apply_weight_x2 (weight, prev1), in);
+                weight = update_weight_x2 (weight, delta, prev1, in);
+                vst1_s32 (bptr, out);
+                prev1 = out;
+            }
+
+            for (k = dpp->term - 1, i = 8; i--; k--) {
+                dpp->samples_B [k & (MAX_TERM - 1)] = *--bptr;
+                dpp->samples_A [k & (MAX_TERM - 1)] = *--bptr;
+            }
+
+            break;
+
+        default:
+            for (bptr = buffer, tptr = buffer - (dpp->term * 2); bptr < eptr; bptr += 2, tptr += 2) {
+                sam = vld1_s32 (tptr);
+                in = vld1_s32 (bptr);
+                out = vadd_s32 (apply_weight_x2 (weight, sam), in);
+                weight = update_weight_x2 (weight, delta, sam, in);
+                vst1_s32 (bptr, out);
+            }
+
+            for (k = dpp->term - 1, i = 8; i--; k--) {
+                dpp->samples_B [k & (MAX_TERM - 1)] = *--bptr;
+                dpp->samples_A [k & (MAX_TERM - 1)] = *--bptr;
+            }
+
+            break;
+    }
+
+    dpp->weight_A = vget_lane_s32 (weight, 0);
+    dpp->weight_B = vget_lane_s32 (weight, 1);
+}
+
+// Final shift from fixup_samples(), 8 samples at a time. A negative shift
+// is an arithmetic right shift, exactly like the scalar ">>=" it replaces.
+
+void shift_samples_neon (int32_t *buffer, uint32_t count, int shift)
+{
+    int32x4_t vshift = vdupq_n_s32 (shift);
+
+    for (; count >= 8; count -= 8, buffer += 8) {
+        vst1q_s32 (buffer, vshlq_s32 (vld1q_s32 (buffer), vshift));
+        vst1q_s32 (buffer + 4, vshlq_s32 (vld1q_s32 (buffer + 4), vshift));
+    }
+
+    if (shift > 0)
+        while (count--)
+            *buffer++ <<= shift;
+    else
+        while (count--)
+            *buffer++ >>= -shift;
+}
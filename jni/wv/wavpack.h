@@ -18,6 +18,7 @@ typedef unsigned char   uchar;
 //typedef unsigned int    uint;
 
 #include <stdio.h>
+#include <string.h>
 
 #define FALSE 0
 #define TRUE 1
@@ -203,16 +204,25 @@ typedef struct {
 // pointers to hold a complete allocated block of WavPack data, although it's
 // possible to decode WavPack blocks without buffering an entire block.
 
-typedef int32_t (*read_stream)(void *, int32_t);
+// Reads up to "bytes" bytes into "buffer" and returns the number read; "id"
+// is whatever was passed when the stream was opened (the msm_ctx for playback).
 
+typedef int32_t (*read_stream)(void *id, void *buffer, int32_t bytes);
 
 
+
+// When reading, "sr" holds up to 64 bits that have been fetched but not yet
+// consumed (bit 0 is the next bit) and "bc" is the number of those bits.
+// Bits above "bc" may hold the next unconsumed byte and are never garbage.
+
 typedef struct bs {
     uchar *buf, *end, *ptr;
     void (*wrap)(struct bs *bs);
-    uint32_t file_bytes, sr;
+    uint64_t sr;
+    uint32_t file_bytes;
     int error, bc;
-  //  read_stream file;
+    read_stream file;
+    void *id;
 } Bitstream;
 
 #define MAX_NTERMS 16
@@ -277,9 +287,9 @@ typedef struct {
     char error_message [80];
 
     read_stream infile;
+    void *infile_id;
     uint32_t total_samples, crc_errors, first_flags;
     int open_flags, norm_offset, reduced_channels, lossy_blocks;
-    msm_ctx *ctx; 	
 } WavpackContext;
 
 //////////////////////// function prototypes and macros //////////////////////
@@ -288,7 +298,7 @@ typedef struct {
 
 // bits.c
 
-void bs_open_read (Bitstream *bs, uchar *buffer_start, uchar *buffer_end, read_stream file, uint32_t file_bytes);
+void bs_open_read (Bitstream *bs, uchar *buffer_start, uchar *buffer_end, read_stream file, void *id, uint32_t file_bytes);
 void bs_open_write (Bitstream *bs, uchar *buffer_start, uchar *buffer_end);
 uint32_t bs_close_write (Bitstream *bs);
 
@@ -306,18 +316,38 @@ uint32_t bs_close_write (Bitstream *bs);
 #define getbits(value, nbits, bs) { \
     while ((nbits) > (bs)->bc) { \
         if (++((bs)->ptr) == (bs)->end) (bs)->wrap (bs); \
-        (bs)->sr |= (int32_t)*((bs)->ptr) << (bs)->bc; \
+        (bs)->sr |= (uint64_t)*((bs)->ptr) << (bs)->bc; \
         (bs)->bc += 8; \
     } \
-    *(value) = (bs)->sr; \
-    if ((bs)->bc > 32) { \
-        (bs)->bc -= (nbits); \
-        (bs)->sr = *((bs)->ptr) >> (8 - (bs)->bc); \
-    } \
-    else { \
-        (bs)->bc -= (nbits); \
-        (bs)->sr >>= (nbits); \
-    } \
+    *(value) = (uint32_t)(bs)->sr; \
+    (bs)->bc -= (nbits); \
+    (bs)->sr >>= (nbits); \
+}
+
+// Top up the read buffer to at least 57 bits. While there are more than 8
+// bytes left in the buffer this is a single unaligned 64-bit load (the data
+// is little-endian, like everything else here); near the end it falls back
+// to a byte at a time so that wrap() is called exactly as getbit() would.
+
+static inline void bs_fill (Bitstream *bs)
+{
+    if (bs->end - bs->ptr > 8) {
+        int bytes = (63 - bs->bc) >> 3;
+        uint64_t next;
+
+        memcpy (&next, bs->ptr + 1, sizeof (next));
+        bs->sr |= next << bs->bc;
+        bs->ptr += bytes;
+        bs->bc += bytes * 8;
+    }
+    else
+        while (bs->bc <= 56) {
+            if (++(bs->ptr) == bs->end)
+                bs->wrap (bs);
+
+            bs->sr |= (uint64_t) *(bs->ptr) << bs->bc;
+            bs->bc += 8;
+        }
 }
 
 #define putbit(bit, bs) { if (bit) (bs)->sr |= (1 << (bs)->bc); \
@@ -406,6 +436,7 @@ int read_channel_info (WavpackContext *wpc, WavpackMetadata *wpmd);
 int read_config_info (WavpackContext *wpc, WavpackMetadata *wpmd);
 int read_sample_rate (WavpackContext *wpc, WavpackMetadata *wpmd);
 int32_t unpack_samples (WavpackContext *wpc, int32_t *buffer, uint32_t sample_count);
+void shift_samples (int32_t *buffer, uint32_t count, int shift);
 int check_crc_error (WavpackContext *wpc);
 
 // pack.c
@@ -452,6 +483,7 @@ void float_normalize (int32_t *values, int32_t num_values, int delta_exp);
 
 //WavpackContext *WavpackOpenFileInput (read_stream infile, char *error);
 WavpackContext *WavpackOpenFileInput (msm_ctx *ctx, char *error);
+WavpackContext *WavpackOpenStreamInput (WavpackContext *wpc, read_stream infile, void *id, char *error);
 
 int WavpackGetMode (WavpackContext *wpc);
 
@@ -474,6 +506,7 @@ int WavpackGetBytesPerSample (WavpackContext *wpc);
 int WavpackGetNumChannels (WavpackContext *wpc);
 int WavpackGetReducedChannels (WavpackContext *wpc);
 WavpackContext *WavpackOpenFileOutput (void);
+void WavpackCloseFile (WavpackContext *wpc);
 int WavpackSetConfiguration (WavpackContext *wpc, WavpackConfig *config, uint32_t total_samples);
 void WavpackAddWrapper (WavpackContext *wpc, void *data, uint32_t bcount);
 int WavpackStartBlock (WavpackContext *wpc, uchar *begin, uchar *end);
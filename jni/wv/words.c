@@ -57,6 +57,11 @@
 #define INC_MED2() (c->median [2] += ((c->median [2] + DIV2) / DIV2) * 5)
 #define DEC_MED2() (c->median [2] -= ((c->median [2] + (DIV2-2)) / DIV2) * 2)
 
+// number of significant bits in av; a single clz where the compiler has it
+
+#if defined(__GNUC__)
+#define count_bits(av) ((av) ? 32 - __builtin_clz (av) : 0)
+#else
 #define count_bits(av) ( \
  (av) < (1 << 8) ? nbits_table [av] : \
   ( \
@@ -64,6 +69,7 @@
    ((av) < (1L << 24) ? nbits_table [(av) >> 16] + 16 : nbits_table [(av) >> 24] + 24) \
   ) \
 )
+#endif
 
 ///////////////////////////// local table storage ////////////////////////////
 
@@ -378,50 +384,51 @@ int32_t get_words (int32_t *buffer, int nsamples, uint32_t flags,
         else {
             int next8;
 
-            if (bs->bc < 8) {
-                if (++(bs->ptr) == bs->end)
-                    bs->wrap (bs);
+            // With at least 32 bits buffered, the whole unary code (up to
+            // LIMIT_ONES + 1 bits) and usually the rest of the word can be
+            // taken from "sr" without going back to memory. Each hit in
+            // ones_count_table resolves up to 8 of the unary bits.
 
-                next8 = (bs->sr |= *(bs->ptr) << bs->bc) & 0xff;
-                bs->bc += 8;
-            }
-            else
-                next8 = bs->sr & 0xff;
+            if (bs->bc < 32)
+                bs_fill (bs);
 
-            if (next8 == 0xff) {
-                bs->bc -= 8;
-                bs->sr >>= 8;
+            next8 = bs->sr & 0xff;
 
-                for (ones_count = 8; ones_count < (LIMIT_ONES + 1) && getbit (bs); ++ones_count);
+            if (next8 != 0xff) {
+                bs->bc -= (ones_count = ones_count_table [next8]) + 1;
+                bs->sr >>= ones_count + 1;
+            }
+            else if ((next8 = (bs->sr >> 8) & 0xff) != 0xff) {
+                bs->bc -= (ones_count = ones_count_table [next8] + 8) + 1;
+                bs->sr >>= ones_count + 1;
+            }
+            else {
+                uint32_t mask;
+                int cbits;
+
+                ones_count = (bs->sr >> LIMIT_ONES) & 1 ? LIMIT_ONES + 1 : LIMIT_ONES;
+                bs->bc -= LIMIT_ONES + 1;
+                bs->sr >>= LIMIT_ONES + 1;
 
                 if (ones_count == (LIMIT_ONES + 1))
                     break;
 
-                if (ones_count == LIMIT_ONES) {
-                    uint32_t mask;
-                    int cbits;
-
-                    for (cbits = 0; cbits < 33 && getbit (bs); ++cbits);
-
-                    if (cbits == 33)
-                        break;
+                for (cbits = 0; cbits < 33 && getbit (bs); ++cbits);
 
-                    if (cbits < 2)
-                        ones_count = cbits;
-                    else {
-                        for (mask = 1, ones_count = 0; --cbits; mask <<= 1)
-                            if (getbit (bs))
-                                ones_count |= mask;
+                if (cbits == 33)
+                    break;
 
-                        ones_count |= mask;
-                    }
+                if (cbits < 2)
+                    ones_count = cbits;
+                else {
+                    for (mask = 1, ones_count = 0; --cbits; mask <<= 1)
+                        if (getbit (bs))
+                            ones_count |= mask;
 
-                    ones_count += LIMIT_ONES;
+                    ones_count |= mask;
                 }
-            }
-            else {
-                bs->bc -= (ones_count = ones_count_table [next8]) + 1;
-                bs->sr >>= ones_count + 1;
+
+                ones_count += LIMIT_ONES;
             }
 
             if (w->holding_one) {
@@ -719,13 +726,7 @@ static int mylog2 (uint32_t avalue)
         return (dbits << 8) + log2_table [(avalue << (9 - dbits)) & 0xff];
     }
     else {
-        if (avalue < (1L << 16))
-            dbits = nbits_table [avalue >> 8] + 8;
-        else if (avalue < (1L << 24))
-            dbits = nbits_table [avalue >> 16] + 16;
-        else
-            dbits = nbits_table [avalue >> 24] + 24;
-
+        dbits = count_bits (avalue);
         return (dbits << 8) + log2_table [(avalue >> (dbits - 9)) & 0xff];
     }
 }
@@ -20,7 +20,9 @@
 //#include "../flac/bitstream.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include <fcntl.h>
+#include <unistd.h>
 static void strcpy_loc (char *dst, char *src) { while ((*dst++ = *src++) != 0); }
 
 ///////////////////////////// local table storage ////////////////////////////
@@ -30,7 +32,7 @@ const uint32_t sample_rates [] = { 6000, 8000, 9600, 11025, 12000, 16000, 22050,
 
 ///////////////////////////// executable code ////////////////////////////////
 
-static uint32_t read_next_header (read_stream infile, WavpackHeader *wphdr);
+static uint32_t read_next_header (read_stream infile, void *id, WavpackHeader *wphdr);
         
 // This function reads data from the specified stream in search of a valid
 // WavPack 4.0 audio block. If this fails in 1 megabyte (or an invalid or
@@ -39,40 +41,48 @@ static uint32_t read_next_header (read_stream infile, WavpackHeader *wphdr);
 // WavpackContext structure is returned (which is used to call all other
 // functions in this module). This can be initiated at the beginning of a
 // WavPack file, or anywhere inside a WavPack file. To determine the exact
-// position within the file use WavpackGetSampleIndex(). For demonstration
-// purposes this uses a single static copy of the WavpackContext structure,
-// so obviously it cannot be used for more than one file at a time. Also,
+// position within the file use WavpackGetSampleIndex(). For playback this
+// uses a single static copy of the WavpackContext structure reading from
+// ctx->fd, so obviously it cannot be used for more than one file at a time
+// (use WavpackOpenStreamInput() with a context of your own for that). Also,
 // this function will not handle "correction" files, plays only the first
 // two channels of multi-channel files, and is limited in resolution in some
 // large integer or floating point files (but always provides at least 24 bits
 // of resolution).
 
-static WavpackContext wpc;
+static WavpackContext wpc_static;
 
-static int32_t read_callback (void *buffer, int32_t bytes)
+static int32_t read_callback (void *id, void *buffer, int32_t bytes)
 {
-    int32_t retval = read(wpc.ctx->fd,buffer, bytes);
+    int32_t retval = audio_read((msm_ctx *) id, buffer, bytes);
     return retval;
 }
 
-
 WavpackContext *WavpackOpenFileInput (msm_ctx *ctx, char *error)
 {
-    WavpackStream *wps = &wpc.stream;
+    return WavpackOpenStreamInput (&wpc_static, read_callback, ctx, error);
+}
+
+// Same as above, but the caller supplies the context (which must stay valid
+// while it is in use) and the reader, which gets "id" with every call.
+
+WavpackContext *WavpackOpenStreamInput (WavpackContext *wpc, read_stream infile, void *id, char *error)
+{
+    WavpackStream *wps = &wpc->stream;
     uint32_t bcount;
 
-    CLEAR (wpc);
-    wpc.infile = read_callback;
-    wpc.total_samples = (uint32_t) -1;
-    wpc.norm_offset = 0;
-    wpc.open_flags = 0;
-    wpc.ctx = ctx;
+    CLEAR (*wpc);
+    wpc->infile = infile;
+    wpc->infile_id = id;
+    wpc->total_samples = (uint32_t) -1;
+    wpc->norm_offset = 0;
+    wpc->open_flags = 0;
 	
     // open the source file for reading and store the size
 
     while (!wps->wphdr.block_samples) {
 
-        bcount = read_next_header (wpc.infile, &wps->wphdr);
+        bcount = read_next_header (wpc->infile, wpc->infile_id, &wps->wphdr);
 
         if (bcount == (uint32_t) -1) {
             strcpy_loc (error, "invalid WavPack file!");
@@ -86,40 +96,40 @@ WavpackContext *WavpackOpenFileInput (msm_ctx *ctx, char *error)
         }
 
         if (wps->wphdr.block_samples && wps->wphdr.total_samples != (uint32_t) -1)
-            wpc.total_samples = wps->wphdr.total_samples;
+            wpc->total_samples = wps->wphdr.total_samples;
 
-        if (!unpack_init (&wpc)) {
-            strcpy_loc (error, wpc.error_message [0] ? wpc.error_message :
+        if (!unpack_init (wpc)) {
+            strcpy_loc (error, wpc->error_message [0] ? wpc->error_message :
                 "invalid WavPack file!");
 
             return NULL;
         }
     }
 
-    wpc.config.flags &= ~0xff;
-    wpc.config.flags |= wps->wphdr.flags & 0xff;
-    wpc.config.bytes_per_sample = (wps->wphdr.flags & BYTES_STORED) + 1;
-    wpc.config.float_norm_exp = wps->float_norm_exp;
+    wpc->config.flags &= ~0xff;
+    wpc->config.flags |= wps->wphdr.flags & 0xff;
+    wpc->config.bytes_per_sample = (wps->wphdr.flags & BYTES_STORED) + 1;
+    wpc->config.float_norm_exp = wps->float_norm_exp;
 
-    wpc.config.bits_per_sample = (wpc.config.bytes_per_sample * 8) - 
+    wpc->config.bits_per_sample = (wpc->config.bytes_per_sample * 8) - 
         ((wps->wphdr.flags & SHIFT_MASK) >> SHIFT_LSB);
 
-    if (!wpc.config.sample_rate) {
+    if (!wpc->config.sample_rate) {
         if (!wps || !wps->wphdr.block_samples || (wps->wphdr.flags & SRATE_MASK) == SRATE_MASK)
-            wpc.config.sample_rate = 44100;
+            wpc->config.sample_rate = 44100;
         else
-            wpc.config.sample_rate = sample_rates [(wps->wphdr.flags & SRATE_MASK) >> SRATE_LSB];
+            wpc->config.sample_rate = sample_rates [(wps->wphdr.flags & SRATE_MASK) >> SRATE_LSB];
     }
 
-    if (!wpc.config.num_channels) {
-        wpc.config.num_channels = (wps->wphdr.flags & MONO_FLAG) ? 1 : 2;
-        wpc.config.channel_mask = 0x5 - wpc.config.num_channels;
+    if (!wpc->config.num_channels) {
+        wpc->config.num_channels = (wps->wphdr.flags & MONO_FLAG) ? 1 : 2;
+        wpc->config.channel_mask = 0x5 - wpc->config.num_channels;
     }
 
     if (!(wps->wphdr.flags & FINAL_BLOCK))
-        wpc.reduced_channels = (wps->wphdr.flags & MONO_FLAG) ? 1 : 2;
+        wpc->reduced_channels = (wps->wphdr.flags & MONO_FLAG) ? 1 : 2;
 
-    return &wpc;
+    return wpc;
 }
 
 // This function obtains general information about an open file and returns
@@ -176,7 +186,7 @@ uint32_t WavpackUnpackSamples (WavpackContext *wpc, int32_t *buffer, uint32_t sa
     while (samples) {
         if (!wps->wphdr.block_samples || !(wps->wphdr.flags & INITIAL_BLOCK) ||
             wps->sample_index >= wps->wphdr.block_index + wps->wphdr.block_samples) {
-                bcount = read_next_header (wpc->infile, &wps->wphdr);
+                bcount = read_next_header (wpc->infile, wpc->infile_id, &wps->wphdr);
 
                 if (bcount == (uint32_t) -1)
                     break;
@@ -332,7 +342,7 @@ int WavpackGetReducedChannels (WavpackContext *wpc)
 // to indicate the error. No additional bytes are read past the header and it
 // is returned in the processor's native endian mode. Seeking is not required.
 
-static uint32_t read_next_header (read_stream infile, WavpackHeader *wphdr)
+static uint32_t read_next_header (read_stream infile, void *id, WavpackHeader *wphdr)
 {
     char buffer [sizeof (*wphdr)], *sp = buffer + sizeof (*wphdr), *ep = sp;
     uint32_t bytes_skipped = 0;
@@ -346,7 +356,7 @@ static uint32_t read_next_header (read_stream infile, WavpackHeader *wphdr)
         else
             bleft = 0;
 
-        if (infile (buffer + bleft, sizeof (*wphdr) - bleft) != (int32_t) sizeof (*wphdr) - bleft)
+        if (infile (id, buffer + bleft, sizeof (*wphdr) - bleft) != (int32_t) sizeof (*wphdr) - bleft)
             return -1;
 
         sp = buffer;
@@ -369,12 +379,20 @@ static uint32_t read_next_header (read_stream infile, WavpackHeader *wphdr)
 
 // Open context for writing WavPack files. The returned context pointer is used
 // in all following calls to the library. A return value of NULL indicates
-// that memory could not be allocated for the context.
+// that memory could not be allocated for the context. Each call returns a new
+// context, so several files may be written at once; release it with
+// WavpackCloseFile() when done.
 
 WavpackContext *WavpackOpenFileOutput (void)
 {
-    CLEAR (wpc);
-    return &wpc;
+    return calloc (1, sizeof (WavpackContext));
+}
+
+// Free a context returned by WavpackOpenFileOutput().
+
+void WavpackCloseFile (WavpackContext *wpc)
+{
+    free (wpc);
 }
 
 // Set configuration for writing WavPack files. This must be done before
@@ -582,7 +600,7 @@ void *WavpackGetWrapperLocation (void *first_block)
 
 static void bs_read (Bitstream *bs);
 
-void bs_open_read (Bitstream *bs, uchar *buffer_start, uchar *buffer_end, read_stream file, uint32_t file_bytes)
+void bs_open_read (Bitstream *bs, uchar *buffer_start, uchar *buffer_end, read_stream file, void *id, uint32_t file_bytes)
 {
     CLEAR (*bs);
     bs->buf = buffer_start;
@@ -591,7 +609,8 @@ void bs_open_read (Bitstream *bs, uchar *buffer_start, uchar *buffer_end, read_s
     if (file) {
         bs->ptr = bs->end - 1;
         bs->file_bytes = file_bytes;
-//        bs->file = file;
+        bs->file = file;
+        bs->id = id;
     }
     else
         bs->ptr = bs->buf - 1;
@@ -606,13 +625,13 @@ void bs_open_read (Bitstream *bs, uchar *buffer_start, uchar *buffer_end, read_s
 
 static void bs_read (Bitstream *bs)
 {
-    if (/* bs->file &&*/ bs->file_bytes) {
+    if (bs->file && bs->file_bytes) {
         uint32_t bytes_read, bytes_to_read = bs->end - bs->buf;
 
         if (bytes_to_read > bs->file_bytes)
             bytes_to_read = bs->file_bytes;
 
-        bytes_read = read_callback /*bs->file*/(bs->buf, bytes_to_read);
+        bytes_read = bs->file (bs->id, bs->buf, bytes_to_read);
 
         if (bytes_read) {
             bs->end = bs->buf + bytes_read;
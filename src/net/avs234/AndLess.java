@@ -38,6 +38,7 @@ import android.os.Environment;
 import android.os.Handler;
 import android.os.IBinder;
 import android.os.Message;
+import android.os.ParcelFileDescriptor;
 import android.os.RemoteException;
 import android.preference.PreferenceManager;
 import android.util.Log;
@@ -136,6 +137,9 @@ public class AndLess extends Activity implements Comparator<File> {
     		public void playItemPaused(boolean paused) {
     			pauseResumeHandler.sendEmptyMessage(paused ? 1 : 0);
     		}
+    		public void playbackEvent(int event, int arg) {
+    			eventHandler.obtainMessage(event, arg, 0).sendToTarget();
+    		}
     	};
     	
     	IBinder.DeathRecipient bdeath = new IBinder.DeathRecipient() {
@@ -181,6 +185,7 @@ public class AndLess extends Activity implements Comparator<File> {
     							log_msg("starting from \"" + startfile + "\" in \""  + f.toString() + "\"");
     							srv.registerCallback(cBack);
     		    				update_headset_mode(null);
+    		    				update_buffer_ms(null);
     		    				playDir(f,startfile);
     							return;
     						}	
@@ -188,6 +193,7 @@ public class AndLess extends Activity implements Comparator<File> {
     						if(setAdapter(f)) {
     		    				srv.registerCallback(cBack);
     		    				update_headset_mode(null);
+    		    				update_buffer_ms(null);
     							playPath(f);
     							return;
     						}
@@ -237,6 +243,7 @@ public class AndLess extends Activity implements Comparator<File> {
     				}
     				srv.registerCallback(cBack);
     				update_headset_mode(null);
+    				update_buffer_ms(null);
     			} catch(RemoteException e) {log_msg("remote exception in onServiceConnected: " + e.toString()); }
     		//	Process.setThreadPriority(Process.THREAD_PRIORITY_AUDIO);
     		}
@@ -794,7 +801,6 @@ public class AndLess extends Activity implements Comparator<File> {
 		private class TrackTimeUpdater {
 
 			private String track_name;
-			private boolean init_completed = false;
 			private boolean need_update = false;
 
 			private Timer timer;
@@ -804,84 +810,141 @@ public class AndLess extends Activity implements Comparator<File> {
 			private final int first_delay = 500;
 			private final int update_period = 500;
 			
+			// The service's status block, mapped once per track so that the updates
+			// below need no binder calls; null if the service has none to give.
+			private AndLessSrv.StatusBlock status;
+			private boolean status_asked = false;
+			
+			private synchronized AndLessSrv.StatusBlock getStatus() throws RemoteException {
+				if(!status_asked) {
+					status_asked = true;
+					ParcelFileDescriptor pfd = srv.get_status_block();
+					if(pfd != null) {
+						try {
+							status = new AndLessSrv.StatusBlock(pfd);
+						} catch(IOException e) {
+							log_err("cannot map status block: " + e.toString());
+							try { pfd.close(); } catch(IOException x) { }
+						} catch(LinkageError e) {	// no libstatusblock.so
+							log_err("cannot read status block: " + e.toString());
+							try { pfd.close(); } catch(IOException x) { }
+						}
+					}
+				}
+				// not playing a native track: the service knows better
+				if(status == null || !status.read() || status.state == AndLessSrv.StatusBlock.STATE_STOPPED) return null;
+				return status;
+			}
+			
+			private synchronized void closeStatus() {
+				if(status != null) status.close();
+				status = null;
+				status_asked = false;
+			}
+			
+			// Track length in the title and the progress bar. Done once the track has had
+			// first_delay to start, and on the service's events until the length is known.
+			private void updateTrackTime(AndLessSrv.StatusBlock st, boolean init) throws RemoteException {
+			//	int track_time = AndLessSrv.curTrackLen;
+				int track_time = st != null ? st.track_len : srv.get_cur_track_len();
+				if(track_time <= 0) {
+					if(init) log_msg("progressUpdate(): fishy track_time " + track_time);
+					track_time = st != null ? st.track_time : srv.get_track_duration();
+				}
+				need_update = track_time <= 0;
+				if(need_update && !init) return;
+				curWindowTitle = (track_time < 3600) ? String.format("[%d:%02d] %s", track_time/60, track_time % 60, track_name) 
+					:	String.format("[%d:%02d:%02d] %s", track_time/3600, (track_time % 3600)/60, track_time % 60, track_name);
+				getWindow().setTitle(curWindowTitle);
+				pBar.setMax(track_time);
+				String sTime = (track_time < 3600) ? String.format("%d:%02d", track_time/60, track_time % 60) 
+						:	String.format("%d:%02d:%02d", track_time/3600, (track_time % 3600)/60, track_time % 60);
+				allTime.setText(sTime);
+			}
+			
+			private void updatePosition(AndLessSrv.StatusBlock st) throws RemoteException {
+			//	pBar.setProgress(srv.get_cur_seconds() - AndLessSrv.curTrackStart);
+   				int seconds = st != null ? st.seconds() : srv.get_cur_seconds();
+   				int progress = seconds - (st != null ? st.track_start : srv.get_cur_track_start());
+   				if(progress > 0) pBar.setProgress(progress);
+   				String sTime = (seconds < 3600) ? String.format("%d:%02d", progress/60, progress % 60) 
+						:	String.format("%d:%02d:%02d", progress/3600, (progress % 3600)/60, progress % 60);
+   				nowTime.setText(sTime);
+			}
+			
+			private Runnable init_task = new Runnable() {
+				public void run() {
+					if(srv == null || track_name == null || !need_update) return;	// an event was first
+					if(!pBar.isPressed()) {
+						try {
+							updateTrackTime(null, true);
+						} catch (Exception e) { 
+							log_err("exception 2 in progress update handler: " + e.toString()); 
+						}
+					}
+				}
+			};
+			
+			// State and track changes come as events, see onEvent(); the timer only
+			// moves the position on while playing.
 			private class UpdaterTask extends TimerTask {
 				public void run() {
 					if(track_name == null) {
 						shutdown();
 						return;
 					}
-					if(init_completed) {
-						progressUpdate.post(new Runnable() {
-							public void run() {
-								if(srv == null) return;
-								if(!pBar.isPressed()) { 
-									try {
-										if(!srv.is_running() || srv.is_paused()) return;
-						   				if(need_update) {		// track_time was unknown at init time
-						   				//	int track_time = AndLessSrv.curTrackLen;
-						   					int track_time = srv.get_cur_track_len();
-						   					if(track_time <= 0) {
-						   						track_time = srv.get_track_duration();
-						   						if(track_time <=0) return;
-						   					}	
-						       				curWindowTitle = (track_time < 3600) ? String.format("[%d:%02d] %s", track_time/60, track_time % 60, track_name) 
-						       					:	String.format("[%d:%02d:%02d] %s", track_time/3600, (track_time % 3600)/60, track_time % 60, track_name);
-						       				getWindow().setTitle(curWindowTitle);
-						       				pBar.setMax(track_time);
-						       				String sTime = (track_time < 3600) ? String.format("%d:%02d", track_time/60, track_time % 60) 
-													:	String.format("%d:%02d:%02d", track_time/3600, (track_time % 3600)/60, track_time % 60);
-											allTime.setText(sTime);
-						   					need_update = false;
-						   				}
-									//	pBar.setProgress(srv.get_cur_seconds() - AndLessSrv.curTrackStart);
-						   				int progress = srv.get_cur_seconds() - srv.get_cur_track_start();
-						   				if(progress > 0) pBar.setProgress(progress);
-						   				String sTime = (srv.get_cur_seconds() < 3600) ? String.format("%d:%02d", progress/60, progress % 60) 
-												:	String.format("%d:%02d:%02d", progress/3600, (progress % 3600)/60, progress % 60);
-						   				nowTime.setText(sTime);
-									} catch (Exception e) { 
-										log_err("exception 1 in progress update handler: " + e.toString()); 
-									}
-								}
-							}
-						});
-						return;
-					}
-					progressUpdate.post(new Runnable() {	// initialize
+					progressUpdate.post(new Runnable() {
 						public void run() {
 							if(srv == null) return;
-							if(!pBar.isPressed()) {
+							if(!pBar.isPressed()) { 
 								try {
-								//	int track_time = AndLessSrv.curTrackLen;
-									int track_time = srv.get_cur_track_len();
-									need_update = false;
-									if(track_time <= 0) {
-										log_msg("progressUpdate(): fishy track_time " + track_time);
-										track_time = srv.get_track_duration();
-										if(track_time <=0) need_update = true;
+									AndLessSrv.StatusBlock st = getStatus();
+									if(st != null) {
+										if(st.state != AndLessSrv.StatusBlock.STATE_PLAYING) return;
+									} else {
+										if(!srv.is_running() || srv.is_paused()) return;
+										// MediaPlayer sends no events when it learns the length
+										if(need_update) updateTrackTime(null, false);
 									}
-									curWindowTitle = (track_time < 3600) ? String.format("[%d:%02d] %s", track_time/60, track_time % 60, track_name) 
-										:	String.format("[%d:%02d:%02d] %s", track_time/3600, (track_time % 3600)/60, track_time % 60, track_name);
-									
-									getWindow().setTitle(curWindowTitle);
-									pBar.setMax(track_time);
-									String sTime = (track_time < 3600) ? String.format("%d:%02d", track_time/60, track_time % 60) 
-											:	String.format("%d:%02d:%02d", track_time/3600, (track_time % 3600)/60, track_time % 60);
-									allTime.setText(sTime);
+									updatePosition(st);
 								} catch (Exception e) { 
-									log_err("exception 2 in progress update handler: " + e.toString()); 
+									log_err("exception 1 in progress update handler: " + e.toString()); 
 								}
 							}
 						}
 					});
-			    	init_completed = true;
 				}
-			}	
+			}
+			
+			// AndLessSrv.EVENT_* pushed by the service, on the UI thread
+			public void onEvent(int event, int arg) {
+				switch(event) {
+					case AndLessSrv.EVENT_UNDERRUN:
+						log_msg("underrun " + arg);
+						return;
+					case AndLessSrv.EVENT_ERROR:
+						log_err("playback error " + arg);
+						shutdown();		// the message comes with errorReported()
+						return;
+				}
+				if(srv == null || track_name == null || pBar.isPressed()) return;
+				try {
+					AndLessSrv.StatusBlock st = getStatus();
+					if(st == null && !srv.is_running()) return;
+					if(need_update) updateTrackTime(st, false);
+					updatePosition(st);
+				} catch (Exception e) { 
+					log_err("exception in event handler: " + e.toString()); 
+				}
+			}
+			
 			public void shutdown() {
 				if(timer_task != null) timer_task.cancel();
 				if(timer != null) timer.cancel();
+				progressUpdate.removeCallbacks(init_task);
 				timer = null; timer_task = null;
-				track_name = null; init_completed = false;
+				track_name = null; need_update = false;
+				closeStatus();
 			}
 			private void reset() {
 				shutdown();
@@ -892,6 +955,8 @@ public class AndLess extends Activity implements Comparator<File> {
 			public void start(String s) {
 				reset();
 				track_name = new String(s);
+				need_update = true;
+				progressUpdate.postDelayed(init_task, first_delay);
 				timer.schedule(timer_task, first_delay, update_period);
 			}
 		}
@@ -949,6 +1014,15 @@ public class AndLess extends Activity implements Comparator<File> {
 		}
       };
       
+      // Events from the service, see AndLessSrv.onEvent()
+      Handler eventHandler = new Handler() {
+		@Override
+		public void handleMessage(Message msg) {
+			super.handleMessage(msg);
+			if(!samsung) ttu.onEvent(msg.what, msg.arg1);
+		}
+      };
+      
     	////////////////////////////////////////////////////////////////
     	///////////////////////// Entry point //////////////////////////
     	////////////////////////////////////////////////////////////////
@@ -965,7 +1039,8 @@ public class AndLess extends Activity implements Comparator<File> {
         		prefs.driver_mode = AndLessSrv.MODE_DIRECT;
         		ButtonVolume.setVisibility(View.VISIBLE);
         	} else {
-        		prefs.driver_mode = AndLessSrv.MODE_CALLBACK;
+        		prefs.driver_mode = Integer.parseInt(settings.getString("output_mode", Integer.toString(AndLessSrv.MODE_CALLBACK)));
+        		if(settings.getBoolean("low_latency", false)) prefs.driver_mode |= AndLessSrv.MODE_FLAG_LOW_LATENCY;
         		ButtonVolume.setVisibility(View.GONE);
         	}
 			if(b_m) {
@@ -982,6 +1057,7 @@ public class AndLess extends Activity implements Comparator<File> {
 				prefs.shuffle = false;
 			}
             update_headset_mode(settings);
+            update_buffer_ms(settings);
         }
 
         void update_headset_mode(SharedPreferences settings) {
@@ -995,6 +1071,16 @@ public class AndLess extends Activity implements Comparator<File> {
             	log_err("remote exception while trying to set headset_mode");
             }
         }
+
+        void update_buffer_ms(SharedPreferences settings) {
+        	if(settings == null) settings = PreferenceManager.getDefaultSharedPreferences(getBaseContext());
+        	int ms = Integer.parseInt(settings.getString("buffer_ms", "0"));
+            if(srv != null) try {
+            	srv.set_buffer_ms(ms);
+            } catch (RemoteException r) {
+            	log_err("remote exception while trying to set buffer_ms");
+            }
+        }
         
     	@Override
         public void onCreate(Bundle savedInstanceState) {
@@ -1128,6 +1214,19 @@ public class AndLess extends Activity implements Comparator<File> {
     	    return true;
 
     	}
+
+    	// Stopping a WAV packing run is only offered while there is one
+    	@Override
+    	public boolean onPrepareOptionsMenu(Menu menu) {
+    		boolean archiving = false;
+    		try {
+    			archiving = srv != null && srv.is_archiving();
+    		} catch (Exception e) {
+    			log_err("exception in is_archiving(): " + e.toString());
+    		}
+    		menu.findItem(R.id.CancelArchive).setVisible(archiving);
+    		return super.onPrepareOptionsMenu(menu);
+    	}
     	
     	private void setContent() {
 //            setRequestedOrientation(1);
@@ -1492,6 +1591,27 @@ public class AndLess extends Activity implements Comparator<File> {
 
     			return true;
     	     	
+    		case R.id.ArchiveWav:
+    			try {
+    				if(srv != null && cur_path != null && srv.archive_wav(cur_path.toString()))
+    					Toast.makeText(getApplicationContext(), R.string.strArchiveStarted, Toast.LENGTH_SHORT).show();
+    				else Toast.makeText(getApplicationContext(), R.string.strArchiveBusy, Toast.LENGTH_SHORT).show();
+    			} catch (Exception e) {
+    				log_err("exception in archive_wav(): " + e.toString());
+    			}
+    			return true;
+
+    		case R.id.CancelArchive:
+    			try {
+    				if(srv != null) {
+    					srv.cancel_archive();
+    					Toast.makeText(getApplicationContext(), R.string.strArchiveCancelled, Toast.LENGTH_SHORT).show();
+    				}
+    			} catch (Exception e) {
+    				log_err("exception in cancel_archive(): " + e.toString());
+    			}
+    			return true;
+    	     	
     	 	case R.id.Quit:
     	 		ExitFromProgram();
     	     	return true;
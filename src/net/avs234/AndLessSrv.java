@@ -2,6 +2,11 @@ package net.avs234;
 
 import java.io.DataOutputStream;
 import java.io.File;
+import java.io.FileInputStream;
+import java.io.IOException;
+import java.nio.ByteBuffer;
+import java.nio.ByteOrder;
+import java.nio.channels.FileChannel;
 import java.util.Timer;
 import java.util.TimerTask;
 
@@ -17,7 +22,10 @@ import android.media.AudioManager;
 import android.media.MediaPlayer;
 import android.net.Uri;
 import android.os.Build;
+import android.os.Handler;
 import android.os.IBinder;
+import android.os.Message;
+import android.os.ParcelFileDescriptor;
 import android.os.PowerManager;
 import android.os.Process;
 import android.os.RemoteCallbackList;
@@ -35,7 +43,7 @@ public class AndLessSrv extends Service {
 		System.loadLibrary("lossless");
 	}
 	
-	public static native int 		audioInit(int ctx, int mode);	
+	public static native int 		audioInit(int ctx, int mode, int buffer_ms);	
 	public static native boolean	audioExit(int ctx);
 	public static native boolean	audioStop(int ctx);
 	public static native boolean	audioPause(int ctx);
@@ -43,7 +51,16 @@ public class AndLessSrv extends Service {
 	
 	public static native int		audioGetDuration(int ctx);
 	public static native int		audioGetCurPosition(int ctx);
+	public static native int		audioGetCurPositionMs(int ctx);
 	public static native boolean	audioSetVolume(int ctx, int vol);
+	public static native boolean	audioSetOutputFile(int ctx, String file);
+	public static native int		audioGetStatusFd(int ctx);
+	public static native int []		audioGetStats(int ctx);
+	public static native int		audioTraceDump(int ctx, String file);
+	public static native boolean	audioSetAtrace(int ctx, boolean on);
+	public static native boolean	audioSetSimd(boolean on);
+	public static native boolean	audioSetPowerSaving(int ctx, boolean on);
+	public static native boolean	audioSetTrackInfo(int ctx, int index, int offset, int track_start, int track_len);
 	
 	public static native int		alacPlay(int ctx,String file, int start);
 	public static native int		flacPlay(int ctx,String file, int start);
@@ -56,6 +73,9 @@ public class AndLessSrv extends Service {
 	public static native int		wvDuration(int ctx,String file);
 	public static native int		apeDuration(int ctx,String file);
 	
+	public static native int		wvArchive(String dir, int threads);
+	public static native boolean	wvArchiveCancel();
+	
 	public static native boolean	libInit(int sdk);
 	public static native boolean	libExit();
 	
@@ -106,6 +126,45 @@ public class AndLessSrv extends Service {
 	public static final int MODE_LIBMEDIA = 2;
 	public static final int MODE_CALLBACK = 3;
 	public static final int MODE_ALSA = 3;
+	public static final int MODE_OPENSL = 5;
+	public static final int MODE_AAUDIO = 6;
+	// No audio output, decoding runs as fast as it can; for benchmarks and tests.
+	public static final int MODE_NULL = 7;
+	// Like MODE_NULL, but the PCM goes to the WAV file set with audioSetOutputFile().
+	public static final int MODE_FILE = 8;
+	// The mode proper, without the flags below.
+	public static final int MODE_MASK = 0xff;
+	// Or'ed into the mode passed to audioInit(): little buffering, and AAudio's low latency path.
+	public static final int MODE_FLAG_LOW_LATENCY = 0x100;
+	// Or'ed into the mode: seconds of buffering, for screen-off playback.
+	public static final int MODE_FLAG_POWER_SAVING = 0x200;
+	
+	// Indices into what audioGetStats() returns for the track playing or the last one,
+	// the same as STAT_* in jni/main.h. Times are in ms, pauses left out.
+	public static final int STAT_UNDERRUNS = 0;
+	public static final int STAT_LAGS = 1;			// MODE_CALLBACK: callbacks the decoder couldn't fill
+	public static final int STAT_FILL_MIN = 2;		// percent of the buffer queued before a write
+	public static final int STAT_FILL_AVG = 3;
+	public static final int STAT_DECODE_MS = 4;
+	public static final int STAT_READ_MS = 5;
+	public static final int STAT_CONVERT_MS = 6;
+	public static final int STAT_WRITE_MS = 7;		// blocked in the output included
+	public static final int STAT_CPU_MS = 8;
+	public static final int STAT_AUDIO_MS = 9;
+	public static final int STAT_ELAPSED_MS = 10;
+	public static final int STAT_SPEED = 11;		// times realtime x100, without the write time
+	
+	// Milliseconds of audio the native output is kept filled with; 0 for the default of the mode flags.
+	// With the screen off it is at least the power saving default, see buffer_policy() in jni/main.c.
+	private static int buffer_ms = 0;
+	
+	// Set while the screen is off: the next track is started with MODE_FLAG_POWER_SAVING, and
+	// the one playing switches to it with audioSetPowerSaving(),
+	// so the decoder fills seconds of buffer in a burst and then sleeps.
+	private static boolean screen_off = false;
+	
+	// False if libInit() couldn't load the atrack library for this Android version.
+	private static boolean atrack_ok = true;
 	
 	// Ad hoc value. 0x2000 seems to be a maximum used by the driver. MSM datasheets needed. 
 	private int volume = 0x1000;
@@ -143,13 +202,100 @@ public class AndLessSrv extends Service {
 			return;	
 		}
 		curTrackLen = time - last_cue_start;
+		publishTrackInfo();
+	}
+	
+	// Playback events pushed by native code, see AUDIO_EVENT_* in jni/main.h
+	// and playbackEvent() in IAndLessSrvCallback.
+	public static final int EVENT_STATE = 1;	// arg: StatusBlock.STATE_*
+	public static final int EVENT_TRACK = 2;	// arg: tracks started so far
+	public static final int EVENT_UNDERRUN = 3;	// arg: underruns so far
+	public static final int EVENT_ERROR = 4;	// arg: LIBLOSSLESS_ERR_* as jni/main.h numbers them
+	
+	private static Handler eventHandler = null;
+	
+	// Callback to be called from native code, on the decoder or a binder thread and
+	// maybe with the decoder's mutex held, so the broadcast is left to the main thread.
+	
+	public static void onEvent(int event, int arg) {
+		Handler h = eventHandler;
+		if(h != null) h.obtainMessage(event, arg, 0).sendToTarget();
+	}
+	
+	// Copies what only the service knows about the track into the native status block, see StatusBlock.
+	
+	private static void publishTrackInfo() {
+		if(ctx != 0 && plist != null) audioSetTrackInfo(ctx, plist.cur_pos, plist.cur_start, curTrackStart, curTrackLen);
+	}
+	
+	// Read-only view of the status block the native code keeps in shared memory,
+	// see audio_status in jni/main.h for the layout. The UI maps it from
+	// get_status_block() and follows playback without calling the service.
+	// It is copied out through libstatusblock.so, see jni/status_read.c,
+	// which orders the reads as the seqlock needs; a ByteBuffer can't.
+	
+	public static class StatusBlock {
+		static {
+			System.loadLibrary("statusblock");
+		}
+		private static native boolean readBlock(ByteBuffer block, int [] out);
+		private static final int SIZE = 64;	// bytes
+		// offsets in ints
+		private static final int STATE = 1, TRACKS = 2, POS_MS = 3, POS_TIME = 4,
+			TRACK_TIME = 6, UNDERRUNS = 7, BUF_MS = 8, INDEX = 12, OFFSET = 13,
+			TRACK_START = 14, TRACK_LEN = 15;
+		public static final int STATE_STOPPED = 0;
+		public static final int STATE_PLAYING = 1;
+		public static final int STATE_PAUSED = 2;
+		private final ParcelFileDescriptor pfd;
+		private final ByteBuffer buf;
+		private final int [] raw = new int[SIZE / 4];
+		// consistent copy of the block, made by read()
+		public int state, tracks, track_time, underruns, buf_ms, index, offset, track_start, track_len;
+		private int pos_ms;
+		private long pos_time;
+		
+		public StatusBlock(ParcelFileDescriptor pfd) throws IOException {
+			this.pfd = pfd;
+			buf = new FileInputStream(pfd.getFileDescriptor()).getChannel().map(FileChannel.MapMode.READ_ONLY, 0, SIZE);
+		}
+		// False if the native side kept updating the block meanwhile.
+		public boolean read() {
+			if(!readBlock(buf, raw)) return false;
+			state = raw[STATE];
+			tracks = raw[TRACKS];
+			pos_ms = raw[POS_MS];
+			long lo = raw[POS_TIME] & 0xffffffffL, hi = raw[POS_TIME + 1] & 0xffffffffL;
+			pos_time = ByteOrder.nativeOrder() == ByteOrder.LITTLE_ENDIAN ? hi << 32 | lo : lo << 32 | hi;
+			track_time = raw[TRACK_TIME];
+			underruns = raw[UNDERRUNS];
+			buf_ms = raw[BUF_MS];
+			index = raw[INDEX];
+			offset = raw[OFFSET];
+			track_start = raw[TRACK_START];
+			track_len = raw[TRACK_LEN];
+			return true;
+		}
+		// Seconds into the file as of now, like get_cur_seconds()
+		public int seconds() {
+			long ms = pos_ms;
+			if(state == STATE_PLAYING) ms += SystemClock.uptimeMillis() - pos_time;
+			return (int) (ms / 1000) + offset;
+		}
+		public void close() {
+			try { pfd.close(); } catch(IOException e) { }
+		}
 	}
 	
 	// Callback used to send new track name or error status to the interface thread.
 	
 	private static final RemoteCallbackList<IAndLessSrvCallback> cBacks = new RemoteCallbackList<IAndLessSrvCallback>();
 	
+	// The broadcasts come from the playback thread, binder threads and eventHandler,
+	// and RemoteCallbackList takes one at a time.
+	
 	private void informTrack(String s, boolean error) {
+	  synchronized(cBacks) {
 		final int k = cBacks.beginBroadcast();
 		for (int i=0; i < k; i++) {
 	         try { 
@@ -166,9 +312,11 @@ public class AndLessSrv extends Service {
 	         }
 	    }
 	    cBacks.finishBroadcast();
+	  }
 	}
 
 	private void informPauseResume(boolean pause) {
+	  synchronized(cBacks) {
 		final int k = cBacks.beginBroadcast();
 		for (int i=0; i < k; i++) {
 	         try { 
@@ -179,6 +327,22 @@ public class AndLessSrv extends Service {
 	         }
 	    }
 	    cBacks.finishBroadcast();
+	  }
+	}
+
+	private void informEvent(int event, int arg) {
+	  synchronized(cBacks) {
+		final int k = cBacks.beginBroadcast();
+		for (int i=0; i < k; i++) {
+	         try { 
+	        	 cBacks.getBroadcastItem(i).playbackEvent(event, arg);
+	         } catch (RemoteException e) { 
+	        	 log_err("remote exception in informEvent(): " + e.toString());
+	        	 break;
+	         }
+	    }
+	    cBacks.finishBroadcast();
+	  }
 	}
 	
 	private MediaPlayer mplayer = null;
@@ -246,10 +410,14 @@ public class AndLessSrv extends Service {
 	}
 
 	private static final int NOTIFY_ID = R.drawable.icon;	
+	private static final int ARCHIVE_NOTIFY_ID = NOTIFY_ID + 1;
 	private void notify(int icon, String s) {
+		notify(NOTIFY_ID, icon, s);
+	}
+	private void notify(int id, int icon, String s) {
 		if(nm == null) return;
 		if(s == null) {
-			nm.cancel(NOTIFY_ID);
+			nm.cancel(id);
 			return;
 		}
 		final Notification notty = new Notification(icon, s, System.currentTimeMillis());
@@ -260,7 +428,7 @@ public class AndLessSrv extends Service {
 		intent.setFlags(0x10100000);
 		notty.setLatestEventInfo(getApplicationContext(), "andLess", s, 
 					PendingIntent.getActivity(this, 0, intent, 0));
-		nm.notify(NOTIFY_ID,notty);
+		nm.notify(id,notty);
 	}
 	
 	////////////////////////////////////////////////////////////////
@@ -328,6 +496,7 @@ public class AndLessSrv extends Service {
 						else curTrackLen = total_cue_len - times[cur_pos];
 						curTrackStart = getCurPosition(); // audioGetCurPosition(ctx);
 						log_msg("track name = " + names[cur_pos] + ", curTrackLen=" + curTrackLen + ", curTrackStart=" + curTrackStart);
+						publishTrackInfo();
 						informTrack(names[cur_pos],false);
 					}
 					if(cur_pos + 1 < names.length) schedule((times[cur_pos+1] - times[cur_pos])*1000);
@@ -365,7 +534,10 @@ public class AndLessSrv extends Service {
 				
 		private boolean permsOkay = false;
 		
+		// mode is one of MODE_*, possibly with MODE_FLAG_LOW_LATENCY
 		private boolean initAudioMode(int mode) {
+			int flags = screen_off ? MODE_FLAG_POWER_SAVING : mode & ~MODE_MASK;
+			mode &= MODE_MASK;
 			if(mode == MODE_DIRECT && !permsOkay) {
 				if(checkSetDevicePermissions()) {
 					log_msg("checkSetDevicePermissions() returned OK");
@@ -375,9 +547,11 @@ public class AndLessSrv extends Service {
 					return false;
 				}
 			}
-			log_msg("initAudioMode(" + mode + "), permsOkay=" + permsOkay);
+			if(mode == MODE_AAUDIO && Integer.parseInt(Build.VERSION.SDK) < 26) mode = MODE_OPENSL;	// AAudio is 8.0+
+			if(!atrack_ok && (mode == MODE_LIBMEDIA || mode == MODE_CALLBACK)) mode = MODE_OPENSL;
+			log_msg("initAudioMode(" + mode + ", " + flags + "), permsOkay=" + permsOkay);
 			try {
-		   		ctx = audioInit(ctx,mode);
+		   		ctx = audioInit(ctx,mode | flags,buffer_ms);
 	   		} catch(Exception e) { 
 		   		log_err("exception in audioInit(): " + e.toString());
 		   		return false;
@@ -388,6 +562,7 @@ public class AndLessSrv extends Service {
 	   		}
            	if(mode == MODE_DIRECT) audioSetVolume(ctx,volume);
 			cur_mode = mode;
+			publishTrackInfo();
            	return true;
 		}
 			
@@ -671,15 +846,62 @@ public class AndLessSrv extends Service {
 		public int		get_track_duration()		{ return plist.getDuration(); }
 		public int		get_cur_track_start() { return curTrackStart; }
 		public int		get_cur_track_len() { return curTrackLen; }
+		public ParcelFileDescriptor get_status_block() {
+			if(ctx == 0 || Integer.parseInt(Build.VERSION.SDK) < 13) return null;	// fromFd() is API 13
+			int fd = audioGetStatusFd(ctx);
+			if(fd < 0) return null;
+			try {
+				return ParcelFileDescriptor.fromFd(fd);
+			} catch(IOException e) {
+				log_err("exception in get_status_block(): " + e.toString());
+				return null;
+			}
+		}
+		public int []	get_stats()	{ return ctx != 0 ? audioGetStats(ctx) : null; }
+		// The native trace of the last few thousand events, as Chrome trace JSON; see jni/trace.c
+		public int		dump_trace(String file)	{ return ctx != 0 ? audioTraceDump(ctx, file) : -1; }
+		public boolean	set_atrace(boolean on)	{ return ctx != 0 && audioSetAtrace(ctx, on); }
+		// NEON kernels on or off, for all contexts; see audioSetSimd() in jni/main.c
+		public boolean	set_simd(boolean on)	{ return audioSetSimd(on); }
 		public String  	get_cur_track_source()	{ try { return plist.files[plist.cur_pos]; } catch(Exception e) {return null;} }
 		public String  	get_cur_track_name()	{ try { return plist.names[plist.cur_pos]; } catch(Exception e) {return null;} }
 		public void		set_driver_mode(int m) 	{ plist.driver_mode = m; }
+		// Used from the next track on, as the driver mode is
+		public void		set_buffer_ms(int ms)	{ buffer_ms = ms; }
 		public void		set_headset_mode(int m)	{ headset_mode = m; }
 		public void 	registerCallback(IAndLessSrvCallback cb)   { if(cb != null) cBacks.register(cb); };
 		public void 	unregisterCallback(IAndLessSrvCallback cb) { if(cb != null) cBacks.unregister(cb); };
 	    public int []	get_cue_from_flac(String file) {return  extractFlacCUE(file); };
 	    public void		launch(String path) { if(launcher != null) launcher.launch(path);  };
+	    public boolean	archive_wav(String path) { return archiver != null && archiver.start(path); }
+	    public void		cancel_archive() { wvArchiveCancel(); }
+	    public boolean	is_archiving() { return archiver != null && archiver.running(); }
 	};
+
+	// Packs the .wav files of a folder to .wv in the background, see jni/wv/archive.c
+	private class Archiver {
+		private Thread th = null;
+		synchronized boolean start(final String path) {
+			if(th != null && th.isAlive()) return false;
+			th = new Thread() {
+				public void run() {
+					Process.setThreadPriority(Process.THREAD_PRIORITY_BACKGROUND);
+					log_msg("archiving " + path);
+					int k = wvArchive(path, 0);
+					if(k < 0) log_err("wvArchive() returned error " + (-k));
+					else log_msg("archived " + k + " file(s) in " + path);
+					AndLessSrv.this.notify(ARCHIVE_NOTIFY_ID, R.drawable.icon, 
+							k < 0 ? getString(R.string.strArchiveFailed) : getString(R.string.strArchiveDone, k));
+				}
+			};
+			th.start();
+			return true;
+		}
+		synchronized boolean running() {
+			return th != null && th.isAlive();
+		}
+	}
+	static Archiver archiver = null;
 	
 	private class Launcher {
 		void launch(String path) {	startActivity((new Intent()).setAction(AndLessSrv.ACTION_VIEW).setData(Uri.fromFile(new File(path))));	}
@@ -701,6 +923,7 @@ public class AndLessSrv extends Service {
 		   	log_msg("onCreate()");
 	        registerPhoneListener();
 	        registerHeadsetReciever();
+	        registerScreenReciever();
 	        if(wakeLock == null) {
 	        	PowerManager pm = (PowerManager)getSystemService(Context.POWER_SERVICE);
 	        	wakeLock = pm.newWakeLock(PowerManager.PARTIAL_WAKE_LOCK, this.getClass().getName());
@@ -708,12 +931,19 @@ public class AndLessSrv extends Service {
 	        }
 	        plist = new AndLessSrv.playlist();
 	        launcher = new Launcher();
+	        archiver = new Archiver();
 	        if(nm == null) nm = (NotificationManager) getSystemService(Context.NOTIFICATION_SERVICE);
+	        eventHandler = new Handler() {
+	        	@Override
+	        	public void handleMessage(Message msg) {
+	        		informEvent(msg.what, msg.arg1);
+	        	}
+	        };
 	        Process.setThreadPriority(Process.THREAD_PRIORITY_AUDIO);
 	        //if(!libInit(Build.VERSION.SDK_INT)) {
 	        if(!libInit(Integer.parseInt(Build.VERSION.SDK))) {	        	
-	        	log_err("cannot initialize atrack library");
-	        	stopSelf();
+	        	log_err("cannot initialize atrack library, will use OpenSL ES");
+	        	atrack_ok = false;
 	        }
 	}
 		
@@ -723,8 +953,10 @@ public class AndLessSrv extends Service {
 		//	cBacks.kill();
 			unregisterPhoneListener();
 			unregisterHeadsetReciever();
+			unregisterScreenReciever();
 			if(plist != null && plist.running) plist.stop();
 			if(ctx != 0) audioExit(ctx);
+			eventHandler = null;
 	        if(wakeLock != null && wakeLock.isHeld()) wakeLock.release();
 	        if(nm != null) nm.cancel(NOTIFY_ID);
 	        libExit();
@@ -788,6 +1020,29 @@ public class AndLessSrv extends Service {
 		unregisterReceiver(headsetReciever);
 	}
 	
+	///////////////////////////////////////////////////////
+	//////////// Screen on/off, for power saving output ///
+	
+	private BroadcastReceiver screenReciever = new BroadcastReceiver() {
+		@Override
+		public void onReceive(Context context, Intent intent) {
+			screen_off = intent.getAction().equals(Intent.ACTION_SCREEN_OFF);
+			log_msg("Screen " + (screen_off ? "off" : "on"));
+			if(ctx != 0) audioSetPowerSaving(ctx, screen_off);	// the track playing too
+		}
+	};
+	
+	private void registerScreenReciever() {
+		IntentFilter filter = new IntentFilter();
+		filter.addAction(Intent.ACTION_SCREEN_OFF);
+		filter.addAction(Intent.ACTION_SCREEN_ON);
+		registerReceiver(screenReciever, filter);
+	}
+	
+	private void unregisterScreenReciever() {
+		unregisterReceiver(screenReciever);
+	}
+	
 	////////////////////////////////////////////////////////
 	//////// Pause when the phone rings, and resume after the call
 
@@ -4,6 +4,7 @@ import android.app.AlertDialog;
 import android.app.Dialog;
 import android.os.Bundle;
 import android.preference.CheckBoxPreference;
+import android.preference.ListPreference;
 import android.preference.Preference;
 import android.preference.PreferenceActivity;
 import android.preference.PreferenceCategory;
@@ -48,6 +49,33 @@ public class Preferences extends PreferenceActivity {
         driver_mode.setKey("driver_mode");
         launchPrefCat.addPreference(driver_mode); */
         
+        ListPreference output_mode = new ListPreference(this);
+        output_mode.setTitle(R.string.strOutput);
+        output_mode.setDialogTitle(R.string.strOutput);
+        output_mode.setKey("output_mode");
+        output_mode.setEntries(new CharSequence[] { getString(R.string.strOutputAudioTrack),
+        		getString(R.string.strOutputOpenSL), getString(R.string.strOutputAAudio) });
+        output_mode.setEntryValues(new CharSequence[] { Integer.toString(AndLessSrv.MODE_CALLBACK),
+        		Integer.toString(AndLessSrv.MODE_OPENSL), Integer.toString(AndLessSrv.MODE_AAUDIO) });
+        output_mode.setDefaultValue(Integer.toString(AndLessSrv.MODE_CALLBACK));
+        launchPrefCat.addPreference(output_mode);
+
+        CheckBoxPreference low_latency = new CheckBoxPreference(this);
+        low_latency.setTitle(R.string.strLowLatency);
+        low_latency.setSummary(R.string.strLowLatencySummary);
+        low_latency.setKey("low_latency");
+        launchPrefCat.addPreference(low_latency);
+
+        ListPreference buffer_ms = new ListPreference(this);
+        buffer_ms.setTitle(R.string.strBuffer);
+        buffer_ms.setDialogTitle(R.string.strBuffer);
+        buffer_ms.setKey("buffer_ms");
+        buffer_ms.setEntries(new CharSequence[] { getString(R.string.strBufferDefault),
+        		"100 ms", "250 ms", "500 ms", "1 s", "2 s", "4 s" });
+        buffer_ms.setEntryValues(new CharSequence[] { "0", "100", "250", "500", "1000", "2000", "4000" });
+        buffer_ms.setDefaultValue("0");
+        launchPrefCat.addPreference(buffer_ms);
+
         CheckBoxPreference book_mode = new CheckBoxPreference(this);
         book_mode.setTitle(R.string.strSaveBooks);
         book_mode.setKey("book_mode");